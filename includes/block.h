@@ -0,0 +1,113 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+#include "dram.h"
+
+// Decoded basic-block cache. Guest code is decoded once into BLOCKs of
+// handler pointers and the run loop dispatches straight through them.
+// Execution is tiered: a new block runs as decoded, and once it has run
+// BLOCK_HOT_EXECS times a copy is queued to a background compiler thread.
+// Its fusion pass folds common instruction pairs into superinstructions,
+// and the result is swapped into the block between two blocks. The hart
+// never waits on the compiler; when the queue is busy it keeps running
+// the decoded block and tries again later.
+
+#define BLOCK_MAX_INSNS     64      // guest instructions per block
+#define BLOCK_HASH_SIZE     4096    // buckets in the pc -> block table
+#define BLOCK_PAGE_SIZE     DRAM_PAGE_SIZE  // blocks never cross a page
+#define BLOCK_RAS_SIZE      16      // shadow return-address stack depth
+#define BLOCK_HOT_EXECS     64      // executions before a block is optimised
+#define BLOCK_JOBS          64      // blocks a cache may have at the compiler
+
+// How a block's last instruction leaves it, used for next-block prediction
+#define BLOCK_EXIT_CALL     0x1     // jal/jalr with rd = ra or t0
+#define BLOCK_EXIT_RET      0x2     // jalr x0, ra or t0
+#define BLOCK_EXIT_JALR     0x4     // any other jalr, uses the per-site target cache
+
+struct CPU;
+struct INSN;
+
+typedef void (*exec_fn)(struct CPU* cpu, uint32_t inst);
+typedef void (*fused_fn)(struct CPU* cpu, const struct INSN* in);
+
+// Instruction pairs the fusion pass folds into one handler
+enum {
+    FUSE_LUI_ADDI,      // lui rd, hi; addi[w] rd, rd, lo
+    FUSE_AUIPC_ADDI,    // auipc rd, hi; addi rd, rd, lo
+    FUSE_AUIPC_JALR,    // auipc rt, hi; jalr rd, lo(rt)
+    FUSE_AUIPC_LOAD,    // auipc rt, hi; l{w,wu,d} rd, lo(rt)
+    FUSE_SLLI_SRLI,     // slli rd, rs, n; srli rd, rd, m
+    FUSE_CMP_BRANCH,    // slt[i][u] rd, ...; beqz/bnez rd, target
+    FUSE_COUNT
+};
+
+typedef struct INSN {
+    exec_fn  exec;              // handler for this instruction
+    fused_fn fused;             // set when this entry also covers the next instruction
+    uint32_t inst;              // raw instruction word
+    // operands pre-decoded for fused handlers
+    uint8_t  kind;              // FUSE_* index
+    uint8_t  rd, rd2;           // destinations of the first and second instruction
+    uint8_t  rs1, rs2;
+    uint8_t  op;                // shift amount, branch sense or load width
+    int64_t  imm;               // constant, first result or compare operand
+    uint64_t imm2;              // second shift amount, load address or branch target
+} INSN;
+
+typedef struct BLOCK {
+    uint64_t pc;                // guest address of the first instruction
+    uint32_t count;             // guest instructions covered
+    uint32_t n;                 // entries in insns[], fused pairs take one
+    uint32_t gen;               // page generation the block was decoded from
+    uint32_t exit;              // BLOCK_EXIT_* flags
+    uint32_t cov_id;            // edge coverage id of pc
+    uint32_t heat;              // executions left before optimising, 0 for never
+    struct BLOCK* target;       // last target of the closing jalr
+    struct BLOCK* ret;          // block a call from here returns to
+    struct BLOCK* next;         // hash chain
+    INSN insns[];
+} BLOCK;
+
+// Translations shared by guests of one image, see block_shared_new()
+typedef struct BLOCK_SHARED BLOCK_SHARED;
+
+// A block at the compiler, see block.c
+typedef struct BLOCK_JOB BLOCK_JOB;
+
+typedef struct BLOCK_CACHE {
+    BLOCK* table[BLOCK_HASH_SIZE];
+    BLOCK_SHARED* shared;       // NULL unless guests share translations
+    int flush_pending;          // set by FENCE.I, acted on between blocks
+    BLOCK* predicted;           // next block, when the last exit hit a prediction
+    BLOCK** patch;              // prediction slot to fill after a miss
+    BLOCK* ras[BLOCK_RAS_SIZE]; // calling blocks, circular
+    uint32_t ras_top, ras_depth;
+    // optimised blocks back from the compiler, the thread advances done_tail
+    BLOCK_JOB* done[BLOCK_JOBS];
+    uint32_t done_head, done_tail;
+    uint32_t jobs;              // queued or compiling
+} BLOCK_CACHE;
+
+void block_cache_init(BLOCK_CACHE* cache);
+
+// A translation table for guests on several threads running the same
+// image. Blocks are published read-only and matched on the instruction
+// words they were decoded from, so a guest whose copy of a page differs
+// decodes its own; each guest still links and predicts on private copies.
+BLOCK_SHARED* block_shared_new(void);
+void block_flush(BLOCK_CACHE* cache);
+BLOCK* block_lookup(struct CPU* cpu, uint64_t pc);
+BLOCK* block_translate(struct CPU* cpu, uint64_t pc);
+
+// Runs the block at cpu->pc, returns 0 once the guest stops
+int block_exec(struct CPU* cpu);
+
+// Runs the single instruction at cpu->pc outside any block, for the debugger
+int block_step(struct CPU* cpu);
+
+// Fusion pass (fusion.c), folds insns[i+1] into insns[i] when they form a known pair
+int fuse_pair(INSN* first, const INSN* second, uint64_t pc);
+extern const char* fuse_names[FUSE_COUNT];
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include "cpu.h"
+
+// Direct kernel boot, skipping an emulated firmware stage. The kernel,
+// an optional initrd and a generated device tree are placed in RAM and
+// the hart starts at the kernel entry with a0 = hart id and a1 = device
+// tree, the state firmware hands over. SBI calls are then served by
+// sbi_call().
+
+#define BOOT_MEM_SIZE       (128ULL << 20)
+#define BOOT_KERNEL_OFFSET  0x200000        // raw images load here, as with OpenSBI
+#define BOOT_DTB_SIZE       0x10000         // reserved at the top of RAM
+
+// Returns 0 on success, -1 on error. initrd and bootargs may be NULL.
+int boot_load(CPU* cpu, const char* kernel, const char* initrd, const char* bootargs);
+
+#endif
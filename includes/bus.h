@@ -2,12 +2,52 @@
 #define BUS_H
 
 #include "dram.h"
+#include "timing.h"
+#include "watch.h"
+#include "shm.h"
+
+#define BUS_MMIO_MAX    16
+
+// Device registers mapped outside RAM, offsets are relative to base
+typedef struct MMIO {
+    uint64_t base;
+    uint64_t size;
+    void* dev;
+    uint64_t (*load)(void* dev, uint64_t off, uint64_t size);
+    void (*store)(void* dev, uint64_t off, uint64_t size, uint64_t value);
+    void (*poll)(void* dev);    // host-side input, run between blocks, may be NULL
+    const char* compatible;     // device tree node for direct boot, NULL for none
+    uint32_t irq;               // PLIC source in the device tree, 0 for none
+    const char* name;           // short name in metrics, may be NULL
+    uint32_t nqueues;           // queues reported by queue_depth
+    uint32_t (*queue_depth)(void* dev, uint32_t queue, uint32_t* size);
+} MMIO;
 
 typedef struct BUS {
     struct DRAM dram;
+    struct TIMING* timing;      // cache model fed by every access, NULL unless -T
+    struct WATCHES* watch;      // checked accesses, set only while watched pages are open
+    SHM shm[SHM_MAX];           // host-shared regions outside RAM, -m
+    uint32_t nshm;
+    MMIO mmio[BUS_MMIO_MAX];    // devices
+    uint32_t nmmio;
+    struct PLIC* plic;          // interrupt controller, NULL without devices
+    int fault;                  // mcause raised by the running instruction, 0 for none,
+                                // the hart stops before its next instruction
 } BUS;
 
+// Accesses outside RAM and every mapped region fault: loads read 0,
+// stores are dropped and bus->fault is set
 uint64_t bus_load(BUS* bus, uint64_t addr, uint64_t size);
 void bus_store(BUS* bus, uint64_t addr, uint64_t size, uint64_t value);
+void bus_load_bytes(BUS* bus, uint64_t addr, uint64_t len, void* dst);
+void bus_store_bytes(BUS* bus, uint64_t addr, uint64_t len, const void* src);
+
+// Adds a device at [base, base + size), returns 0 on success
+int bus_map(BUS* bus, const MMIO* dev);
+
+// Lets devices pick up host input, called from the run loop
+void bus_poll(BUS* bus);
+#define BUS_POLL_BLOCKS 1024
 
 #endif
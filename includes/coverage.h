@@ -0,0 +1,29 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stdint.h>
+
+// AFL-style edge coverage. Each decoded block gets a 16-bit id from its pc
+// and entering a block bumps map[id ^ prev]. With __AFL_SHM_ID set the map
+// is the fuzzer's shared memory, otherwise a private one for -s reports.
+
+#define COV_MAP_SIZE    (1 << 16)
+
+typedef struct COVERAGE {
+    uint8_t* map;               // NULL while coverage is off
+    uint32_t prev;              // id of the previous block, shifted
+} COVERAGE;
+
+int coverage_init(COVERAGE* cov);
+uint32_t coverage_count(const COVERAGE* cov);
+
+static inline uint32_t coverage_block_id(uint64_t pc) {
+    return (uint32_t)(((pc >> 2) * 0x9e3779b1u) >> 16) & (COV_MAP_SIZE - 1);
+}
+
+static inline void coverage_edge(COVERAGE* cov, uint32_t id) {
+    cov->map[id ^ cov->prev]++;
+    cov->prev = id >> 1;
+}
+
+#endif
@@ -3,17 +3,63 @@
 
 #include <stdint.h>
 #include "bus.h"
+#include "vector.h"
+#include "block.h"
+#include "stats.h"
+#include "coverage.h"
+#include "hook.h"
+#include "timing.h"
+#include "replay.h"
+#include "metrics.h"
 
 typedef struct CPU {
     uint64_t regs[32];          // 32 64-bit registers (x0-x31)
     uint64_t pc;                // 64-bit program counter
-    uint64_t csr[4069];
+    uint64_t csr[4096];         // every 12-bit CSR number
+    struct VPU vpu;             // RVV vector register file
     struct BUS bus;             // CPU connected to BUS
+    BLOCK_CACHE blocks;         // decoded basic blocks
+    STATS stats;
+    COVERAGE cov;               // edge coverage, off unless -c
+    HOOKS hooks;                // library routines run on the host, off unless -H
+    TIMING timing;              // cache/TLB model, used through bus.timing
+    REPLAY replay;              // nondeterministic input log, off unless -R/-P
+    WATCHES watch;              // data watchpoints, -W or gdb
+    METRICS metrics;            // live counters in shared memory, off unless -M
+    struct USER* user;          // Linux user-mode personality, NULL for bare-metal images
+    struct GDB* gdb;            // remote debugger, NULL unless -g
+    uint64_t icount;            // instructions per time tick, 0 follows the host clock
+    uint64_t clock_origin;      // host ns at start, time 0
+    uint64_t reservation;       // address reserved by LR, RESERVATION_NONE after SC
+    int sbi;                    // ECALLs are SBI calls to the built-in firmware, direct boot
+    int marker;                 // guest hit EBREAK or wrote FORKSRV, cleared by the run loop
+    int xlen;                   // 32 or 64, from the ELF class, set with cpu_set_xlen
+    exec_fn (*decode)(uint32_t inst);   // cpu_decode or cpu_decode32, matching xlen
 } CPU;
 
+#define RESERVATION_NONE    UINT64_MAX  // never an aligned address
+
+extern int cpu_trace;
+
 void cpu_init(struct CPU *cpu);
 uint32_t cpu_fetch(struct CPU *cpu);
 int cpu_execute(struct CPU *cpu, uint32_t inst);
 void dump_registers(struct CPU *cpu); 
+void print_op(char* s);
+exec_fn cpu_decode(uint32_t inst);
+exec_fn cpu_decode32(uint32_t inst);
+void cpu_set_xlen(struct CPU *cpu, int xlen);
+void cpu_illegal(struct CPU *cpu, uint32_t inst);
+int cpu_fault(struct CPU *cpu);
+
+// Instruction decoder functions
+uint64_t rd(uint32_t inst);
+uint64_t rs1(uint32_t inst);
+uint64_t rs2(uint32_t inst);
+uint64_t imm_I(uint32_t inst);
+uint64_t imm_S(uint32_t inst);
+uint64_t imm_B(uint32_t inst);
+uint64_t imm_U(uint32_t inst);
+uint64_t imm_J(uint32_t inst);
 
 #endif
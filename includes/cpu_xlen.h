@@ -0,0 +1,338 @@
+// Handlers whose results depend on the register width, instantiated by
+// cpu.c once per XLEN. Before each inclusion it defines XLEN, XFN(name),
+// xlen_t/sxlen_t (one register) and uxlen2_t/sxlen2_t (twice as wide).
+// Registers hold XLEN-bit values zero-extended to 64 bits, so an RV32
+// handler does 32-bit arithmetic, shifts and compares, and forms 32-bit
+// addresses and pcs, with no width test of its own at run time.
+// No include guard, this file is meant to be included more than once.
+
+#define X(r)        ((xlen_t) cpu->regs[r])
+#define SX(r)       ((sxlen_t) cpu->regs[r])
+#define SET(r, v)   (cpu->regs[r] = (xlen_t)(v))
+#define SHAMT_MASK  (XLEN - 1)
+#define SXLEN_MIN   ((sxlen_t)((xlen_t)1 << (XLEN - 1)))
+
+void XFN(LUI)(CPU* cpu, uint32_t inst) {
+    // LUI places upper 20 bits of U-immediate value to rd
+    SET(rd(inst), (sxlen_t)(int32_t)(inst & 0xfffff000));
+    print_op("lui\n");
+}
+
+void XFN(AUIPC)(CPU* cpu, uint32_t inst) {
+    // AUIPC forms a 32-bit offset from the 20 upper bits
+    // of the U-immediate
+    SET(rd(inst), cpu->pc + imm_U(inst) - 4);
+    print_op("auipc\n");
+}
+
+void XFN(JAL)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), cpu->pc);
+    cpu->pc = (xlen_t)(cpu->pc + imm_J(inst) - 4);
+    print_op("jal\n");
+    if (ADDR_MISALIGNED(cpu->pc)) {
+        fprintf(stderr, "JAL pc address misalligned");
+        exit(0);
+    }
+}
+
+void XFN(JALR)(CPU* cpu, uint32_t inst) {
+    uint64_t tmp = cpu->pc;
+    cpu->pc = (xlen_t)((X(rs1(inst)) + imm_I(inst)) & ~(uint64_t)1);
+    SET(rd(inst), tmp);
+    print_op("jalr\n");
+    if (ADDR_MISALIGNED(cpu->pc)) {
+        fprintf(stderr, "JAL pc address misalligned");
+        exit(0);
+    }
+}
+
+#define BRANCH(fn, cond, text)                              \
+void fn(CPU* cpu, uint32_t inst) {                          \
+    if (cond)                                               \
+        cpu->pc = (xlen_t)(cpu->pc + imm_B(inst) - 4);      \
+    print_op(text);                                         \
+}
+BRANCH(XFN(BEQ),  X(rs1(inst)) == X(rs2(inst)),   "beq\n")
+BRANCH(XFN(BNE),  X(rs1(inst)) != X(rs2(inst)),   "bne\n")
+BRANCH(XFN(BLT),  SX(rs1(inst)) < SX(rs2(inst)),  "blt\n")
+BRANCH(XFN(BGE),  SX(rs1(inst)) >= SX(rs2(inst)), "bge\n")
+BRANCH(XFN(BLTU), X(rs1(inst)) < X(rs2(inst)),    "bltu\n")
+BRANCH(XFN(BGEU), X(rs1(inst)) >= X(rs2(inst)),   "bgeu\n")
+#undef BRANCH
+
+// loads extend to the register width, addresses wrap at it
+#define LOAD_OP(fn, size, ext, text)                        \
+void fn(CPU* cpu, uint32_t inst) {                          \
+    xlen_t addr = X(rs1(inst)) + imm_I(inst);               \
+    SET(rd(inst), (ext) cpu_load(cpu, addr, size));         \
+    print_op(text);                                         \
+}
+LOAD_OP(XFN(LB),  8,  int8_t,   "lb\n")
+LOAD_OP(XFN(LH),  16, int16_t,  "lh\n")
+LOAD_OP(XFN(LW),  32, int32_t,  "lw\n")
+LOAD_OP(XFN(LBU), 8,  uint8_t,  "lbu\n")
+LOAD_OP(XFN(LHU), 16, uint16_t, "lhu\n")
+#undef LOAD_OP
+
+#define STORE_OP(fn, size, text)                            \
+void fn(CPU* cpu, uint32_t inst) {                          \
+    xlen_t addr = X(rs1(inst)) + imm_S(inst);               \
+    cpu_store(cpu, addr, size, X(rs2(inst)));               \
+    print_op(text);                                         \
+}
+STORE_OP(XFN(SB), 8,  "sb\n")
+STORE_OP(XFN(SH), 16, "sh\n")
+STORE_OP(XFN(SW), 32, "sw\n")
+#undef STORE_OP
+
+void XFN(ADDI)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) + imm_I(inst));
+    print_op("addi\n");
+}
+void XFN(SLLI)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) << (imm_I(inst) & SHAMT_MASK));
+    print_op("slli\n");
+}
+void XFN(SLTI)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), (SX(rs1(inst)) < (sxlen_t) imm_I(inst)) ? 1 : 0);
+    print_op("slti\n");
+}
+void XFN(SLTIU)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), (X(rs1(inst)) < (xlen_t) imm_I(inst)) ? 1 : 0);
+    print_op("sltiu\n");
+}
+void XFN(XORI)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) ^ imm_I(inst));
+    print_op("xori\n");
+}
+void XFN(SRLI)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) >> (imm_I(inst) & SHAMT_MASK));
+    print_op("srli\n");
+}
+void XFN(SRAI)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), SX(rs1(inst)) >> (imm_I(inst) & SHAMT_MASK));
+    print_op("srai\n");
+}
+void XFN(ORI)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) | imm_I(inst));
+    print_op("ori\n");
+}
+void XFN(ANDI)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) & imm_I(inst));
+    print_op("andi\n");
+}
+
+void XFN(ADD)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) + X(rs2(inst)));
+    print_op("add\n");
+}
+void XFN(SUB)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) - X(rs2(inst)));
+    print_op("sub\n");
+}
+void XFN(SLL)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) << (X(rs2(inst)) & SHAMT_MASK));
+    print_op("sll\n");
+}
+void XFN(SLT)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), (SX(rs1(inst)) < SX(rs2(inst))) ? 1 : 0);
+    print_op("slt\n");
+}
+void XFN(SLTU)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), (X(rs1(inst)) < X(rs2(inst))) ? 1 : 0);
+    print_op("slti\n");
+}
+void XFN(XOR)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) ^ X(rs2(inst)));
+    print_op("xor\n");
+}
+void XFN(SRL)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) >> (X(rs2(inst)) & SHAMT_MASK));
+    print_op("srl\n");
+}
+void XFN(SRA)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), SX(rs1(inst)) >> (X(rs2(inst)) & SHAMT_MASK));
+    print_op("sra\n");
+}
+void XFN(OR)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) | X(rs2(inst)));
+    print_op("or\n");
+}
+void XFN(AND)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) & X(rs2(inst)));
+    print_op("and\n");
+}
+
+// M extension, the high halves come from a product twice the register width
+void XFN(MUL)(CPU* cpu, uint32_t inst) {
+    SET(rd(inst), X(rs1(inst)) * X(rs2(inst)));
+    print_op("mul\n");
+}
+void XFN(MULH)(CPU* cpu, uint32_t inst) {
+    sxlen2_t p = (sxlen2_t) SX(rs1(inst)) * SX(rs2(inst));
+    SET(rd(inst), p >> XLEN);
+    print_op("mulh\n");
+}
+void XFN(MULHSU)(CPU* cpu, uint32_t inst) {
+    sxlen2_t p = (sxlen2_t) SX(rs1(inst)) * (uxlen2_t) X(rs2(inst));
+    SET(rd(inst), p >> XLEN);
+    print_op("mulhsu\n");
+}
+void XFN(MULHU)(CPU* cpu, uint32_t inst) {
+    uxlen2_t p = (uxlen2_t) X(rs1(inst)) * X(rs2(inst));
+    SET(rd(inst), p >> XLEN);
+    print_op("mulhu\n");
+}
+// division by zero and overflow give the results the spec defines, never a host trap
+void XFN(DIV)(CPU* cpu, uint32_t inst) {
+    sxlen_t a = SX(rs1(inst)), b = SX(rs2(inst));
+    SET(rd(inst), (b == 0) ? -1 : (a == SXLEN_MIN && b == -1) ? a : a / b);
+    print_op("div\n");
+}
+void XFN(DIVU)(CPU* cpu, uint32_t inst) {
+    xlen_t a = X(rs1(inst)), b = X(rs2(inst));
+    SET(rd(inst), (b == 0) ? (xlen_t) -1 : a / b);
+    print_op("divu\n");
+}
+void XFN(REM)(CPU* cpu, uint32_t inst) {
+    sxlen_t a = SX(rs1(inst)), b = SX(rs2(inst));
+    SET(rd(inst), (b == 0) ? a : (a == SXLEN_MIN && b == -1) ? 0 : a % b);
+    print_op("rem\n");
+}
+void XFN(REMU)(CPU* cpu, uint32_t inst) {
+    xlen_t a = X(rs1(inst)), b = X(rs2(inst));
+    SET(rd(inst), (b == 0) ? a : a % b);
+    print_op("remu\n");
+}
+
+// CSR instructions
+// the old value is read before rs1 is used, rd may be rs1. csrrw[i] with
+// rd = x0 does not read the CSR, set/clear with x0 or a zero immediate
+// do not write it. Values are cut to the register width.
+static void XFN(csr_result)(CPU* cpu, uint32_t inst, uint64_t old) {
+    if (rd(inst))
+        SET(rd(inst), old);
+}
+void XFN(CSRRW)(CPU* cpu, uint32_t inst) {
+    uint64_t old = rd(inst) ? csr_read(cpu, csr(inst)) : 0;
+    csr_write(cpu, csr(inst), X(rs1(inst)));
+    XFN(csr_result)(cpu, inst, old);
+    print_op("csrrw\n");
+}
+void XFN(CSRRS)(CPU* cpu, uint32_t inst) {
+    uint64_t old = csr_read(cpu, csr(inst));
+    if (rs1(inst))
+        csr_write(cpu, csr(inst), old | X(rs1(inst)));
+    XFN(csr_result)(cpu, inst, old);
+    print_op("csrrs\n");
+}
+void XFN(CSRRC)(CPU* cpu, uint32_t inst) {
+    uint64_t old = csr_read(cpu, csr(inst));
+    if (rs1(inst))
+        csr_write(cpu, csr(inst), old & ~(uint64_t) X(rs1(inst)));
+    XFN(csr_result)(cpu, inst, old);
+    print_op("csrrc\n");
+}
+void XFN(CSRRWI)(CPU* cpu, uint32_t inst) {
+    uint64_t old = rd(inst) ? csr_read(cpu, csr(inst)) : 0;
+    csr_write(cpu, csr(inst), rs1(inst));
+    XFN(csr_result)(cpu, inst, old);
+    print_op("csrrwi\n");
+}
+void XFN(CSRRSI)(CPU* cpu, uint32_t inst) {
+    uint64_t old = csr_read(cpu, csr(inst));
+    if (rs1(inst))
+        csr_write(cpu, csr(inst), old | rs1(inst));
+    XFN(csr_result)(cpu, inst, old);
+    print_op("csrrsi\n");
+}
+void XFN(CSRRCI)(CPU* cpu, uint32_t inst) {
+    uint64_t old = csr_read(cpu, csr(inst));
+    if (rs1(inst))
+        csr_write(cpu, csr(inst), old & ~rs1(inst));
+    XFN(csr_result)(cpu, inst, old);
+    print_op("csrrci\n");
+}
+
+// A extension. Word accesses return their value sign-extended to XLEN.
+// LR reserves its address, SC stores only while that reservation holds and
+// writes 0 to rd when it did; every SC ends the reservation.
+#define LR_OP(fn, size, st, text)                                       \
+void fn(CPU* cpu, uint32_t inst) {                                      \
+    xlen_t addr = X(rs1(inst));                                         \
+    if (!amo_aligned(cpu, addr, size, CAUSE_LOAD_MISALIGN))             \
+        return;                                                         \
+    st value = cpu_load(cpu, addr, size);                               \
+    cpu->reservation = addr;                                            \
+    SET(rd(inst), value);                                               \
+    print_op(text);                                                     \
+}
+#define SC_OP(fn, size, text)                                           \
+void fn(CPU* cpu, uint32_t inst) {                                      \
+    xlen_t addr = X(rs1(inst));                                         \
+    if (!amo_aligned(cpu, addr, size, CAUSE_STORE_MISALIGN))            \
+        return;                                                         \
+    int held = cpu->reservation == addr;                                \
+    cpu->reservation = RESERVATION_NONE;                                \
+    if (held)                                                           \
+        cpu_store(cpu, addr, size, X(rs2(inst)));                       \
+    SET(rd(inst), !held);                                               \
+    print_op(text);                                                     \
+}
+// memory gets expr of a and b, the old value and rs2 at the access width,
+// and rd gets a
+#define AMO_OP(fn, size, ut, st, expr, text)                            \
+void fn(CPU* cpu, uint32_t inst) {                                      \
+    xlen_t addr = X(rs1(inst));                                         \
+    if (!amo_aligned(cpu, addr, size, CAUSE_STORE_MISALIGN))            \
+        return;                                                         \
+    ut a = cpu_load(cpu, addr, size);                                   \
+    ut b = X(rs2(inst));                                                \
+    if (cpu->bus.fault)                                                 \
+        return;                                                         \
+    cpu_store(cpu, addr, size, (ut)(expr));                             \
+    SET(rd(inst), (st) a);                                              \
+    print_op(text);                                                     \
+}
+
+LR_OP(XFN(LR_W), 32, int32_t, "lr.w\n")
+SC_OP(XFN(SC_W), 32, "sc.w\n")
+AMO_OP(XFN(AMOSWAP_W), 32, uint32_t, int32_t, b, "amoswap.w\n")
+AMO_OP(XFN(AMOADD_W), 32, uint32_t, int32_t, a + b, "amoadd.w\n")
+AMO_OP(XFN(AMOXOR_W), 32, uint32_t, int32_t, a ^ b, "amoxor.w\n")
+AMO_OP(XFN(AMOAND_W), 32, uint32_t, int32_t, a & b, "amoand.w\n")
+AMO_OP(XFN(AMOOR_W), 32, uint32_t, int32_t, a | b, "amoor.w\n")
+AMO_OP(XFN(AMOMIN_W), 32, uint32_t, int32_t, (int32_t) a < (int32_t) b ? a : b, "amomin.w\n")
+AMO_OP(XFN(AMOMAX_W), 32, uint32_t, int32_t, (int32_t) a > (int32_t) b ? a : b, "amomax.w\n")
+AMO_OP(XFN(AMOMINU_W), 32, uint32_t, int32_t, a < b ? a : b, "amominu.w\n")
+AMO_OP(XFN(AMOMAXU_W), 32, uint32_t, int32_t, a > b ? a : b, "amomaxu.w\n")
+
+#if XLEN == 64
+LR_OP(XFN(LR_D), 64, int64_t, "lr.d\n")
+SC_OP(XFN(SC_D), 64, "sc.d\n")
+AMO_OP(XFN(AMOSWAP_D), 64, uint64_t, int64_t, b, "amoswap.d\n")
+AMO_OP(XFN(AMOADD_D), 64, uint64_t, int64_t, a + b, "amoadd.d\n")
+AMO_OP(XFN(AMOXOR_D), 64, uint64_t, int64_t, a ^ b, "amoxor.d\n")
+AMO_OP(XFN(AMOAND_D), 64, uint64_t, int64_t, a & b, "amoand.d\n")
+AMO_OP(XFN(AMOOR_D), 64, uint64_t, int64_t, a | b, "amoor.d\n")
+AMO_OP(XFN(AMOMIN_D), 64, uint64_t, int64_t, (int64_t) a < (int64_t) b ? a : b, "amomin.d\n")
+AMO_OP(XFN(AMOMAX_D), 64, uint64_t, int64_t, (int64_t) a > (int64_t) b ? a : b, "amomax.d\n")
+AMO_OP(XFN(AMOMINU_D), 64, uint64_t, int64_t, a < b ? a : b, "amominu.d\n")
+AMO_OP(XFN(AMOMAXU_D), 64, uint64_t, int64_t, a > b ? a : b, "amomaxu.d\n")
+#endif
+
+#undef LR_OP
+#undef SC_OP
+#undef AMO_OP
+
+#undef X
+#undef SX
+#undef SET
+#undef SHAMT_MASK
+#undef SXLEN_MIN
+#undef XLEN
+#undef XFN
+#undef xlen_t
+#undef sxlen_t
+#undef uxlen2_t
+#undef sxlen2_t
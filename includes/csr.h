@@ -24,6 +24,15 @@
 #define FRM         0x002 // URW Floating-Point Dynamic Rounding Mode.
 #define FCSR        0x003 // URW Floating-Point Control and Status Register (frm + fflags)
 
+//User Vector CSRs
+#define VSTART      0x008 // URW Vector start position.
+#define VXSAT       0x009 // URW Fixed-Point Saturate Flag.
+#define VXRM        0x00A // URW Fixed-Point Rounding Mode.
+#define VCSR        0x00F // URW Vector control and status register.
+#define VL          0xC20 // URO Vector length.
+#define VTYPE       0xC21 // URO Vector data type register.
+#define VLENB       0xC22 // URO VLEN/8 (vector register length in bytes).
+
 //User Counter/Timers
 #define CYCLE       0xC00 // URO Cycle counter for RDCYCLE instruction.
 #define TIME        0xC01 // URO Timer for RDTIME instruction.
@@ -55,6 +64,7 @@
 #define SCAUSE      0x142 // SRW Supervisor trap cause.
 #define STVAL       0x143 // SRW Supervisor bad address or instruction.
 #define SIP         0x144 // SRW Supervisor interrupt pending.
+#define STIMECMP    0x14D // SRW Supervisor timer compare.
 
 //Supervisor Protection and Translation
 #define SATP        0x180 // SRW Supervisor address translation and protection.
@@ -68,6 +78,9 @@
 //Machine Trap Setup
 #define MSTATUS     0x300 // MRW Machine status register.
 #define MISA        0x301 // MRW ISA and extensions
+    #define MISA_MXL32  (1ULL << 30)            // MXL, bits XLEN-1:XLEN-2
+    #define MISA_MXL64  (2ULL << 62)
+    #define MISA_EXT(c) (1ULL << ((c) - 'A'))
 #define MEDELEG     0x302 // MRW Machine exception delegation register.
 #define MIDELEG     0x303 // MRW Machine interrupt delegation register.
 #define MIE         0x304 // MRW Machine interrupt-enable register.
@@ -124,10 +137,34 @@
 #define DSCRATCH0   0x7B2 // DRW Debug scratch register 0.
 #define DSCRATCH1   0x7B3 // DRW Debug scratch register 1.
 
+//Emulator Custom Registers
+#define FORKSRV     0x8C0 // URW Fork-server marker, writing it stops at the marker.
+
+
+#define SIP_STIP    (1 << 5)    // supervisor timer interrupt pending
+#define TIMEBASE_HZ 10000000    // rate of the time csr
+
+// Exception causes (mcause). Traps are not delivered to the guest yet,
+// the hart counts them in stats.traps.
+#define CAUSE_FETCH_ACCESS  1
+#define CAUSE_ILLEGAL_INSN  2
+#define CAUSE_BREAKPOINT    3
+#define CAUSE_LOAD_MISALIGN 4
+#define CAUSE_LOAD_ACCESS   5
+#define CAUSE_STORE_MISALIGN 6
+#define CAUSE_STORE_ACCESS  7
+#define CAUSE_ECALL_U       8
+#define CAUSE_ECALL_S       9
+#define CAUSE_ECALL_M       11
 
 // functions
 
 uint64_t csr_read(CPU* cpu, uint64_t csr);
 void csr_write(CPU* cpu, uint64_t csr, uint64_t value);
 
+// Counters. Normally time and cycle follow the host clock; in icount mode
+// they are a fixed function of instret, which advances once per block.
+uint64_t cpu_time(CPU* cpu);
+uint64_t cpu_cycle(CPU* cpu);
+
 #endif
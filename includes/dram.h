@@ -3,13 +3,32 @@
 
 #include <stdint.h>
 
+// default layout for bare-metal images, user-mode ELFs pick their own
 #define DRAM_SIZE 1024*1024*1
 #define DRAM_BASE 0x80000000
 
+#define DRAM_PAGE_SHIFT 12
+#define DRAM_PAGE_SIZE  (1 << DRAM_PAGE_SHIFT)
+
 typedef struct DRAM {
-	uint8_t mem[DRAM_SIZE];     // Dram memory of DRAM_SIZE
+    uint64_t base;              // guest address of mem[0]
+    uint64_t size;
+    uint64_t pages;
+	uint8_t* mem;               // Dram memory of size bytes, mmap'd so snapshots can map over it
+    uint64_t* code;             // bitmap, pages decoded into the block cache
+    uint64_t* dirty;            // bitmap, pages written since the last checkpoint
+    uint32_t* gen;              // per page, bumped when a code page is written
 } DRAM;
 
+void dram_init(DRAM* dram, uint64_t base, uint64_t size);
+void dram_free(DRAM* dram);
+
+// 1 when [addr, addr + len) lies inside dram, checked on every guest access
+static inline int dram_contains(DRAM* dram, uint64_t addr, uint64_t len) {
+    return addr >= dram->base && addr - dram->base <= dram->size
+        && len <= dram->size - (addr - dram->base);
+}
+
 uint64_t dram_load(DRAM* dram, uint64_t addr, uint64_t size);
 //uint64_t dram_load_8(DRAM* dram, uint64_t addr);
 //uint64_t dram_load_16(DRAM* dram, uint64_t addr);
@@ -22,4 +41,25 @@ void dram_store(DRAM* dram, uint64_t addr, uint64_t size, uint64_t value);
 //void dram_store_32(DRAM* dram, uint64_t addr, uint64_t value);
 //void dram_store_64(DRAM* dram, uint64_t addr, uint64_t value);
 
+// bulk copies between dram and a host buffer, used by vector loads/stores
+void dram_load_bytes(DRAM* dram, uint64_t addr, uint64_t len, void* dst);
+void dram_store_bytes(DRAM* dram, uint64_t addr, uint64_t len, const void* src);
+
+// self-modifying code tracking: a store to a marked page bumps its
+// generation, which stales every block decoded from that page
+void dram_mark_code(DRAM* dram, uint64_t addr);
+uint32_t dram_page_gen(DRAM* dram, uint64_t addr);
+
+// for host code writing into mem[] directly, e.g. zero-copy syscalls
+void dram_touch(DRAM* dram, uint64_t addr, uint64_t len);
+
+// Maps len bytes of fd at off over guest RAM at addr (both page-aligned),
+// copy-on-write: guests mapping the same file share its pages in the host
+// page cache until they write them. Falls back to reading when the host
+// page size differs. Returns 0 on success, -1 on error.
+int dram_map_file(DRAM* dram, uint64_t addr, uint64_t len, int fd, uint64_t off);
+
+// Places a raw image at the start of RAM, cut to RAM size. Returns 0 on success.
+int dram_load_image(DRAM* dram, const char* path);
+
 #endif
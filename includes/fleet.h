@@ -0,0 +1,31 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// Fleet mode: many independent guests of one image in a single process,
+// run to completion by a pool of host threads. Every guest maps the image
+// or snapshots copy-on-write, so the file's pages are held once in the
+// host page cache and each guest only owns the pages it writes. Guests
+// also share one table of translated blocks, see block_shared_new().
+
+#define FLEET_MAX           4096
+#define FLEET_THREADS_MAX   256
+
+typedef struct FLEET {
+    uint32_t guests;
+    uint32_t threads;           // 0 for one per host cpu
+    const char* image;          // raw image, or NULL to restore snapshots
+    char** restore;
+    int nrestore;
+    uint64_t icount;
+    int stats;
+    const char* metrics;        // -M, one slot per guest
+} FLEET;
+
+// Runs every guest to its end and prints one line per guest.
+// Returns 0, or -1 if the fleet could not be set up.
+int fleet_run(const FLEET* fleet);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+
+#include "cpu.h"
+
+// AFL-compatible fork server. Once the guest reaches its marker (EBREAK or
+// a write to the FORKSRV CSR) the emulator forks one child per request on
+// the control pipe; each child inherits guest RAM and the decoded block
+// cache copy-on-write, runs to completion and exits with the guest's a0.
+
+#define FORKSRV_CTL_FD  198     // requests from the driver
+#define FORKSRV_ST_FD   199     // hello, child pids and wait statuses
+
+// Serves requests until the driver closes the pipe, then exits. Returns
+// only in a child, after loading the input file (if any) into the guest
+// buffer at a0 of capacity a1 and setting a0 to its length.
+void forkserver_run(CPU* cpu, const char* input);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// GDB remote serial protocol server. Breakpoints live in the translator:
+// a block never runs past a breakpoint address, and a block starting at
+// one is a single trap entry, so the run loop never compares pcs. Adding
+// or removing a breakpoint flushes the block cache to apply it.
+
+#define GDB_MAX_BREAKPOINTS 64
+#define GDB_POLL_BLOCKS     4096    // blocks between checks for a ^C from gdb
+
+// stop signals as gdb numbers them
+#define GDB_SIGINT          2
+#define GDB_SIGTRAP         5
+
+typedef struct GDB {
+    int fd;                         // connected debugger
+    int noack;                      // QStartNoAckMode negotiated
+    int stop;                       // signal to report and serve before the next block, -1 at entry
+    uint32_t poll;
+    uint32_t nbreak;
+    uint64_t breaks[GDB_MAX_BREAKPOINTS];
+} GDB;
+
+// Listens on a TCP port on localhost, or a unix socket when addr has a
+// '/', and waits for gdb. The guest starts stopped. Returns 0 on success.
+int gdb_start(CPU* cpu, const char* addr);
+
+// Run loop hook, between blocks: serves the debugger while the guest is
+// stopped. Returns 0 when gdb killed the guest or it stopped while stepping.
+int gdb_poll(CPU* cpu);
+
+// Guest finished, reports its exit status to gdb and hangs up
+void gdb_exit(CPU* cpu);
+
+// 1 when a breakpoint is set at pc, for the translator
+int gdb_breakpoint(const GDB* gdb, uint64_t pc);
+
+// Block handler of a breakpoint entry
+void gdb_break_exec(CPU* cpu, uint32_t inst);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef HOOK_H
+#define HOOK_H
+
+#include <stdint.h>
+
+// Host implementations of hot guest library routines. Entry points are
+// found in the ELF symbol table; a block starting at one becomes a single
+// native call that writes a0 and returns to ra, so the routine is never
+// interpreted. In verify mode the routines are interpreted as usual and
+// their results are checked against the host's at the return.
+
+enum {
+    HOOK_MEMCPY,
+    HOOK_MEMMOVE,
+    HOOK_MEMSET,
+    HOOK_MEMCMP,
+    HOOK_STRLEN,
+    HOOK_STRCMP,
+    HOOK_COUNT
+};
+
+#define HOOK_VERIFY_MAX (1 << 20)   // longer calls are not checked
+
+struct CPU;
+
+typedef struct HOOKS {
+    int n;                          // routines hooked
+    uint64_t pc[HOOK_COUNT];        // entry per routine, 0 when not hooked
+    int verify;
+    // verify mode: the call in flight, checked once it returns to ret with sp unchanged
+    int pending;                    // HOOK_* + 1, 0 when none
+    uint64_t ret, sp;
+    uint64_t dst, len;              // memory the routine should have written
+    int64_t expect;                 // a0 at the return
+    uint8_t* expect_buf;            // what dst should hold
+} HOOKS;
+
+extern const char* hook_names[HOOK_COUNT];
+
+// Looks up the allowlisted routines ("all" or a comma list) in the ELF at
+// path. Returns 0 on success, -1 on error.
+int hook_install(struct CPU* cpu, const char* path, const char* allow, int verify);
+
+// HOOK_* whose entry is pc, -1 when pc should be decoded normally
+int hook_find(const HOOKS* hooks, uint64_t pc);
+
+// Block handler for a hooked entry, inst holds the HOOK_* index
+void hook_exec(struct CPU* cpu, uint32_t inst);
+
+// Verify mode, called before each block
+void hook_verify(struct CPU* cpu);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdint.h>
+#include "bus.h"
+
+// Static RISC-V ELF images. The whole file is kept in memory so later
+// passes (symbol lookup) can read its sections without reopening it.
+
+typedef struct ELF_FILE {
+    uint8_t* data;
+    uint64_t size;
+    int      elf_class;         // ELFCLASS32 or ELFCLASS64
+    uint64_t entry;
+    uint64_t lo, hi;            // page-aligned extent of the PT_LOAD segments
+    uint64_t phdr;              // guest address of the program headers, for AT_PHDR
+    uint64_t phnum, phentsize;
+} ELF_FILE;
+
+// Reads and checks path, returns 0 on success, -1 on error
+int elf_open(ELF_FILE* elf, const char* path);
+// Copies the PT_LOAD segments into guest memory, bss is left as zeroed RAM
+int elf_load(ELF_FILE* elf, BUS* bus);
+// Address of the function symbol name in .symtab, 0 when there is none
+uint64_t elf_symbol(ELF_FILE* elf, const char* name);
+void elf_close(ELF_FILE* elf);
+
+struct CPU;
+
+// Loads a bare-metal image. An ELF goes to its segments and sets the pc
+// and the guest's XLEN from its class, anything else is a raw RV64 image
+// mapped at the start of DRAM. Returns 0 on success, -1 on error.
+int image_load(struct CPU* cpu, const char* path);
+
+#endif
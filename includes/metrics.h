@@ -0,0 +1,78 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+// Live counters in shared memory. -M maps a host file, or shm:name for a
+// POSIX shared-memory object, holding a header and one slot per hart.
+// Harts store into their slot with relaxed atomics: instructions and
+// blocks after every block, everything else every METRICS_POLL_BLOCKS
+// blocks. A reader such as rvstat samples the page while the emulator
+// runs, and derives rates from two samples. Counters only grow, except
+// ips and the queue depths, which are current values.
+
+#define METRICS_MAGIC       "RVMETRIC"
+#define METRICS_VERSION     2
+#define METRICS_TRAPS       16          // synchronous exceptions, by mcause code
+#define METRICS_QUEUES      16          // device queues listed in the header
+#define METRICS_POLL_BLOCKS 1024        // blocks between full updates
+#define METRICS_INTERVAL_NS 1000000000ULL   // window of the ips figure
+
+typedef struct METRICS_QUEUE {
+    char     name[24];          // "net@10001000.0": device, base, queue index
+    uint32_t depth;             // entries made available and not yet taken
+    uint32_t size;              // ring entries, 0 until the driver sets the queue up
+} METRICS_QUEUE;
+
+typedef struct METRICS_HART {
+    uint64_t instret;
+    uint64_t blocks_executed;
+    uint64_t blocks_translated;     // decode misses, other executions hit the block cache
+    uint64_t tlb_hits, tlb_misses;  // -T detailed phases only
+    uint64_t traps[METRICS_TRAPS];
+    uint64_t interrupts;            // claimed from the PLIC
+    uint64_t wfi;                   // WFI instructions executed
+    uint64_t ips;                   // instructions per second over the last interval
+    uint64_t updated_ns;            // CLOCK_MONOTONIC time of the last full update
+    uint64_t running;               // 1 while the hart runs, 0 once it stopped
+} METRICS_HART;
+
+typedef struct METRICS_PAGE {
+    char     magic[8];          // written last, a reader may see the file before
+    uint32_t version;
+    uint32_t pid;
+    uint32_t nharts;
+    uint32_t nqueues;
+    METRICS_QUEUE queue[METRICS_QUEUES];
+    METRICS_HART hart[];
+} METRICS_PAGE;
+
+// A hart's view of the page
+typedef struct METRICS {
+    METRICS_HART* hart;         // NULL unless -M
+    METRICS_PAGE* page;         // for device queues, set on a machine's first hart only
+    uint32_t polls;             // blocks since the last full update
+    uint64_t interval_ns;       // start of the ips interval
+    uint64_t interval_instret;
+} METRICS;
+
+struct CPU;
+
+// Creates or truncates spec and maps a page with nharts slots. Returns NULL on error.
+METRICS_PAGE* metrics_open(const char* spec, uint32_t nharts);
+
+// Gives cpu slot i. Slot 0 also lists its bus's device queues in the header.
+void metrics_attach(struct CPU* cpu, METRICS_PAGE* page, uint32_t i);
+
+// Stores every counter; called every METRICS_POLL_BLOCKS blocks and when the hart stops
+void metrics_update(struct CPU* cpu);
+void metrics_stop(struct CPU* cpu);
+
+// After each block, returns 1 when a full update is due
+static inline int metrics_block(METRICS* m, uint64_t instret, uint64_t blocks) {
+    __atomic_store_n(&m->hart->instret, instret, __ATOMIC_RELAXED);
+    __atomic_store_n(&m->hart->blocks_executed, blocks, __ATOMIC_RELAXED);
+    return ++m->polls == METRICS_POLL_BLOCKS;
+}
+
+#endif
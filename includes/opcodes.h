@@ -33,54 +33,107 @@
 #define I_TYPE  0x13
     #define ADDI    0x0
     #define SLLI    0x1
+        // funct6 (imm[11:6]), imm[5] is shamt[5] on RV64
+        #define BSETI   0x0a
+        #define BCLRI   0x12
+        #define BINVI   0x1a
+        #define ZBB_UNARY 0x18  // selected by imm[4:0]
+            #define CLZ     0x0
+            #define CTZ     0x1
+            #define CPOP    0x2
+            #define SEXT_B  0x4
+            #define SEXT_H  0x5
     #define SLTI    0x2
     #define SLTIU   0x3
     #define XORI    0x4
     #define SRI     0x5
+        // funct6 (imm[11:6]), imm[5] is shamt[5] on RV64
         #define SRLI    0x00
-        #define SRAI    0x20
+        #define SRAI    0x10
+        #define ORC_B   0x0a    // imm[11:0] = 0x287
+        #define BEXTI   0x12
+        #define RORI    0x18
+        #define REV8    0x1a    // imm[11:0] = 0x6b8
     #define ORI     0x6
     #define ANDI    0x7
 
 #define R_TYPE  0x33
+    #define MULDIV  0x01    // funct7 of the M extension, selected by funct3
+        #define MUL     0x0
+        #define MULH    0x1
+        #define MULHSU  0x2
+        #define MULHU   0x3
+        #define DIV     0x4
+        #define DIVU    0x5
+        #define REM     0x6
+        #define REMU    0x7
     #define ADDSUB  0x0
         #define ADD     0x00
         #define SUB     0x20
     #define SLL     0x1
+        #define ROL     0x30
+        #define BCLR    0x24
+        #define BINV    0x34
+        #define BSET    0x14
     #define SLT     0x2
+        #define SH1ADD  0x10
     #define SLTU    0x3
     #define XOR     0x4
+        #define SH2ADD  0x10
+        #define MIN     0x05
+        #define XNOR    0x20
     #define SR      0x5
         #define SRL     0x00
         #define SRA     0x20
+        #define MINU    0x05
+        #define ROR     0x30
+        #define BEXT    0x24
     #define OR      0x6
+        #define SH3ADD  0x10
+        #define MAX     0x05
+        #define ORN     0x20
     #define AND     0x7
+        #define MAXU    0x05
+        #define ANDN    0x20
 
 #define FENCE   0x0f
+    #define FENCE_I 0x1
 
 #define I_TYPE_64 0x1b
     #define ADDIW   0x0
     #define SLLIW   0x1
+        #define SLLI_UW 0x02    // funct6, 6-bit shamt
+        // ZBB_UNARY funct6 gives clzw/ctzw/cpopw
     #define SRIW    0x5
         #define SRLIW   0x00
         #define SRAIW   0x20
+        #define RORIW   0x30
 
 #define R_TYPE_64 0x3b
     #define ADDSUB   0x0
         #define ADDW    0x00
         #define MULW    0x01
         #define SUBW    0x20
+        #define ADD_UW  0x04
     #define DIVW    0x4
+        #define ZEXT_H  0x04    // rs2 = 0
+        #define SH2ADD_UW 0x10
     #define SLLW    0x1
+        #define ROLW    0x30
+    #define ZBA_SH1 0x2         // funct3 of sh1add.uw alone
+        #define SH1ADD_UW 0x10
     #define SRW     0x5
         #define SRLW   0x00
         #define DIVUW   0x01
         #define SRAW   0x20
+        #define RORW   0x30
     #define REMW    0x6
+        #define SH3ADD_UW 0x10
     #define REMUW   0x7
 
 #define CSR 0x73
     #define ECALLBREAK    0x00     // contains both ECALL and EBREAK
+        #define WFI     0x105      // funct12
     #define CSRRW   0x01
     #define CSRRS   0x02
     #define CSRRC   0x03
@@ -88,7 +141,10 @@
     #define CSRRSI  0x06
     #define CSRRCI  0x07
 
-#define AMO_W 0x2f
+#define AMO     0x2f        // funct3 is the width, funct7[6:2] the operation
+    #define AMO_W       0x2
+    #define AMO_D       0x3
+
     #define LR_W        0x02
     #define SC_W        0x03
     #define AMOSWAP_W   0x01
@@ -101,17 +157,114 @@
     #define AMOMINU_W   0x18
     #define AMOMAXU_W   0x1c
 
-//#define AMO_D 0x2f
-    //#define LR_D        0x02
-    //#define SC_D        0x03
-    //#define AMOSWAP_D   0x01
-    //#define AMOADD_D    0x00
-    //#define AMOXOR_D    0x04
-    //#define AMOAND_D    0x0c
-    //#define AMOOR_D     0x08
-    //#define AMOMIN_D    0x10
-    //#define AMOMAX_D    0x14
-    //#define AMOMINU_D   0x18
-    //#define AMOMAXU_D   0x1c
+    #define LR_D        0x02
+    #define SC_D        0x03
+    #define AMOSWAP_D   0x01
+    #define AMOADD_D    0x00
+    #define AMOXOR_D    0x04
+    #define AMOAND_D    0x0c
+    #define AMOOR_D     0x08
+    #define AMOMIN_D    0x10
+    #define AMOMAX_D    0x14
+    #define AMOMINU_D   0x18
+    #define AMOMAXU_D   0x1c
+
+// RVV 1.0 vector extension
+#define LOAD_FP     0x07    // vector loads share the LOAD-FP opcode
+#define STORE_FP    0x27    // vector stores share the STORE-FP opcode
+    // width field
+    #define VE8     0x0
+    #define VE16    0x5
+    #define VE32    0x6
+    #define VE64    0x7
+    // mop field
+    #define VMOP_UNIT       0x0
+    #define VMOP_INDEXED_U  0x1
+    #define VMOP_STRIDED    0x2
+    #define VMOP_INDEXED_O  0x3
+    // lumop/sumop field
+    #define VUMOP_UNIT      0x00
+    #define VUMOP_WHOLE     0x08
+    #define VUMOP_MASK      0x0b
+
+#define OP_V    0x57
+    #define OPIVV   0x0
+    #define OPFVV   0x1
+    #define OPMVV   0x2
+    #define OPIVI   0x3
+    #define OPIVX   0x4
+    #define OPFVF   0x5
+    #define OPMVX   0x6
+    #define OPCFG   0x7
+        // funct6, OPI*
+        #define VADD        0x00
+        #define VSUB        0x02
+        #define VRSUB       0x03
+        #define VMINU       0x04
+        #define VMIN        0x05
+        #define VMAXU       0x06
+        #define VMAX        0x07
+        #define VAND        0x09
+        #define VOR         0x0a
+        #define VXOR        0x0b
+        #define VMERGE      0x17    // vmv.v.* when vm=1
+        #define VMSEQ       0x18
+        #define VMSNE       0x19
+        #define VMSLTU      0x1a
+        #define VMSLT       0x1b
+        #define VMSLEU      0x1c
+        #define VMSLE       0x1d
+        #define VMSGTU      0x1e
+        #define VMSGT       0x1f
+        #define VSLL        0x25
+        #define VSRL        0x28
+        #define VSRA        0x29
+        // funct6, OPM*
+        #define VREDSUM     0x00
+        #define VREDAND     0x01
+        #define VREDOR      0x02
+        #define VREDXOR     0x03
+        #define VREDMINU    0x04
+        #define VREDMIN     0x05
+        #define VREDMAXU    0x06
+        #define VREDMAX     0x07
+        #define VWXUNARY0   0x10    // vmv.x.s, vcpop.m, vfirst.m (vmv.s.x for OPMVX)
+            #define VMV_X_S     0x00
+            #define VCPOP       0x10
+            #define VFIRST      0x11
+        #define VMUNARY0    0x14
+            #define VID         0x11
+        #define VMANDN      0x18
+        #define VMAND       0x19
+        #define VMOR        0x1a
+        #define VMXOR       0x1b
+        #define VMORN       0x1c
+        #define VMNAND      0x1d
+        #define VMNOR       0x1e
+        #define VMXNOR      0x1f
+        #define VDIVU       0x20
+        #define VDIV        0x21
+        #define VREMU       0x22
+        #define VREM        0x23
+        #define VMULHU      0x24
+        #define VMUL        0x25
+        #define VMULH       0x27
+        #define VMACC       0x2d
+        // funct6, OPF*
+        #define VFADD       0x00
+        #define VFREDUSUM   0x01
+        #define VFSUB       0x02
+        #define VFREDOSUM   0x03
+        #define VFMIN       0x04
+        #define VFREDMIN    0x05
+        #define VFMAX       0x06
+        #define VFREDMAX    0x07
+        #define VMFEQ       0x18
+        #define VMFLE       0x19
+        #define VMFLT       0x1b
+        #define VMFNE       0x1c
+        #define VFDIV       0x20
+        #define VFMUL       0x24
+        #define VFMACC      0x2c
 
 #endif
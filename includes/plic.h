@@ -0,0 +1,51 @@
+#ifndef PLIC_H
+#define PLIC_H
+
+#include <stdint.h>
+
+// Platform-level interrupt controller, register layout of the SiFive PLIC
+// that Linux's riscv,plic0 driver expects. Source lines, pending, claimed
+// and per-context enables are 64-bit bitmaps, with a bitmap per priority
+// level, so finding the interrupt to claim is a few ANDs and a
+// find-first-set. The hart's external interrupt bit (MEIP for context 0,
+// SEIP for context 1) is only touched when a context's best candidate
+// changes.
+
+#define PLIC_BASE           0x0c000000
+#define PLIC_SIZE           0x00600000
+#define PLIC_SOURCES        64          // source 0 means none
+#define PLIC_PRIORITY_MAX   7
+#define PLIC_CONTEXTS       2           // hart 0 M-mode, hart 0 S-mode
+
+// registers
+#define PLIC_PRIORITY       0x000000    // + 4 * source
+#define PLIC_PENDING        0x001000
+#define PLIC_ENABLE         0x002000    // + 0x80 * context
+#define PLIC_CONTEXT        0x200000    // + 0x1000 * context: threshold, claim/complete
+#define PLIC_CLAIM          0x4
+
+#define MIP_SEIP            (1 << 9)
+#define MIP_MEIP            (1 << 11)
+
+typedef struct PLIC {
+    uint32_t priority[PLIC_SOURCES];
+    uint64_t level[PLIC_PRIORITY_MAX + 1];  // sources at each priority
+    uint64_t line;              // sources whose device raises its line
+    uint64_t claimed;           // claimed and not yet completed
+    uint64_t pending;           // line & ~claimed
+    uint64_t enable[PLIC_CONTEXTS];
+    uint32_t threshold[PLIC_CONTEXTS];
+    uint32_t best[PLIC_CONTEXTS];   // source the context was last notified of
+    uint64_t* csr;              // the hart's csr file, for mip and sip
+    uint64_t claims;            // interrupts claimed, for metrics
+} PLIC;
+
+struct BUS;
+
+// Maps a PLIC driving the external interrupt bits in csr. Returns 0 on success.
+int plic_init(struct BUS* bus, uint64_t* csr);
+
+// Sets the line of source irq (1 to PLIC_SOURCES - 1) high or low
+void plic_set(PLIC* plic, uint32_t irq, int high);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Record/replay of nondeterministic inputs. Everything the guest sees
+// that does not follow from its own execution, host syscall results in
+// user mode and console input through SBI, is logged as an event. An
+// event holds the instret it happened at, a0/a1 afterwards and the guest
+// memory the host wrote. Replay applies the events instead of asking the
+// host, which reproduces the run exactly, and stops at the first event
+// whose instret, kind or number does not match.
+
+#define REPLAY_MAGIC        "RVREPLAY"
+#define REPLAY_VERSION      1
+#define REPLAY_MAX_REGIONS  64
+
+enum { REPLAY_OFF, REPLAY_RECORD, REPLAY_PLAY };
+
+enum {
+    REPLAY_START,           // initial user-mode stack, argv and environment
+    REPLAY_SYSCALL,         // nr is the syscall number
+    REPLAY_SBI,             // nr is the SBI extension
+};
+
+typedef struct REPLAY_EVENT {
+    uint64_t instret;
+    uint32_t kind;
+    uint32_t nregions;      // each an addr, len header followed by len bytes
+    uint64_t nr;
+    uint64_t a0, a1;
+} REPLAY_EVENT;
+
+typedef struct REPLAY_REGION {
+    uint64_t addr, len;
+} REPLAY_REGION;
+
+typedef struct REPLAY {
+    int mode;
+    FILE* log;
+    uint32_t nregions;      // guest memory written by the host during the current event
+    REPLAY_REGION regions[REPLAY_MAX_REGIONS];
+    uint64_t events;
+} REPLAY;
+
+struct CPU;
+
+int replay_open(REPLAY* r, const char* path, int mode);
+void replay_close(REPLAY* r);
+
+// Recording: notes guest memory the host is writing for the current event
+void replay_region(REPLAY* r, uint64_t addr, uint64_t len);
+// Recording: trims the noted regions to the first len bytes, for read()-like calls
+void replay_clip(REPLAY* r, uint64_t len);
+// Recording: logs the event with the current a0/a1 and noted regions
+void replay_record(struct CPU* cpu, uint32_t kind, uint64_t nr);
+
+// Replay: applies the next event, which must match kind and nr at the
+// current instret. Returns 0, or -1 after reporting a divergence.
+int replay_play(struct CPU* cpu, uint32_t kind, uint64_t nr);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SBI_H
+#define SBI_H
+
+#include "cpu.h"
+
+// Built-in SBI firmware. With direct boot an ECALL from the kernel is an
+// SBI call: extension id in a7, function id in a6, arguments in a0-a5.
+// It is served here and returns error/value in a0/a1, as OpenSBI would.
+
+// Extension ids
+#define SBI_EXT_LEGACY_TIMER    0x00
+#define SBI_EXT_LEGACY_PUTCHAR  0x01
+#define SBI_EXT_LEGACY_GETCHAR  0x02
+#define SBI_EXT_LEGACY_CLR_IPI  0x03
+#define SBI_EXT_LEGACY_IPI      0x04
+#define SBI_EXT_LEGACY_FENCE_I  0x05
+#define SBI_EXT_LEGACY_SFENCE   0x06
+#define SBI_EXT_LEGACY_SFENCE_A 0x07
+#define SBI_EXT_LEGACY_SHUTDOWN 0x08
+#define SBI_EXT_BASE            0x10
+#define SBI_EXT_TIME            0x54494D45  // "TIME"
+#define SBI_EXT_IPI             0x735049    // "sPI"
+#define SBI_EXT_RFENCE          0x52464E43  // "RFNC"
+#define SBI_EXT_HSM             0x48534D    // "HSM"
+#define SBI_EXT_SRST            0x53525354  // "SRST"
+#define SBI_EXT_DBCN            0x4442434E  // "DBCN"
+
+// Error codes
+#define SBI_SUCCESS                 0
+#define SBI_ERR_FAILED              -1
+#define SBI_ERR_NOT_SUPPORTED       -2
+#define SBI_ERR_INVALID_PARAM       -3
+#define SBI_ERR_INVALID_ADDRESS     -5
+#define SBI_ERR_ALREADY_AVAILABLE   -6
+
+#define SBI_SPEC_VERSION    0x02000000      // v2.0
+#define SBI_IMPL_ID         0x7276          // "rv", not a registered implementation
+#define SBI_IMPL_VERSION    1
+
+void sbi_call(CPU* cpu);
+
+#endif
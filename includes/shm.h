@@ -0,0 +1,35 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdint.h>
+
+// Shared guest memory regions. Each is an mmap of a host file or POSIX
+// shared-memory object placed on the bus outside RAM, so host tools can
+// read and write guest data in place while the emulator runs. A region
+// may have a doorbell: a 64-bit register just past its end, stores to it
+// are added to an eventfd (or written to any fd) inherited from the parent.
+
+#define SHM_MAX         4
+#define SHM_DOORBELL    8           // doorbell register bytes, at base + size
+
+typedef struct SHM {
+    uint64_t base;
+    uint64_t size;
+    uint8_t* mem;
+    int doorbell;                   // fd, -1 for none
+} SHM;
+
+struct BUS;
+
+// -m addr,size,path[,fd]: path is a host file, or shm:name for shm_open.
+// Creates and sizes the object when needed. Returns 0 on success.
+int shm_map(struct BUS* bus, const char* spec);
+
+// Region whose mapping, or whose doorbell, holds all of [addr, addr + len),
+// or NULL for an access outside both or straddling the two
+SHM* shm_find(struct BUS* bus, uint64_t addr, uint64_t len);
+
+uint64_t shm_load(SHM* shm, uint64_t addr, uint64_t size);
+void shm_store(SHM* shm, uint64_t addr, uint64_t size, uint64_t value);
+
+#endif
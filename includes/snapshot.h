@@ -0,0 +1,39 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// Machine snapshots. A file holds a header page, the hart state and
+// page-aligned RAM pages, so restore can mmap RAM copy-on-write instead
+// of reading it. A full snapshot stores all of RAM; an incremental one
+// stores only pages written since the previous checkpoint, listed in a
+// page index, and is restored on top of the snapshots before it.
+
+#define SNAPSHOT_MAGIC      "RVSNAP\0\0"
+#define SNAPSHOT_VERSION    3
+
+#define SNAPSHOT_FULL        0x1
+
+typedef struct SNAPSHOT_HEADER {
+    char     magic[8];
+    uint32_t version;
+    uint32_t flags;             // SNAPSHOT_FULL
+    uint64_t dram_base;
+    uint64_t dram_size;
+    uint64_t page_size;
+    uint64_t cpu_offset;        // hart state
+    uint64_t cpu_size;
+    uint64_t index_offset;      // uint32_t page numbers, incremental only
+    uint64_t ram_offset;        // page-aligned start of the stored pages
+    uint64_t npages;
+} SNAPSHOT_HEADER;
+
+// Writes a full snapshot, or only the pages dirtied since the last
+// checkpoint when full is 0. Returns 0 on success, -1 on error.
+int snapshot_save(CPU* cpu, const char* path, int full);
+
+// Applies a snapshot over the current machine. Returns 0 on success, -1 on error.
+int snapshot_restore(CPU* cpu, const char* path);
+
+#endif
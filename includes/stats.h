@@ -0,0 +1,33 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "block.h"
+#include "hook.h"
+
+#define STATS_TRAPS     16
+
+// Execution counters, printed at exit with -s
+typedef struct STATS {
+    uint64_t instret;               // guest instructions retired
+    uint64_t blocks_executed;
+    uint64_t blocks_translated;
+    uint64_t blocks_shared;         // of those, copied from another guest's translation
+    uint64_t blocks_invalidated;    // dropped after a store into their page
+    uint64_t blocks_optimised;      // hot blocks given their fused version
+    uint64_t cache_flushes;         // FENCE.I
+    uint64_t ras_hits, ras_misses;  // returns predicted by the shadow stack
+    uint64_t ibtc_hits, ibtc_misses;// other jalr, predicted per site
+    uint64_t fused[FUSE_COUNT];     // superinstructions executed, per pair
+    uint64_t sbi_calls;             // served by the built-in firmware
+    uint64_t hooked[HOOK_COUNT];    // library calls run on the host, or checked with -V
+    uint64_t hook_mismatches;
+    uint64_t watch_faults;          // watched-page accesses run on the slow path
+    uint64_t traps[STATS_TRAPS];    // synchronous exceptions, by mcause code
+    uint64_t wfi;                   // WFI instructions, a guest idle loop shows here
+} STATS;
+
+void stats_print(const STATS* stats, FILE* out);
+
+#endif
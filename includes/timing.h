@@ -0,0 +1,57 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Cache and TLB timing model. Instruction fetch (per executed block) and
+// every load and store go through set-associative L1I/L1D, a shared L2
+// and a TLB, each with LRU replacement. A sampling controller cycles
+// through three phases so long runs stay close to functional speed:
+//   fast    - the model is off
+//   warm    - caches and TLB are updated, nothing is counted
+//   detail  - hits, misses and cycles are counted
+// Cycles are one per instruction plus the miss penalties, so the
+// estimated CPI is cycles / instructions over the detailed phases.
+
+enum { TIMING_FAST, TIMING_WARM, TIMING_DETAIL };
+
+typedef struct CACHE {
+    const char* name;
+    uint32_t sets, ways;
+    uint32_t shift;             // log2 of the line size, the page size for the TLB
+    uint64_t* tags;             // sets * ways, line number + 1 so 0 is an empty way
+    uint64_t* stamp;            // last use of each way, for LRU
+    uint64_t clock;
+    uint64_t hits, misses;      // detailed phases only
+} CACHE;
+
+typedef struct TIMING {
+    int phase;
+    CACHE l1i, l1d, l2, tlb;
+    uint32_t l2_lat;            // cycles added by an L1 miss
+    uint32_t mem_lat;           // and by an L2 miss on top of it
+    uint32_t tlb_lat;           // by a TLB miss
+    uint64_t ff, warm, detail;  // instructions per phase, ff = 0 details everything
+    uint64_t phase_end;         // instret at which the phase changes
+    uint64_t insns, cycles;     // detailed phases only
+    uint64_t samples;
+} TIMING;
+
+// Sets the default geometry then applies spec, comma separated
+// l1i|l1d|l2=SIZE/WAYS, tlb=ENTRIES/WAYS, l2lat|memlat|tlblat=CYCLES.
+// Returns 0 on success, -1 on error.
+int timing_config(TIMING* t, const char* spec);
+
+// sampling is "ff:warm:detail" instruction counts, or "0" for all detail
+int timing_init(TIMING* t, const char* sampling);
+
+// Data access of len bytes at addr, from the bus
+void timing_data(TIMING* t, uint64_t addr, uint64_t len);
+
+// Before a block of count instructions at pc runs, instret already includes it
+void timing_block(TIMING* t, uint64_t pc, uint32_t count, uint64_t instret);
+
+void timing_print(const TIMING* t, FILE* out);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef USER_H
+#define USER_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// Linux user-mode personality: runs a static RISC-V Linux ELF without a
+// kernel. ECALLs are serviced by translating the syscall to the host, with
+// guest buffers passed as host pointers into guest RAM.
+
+#define USER_MEM_SIZE   (256ULL << 20)  // guest address space, from the image base up
+#define USER_STACK_SIZE (8ULL << 20)    // at the top of it
+
+typedef struct USER {
+    uint64_t brk_start, brk;    // heap, grows up from the end of the image
+    uint64_t mmap_base;         // lowest mmap so far, mappings grow down from the stack
+    uint64_t stack_lo;
+    int exit_code;
+} USER;
+
+// Loads path and builds the initial stack (argv, envp, auxv). Returns 0 on success.
+int user_load(CPU* cpu, const char* path, int argc, char** argv, char** envp);
+void user_syscall(CPU* cpu);
+
+#endif
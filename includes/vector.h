@@ -0,0 +1,25 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <stdint.h>
+
+#define VLEN    256             // bits in each vector register
+#define VLEN_BYTES (VLEN / 8)   // bytes in each vector register
+#define ELEN    64              // widest supported element
+
+#define VTYPE_VILL  (1ULL << 63) // vtype.vill, set when vsetvl asks for an unsupported config
+
+typedef struct VPU {
+    uint8_t v[32][VLEN_BYTES] __attribute__((aligned(32)));  // v0-v31, v0 doubles as the mask
+} VPU;
+
+struct CPU;
+
+// Select the host SIMD kernels (SSE2/SSE4.1/AVX2 or plain C) for this machine
+void vector_init(void);
+
+void exec_OP_V(struct CPU* cpu, uint32_t inst);
+void exec_VLOAD(struct CPU* cpu, uint32_t inst);
+void exec_VSTORE(struct CPU* cpu, uint32_t inst);
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include "bus.h"
+#include "plic.h"
+
+// virtio-mmio transport (version 2) with split virtqueues. Devices see
+// descriptor chains as iovecs straight into guest RAM, take and complete
+// them in batches, and publish the used index once per batch. Interrupts
+// follow EVENT_IDX when the driver accepts it, or VRING_AVAIL_F_NO_INTERRUPT.
+
+#define VIRTIO_MMIO_BASE    0x10001000
+#define VIRTIO_MMIO_SIZE    0x1000
+#define VIRTIO_MMIO_MAX     8
+
+#define VIRTIO_QUEUE_MAX    2
+#define VIRTIO_QUEUE_SIZE   256     // QueueNumMax
+#define VIRTIO_CHAIN_MAX    64      // descriptors followed per chain
+
+// feature bits
+#define VIRTIO_F_VERSION_1          (1ULL << 32)
+#define VIRTIO_RING_F_EVENT_IDX     (1ULL << 29)
+
+// MMIO registers
+#define VIRTIO_MAGIC                0x000
+#define VIRTIO_VERSION              0x004
+#define VIRTIO_DEVICE_ID            0x008
+#define VIRTIO_VENDOR_ID            0x00c
+#define VIRTIO_DEVICE_FEATURES      0x010
+#define VIRTIO_DEVICE_FEATURES_SEL  0x014
+#define VIRTIO_DRIVER_FEATURES      0x020
+#define VIRTIO_DRIVER_FEATURES_SEL  0x024
+#define VIRTIO_QUEUE_SEL            0x030
+#define VIRTIO_QUEUE_NUM_MAX        0x034
+#define VIRTIO_QUEUE_NUM            0x038
+#define VIRTIO_QUEUE_READY          0x044
+#define VIRTIO_QUEUE_NOTIFY         0x050
+#define VIRTIO_INTERRUPT_STATUS     0x060
+#define VIRTIO_INTERRUPT_ACK        0x064
+#define VIRTIO_STATUS               0x070
+#define VIRTIO_QUEUE_DESC_LOW       0x080
+#define VIRTIO_QUEUE_DESC_HIGH      0x084
+#define VIRTIO_QUEUE_DRIVER_LOW     0x090
+#define VIRTIO_QUEUE_DRIVER_HIGH    0x094
+#define VIRTIO_QUEUE_DEVICE_LOW     0x0a0
+#define VIRTIO_QUEUE_DEVICE_HIGH    0x0a4
+#define VIRTIO_CONFIG_GENERATION    0x0fc
+#define VIRTIO_CONFIG               0x100
+
+#define VIRTIO_INT_USED     0x1     // InterruptStatus, a queue has new used entries
+
+typedef struct VIRTQ {
+    uint32_t num;               // ring entries, 0 until the driver sets it
+    uint32_t ready;
+    uint64_t desc, avail, used; // guest addresses of the three rings
+    uint16_t last_avail;        // next avail entry the device takes
+    uint16_t used_idx;          // next used entry, published by virtq_publish
+    uint16_t signalled;         // used_idx when the driver was last interrupted
+} VIRTQ;
+
+// One descriptor chain: readable buffers first, then writable ones
+typedef struct VIRTQ_CHAIN {
+    uint16_t head;
+    uint32_t nout, nin;
+    struct iovec iov[VIRTIO_CHAIN_MAX];
+} VIRTQ_CHAIN;
+
+typedef struct VIRTIO {
+    uint32_t device_id;
+    const char* name;           // short name in metrics
+    uint64_t features;          // offered
+    uint64_t driver_features;   // accepted
+    uint32_t features_sel, driver_features_sel;
+    uint32_t queue_sel;
+    uint32_t status;
+    uint32_t isr;               // InterruptStatus
+    uint32_t nqueues;
+    VIRTQ q[VIRTIO_QUEUE_MAX];
+    uint8_t* config;            // device config space, little-endian
+    uint32_t config_len;
+    DRAM* dram;
+    PLIC* plic;                 // raises irq while isr is non-zero
+    uint32_t irq;
+    // device side
+    void* dev;
+    void (*notify)(struct VIRTIO* vio, uint32_t queue);
+    void (*reset)(struct VIRTIO* vio);
+} VIRTIO;
+
+// Maps vio at the next free virtio-mmio slot, its interrupt is the slot
+// number plus one. poll may be NULL.
+int virtio_attach(BUS* bus, VIRTIO* vio, void (*poll)(void* dev));
+
+// Entries the driver has made available and the device has not taken
+uint16_t virtq_pending(VIRTIO* vio, VIRTQ* q);
+
+// Reads the chain i entries past last_avail, without taking it.
+// Returns 0 on success, -1 for a malformed chain.
+int virtq_peek(VIRTIO* vio, VIRTQ* q, uint16_t i, VIRTQ_CHAIN* c);
+
+// Completes a chain with len bytes written. The driver sees it once the
+// batch is published, which also takes the consumed avail entries.
+void virtq_push(VIRTIO* vio, VIRTQ* q, uint16_t head, uint32_t len);
+void virtq_publish(VIRTIO* vio, VIRTQ* q, uint16_t consumed);
+
+// Host wrote len bytes of guest RAM at p
+void virtio_written(VIRTIO* vio, const void* p, uint64_t len);
+
+// Bytes [skip, skip + len) of iov[0..n) as iovecs in out, returns their count
+uint32_t virtio_iov_slice(const struct iovec* iov, uint32_t n, uint64_t skip, uint64_t len,
+                          struct iovec* out);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef VIRTIO_9P_H
+#define VIRTIO_9P_H
+
+#include <stdint.h>
+#include "virtio.h"
+
+// virtio-9p host directory share, serving 9P2000.L (mount -t 9p -o
+// trans=virtio,version=9p2000.L <tag> /mnt). Tread and Twrite move file
+// data with preadv/pwritev straight between the file and guest RAM. With
+// worker threads, requests are handed to a pool when the driver kicks the
+// queue and the hart keeps running; completions are published from the
+// run loop's device poll. Names are resolved one element at a time under
+// the share's root and host symlinks are never followed, so the guest
+// cannot reach outside it.
+
+#define VIRTIO_ID_9P    9
+#define P9_MSIZE        (256 * 1024)    // largest message we negotiate
+#define P9_THREADS_MAX  16
+
+// -9 path[,tag[,threads]]: shares path under tag (default "hostshare").
+// Returns 0 on success.
+int virtio_9p_init(BUS* bus, const char* spec);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef VIRTIO_NET_H
+#define VIRTIO_NET_H
+
+#include <stdint.h>
+#include "virtio.h"
+
+// virtio-net over a local datagram socket, one datagram per Ethernet frame.
+// Frames move in batches of up to NET_BATCH chains per sendmmsg/recvmmsg,
+// gathered straight from and scattered straight into guest RAM; the
+// message and iovec arrays are allocated once with the device.
+
+#define NET_BATCH       32
+#define NET_HDR_SIZE    12          // virtio_net_hdr_v1, VERSION_1 always has num_buffers
+
+#define VIRTIO_ID_NET   1
+
+// -n path: connects to a unix datagram socket, or fd:N uses an inherited
+// socket such as one end of a socketpair. Returns 0 on success.
+int virtio_net_init(BUS* bus, const char* backend);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdint.h>
+#include <setjmp.h>
+
+// Data watchpoints on guest RAM. The host pages backing a watched range
+// are mprotected (read-only for write watches, no access otherwise), so
+// guest code runs at full speed until it touches one. The SIGSEGV unwinds
+// to block_exec, which re-runs the faulting instruction alone with the
+// pages open and every bus access checked against the watched ranges.
+
+#define WATCH_MAX       16
+
+#define WATCH_WRITE     0x1
+#define WATCH_READ      0x2
+#define WATCH_ACCESS    (WATCH_READ | WATCH_WRITE)
+
+struct CPU;
+struct BLOCK;
+
+typedef struct WATCH {
+    uint64_t addr;
+    uint64_t len;
+    int kind;                   // WATCH_* accesses that trigger it
+} WATCH;
+
+typedef struct WATCHES {
+    uint32_t n;
+    WATCH list[WATCH_MAX];
+    int open;                   // pages unprotected, nesting count
+    int stray;                  // host code outside a block faulted the pages open
+    volatile int in_block;      // env is live, faults unwind to block_exec
+    sigjmp_buf env;
+    // first hit of the last checked instruction or host call
+    int hit;                    // 1 + index into list, 0 for none
+    int hit_kind;               // WATCH_READ or WATCH_WRITE
+    uint64_t hit_addr;
+} WATCHES;
+
+// Adds or removes a watch on [addr, addr + len) in guest RAM. Returns 0 on success.
+int watch_add(struct CPU* cpu, uint64_t addr, uint64_t len, int kind);
+int watch_remove(struct CPU* cpu, uint64_t addr, uint64_t len, int kind);
+
+// -W addr,len[,r|w|a]
+int watch_parse(struct CPU* cpu, const char* spec);
+
+// Unprotects the watched pages for checked host-side access, and restores them
+void watch_open(struct CPU* cpu);
+void watch_close(struct CPU* cpu);
+
+// Bus check, records a hit when [addr, addr + len) meets a watch of this kind
+void watch_access(WATCHES* w, uint64_t addr, uint64_t len, int kind);
+
+// Reports and clears a hit by the instruction at pc: stops gdb, or logs it
+void watch_report(struct CPU* cpu, uint64_t pc);
+
+// Slow path after a fault in b, runs the faulting instruction with checks
+int watch_fault(struct CPU* cpu, struct BLOCK* b);
+
+#endif
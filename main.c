@@ -2,8 +2,22 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "includes/cpu.h"
+#include "includes/snapshot.h"
+#include "includes/forkserver.h"
+#include "includes/user.h"
+#include "includes/boot.h"
+#include "includes/csr.h"
+#include "includes/gdbstub.h"
+#include "includes/virtio_net.h"
+#include "includes/virtio_9p.h"
+#include "includes/plic.h"
+#include "includes/fleet.h"
+#include "includes/loader.h"
+
+extern char** environ;
 
 // ANSI colors
 
@@ -15,75 +29,273 @@
 #define ANSI_CYAN    "\x1b[36m"
 #define ANSI_RESET   "\x1b[0m"
 
-void read_file(CPU* cpu, char *filename)
-{
-	FILE *file;
-	uint8_t *buffer;
-	unsigned long fileLen;
-
-	//Open file
-	file = fopen(filename, "rb");
-	if (!file)
-	{
-		fprintf(stderr, "Unable to open file %s", filename);
-	}
-
-	//Get file length
-	fseek(file, 0, SEEK_END);
-	fileLen=ftell(file);
-	fseek(file, 0, SEEK_SET);
-
-	//Allocate memory
-	buffer=(uint8_t *)malloc(fileLen+1);
-	if (!buffer)
-	{
-		fprintf(stderr, "Memory error!");
-        fclose(file);
-	}
+static void usage(void) {
+    printf("Usage: rvemu [-q] [-s] [-w snap [-p N]] <filename>\n");
+    printf("       rvemu [options] -r snap [-r snap ...]\n");
+    printf("       rvemu [options] -u prog.elf [args...]\n");
+    printf("       rvemu [options] -k kernel [-i initrd] [-a bootargs]\n");
+    printf("  -q    quiet, no per-instruction trace\n");
+    printf("  -s    print execution statistics on exit\n");
+    printf("  -u    run a static RV64 Linux ELF in user mode, syscalls go to the host\n");
+    printf("  -k    boot a kernel directly in %llu MiB of RAM, with a generated\n", BOOT_MEM_SIZE >> 20);
+    printf("        device tree in a1 and SBI calls served by the emulator\n");
+    printf("  -i    initrd for -k, -a its kernel command line\n");
+    printf("  -H    run library routines on the host, \"all\" or a list such as\n");
+    printf("        memcpy,memset,strlen, found in the -u or -k ELF's symbols\n");
+    printf("  -V    with -H, interpret the routines and check them against the host\n");
+    printf("  -T    cache/TLB timing model, sampled as ff:warm:detail instruction\n");
+    printf("        counts (fast-forward, warm up, measure, repeat) or 0 for all detail\n");
+    printf("  -C    cache geometry for -T, e.g. l1d=32k/8,l2=1m/16,tlb=64/4,memlat=100\n");
+    printf("  -R    record host inputs (syscall results, console input) to log\n");
+    printf("  -P    replay a log from -R, reproducing the recorded run exactly;\n");
+    printf("        both need -I and cannot be used with -n, -9 or -m\n");
+    printf("  -I    icount: time advances one tick (%d ns) per N instructions and\n", 1000000000 / TIMEBASE_HZ);
+    printf("        cycle once per instruction, independent of the host\n");
+    printf("  -g    wait for gdb on a localhost TCP port, or a unix socket path,\n");
+    printf("        with the guest stopped at its first instruction\n");
+    printf("  -m    map a host file, or shm:name for a POSIX shared-memory object,\n");
+    printf("        into the guest as addr,size,path[,fd]; with fd, a store to\n");
+    printf("        addr+size is written to that inherited eventfd as a doorbell\n");
+    printf("  -n    virtio-net device, frames are datagrams on a unix socket path\n");
+    printf("        or fd:N, an inherited socket such as a socketpair end\n");
+    printf("  -9    virtio-9p share of a host directory, path[,tag[,threads]];\n");
+    printf("        the tag defaults to hostshare, threads serve requests off the hart\n");
+    printf("  -N    fleet: run N copies of the image or snapshots as guests[,threads]\n");
+    printf("        in one process, sharing image pages and translated code\n");
+    printf("  -M    publish live counters for rvstat in a host file, or shm:name\n");
+    printf("  -W    watch guest memory, addr,len[,w|r|a] for writes (default),\n");
+    printf("        reads or both; each hit is logged with its pc, or stops gdb;\n");
+    printf("        not with -n or -9, whose devices write guest RAM directly\n");
+    printf("  -r    restore a snapshot instead of loading a binary, repeat to\n");
+    printf("        apply incremental snapshots on top of a full one; -r, -w\n");
+    printf("        and -p cannot be used with -u, -k, -n, -9 or -m\n");
+    printf("  -w    write a snapshot to snap when the guest stops\n");
+    printf("  -p    also checkpoint every N instructions to snap.0, snap.1, ...\n");
+    printf("        only the first checkpoint of a run is full, later ones hold\n");
+    printf("        the pages written since the previous checkpoint\n");
+    printf("  -F    fork server: at the guest's EBREAK or FORKSRV csr write, fork\n");
+    printf("        a child per request on fd %d, each exits with the guest's a0\n", FORKSRV_CTL_FD);
+    printf("  -f    input file copied to the guest buffer at a0 (size a1) per child\n");
+    printf("  -c    record AFL edge coverage, into __AFL_SHM_ID when set\n");
+    exit(1);
+}
 
-	//Read file contents into buffer
-	fread(buffer, fileLen, 1, file);
-	fclose(file);
+#define MAX_RESTORE 64
 
-    // Print file contents in hex
-    /*for (int i=0; i<fileLen; i+=2) {*/
-        /*if (i%16==0) printf("\n%.8x: ", i);*/
-        /*printf("%02x%02x ", *(buffer+i), *(buffer+i+1));*/
-    /*}*/
-    /*printf("\n");*/
+static int checkpoints = 0;
 
-    // copy the bin executable to dram
-    memcpy(cpu->bus.dram.mem, buffer, fileLen*sizeof(uint8_t));
-	free(buffer);
+static void checkpoint(CPU* cpu, const char* path) {
+    watch_open(cpu);            // the file writes cannot read protected pages
+    if (snapshot_save(cpu, path, checkpoints == 0) == 0)
+        checkpoints++;
+    watch_close(cpu);
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Usage: rvemu <filename>\n");
-        exit(1);
+    int opt, stats = 0, nrestore = 0, forkserver = 0, child = 0, coverage = 0, user = 0;
+    char* restore[MAX_RESTORE];
+    char* snap = NULL;
+    char* input = NULL;
+    char* kernel = NULL;
+    char* initrd = NULL;
+    char* bootargs = NULL;
+    char* hooks = NULL;
+    int verify = 0;
+    char* sampling = NULL;
+    char* caches = NULL;
+    char* replay = NULL;
+    char* debug = NULL;
+    char* watches[WATCH_MAX];
+    char* regions[SHM_MAX];
+    char* netdev = NULL;
+    char* share = NULL;
+    char* metrics = NULL;
+    int nregion = 0;
+    int nwatch = 0;
+    int replay_mode = REPLAY_OFF;
+    uint64_t icount = 0;
+    uint64_t period = 0;
+    FLEET fleet = { 0 };
+    char* end;
+    while ((opt = getopt(argc, argv, "+qsr:w:p:Ff:cuk:i:a:H:VT:C:R:P:I:g:W:m:n:9:N:M:")) != -1) {
+        switch (opt) {
+            case 'q': cpu_trace = 0; break;
+            case 's': stats = 1; break;
+            case 'r':
+                if (nrestore == MAX_RESTORE)
+                    usage();
+                restore[nrestore++] = optarg;
+                break;
+            case 'w': snap = optarg; break;
+            case 'p': period = strtoull(optarg, NULL, 0); break;
+            case 'F': forkserver = 1; break;
+            case 'f': input = optarg; break;
+            case 'c': coverage = 1; break;
+            case 'u': user = 1; break;
+            case 'k': kernel = optarg; break;
+            case 'i': initrd = optarg; break;
+            case 'a': bootargs = optarg; break;
+            case 'H': hooks = optarg; break;
+            case 'V': verify = 1; break;
+            case 'T': sampling = optarg; break;
+            case 'C': caches = optarg; break;
+            case 'R': replay = optarg; replay_mode = REPLAY_RECORD; break;
+            case 'P': replay = optarg; replay_mode = REPLAY_PLAY; break;
+            case 'g': debug = optarg; break;
+            case 'n': netdev = optarg; break;
+            case '9': share = optarg; break;
+            case 'M': metrics = optarg; break;
+            case 'N':
+                fleet.guests = strtoul(optarg, &end, 0);
+                if (*end == ',')
+                    fleet.threads = strtoul(end + 1, &end, 0);
+                if (*end || fleet.guests == 0 || fleet.guests > FLEET_MAX
+                        || fleet.threads > FLEET_THREADS_MAX)
+                    usage();
+                break;
+            case 'm':
+                if (nregion == SHM_MAX)
+                    usage();
+                regions[nregion++] = optarg;
+                break;
+            case 'W':
+                if (nwatch == WATCH_MAX)
+                    usage();
+                watches[nwatch++] = optarg;
+                break;
+            case 'I':
+                icount = strtoull(optarg, NULL, 0);
+                if (icount == 0)
+                    usage();
+                break;
+            default: usage();
+        }
+    }
+    if ((user ? argc - optind < 1 : argc - optind != (nrestore || kernel ? 0 : 1))
+            || (period && !snap) || ((initrd || bootargs) && !kernel)
+            || (hooks && !user && !kernel) || (verify && !hooks) || (caches && !sampling))
+        usage();
+    // snapshots hold the hart and RAM, not user-mode, SBI or device state
+    if ((snap || nrestore) && (user || kernel || netdev || share || nregion))
+        usage();
+    // device inputs and the host clock are not logged, a replayed run has neither
+    if (replay && (!icount || netdev || share || nregion))
+        usage();
+
+    // a fleet runs plain images or snapshots, none of the per-run machinery
+    if (fleet.guests) {
+        if (user || kernel || snap || forkserver || coverage || hooks || sampling || replay
+                || debug || nwatch || nregion || netdev || share)
+            usage();
+        cpu_trace = 0;
+        fleet.image = nrestore ? NULL : argv[optind];
+        fleet.restore = restore;
+        fleet.nrestore = nrestore;
+        fleet.icount = icount;
+        fleet.stats = stats;
+        fleet.metrics = metrics;
+        return fleet_run(&fleet) < 0 ? 1 : 0;
     }
 
     // Initialize cpu, registers and program counter
     struct CPU cpu;
     cpu_init(&cpu);
-    // Read input file
-    read_file(&cpu, argv[1]);
-
-    // cpu loop
-    while (1) {
-        // fetch
-        uint32_t inst = cpu_fetch(&cpu);
-        // Increment the program counter
-        cpu.pc += 4;
-        // execute
-        if (!cpu_execute(&cpu, inst))
-            break;
-
-        dump_registers(&cpu);
+    cpu.icount = icount;
+    if (coverage && coverage_init(&cpu.cov) < 0)
+        exit(1);
+    if (replay && replay_open(&cpu.replay, replay, replay_mode) < 0)
+        exit(1);
+    // devices first, direct boot lists them in the device tree
+    if ((netdev || share) && plic_init(&cpu.bus, cpu.csr) < 0)
+        exit(1);
+    if (netdev && virtio_net_init(&cpu.bus, netdev) < 0)
+        exit(1);
+    if (share && virtio_9p_init(&cpu.bus, share) < 0)
+        exit(1);
+    if (user) {
+        if (user_load(&cpu, argv[optind], argc - optind, argv + optind, environ) < 0)
+            exit(1);
+    } else if (kernel) {
+        if (boot_load(&cpu, kernel, initrd, bootargs) < 0)
+            exit(1);
+    } else if (nrestore) {
+        for (int i = 0; i < nrestore; i++)
+            if (snapshot_restore(&cpu, restore[i]) < 0)
+                exit(1);
+    } else {
+        // a raw image is mapped, not copied, so its pages are shared until written
+        if (image_load(&cpu, argv[optind]) < 0)
+            exit(1);
+    }
+    if (hooks && hook_install(&cpu, user ? argv[optind] : kernel, hooks, verify) < 0)
+        exit(1);
+    if (sampling) {
+        if (timing_config(&cpu.timing, caches) < 0 || timing_init(&cpu.timing, sampling) < 0)
+            exit(1);
+        cpu.bus.timing = &cpu.timing;
+    }
+    for (int i = 0; i < nregion; i++)
+        if (shm_map(&cpu.bus, regions[i]) < 0)
+            exit(1);
+    for (int i = 0; i < nwatch; i++)
+        if (watch_parse(&cpu, watches[i]) < 0)
+            exit(1);
+    if (debug && cpu.xlen == 32) {
+        fprintf(stderr, "[-] ERROR-> -g supports RV64 guests only\n");
+        exit(1);
+    }
+    if (debug && gdb_start(&cpu, debug) < 0)
+        exit(1);
+    // last, so the page lists every device queue
+    if (metrics) {
+        METRICS_PAGE* page = metrics_open(metrics, 1);
+        if (!page)
+            exit(1);
+        metrics_attach(&cpu, page, 0);
+    }
 
+    // cpu loop, one decoded block at a time
+    uint64_t next_checkpoint = cpu.stats.instret + period;
+    uint32_t polls = 0;
+    char path[4096];
+    // with gdb attached, each block first gives the debugger a chance to stop it
+    while ((!cpu.gdb || gdb_poll(&cpu)) && block_exec(&cpu)) {
         if(cpu.pc==0)
             break;
+        if (cpu.marker) {
+            cpu.marker = 0;
+            if (forkserver && !child) {
+                forkserver_run(&cpu, input);    // returns in each child
+                child = 1;
+            }
+        }
+        if (cpu.bus.nmmio && ++polls == BUS_POLL_BLOCKS) {
+            polls = 0;
+            bus_poll(&cpu.bus);
+        }
+        if (period && cpu.stats.instret >= next_checkpoint) {
+            snprintf(path, sizeof(path), "%s.%d", snap, checkpoints);
+            checkpoint(&cpu, path);
+            next_checkpoint += period;
+        }
     }
-    /*dump_registers(&cpu);*/
-    return 0;
+    if (cpu.metrics.hart)
+        metrics_stop(&cpu);
+    if (cpu.gdb)
+        gdb_exit(&cpu);
+    if (replay)
+        replay_close(&cpu.replay);
+    if (snap)
+        checkpoint(&cpu, snap);
+    if (!cpu_trace && !cpu.user)
+        dump_registers(&cpu);
+    if (stats)
+        stats_print(&cpu.stats, stderr);
+    if (cpu.bus.timing)
+        timing_print(&cpu.timing, stderr);
+    if (stats && cpu.cov.map)
+        fprintf(stderr, "edges covered        : %u\n", coverage_count(&cpu.cov));
+    if (cpu.user)
+        return cpu.user->exit_code;
+    return child ? (int)(cpu.regs[10] & 0xff) : 0;
 }
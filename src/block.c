@@ -0,0 +1,538 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../includes/cpu.h"
+#include "../includes/block.h"
+#include "../includes/opcodes.h"
+#include "../includes/csr.h"
+#include "../includes/gdbstub.h"
+
+#define BLOCK_HASH(pc)  (((pc) >> 2) & (BLOCK_HASH_SIZE - 1))
+
+// A published translation, followed by the count instruction words it was decoded from
+typedef struct BLOCK_TEMPLATE {
+    uint64_t pc;
+    uint32_t count, n, exit;
+    struct BLOCK_TEMPLATE* next;
+    INSN insns[];
+} BLOCK_TEMPLATE;
+
+struct BLOCK_SHARED {
+    pthread_rwlock_t lock;
+    BLOCK_TEMPLATE* table[BLOCK_HASH_SIZE];
+};
+
+#define TEMPLATE_WORDS(t)   ((const uint32_t*)((t)->insns + (t)->n))
+
+// A hot block's entries, copied so the compiler never reads a live BLOCK
+struct BLOCK_JOB {
+    BLOCK_CACHE* cache;         // gets the result in its done ring
+    BLOCK* block;               // to patch, only compared by the compiler
+    uint64_t pc;
+    uint32_t gen;
+    uint32_t n, out;
+    INSN insns[BLOCK_MAX_INSNS];    // as decoded
+    INSN fused[BLOCK_MAX_INSNS];    // out entries, filled by the compiler
+};
+
+#define COMPILER_QUEUE  256
+
+// The one background compiler, shared by every cache in the process
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    BLOCK_JOB* queue[COMPILER_QUEUE];
+    uint32_t head, tail;
+    int state;                  // 0 not started, 1 running, -1 unavailable
+} compiler = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static void block_reset_predictions(BLOCK_CACHE* cache) {
+    cache->predicted = NULL;
+    cache->patch = NULL;
+    cache->ras_top = 0;
+    cache->ras_depth = 0;
+}
+
+void block_cache_init(BLOCK_CACHE* cache) {
+    memset(cache->table, 0, sizeof(cache->table));
+    cache->shared = NULL;
+    cache->flush_pending = 0;
+    cache->done_head = cache->done_tail = 0;
+    cache->jobs = 0;
+    block_reset_predictions(cache);
+}
+
+// Drops every cached block pointer before a block is freed
+static void block_unlink_all(BLOCK_CACHE* cache) {
+    for (int i = 0; i < BLOCK_HASH_SIZE; i++)
+        for (BLOCK* b = cache->table[i]; b; b = b->next)
+            b->target = b->ret = NULL;
+    block_reset_predictions(cache);
+}
+
+void block_flush(BLOCK_CACHE* cache) {
+    for (int i = 0; i < BLOCK_HASH_SIZE; i++) {
+        BLOCK* b = cache->table[i];
+        while (b) {
+            BLOCK* next = b->next;
+            free(b);
+            b = next;
+        }
+        cache->table[i] = NULL;
+    }
+    cache->flush_pending = 0;
+    block_reset_predictions(cache);
+}
+
+// Finds the block for pc, dropping it if its page was written since decode
+BLOCK* block_lookup(CPU* cpu, uint64_t pc) {
+    BLOCK** link = &cpu->blocks.table[BLOCK_HASH(pc)];
+    for (BLOCK* b = *link; b; link = &b->next, b = b->next) {
+        if (b->pc != pc)
+            continue;
+        if (b->gen == dram_page_gen(&cpu->bus.dram, pc))
+            return b;
+        *link = b->next;
+        block_unlink_all(&cpu->blocks);
+        free(b);
+        cpu->stats.blocks_invalidated++;
+        break;
+    }
+    return NULL;
+}
+
+static int is_link_reg(uint64_t r) {
+    return r == 1 || r == 5;
+}
+
+static uint32_t exit_kind(uint32_t inst) {
+    switch (inst & 0x7f) {
+        case JAL:
+            return is_link_reg(rd(inst)) ? BLOCK_EXIT_CALL : 0;
+        case JALR:
+            if (is_link_reg(rd(inst)))
+                return BLOCK_EXIT_CALL | BLOCK_EXIT_JALR;
+            if (rd(inst) == 0 && is_link_reg(rs1(inst)))
+                return BLOCK_EXIT_RET;
+            return BLOCK_EXIT_JALR;
+        default:
+            return 0;
+    }
+}
+
+// Instructions after which control may not simply fall through to pc + 4
+static int ends_block(uint32_t inst) {
+    switch (inst & 0x7f) {
+        case JAL:
+        case JALR:
+        case B_TYPE:
+        case CSR:
+        case FENCE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+BLOCK_SHARED* block_shared_new(void) {
+    BLOCK_SHARED* s = calloc(1, sizeof(BLOCK_SHARED));
+    if (!s) {
+        fprintf(stderr, "Memory error!");
+        exit(1);
+    }
+    pthread_rwlock_init(&s->lock, NULL);
+    return s;
+}
+
+// Translation published for pc whose words match this guest's memory
+static const BLOCK_TEMPLATE* shared_find(BLOCK_SHARED* s, DRAM* dram, uint64_t pc) {
+    const uint8_t* code = dram->mem + (pc - dram->base);
+    const BLOCK_TEMPLATE* t = s->table[BLOCK_HASH(pc)];
+    for (; t; t = t->next)
+        if (t->pc == pc && memcmp(TEMPLATE_WORDS(t), code, 4 * t->count) == 0)
+            break;
+    return t;
+}
+
+static void shared_publish(BLOCK_SHARED* s, DRAM* dram, const BLOCK* b) {
+    BLOCK_TEMPLATE* t = malloc(sizeof(BLOCK_TEMPLATE) + b->n * sizeof(INSN) + 4 * b->count);
+    if (!t) {
+        fprintf(stderr, "Memory error!");
+        exit(1);
+    }
+    t->pc = b->pc;
+    t->count = b->count;
+    t->n = b->n;
+    t->exit = b->exit;
+    memcpy(t->insns, b->insns, b->n * sizeof(INSN));
+    memcpy((uint32_t*) TEMPLATE_WORDS(t), dram->mem + (b->pc - dram->base), 4 * b->count);
+
+    pthread_rwlock_wrlock(&s->lock);
+    if (shared_find(s, dram, b->pc)) {
+        free(t);                    // another guest got there first
+    } else {
+        t->next = s->table[BLOCK_HASH(b->pc)];
+        s->table[BLOCK_HASH(b->pc)] = t;
+    }
+    pthread_rwlock_unlock(&s->lock);
+}
+
+// Adds a block built from n entries to the cache
+static BLOCK* block_insert(CPU* cpu, uint64_t pc, uint32_t count, uint32_t exits,
+                           const INSN* insns, uint32_t n) {
+    BLOCK* b = malloc(sizeof(BLOCK) + n * sizeof(INSN));
+    if (!b) {
+        fprintf(stderr, "Memory error!");
+        exit(1);
+    }
+    b->pc = pc;
+    b->count = count;
+    b->n = n;
+    dram_mark_code(&cpu->bus.dram, pc);
+    b->gen = dram_page_gen(&cpu->bus.dram, pc);
+    b->exit = exits;
+    b->cov_id = coverage_block_id(pc);
+    b->target = NULL;
+    b->ret = NULL;
+    b->heat = 0;
+    memcpy(b->insns, insns, n * sizeof(INSN));
+    b->next = cpu->blocks.table[BLOCK_HASH(pc)];
+    cpu->blocks.table[BLOCK_HASH(pc)] = b;
+    cpu->stats.blocks_translated++;
+    return b;
+}
+
+// Folds instruction pairs in place, returns the entries left
+static uint32_t fuse_block(INSN* insns, uint32_t n, uint64_t pc) {
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < n; i++, out++) {
+        insns[out] = insns[i];
+        if (i + 1 < n && insns[i].exec && fuse_pair(&insns[out], &insns[i + 1], pc + 4 * i))
+            i++;
+    }
+    return out;
+}
+
+static void* compiler_main(void* arg) {
+    for (;;) {
+        pthread_mutex_lock(&compiler.lock);
+        while (compiler.head == compiler.tail)
+            pthread_cond_wait(&compiler.wake, &compiler.lock);
+        BLOCK_JOB* job = compiler.queue[compiler.head++ % COMPILER_QUEUE];
+        pthread_mutex_unlock(&compiler.lock);
+
+        memcpy(job->fused, job->insns, job->n * sizeof(INSN));
+        job->out = fuse_block(job->fused, job->n, job->pc);
+        BLOCK_CACHE* cache = job->cache;
+        cache->done[cache->done_tail % BLOCK_JOBS] = job;
+        __atomic_store_n(&cache->done_tail, cache->done_tail + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+// A forked child has no compiler thread, its first hot block starts one.
+// Queued jobs are kept for it; one being compiled at the fork is lost.
+static void compiler_atfork_child(void) {
+    pthread_mutex_init(&compiler.lock, NULL);
+    pthread_cond_init(&compiler.wake, NULL);
+    compiler.state = 0;
+}
+
+static int compiler_start(void) {
+    static int registered;
+    pthread_t thread;
+    if (!registered) {
+        pthread_atfork(NULL, NULL, compiler_atfork_child);
+        registered = 1;
+    }
+    if (pthread_create(&thread, NULL, compiler_main, NULL) != 0)
+        return -1;
+    pthread_detach(thread);
+    return 1;
+}
+
+// b turned hot. Queues a copy for the compiler, or fuses it here when no
+// thread can be had. A busy or full queue is never waited for, b stays
+// as decoded and comes back once it is hot again.
+static void block_promote(CPU* cpu, BLOCK* b) {
+    BLOCK_CACHE* cache = &cpu->blocks;
+    if (compiler.state == 0)
+        compiler.state = compiler_start();
+    if (compiler.state < 0) {
+        b->n = fuse_block(b->insns, b->n, b->pc);
+        cpu->stats.blocks_optimised++;
+        return;
+    }
+    if (cache->jobs == BLOCK_JOBS || pthread_mutex_trylock(&compiler.lock) != 0) {
+        b->heat = BLOCK_HOT_EXECS;
+        return;
+    }
+    BLOCK_JOB* job = NULL;
+    if (compiler.tail - compiler.head < COMPILER_QUEUE)
+        job = malloc(sizeof(BLOCK_JOB));
+    if (job) {
+        job->cache = cache;
+        job->block = b;
+        job->pc = b->pc;
+        job->gen = b->gen;
+        job->n = b->n;
+        memcpy(job->insns, b->insns, b->n * sizeof(INSN));
+        compiler.queue[compiler.tail++ % COMPILER_QUEUE] = job;
+        cache->jobs++;
+        pthread_cond_signal(&compiler.wake);
+    } else {
+        b->heat = BLOCK_HOT_EXECS;
+    }
+    pthread_mutex_unlock(&compiler.lock);
+}
+
+// Patches finished jobs into their blocks. This runs between blocks, so no
+// block is executing while its entries change. A block that was dropped
+// since, or whose memory now holds a different decode, is left alone.
+static void block_install(CPU* cpu) {
+    BLOCK_CACHE* cache = &cpu->blocks;
+    uint32_t tail = __atomic_load_n(&cache->done_tail, __ATOMIC_ACQUIRE);
+    for (; cache->done_head != tail; cache->done_head++) {
+        BLOCK_JOB* job = cache->done[cache->done_head % BLOCK_JOBS];
+        BLOCK* b = cache->table[BLOCK_HASH(job->pc)];
+        while (b && b != job->block)
+            b = b->next;
+        if (b && b->pc == job->pc && b->gen == job->gen && b->n == job->n
+                && memcmp(b->insns, job->insns, job->n * sizeof(INSN)) == 0) {
+            memcpy(b->insns, job->fused, job->out * sizeof(INSN));
+            b->n = job->out;
+            cpu->stats.blocks_optimised++;
+        }
+        cache->jobs--;
+        free(job);
+    }
+}
+
+BLOCK* block_translate(CPU* cpu, uint64_t pc) {
+    INSN insns[BLOCK_MAX_INSNS];
+    uint32_t n = 0;
+    uint64_t addr = pc;
+
+    if (!dram_contains(&cpu->bus.dram, pc, 4) || (pc & 0x3))
+        return NULL;
+
+    // only plain guest code is shared, hooks and breakpoints are per guest
+    BLOCK_SHARED* shared = cpu->blocks.shared;
+    if (shared && (cpu_trace || cpu->gdb || hook_find(&cpu->hooks, pc) >= 0))
+        shared = NULL;
+    if (shared) {
+        pthread_rwlock_rdlock(&shared->lock);
+        const BLOCK_TEMPLATE* t = shared_find(shared, &cpu->bus.dram, pc);
+        BLOCK* b = t ? block_insert(cpu, pc, t->count, t->exit, t->insns, t->n) : NULL;
+        pthread_rwlock_unlock(&shared->lock);
+        if (b) {
+            cpu->stats.blocks_shared++;
+            return b;
+        }
+    }
+
+    // a breakpoint is an entry of its own that stops before the instruction
+    int hook = cpu_trace ? -1 : hook_find(&cpu->hooks, pc);
+    if (cpu->gdb && gdb_breakpoint(cpu->gdb, pc)) {
+        insns[n++] = (INSN){ .exec = gdb_break_exec };
+        hook = -1;
+    } else if (hook >= 0) {
+        // a hooked library routine is one host call that returns to ra
+        insns[n++] = (INSN){ .exec = hook_exec, .inst = hook };
+    } else {
+        // decode up to the first control transfer, page end or illegal instruction
+        do {
+            uint32_t inst = dram_load(&cpu->bus.dram, addr, 32);  // not a timed fetch
+            exec_fn exec = cpu->decode(inst);
+            if (!exec && n > 0)
+                break;          // the illegal instruction gets a block of its own
+            if (n > 0 && cpu->gdb && gdb_breakpoint(cpu->gdb, addr))
+                break;
+            insns[n++] = (INSN){ .exec = exec, .inst = inst };
+            addr += 4;
+            if (!exec || ends_block(inst))
+                break;
+        } while (n < BLOCK_MAX_INSNS && (addr % BLOCK_PAGE_SIZE) != 0);
+    }
+
+    uint32_t count = (insns[0].exec == gdb_break_exec) ? 0 : n;
+    uint32_t exits = (hook >= 0) ? BLOCK_EXIT_RET : exit_kind(insns[n - 1].inst);
+
+    // fusion is skipped while tracing so the trace shows every instruction,
+    // and for RV32 guests, the fused handlers compute with 64-bit registers.
+    // Shared translations are fused at once, other guests reuse them.
+    int fusable = !cpu_trace && cpu->xlen == 64;
+    int tiered = fusable && !shared && count > 1;
+    if (fusable && !tiered)
+        n = fuse_block(insns, n, pc);
+
+    BLOCK* b = block_insert(cpu, pc, count, exits, insns, n);
+    if (tiered)
+        b->heat = BLOCK_HOT_EXECS;
+    if (shared)
+        shared_publish(shared, &cpu->bus.dram, b);
+    return b;
+}
+
+// Per-instruction trace path, same output as stepping cpu_execute() by hand
+static int block_exec_traced(CPU* cpu, const BLOCK* b) {
+    for (uint32_t i = 0; i < b->n; i++) {
+        cpu->pc += 4;
+        if (!cpu_execute(cpu, b->insns[i].inst))
+            return 0;
+        dump_registers(cpu);
+    }
+    return 1;
+}
+
+// Called once b has run: pushes calls on the return stack and, for returns
+// and indirect jumps, checks whether the cached successor matches cpu->pc
+static void block_predict(CPU* cpu, BLOCK* b) {
+    BLOCK_CACHE* cache = &cpu->blocks;
+    BLOCK** slot = NULL;
+
+    if (b->exit & BLOCK_EXIT_RET) {
+        if (cache->ras_depth == 0) {
+            cpu->stats.ras_misses++;
+            return;
+        }
+        cache->ras_top = (cache->ras_top + BLOCK_RAS_SIZE - 1) % BLOCK_RAS_SIZE;
+        cache->ras_depth--;
+        BLOCK* caller = cache->ras[cache->ras_top];
+        if (caller->pc + 4 * caller->count != cpu->pc) {
+            cpu->stats.ras_misses++;        // longjmp or a hand-rolled return
+            return;
+        }
+        slot = &caller->ret;
+    } else if (b->exit & BLOCK_EXIT_JALR) {
+        slot = &b->target;
+    }
+
+    if (b->exit & BLOCK_EXIT_CALL) {
+        cache->ras[cache->ras_top] = b;
+        cache->ras_top = (cache->ras_top + 1) % BLOCK_RAS_SIZE;
+        if (cache->ras_depth < BLOCK_RAS_SIZE)
+            cache->ras_depth++;
+    }
+    if (!slot)
+        return;
+
+    BLOCK* next = *slot;
+    int hit = next && next->pc == cpu->pc
+        && next->gen == dram_page_gen(&cpu->bus.dram, next->pc);
+    if (b->exit & BLOCK_EXIT_RET) {
+        if (hit) cpu->stats.ras_hits++; else cpu->stats.ras_misses++;
+    } else {
+        if (hit) cpu->stats.ibtc_hits++; else cpu->stats.ibtc_misses++;
+    }
+    if (hit)
+        cache->predicted = next;
+    else
+        cache->patch = slot;
+}
+
+static int block_run(CPU* cpu, BLOCK* b);
+
+int block_exec(CPU* cpu) {
+    BLOCK_CACHE* cache = &cpu->blocks;
+    if (cache->flush_pending) {
+        block_flush(cache);
+        cpu->stats.cache_flushes++;
+    }
+    if (cache->done_head != __atomic_load_n(&cache->done_tail, __ATOMIC_RELAXED))
+        block_install(cpu);
+
+    if (cpu->hooks.verify)
+        hook_verify(cpu);
+
+    BLOCK* b = cache->predicted;
+    cache->predicted = NULL;
+    if (!b) {
+        b = block_lookup(cpu, cpu->pc);
+        if (!b)
+            b = block_translate(cpu, cpu->pc);
+        if (!b) {
+            fprintf(stderr, "[-] ERROR-> instruction fetch outside memory at %#lx\n", cpu->pc);
+            cpu->stats.traps[CAUSE_FETCH_ACCESS]++;
+            return 0;
+        }
+        if (cache->patch)
+            *cache->patch = b;          // remember the successor for next time
+        cache->patch = NULL;
+    }
+    if (b->heat && --b->heat == 0)
+        block_promote(cpu, b);
+
+    cpu->stats.blocks_executed++;
+    cpu->stats.instret += b->count;
+    if (cpu->bus.timing)
+        timing_block(cpu->bus.timing, b->pc, b->count, cpu->stats.instret);
+    if (cpu->cov.map)
+        coverage_edge(&cpu->cov, b->cov_id);
+    if (cpu->metrics.hart && metrics_block(&cpu->metrics, cpu->stats.instret,
+                                           cpu->stats.blocks_executed))
+        metrics_update(cpu);
+
+    // a watched page faults back here, and the instruction reruns checked
+    if (cpu->watch.n) {
+        if (cpu->watch.stray) {
+            cpu->watch.stray = 0;
+            watch_close(cpu);
+        }
+        if (sigsetjmp(cpu->watch.env, 0))
+            return watch_fault(cpu, b);
+        cpu->watch.in_block = 1;
+        int ok = block_run(cpu, b);
+        cpu->watch.in_block = 0;
+        return ok;
+    }
+    return block_run(cpu, b);
+}
+
+// Dispatches b's entries, returns 0 once the guest stops
+static int block_run(CPU* cpu, BLOCK* b) {
+    if (cpu_trace && b->count) {       // breakpoint entries have no instruction to trace
+        if (!block_exec_traced(cpu, b))
+            return 0;
+        block_predict(cpu, b);
+        return 1;
+    }
+
+    if (!b->insns[0].exec) {
+        cpu_illegal(cpu, b->insns[0].inst);
+        return 0;
+    }
+
+    const INSN* in  = b->insns;
+    const INSN* end = b->insns + b->n;
+    for (; in < end; in++) {
+        cpu->regs[0] = 0;               // x0 hardwired to 0 at each cycle
+        if (in->fused) {
+            cpu->stats.fused[in->kind]++;
+            in->fused(cpu, in);
+        } else {
+            cpu->pc += 4;
+            in->exec(cpu, in->inst);
+        }
+        if (cpu->bus.fault)
+            return cpu_fault(cpu);
+    }
+    block_predict(cpu, b);
+    return 1;
+}
+
+int block_step(CPU* cpu) {
+    if (!dram_contains(&cpu->bus.dram, cpu->pc, 4) || (cpu->pc & 0x3)) {
+        fprintf(stderr, "[-] ERROR-> instruction fetch outside memory at %#lx\n", cpu->pc);
+        cpu->stats.traps[CAUSE_FETCH_ACCESS]++;
+        return 0;
+    }
+    // the next block starts from a clean lookup, not a prediction made for this pc
+    cpu->blocks.predicted = NULL;
+    cpu->blocks.patch = NULL;
+    cpu->stats.instret++;
+    cpu->pc += 4;
+    return cpu_execute(cpu, dram_load(&cpu->bus.dram, cpu->pc - 4, 32));
+}
@@ -0,0 +1,318 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include "../includes/boot.h"
+#include "../includes/loader.h"
+#include "../includes/csr.h"
+#include "../includes/plic.h"
+
+#define FDT_MAGIC       0xd00dfeed
+#define FDT_BEGIN_NODE  0x1
+#define FDT_END_NODE    0x2
+#define FDT_PROP        0x3
+#define FDT_END         0x9
+
+#define FDT_STRUCT_MAX  8192
+#define FDT_STRINGS_MAX 1024
+
+#define PHANDLE_CPU_INTC    1
+#define PHANDLE_PLIC        2
+
+//=====================================================================================
+//   Device tree
+//=====================================================================================
+
+// Flattened device tree under construction, values are big-endian
+typedef struct FDT {
+    uint8_t  dt[FDT_STRUCT_MAX];
+    uint32_t dt_len;
+    char     strings[FDT_STRINGS_MAX];
+    uint32_t str_len;
+} FDT;
+
+static void put_be32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void fdt_u32(FDT* f, uint32_t v) {
+    put_be32(f->dt + f->dt_len, v);
+    f->dt_len += 4;
+}
+
+// Raw bytes, zero-padded to the next 4-byte boundary
+static void fdt_bytes(FDT* f, const void* p, uint32_t len) {
+    memcpy(f->dt + f->dt_len, p, len);
+    f->dt_len += len;
+    while (f->dt_len & 3)
+        f->dt[f->dt_len++] = 0;
+}
+
+static void fdt_begin(FDT* f, const char* name) {
+    fdt_u32(f, FDT_BEGIN_NODE);
+    fdt_bytes(f, name, strlen(name) + 1);
+}
+
+static void fdt_end(FDT* f) {
+    fdt_u32(f, FDT_END_NODE);
+}
+
+// Property names are stored once in the strings block
+static void fdt_prop(FDT* f, const char* name, const void* val, uint32_t len) {
+    uint32_t off = 0;
+    while (off < f->str_len && strcmp(f->strings + off, name) != 0)
+        off += strlen(f->strings + off) + 1;
+    if (off == f->str_len) {
+        strcpy(f->strings + off, name);
+        f->str_len += strlen(name) + 1;
+    }
+    fdt_u32(f, FDT_PROP);
+    fdt_u32(f, len);
+    fdt_u32(f, off);
+    fdt_bytes(f, val, len);
+}
+
+static void fdt_prop_str(FDT* f, const char* name, const char* s) {
+    fdt_prop(f, name, s, strlen(s) + 1);
+}
+
+static void fdt_prop_u32(FDT* f, const char* name, uint32_t v) {
+    uint8_t be[4];
+    put_be32(be, v);
+    fdt_prop(f, name, be, 4);
+}
+
+static void fdt_prop_cells(FDT* f, const char* name, const uint32_t* v, int n) {
+    uint8_t be[32];
+    for (int i = 0; i < n; i++)
+        put_be32(be + 4 * i, v[i]);
+    fdt_prop(f, name, be, 4 * n);
+}
+
+// A two-cell value, or a <base size> pair of them when n is 2
+static void fdt_prop_u64(FDT* f, const char* name, const uint64_t* v, int n) {
+    uint8_t be[16];
+    for (int i = 0; i < n; i++) {
+        put_be32(be + 8 * i, v[i] >> 32);
+        put_be32(be + 8 * i + 4, v[i]);
+    }
+    fdt_prop(f, name, be, 8 * n);
+}
+
+// Writes the blob for this machine to dst, returns its size
+static uint32_t fdt_build(uint8_t* dst, BUS* bus, uint64_t initrd_start,
+                          uint64_t initrd_end, const char* bootargs) {
+    static FDT f;
+    DRAM* dram = &bus->dram;
+    f.dt_len = f.str_len = 0;
+
+    fdt_begin(&f, "");
+    fdt_prop_u32(&f, "#address-cells", 2);
+    fdt_prop_u32(&f, "#size-cells", 2);
+    fdt_prop_str(&f, "compatible", "riscv-virtio");
+    fdt_prop_str(&f, "model", "riscv_emulator");
+
+    fdt_begin(&f, "chosen");
+    fdt_prop_str(&f, "bootargs", bootargs ? bootargs : "");
+    if (initrd_end > initrd_start) {
+        fdt_prop_u64(&f, "linux,initrd-start", &initrd_start, 1);
+        fdt_prop_u64(&f, "linux,initrd-end", &initrd_end, 1);
+    }
+    fdt_end(&f);
+
+    char name[64];
+    uint64_t reg[2] = { dram->base, dram->size };
+    snprintf(name, sizeof(name), "memory@%lx", dram->base);
+    fdt_begin(&f, name);
+    fdt_prop_str(&f, "device_type", "memory");
+    fdt_prop_u64(&f, "reg", reg, 2);
+    fdt_end(&f);
+
+    fdt_begin(&f, "cpus");
+    fdt_prop_u32(&f, "#address-cells", 1);
+    fdt_prop_u32(&f, "#size-cells", 0);
+    fdt_prop_u32(&f, "timebase-frequency", TIMEBASE_HZ);
+    fdt_begin(&f, "cpu@0");
+    fdt_prop_str(&f, "device_type", "cpu");
+    fdt_prop_u32(&f, "reg", 0);
+    fdt_prop_str(&f, "status", "okay");
+    fdt_prop_str(&f, "compatible", "riscv");
+    fdt_prop_str(&f, "riscv,isa", "rv64imav");
+    fdt_prop_str(&f, "mmu-type", "riscv,none");
+    fdt_begin(&f, "interrupt-controller");
+    fdt_prop_u32(&f, "#interrupt-cells", 1);
+    fdt_prop(&f, "interrupt-controller", NULL, 0);
+    fdt_prop_str(&f, "compatible", "riscv,cpu-intc");
+    fdt_prop_u32(&f, "phandle", PHANDLE_CPU_INTC);
+    fdt_end(&f);
+    fdt_end(&f);
+    fdt_end(&f);
+
+    // devices on the bus, node names as Linux's virtio-mmio probe expects
+    fdt_begin(&f, "soc");
+    fdt_prop_u32(&f, "#address-cells", 2);
+    fdt_prop_u32(&f, "#size-cells", 2);
+    fdt_prop_str(&f, "compatible", "simple-bus");
+    fdt_prop(&f, "ranges", NULL, 0);
+    if (bus->plic) {
+        // contexts 0 and 1 are hart 0's machine and supervisor external interrupts
+        static const char plic_compat[] = "sifive,plic-1.0.0\0riscv,plic0";
+        uint64_t reg[2] = { PLIC_BASE, PLIC_SIZE };
+        uint32_t ctx[4] = { PHANDLE_CPU_INTC, 11, PHANDLE_CPU_INTC, 9 };
+        snprintf(name, sizeof(name), "plic@%x", PLIC_BASE);
+        fdt_begin(&f, name);
+        fdt_prop(&f, "compatible", plic_compat, sizeof(plic_compat));
+        fdt_prop_u64(&f, "reg", reg, 2);
+        fdt_prop_u32(&f, "#address-cells", 0);
+        fdt_prop_u32(&f, "#interrupt-cells", 1);
+        fdt_prop(&f, "interrupt-controller", NULL, 0);
+        fdt_prop_cells(&f, "interrupts-extended", ctx, 4);
+        fdt_prop_u32(&f, "riscv,ndev", PLIC_SOURCES - 1);
+        fdt_prop_u32(&f, "phandle", PHANDLE_PLIC);
+        fdt_end(&f);
+    }
+    for (uint32_t i = 0; i < bus->nmmio; i++) {
+        MMIO* m = &bus->mmio[i];
+        if (!m->compatible)
+            continue;
+        uint64_t dev[2] = { m->base, m->size };
+        snprintf(name, sizeof(name), "%s@%lx",
+                 strcmp(m->compatible, "virtio,mmio") == 0 ? "virtio_mmio" : "device", m->base);
+        fdt_begin(&f, name);
+        fdt_prop_str(&f, "compatible", m->compatible);
+        fdt_prop_u64(&f, "reg", dev, 2);
+        if (m->irq && bus->plic) {
+            fdt_prop_u32(&f, "interrupt-parent", PHANDLE_PLIC);
+            fdt_prop_u32(&f, "interrupts", m->irq);
+        }
+        fdt_end(&f);
+    }
+    fdt_end(&f);
+
+    fdt_end(&f);
+    fdt_u32(&f, FDT_END);
+
+    // header, empty reservation map, structure block, strings
+    uint32_t off_rsvmap  = 40;
+    uint32_t off_struct  = off_rsvmap + 16;
+    uint32_t off_strings = off_struct + f.dt_len;
+    uint32_t total       = off_strings + f.str_len;
+    uint32_t header[10]  = { FDT_MAGIC, total, off_struct, off_strings, off_rsvmap,
+                             17, 16, 0, f.str_len, f.dt_len };
+    for (int i = 0; i < 10; i++)
+        put_be32(dst + 4 * i, header[i]);
+    memset(dst + off_rsvmap, 0, 16);
+    memcpy(dst + off_struct, f.dt, f.dt_len);
+    memcpy(dst + off_strings, f.strings, f.str_len);
+    return total;
+}
+
+//=====================================================================================
+//   Loader
+//=====================================================================================
+
+static uint8_t* read_whole(const char* path, uint64_t* len) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Unable to open file %s\n", path);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t* buf = malloc(*len + 1);
+    if (!buf || fread(buf, 1, *len, file) != *len) {
+        fprintf(stderr, "Unable to read file %s\n", path);
+        free(buf);
+        buf = NULL;
+    }
+    fclose(file);
+    return buf;
+}
+
+// Copies a whole file to guest addr, fails if it does not fit below limit
+static int load_at(CPU* cpu, const char* path, uint64_t addr, uint64_t limit, uint64_t* len) {
+    uint8_t* buf = read_whole(path, len);
+    if (!buf)
+        return -1;
+    if (addr + *len > limit || !dram_contains(&cpu->bus.dram, addr, *len)) {
+        fprintf(stderr, "[-] ERROR-> %s does not fit in guest memory\n", path);
+        free(buf);
+        return -1;
+    }
+    bus_store_bytes(&(cpu->bus), addr, *len, buf);
+    free(buf);
+    return 0;
+}
+
+int boot_load(CPU* cpu, const char* kernel, const char* initrd, const char* bootargs) {
+    DRAM* dram = &cpu->bus.dram;
+    if (bootargs && strlen(bootargs) > FDT_STRUCT_MAX / 2) {
+        fprintf(stderr, "[-] ERROR-> kernel command line too long\n");
+        return -1;
+    }
+    dram_free(dram);
+    dram_init(dram, DRAM_BASE, BOOT_MEM_SIZE);
+
+    // top of RAM: device tree, then the initrd below it
+    uint64_t dtb = dram->base + dram->size - BOOT_DTB_SIZE;
+    uint64_t initrd_start = 0, initrd_end = 0;
+    uint64_t limit = dtb;
+
+    uint64_t len;
+    if (initrd) {
+        uint8_t* buf = read_whole(initrd, &len);
+        if (!buf)
+            return -1;
+        free(buf);
+        initrd_start = (dtb - len) & ~(uint64_t)(DRAM_PAGE_SIZE - 1);
+        if (len > dtb - dram->base - BOOT_KERNEL_OFFSET
+                || load_at(cpu, initrd, initrd_start, dtb, &len) < 0)
+            return -1;
+        initrd_end = initrd_start + len;
+        limit = initrd_start;
+    }
+
+    // ELF kernels go to their link address, raw images to the usual offset
+    uint8_t* head = read_whole(kernel, &len);
+    if (!head)
+        return -1;
+    int is_elf = len >= SELFMAG && memcmp(head, ELFMAG, SELFMAG) == 0;
+    free(head);
+    if (is_elf) {
+        ELF_FILE elf;
+        if (elf_open(&elf, kernel) < 0)
+            return -1;
+        if (elf.elf_class != ELFCLASS64) {
+            fprintf(stderr, "[-] ERROR-> %s: only RV64 kernels boot\n", kernel);
+            elf_close(&elf);
+            return -1;
+        }
+        int err = elf.hi > limit ? -1 : elf_load(&elf, &(cpu->bus));
+        if (err < 0)
+            fprintf(stderr, "[-] ERROR-> %s does not fit in guest memory\n", kernel);
+        cpu->pc = elf.entry;
+        elf_close(&elf);
+        if (err < 0)
+            return -1;
+    } else {
+        if (load_at(cpu, kernel, dram->base + BOOT_KERNEL_OFFSET, limit, &len) < 0)
+            return -1;
+        cpu->pc = dram->base + BOOT_KERNEL_OFFSET;
+    }
+
+    uint8_t* blob = malloc(BOOT_DTB_SIZE);
+    if (!blob) {
+        fprintf(stderr, "Memory error!");
+        exit(1);
+    }
+    uint32_t size = fdt_build(blob, &(cpu->bus), initrd_start, initrd_end, bootargs);
+    bus_store_bytes(&(cpu->bus), dtb, size, blob);
+    free(blob);
+
+    cpu->regs[10] = 0;          // a0, boot hart id
+    cpu->regs[11] = dtb;        // a1, device tree
+    cpu->sbi = 1;
+    return 0;
+}
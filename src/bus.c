@@ -1,8 +1,110 @@
+#include <stdio.h>
+#include <string.h>
 #include "../includes/bus.h"
+#include "../includes/csr.h"
+
+// data accesses feed the cache model outside its fast-forward phase
+static inline void bus_timing(BUS* bus, uint64_t addr, uint64_t len) {
+    if (bus->timing && bus->timing->phase != TIMING_FAST)
+        timing_data(bus->timing, addr, len);
+}
+
+// set only on the watchpoint slow path, the fast path faults instead
+static inline void bus_watch(BUS* bus, uint64_t addr, uint64_t len, int kind) {
+    if (bus->watch)
+        watch_access(bus->watch, addr, len, kind);
+}
+
+static void bus_fault(BUS* bus, uint64_t addr, uint64_t len, int cause) {
+    fprintf(stderr, "[-] ERROR-> %s access fault at %#lx, %lu bytes\n",
+            cause == CAUSE_LOAD_ACCESS ? "load" : "store", addr, len);
+    if (!bus->fault)
+        bus->fault = cause;
+}
+
+static MMIO* mmio_find(BUS* bus, uint64_t addr, uint64_t len) {
+    for (uint32_t i = 0; i < bus->nmmio; i++) {
+        MMIO* m = &bus->mmio[i];
+        if (addr >= m->base && addr - m->base < m->size && len <= m->size - (addr - m->base))
+            return m;
+    }
+    return NULL;
+}
+
+// Addresses outside RAM: host-shared regions, then devices, then a fault
+static uint64_t bus_io_load(BUS* bus, uint64_t addr, uint64_t size) {
+    SHM* shm = shm_find(bus, addr, size / 8);
+    if (shm)
+        return shm_load(shm, addr, size);
+    MMIO* m = mmio_find(bus, addr, size / 8);
+    if (m)
+        return m->load(m->dev, addr - m->base, size);
+    bus_fault(bus, addr, size / 8, CAUSE_LOAD_ACCESS);
+    return 0;
+}
+
+static void bus_io_store(BUS* bus, uint64_t addr, uint64_t size, uint64_t value) {
+    SHM* shm = shm_find(bus, addr, size / 8);
+    if (shm) {
+        shm_store(shm, addr, size, value);
+        return;
+    }
+    MMIO* m = mmio_find(bus, addr, size / 8);
+    if (m) {
+        m->store(m->dev, addr - m->base, size, value);
+        return;
+    }
+    bus_fault(bus, addr, size / 8, CAUSE_STORE_ACCESS);
+}
 
 uint64_t bus_load(BUS* bus, uint64_t addr, uint64_t size) {
+    bus_timing(bus, addr, size / 8);
+    bus_watch(bus, addr, size / 8, WATCH_READ);
+    if (!dram_contains(&bus->dram, addr, size / 8))
+        return bus_io_load(bus, addr, size);
     return dram_load(&(bus->dram), addr, size);
 }
 void bus_store(BUS* bus, uint64_t addr, uint64_t size, uint64_t value) {
+    bus_timing(bus, addr, size / 8);
+    bus_watch(bus, addr, size / 8, WATCH_WRITE);
+    if (!dram_contains(&bus->dram, addr, size / 8)) {
+        bus_io_store(bus, addr, size, value);
+        return;
+    }
     dram_store(&(bus->dram), addr, size, value);
 }
+void bus_load_bytes(BUS* bus, uint64_t addr, uint64_t len, void* dst) {
+    bus_timing(bus, addr, len);
+    bus_watch(bus, addr, len, WATCH_READ);
+    if (!dram_contains(&bus->dram, addr, len)) {
+        memset(dst, 0, len);
+        bus_fault(bus, addr, len, CAUSE_LOAD_ACCESS);
+        return;
+    }
+    dram_load_bytes(&(bus->dram), addr, len, dst);
+}
+void bus_store_bytes(BUS* bus, uint64_t addr, uint64_t len, const void* src) {
+    bus_timing(bus, addr, len);
+    bus_watch(bus, addr, len, WATCH_WRITE);
+    if (!dram_contains(&bus->dram, addr, len)) {
+        bus_fault(bus, addr, len, CAUSE_STORE_ACCESS);
+        return;
+    }
+    dram_store_bytes(&(bus->dram), addr, len, src);
+}
+
+int bus_map(BUS* bus, const MMIO* dev) {
+    if (bus->nmmio == BUS_MMIO_MAX || mmio_find(bus, dev->base, 1)
+            || mmio_find(bus, dev->base + dev->size - 1, 1)) {
+        fprintf(stderr, "[-] ERROR-> no room for a device at %#lx\n", dev->base);
+        return -1;
+    }
+    bus->mmio[bus->nmmio++] = *dev;
+    return 0;
+}
+
+void bus_poll(BUS* bus) {
+    for (uint32_t i = 0; i < bus->nmmio; i++)
+        if (bus->mmio[i].poll)
+            bus->mmio[i].poll(bus->mmio[i].dev);
+}
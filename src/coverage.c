@@ -0,0 +1,32 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/shm.h>
+#include "../includes/coverage.h"
+
+int coverage_init(COVERAGE* cov) {
+    char* id = getenv("__AFL_SHM_ID");
+    cov->prev = 0;
+    if (id) {
+        void* map = shmat(atoi(id), NULL, 0);
+        if (map == (void*) -1) {
+            fprintf(stderr, "[-] ERROR-> cannot attach coverage map %s\n", id);
+            return -1;
+        }
+        cov->map = map;
+    } else {
+        cov->map = calloc(COV_MAP_SIZE, 1);
+        if (!cov->map) {
+            fprintf(stderr, "Memory error!");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+uint32_t coverage_count(const COVERAGE* cov) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < COV_MAP_SIZE; i++)
+        n += cov->map[i] != 0;
+    return n;
+}
@@ -1,9 +1,14 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "../includes/cpu.h"
 #include "../includes/opcodes.h"
 #include "../includes/csr.h"
+#include "../includes/vector.h"
+#include "../includes/user.h"
+#include "../includes/sbi.h"
 
 #define ANSI_YELLOW  "\x1b[33m"
 #define ANSI_BLUE    "\x1b[31m"
@@ -12,15 +17,56 @@
 #define ADDR_MISALIGNED(addr) (addr & 0x3)
 
 
+int cpu_trace = 1;                       // per-instruction trace, off with -q
+
 // print operation for DEBUG
 void print_op(char* s) {
-    printf("%s%s%s", ANSI_BLUE, s, ANSI_RESET);
+    if (cpu_trace)
+        printf("%s%s%s", ANSI_BLUE, s, ANSI_RESET);
 }
 
 void cpu_init(CPU *cpu) {
     cpu->regs[0] = 0x00;                    // register x0 hardwired to 0
     cpu->regs[2] = DRAM_BASE + DRAM_SIZE;   // Set stack pointer
     cpu->pc      = DRAM_BASE;               // Set program counter to the base address
+
+    memset(&cpu->vpu, 0, sizeof(cpu->vpu));
+    cpu->csr[VSTART] = 0;
+    cpu->csr[VL]     = 0;
+    cpu->csr[VTYPE]  = VTYPE_VILL;          // no vsetvl executed yet
+    cpu->csr[VLENB]  = VLEN_BYTES;
+    cpu->csr[STIMECMP] = UINT64_MAX;        // no timer armed
+    vector_init();
+
+    cpu->marker = 0;
+    cpu->user = NULL;
+    cpu->gdb = NULL;
+    cpu->sbi = 0;
+    cpu->icount = 0;
+    cpu->reservation = RESERVATION_NONE;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    cpu->clock_origin = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    cpu->cov.map = NULL;
+    cpu->cov.prev = 0;
+    memset(&cpu->hooks, 0, sizeof(cpu->hooks));
+    cpu->watch.n = 0;
+    cpu->watch.open = 0;
+    cpu->watch.stray = 0;
+    cpu->watch.in_block = 0;
+    cpu->watch.hit = 0;
+    memset(&cpu->replay, 0, sizeof(cpu->replay));
+    memset(&cpu->metrics, 0, sizeof(cpu->metrics));
+    dram_init(&cpu->bus.dram, DRAM_BASE, DRAM_SIZE);
+    cpu->bus.timing = NULL;
+    cpu->bus.watch = NULL;
+    cpu->bus.nshm = 0;
+    cpu->bus.nmmio = 0;
+    cpu->bus.plic = NULL;
+    cpu->bus.fault = 0;
+    memset(&cpu->stats, 0, sizeof(cpu->stats));
+    block_cache_init(&cpu->blocks);
+    cpu_set_xlen(cpu, 64);
 }
 
 uint32_t cpu_fetch(CPU *cpu) {
@@ -68,7 +114,7 @@ uint64_t imm_B(uint32_t inst) {
 }
 uint64_t imm_U(uint32_t inst) {
     // imm[31:12] = inst[31:12]
-    return (int64_t)(int32_t)(inst & 0xfffff999);
+    return (int64_t)(int32_t)(inst & 0xfffff000);
 }
 uint64_t imm_J(uint32_t inst) {
     // imm[20|10:1|11|19:12] = inst[31|30:21|20|19:12]
@@ -93,103 +139,35 @@ uint64_t csr(uint32_t inst) {
 //   Instruction Execution Functions
 //=====================================================================================
 
-void exec_LUI(CPU* cpu, uint32_t inst) {
-    // LUI places upper 20 bits of U-immediate value to rd
-    cpu->regs[rd(inst)] = (uint64_t)(int64_t)(int32_t)(inst & 0xfffff000);
-    print_op("lui\n");
-}
-
-void exec_AUIPC(CPU* cpu, uint32_t inst) {
-    // AUIPC forms a 32-bit offset from the 20 upper bits 
-    // of the U-immediate
-    uint64_t imm = imm_U(inst);
-    cpu->regs[rd(inst)] = ((int64_t) cpu->pc + (int64_t) imm) - 4;
-    print_op("auipc\n");
-}
-
-void exec_JAL(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_J(inst);
-    cpu->regs[rd(inst)] = cpu->pc;
-    /*print_op("JAL-> rd:%ld, pc:%lx\n", rd(inst), cpu->pc);*/
-    cpu->pc = cpu->pc + (int64_t) imm - 4;
-    print_op("jal\n");
-    if (ADDR_MISALIGNED(cpu->pc)) {
-        fprintf(stderr, "JAL pc address misalligned");
-        exit(0);
-    }
-}
-
-void exec_JALR(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_I(inst);
-    uint64_t tmp = cpu->pc;
-    cpu->pc = (cpu->regs[rs1(inst)] + (int64_t) imm) & 0xfffffffe;
-    cpu->regs[rd(inst)] = tmp;
-    /*print_op("NEXT -> %#lx, imm:%#lx\n", cpu->pc, imm);*/
-    print_op("jalr\n");
-    if (ADDR_MISALIGNED(cpu->pc)) {
-        fprintf(stderr, "JAL pc address misalligned");
-        exit(0);
-    }
-}
-
-void exec_BEQ(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_B(inst);
-    if ((int64_t) cpu->regs[rs1(inst)] == (int64_t) cpu->regs[rs2(inst)])
-        cpu->pc = cpu->pc + (int64_t) imm - 4;
-    print_op("beq\n");
-}
-void exec_BNE(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_B(inst);
-    if ((int64_t) cpu->regs[rs1(inst)] != (int64_t) cpu->regs[rs2(inst)])
-        cpu->pc = (cpu->pc + (int64_t) imm - 4);
-    print_op("bne\n");
-}
-void exec_BLT(CPU* cpu, uint32_t inst) {
-    /*print_op("Operation: BLT\n");*/
-    uint64_t imm = imm_B(inst);
-    if ((int64_t) cpu->regs[rs1(inst)] < (int64_t) cpu->regs[rs2(inst)])
-        cpu->pc = cpu->pc + (int64_t) imm - 4;
-    print_op("blt\n");
-}
-void exec_BGE(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_B(inst);
-    if ((int64_t) cpu->regs[rs1(inst)] >= (int64_t) cpu->regs[rs2(inst)])
-        cpu->pc = cpu->pc + (int64_t) imm - 4;
-    print_op("bge\n");
-}
-void exec_BLTU(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_B(inst);
-    if (cpu->regs[rs1(inst)] < cpu->regs[rs2(inst)])
-        cpu->pc = cpu->pc + (int64_t) imm - 4;
-    print_op("bltu\n");
-}
-void exec_BGEU(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_B(inst);
-    if (cpu->regs[rs1(inst)] >= cpu->regs[rs2(inst)])
-        cpu->pc = (int64_t) cpu->pc + (int64_t) imm - 4;
-    print_op("jal\n");
-}
-void exec_LB(CPU* cpu, uint32_t inst) {
-    // load 1 byte to rd from address in rs1
-    uint64_t imm = imm_I(inst);
-    uint64_t addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = (int64_t)(int8_t) cpu_load(cpu, addr, 8);
-    print_op("lb\n");
-}
-void exec_LH(CPU* cpu, uint32_t inst) {
-    // load 2 byte to rd from address in rs1
-    uint64_t imm = imm_I(inst);
-    uint64_t addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = (int64_t)(int16_t) cpu_load(cpu, addr, 16);
-    print_op("lh\n");
-}
-void exec_LW(CPU* cpu, uint32_t inst) {
-    // load 4 byte to rd from address in rs1
-    uint64_t imm = imm_I(inst);
-    uint64_t addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) cpu_load(cpu, addr, 32);
-    print_op("lw\n");
-}
+// Atomics need a naturally aligned address, others raise cause
+static int amo_aligned(CPU* cpu, uint64_t addr, uint64_t size, int cause) {
+    if ((addr & (size / 8 - 1)) == 0)
+        return 1;
+    fprintf(stderr, "[-] ERROR-> misaligned atomic access at %#lx\n", addr);
+    cpu->bus.fault = cause;
+    return 0;
+}
+
+// Handlers that depend on XLEN are instantiated once per width, RV64 under
+// the exec_ names and RV32 as exec32_. The decoder for the guest's class
+// picks the set, so no handler tests the width while it runs.
+#define XLEN        64
+#define XFN(name)   exec_##name
+#define xlen_t      uint64_t
+#define sxlen_t     int64_t
+#define uxlen2_t    unsigned __int128
+#define sxlen2_t    __int128
+#include "../includes/cpu_xlen.h"
+
+#define XLEN        32
+#define XFN(name)   exec32_##name
+#define xlen_t      uint32_t
+#define sxlen_t     int32_t
+#define uxlen2_t    uint64_t
+#define sxlen2_t    int64_t
+#include "../includes/cpu_xlen.h"
+
+// RV64 only from here to the end of the vector handlers
 void exec_LD(CPU* cpu, uint32_t inst) {
     // load 8 byte to rd from address in rs1
     uint64_t imm = imm_I(inst);
@@ -197,20 +175,6 @@ void exec_LD(CPU* cpu, uint32_t inst) {
     cpu->regs[rd(inst)] = (int64_t) cpu_load(cpu, addr, 64);
     print_op("ld\n");
 }
-void exec_LBU(CPU* cpu, uint32_t inst) {
-    // load unsigned 1 byte to rd from address in rs1
-    uint64_t imm = imm_I(inst);
-    uint64_t addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = cpu_load(cpu, addr, 8);
-    print_op("lbu\n");
-}
-void exec_LHU(CPU* cpu, uint32_t inst) {
-    // load unsigned 2 byte to rd from address in rs1
-    uint64_t imm = imm_I(inst);
-    uint64_t addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = cpu_load(cpu, addr, 16);
-    print_op("lhu\n");
-}
 void exec_LWU(CPU* cpu, uint32_t inst) {
     // load unsigned 2 byte to rd from address in rs1
     uint64_t imm = imm_I(inst);
@@ -218,24 +182,6 @@ void exec_LWU(CPU* cpu, uint32_t inst) {
     cpu->regs[rd(inst)] = cpu_load(cpu, addr, 32);
     print_op("lwu\n");
 }
-void exec_SB(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_S(inst);
-    uint64_t addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu_store(cpu, addr, 8, cpu->regs[rs2(inst)]);
-    print_op("sb\n");
-}
-void exec_SH(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_S(inst);
-    uint64_t addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu_store(cpu, addr, 16, cpu->regs[rs2(inst)]);
-    print_op("sh\n");
-}
-void exec_SW(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_S(inst);
-    uint64_t addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu_store(cpu, addr, 32, cpu->regs[rs2(inst)]);
-    print_op("sw\n");
-}
 void exec_SD(CPU* cpu, uint32_t inst) {
     uint64_t imm = imm_S(inst);
     uint64_t addr = cpu->regs[rs1(inst)] + (int64_t) imm;
@@ -243,146 +189,64 @@ void exec_SD(CPU* cpu, uint32_t inst) {
     print_op("sd\n");
 }
 
-void exec_ADDI(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] + (int64_t) imm;
-    print_op("addi\n");
-}
-
-void exec_SLLI(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] << shamt(inst);
-    print_op("slli\n");
-}
-
-void exec_SLTI(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_I(inst);
-    cpu->regs[rd(inst)] = (cpu->regs[rs1(inst)] < (int64_t) imm)?1:0;
-    print_op("slti\n");
-}
-
-void exec_SLTIU(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_I(inst);
-    cpu->regs[rd(inst)] = (cpu->regs[rs1(inst)] < imm)?1:0;
-    print_op("sltiu\n");
-}
-
-void exec_XORI(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] ^ imm;
-    print_op("xori\n");
-}
-
-void exec_SRLI(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] >> imm;
-    print_op("srli\n");
-}
-
-void exec_SRAI(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_I(inst);
-    cpu->regs[rd(inst)] = (int32_t)cpu->regs[rs1(inst)] >> imm;
-    print_op("srai\n");
-}
-
-void exec_ORI(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] | imm;
-    print_op("ori\n");
-}
-
-void exec_ANDI(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] & imm;
-    print_op("andi\n");
-}
-
-void exec_ADD(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] =
-        (uint64_t) ((int64_t)cpu->regs[rs1(inst)] + (int64_t)cpu->regs[rs2(inst)]);
-    print_op("add\n");
-}
-
-void exec_SUB(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] =
-        (uint64_t) ((int64_t)cpu->regs[rs1(inst)] - (int64_t)cpu->regs[rs2(inst)]);
-    print_op("sub\n");
-}
-
-void exec_SLL(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] << (int64_t)cpu->regs[rs2(inst)];
-    print_op("sll\n");
-}
-
-void exec_SLT(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = (cpu->regs[rs1(inst)] < (int64_t) cpu->regs[rs2(inst)])?1:0;
-    print_op("slt\n");
-}
-
-void exec_SLTU(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = (cpu->regs[rs1(inst)] < cpu->regs[rs2(inst)])?1:0;
-    print_op("slti\n");
-}
-
-void exec_XOR(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] ^ cpu->regs[rs2(inst)];
-    print_op("xor\n");
-}
-
-void exec_SRL(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] >> cpu->regs[rs2(inst)];
-    print_op("srl\n");
+void exec_FENCE(CPU* cpu, uint32_t inst) {
+    print_op("fence\n");
 }
 
-void exec_SRA(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = (int32_t)cpu->regs[rs1(inst)] >> 
-        (int64_t) cpu->regs[rs2(inst)];
-    print_op("sra\n");
+void exec_FENCE_I(CPU* cpu, uint32_t inst) {
+    // FENCE ends a block, so the cache is flushed before the next one runs
+    cpu->blocks.flush_pending = 1;
+    print_op("fence.i\n");
 }
 
-void exec_OR(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] | cpu->regs[rs2(inst)];
-    print_op("or\n");
+void exec_ECALL(CPU* cpu, uint32_t inst) {
+    cpu->stats.traps[cpu->user ? CAUSE_ECALL_U : cpu->sbi ? CAUSE_ECALL_S : CAUSE_ECALL_M]++;
+    // the host kernel would fail on protected pages, watches are checked in software
+    watch_open(cpu);
+    if (cpu->user)
+        user_syscall(cpu);
+    else if (cpu->sbi)
+        sbi_call(cpu);
+    watch_close(cpu);
+    watch_report(cpu, cpu->pc - 4);
 }
-
-void exec_AND(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] & cpu->regs[rs2(inst)];
-    print_op("and\n");
+void exec_EBREAK(CPU* cpu, uint32_t inst) {
+    cpu->stats.traps[CAUSE_BREAKPOINT]++;
+    cpu->marker = 1;
 }
 
-void exec_FENCE(CPU* cpu, uint32_t inst) {
-    print_op("fence\n");
+// WFI is a hint and returns at once, it is only counted
+void exec_WFI(CPU* cpu, uint32_t inst) {
+    cpu->stats.wfi++;
 }
 
-void exec_ECALL(CPU* cpu, uint32_t inst) {}
-void exec_EBREAK(CPU* cpu, uint32_t inst) {}
-
 void exec_ECALLBREAK(CPU* cpu, uint32_t inst) {
     if (imm_I(inst) == 0x0)
         exec_ECALL(cpu, inst);
     if (imm_I(inst) == 0x1)
         exec_EBREAK(cpu, inst);
+    if (imm_I(inst) == WFI)
+        exec_WFI(cpu, inst);
     print_op("ecallbreak\n");
 }
 
 
 void exec_ADDIW(CPU* cpu, uint32_t inst) {
     uint64_t imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] + (int64_t) imm;
+    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] + (int64_t) imm);
     print_op("addiw\n");
 }
 
-// TODO
 void exec_SLLIW(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] <<  shamt(inst));
+    cpu->regs[rd(inst)] = (int64_t)(int32_t) ((uint32_t)cpu->regs[rs1(inst)] << shamt(inst));
     print_op("slliw\n");
 }
 void exec_SRLIW(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] >>  shamt(inst));
+    cpu->regs[rd(inst)] = (int64_t)(int32_t) ((uint32_t)cpu->regs[rs1(inst)] >> shamt(inst));
     print_op("srliw\n");
 }
 void exec_SRAIW(CPU* cpu, uint32_t inst) {
-    uint64_t imm = imm_I(inst);
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] >> (uint64_t)(int64_t)(int32_t) imm);
+    cpu->regs[rd(inst)] = (int64_t) ((int32_t)cpu->regs[rs1(inst)] >> shamt(inst));
     print_op("sraiw\n");
 }
 void exec_ADDW(CPU* cpu, uint32_t inst) {
@@ -400,317 +264,674 @@ void exec_SUBW(CPU* cpu, uint32_t inst) {
             - (int64_t) cpu->regs[rs2(inst)]);
     print_op("subw\n");
 }
+// division by zero and overflow give the results the spec defines, never a host trap
 void exec_DIVW(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] 
-            / (int64_t) cpu->regs[rs2(inst)]);
+    int32_t a = cpu->regs[rs1(inst)], b = cpu->regs[rs2(inst)];
+    cpu->regs[rd(inst)] = (int64_t) ((b == 0) ? -1 : (a == INT32_MIN && b == -1) ? a : a / b);
     print_op("divw\n");
 }
 void exec_SLLW(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] <<  cpu->regs[rs2(inst)]);
+    cpu->regs[rd(inst)] = (int64_t)(int32_t) ((uint32_t)cpu->regs[rs1(inst)] << (cpu->regs[rs2(inst)] & 0x1f));
     print_op("sllw\n");
 }
 void exec_SRLW(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] >>  cpu->regs[rs2(inst)]);
+    cpu->regs[rd(inst)] = (int64_t)(int32_t) ((uint32_t)cpu->regs[rs1(inst)] >> (cpu->regs[rs2(inst)] & 0x1f));
     print_op("srlw\n");
 }
 void exec_DIVUW(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] / (int64_t) cpu->regs[rs2(inst)];
+    uint32_t a = cpu->regs[rs1(inst)], b = cpu->regs[rs2(inst)];
+    cpu->regs[rd(inst)] = (int64_t)(int32_t) ((b == 0) ? UINT32_MAX : a / b);
     print_op("divuw\n");
 }
 void exec_SRAW(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] >>  (uint64_t)(int64_t)(int32_t) cpu->regs[rs2(inst)]);
+    cpu->regs[rd(inst)] = (int64_t) ((int32_t)cpu->regs[rs1(inst)] >> (cpu->regs[rs2(inst)] & 0x1f));
     print_op("sraw\n");
 }
 void exec_REMW(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] 
-            % (int64_t) cpu->regs[rs2(inst)]);
+    int32_t a = cpu->regs[rs1(inst)], b = cpu->regs[rs2(inst)];
+    cpu->regs[rd(inst)] = (int64_t) ((b == 0) ? a : (a == INT32_MIN && b == -1) ? 0 : a % b);
     print_op("remw\n");
 }
 void exec_REMUW(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] % (int64_t) cpu->regs[rs2(inst)];
+    uint32_t a = cpu->regs[rs1(inst)], b = cpu->regs[rs2(inst)];
+    cpu->regs[rd(inst)] = (int64_t)(int32_t) ((b == 0) ? a : a % b);
     print_op("remuw\n");
 }
 
-// CSR instructions
-void exec_CSRRW(CPU* cpu, uint32_t inst) {
-    cpu->regs[rd(inst)] = csr_read(cpu, csr(inst));
-    csr_write(cpu, csr(inst), cpu->regs[rs1(inst)]);
-    print_op("csrrw\n");
-}
-void exec_CSRRS(CPU* cpu, uint32_t inst) {
-    csr_write(cpu, csr(inst), cpu->csr[csr(inst)] | cpu->regs[rs1(inst)]);
-    print_op("csrrs\n");
-}
-void exec_CSRRC(CPU* cpu, uint32_t inst) {
-    csr_write(cpu, csr(inst), cpu->csr[csr(inst)] & !(cpu->regs[rs1(inst)]) );
-    print_op("csrrc\n");
-}
-void exec_CSRRWI(CPU* cpu, uint32_t inst) {
-    csr_write(cpu, csr(inst), rs1(inst));
-    print_op("csrrwi\n");
-}
-void exec_CSRRSI(CPU* cpu, uint32_t inst) {
-    csr_write(cpu, csr(inst), cpu->csr[csr(inst)] | rs1(inst));
-    print_op("csrrsi\n");
-}
-void exec_CSRRCI(CPU* cpu, uint32_t inst) {
-    csr_write(cpu, csr(inst), cpu->csr[csr(inst)] & !rs1(inst));
-    print_op("csrrci\n");
-}
-
-// AMO_W
-void exec_LR_W(CPU* cpu, uint32_t inst) {}  
-void exec_SC_W(CPU* cpu, uint32_t inst) {}  
-void exec_AMOSWAP_W(CPU* cpu, uint32_t inst) {}  
-void exec_AMOADD_W(CPU* cpu, uint32_t inst) {
-    uint32_t tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    uint32_t res = tmp + (uint32_t)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoadd.w\n");
-} 
-void exec_AMOXOR_W(CPU* cpu, uint32_t inst) {
-    uint32_t tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    uint32_t res = tmp ^ (uint32_t)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoxor.w\n");
-} 
-void exec_AMOAND_W(CPU* cpu, uint32_t inst) {
-    uint32_t tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    uint32_t res = tmp & (uint32_t)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoand.w\n");
-} 
-void exec_AMOOR_W(CPU* cpu, uint32_t inst) {
-    uint32_t tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    uint32_t res = tmp | (uint32_t)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoor.w\n");
-} 
-void exec_AMOMIN_W(CPU* cpu, uint32_t inst) {} 
-void exec_AMOMAX_W(CPU* cpu, uint32_t inst) {} 
-void exec_AMOMINU_W(CPU* cpu, uint32_t inst) {} 
-void exec_AMOMAXU_W(CPU* cpu, uint32_t inst) {} 
-
-// AMO_D TODO
-void exec_LR_D(CPU* cpu, uint32_t inst) {}  
-void exec_SC_D(CPU* cpu, uint32_t inst) {}  
-void exec_AMOSWAP_D(CPU* cpu, uint32_t inst) {}  
-void exec_AMOADD_D(CPU* cpu, uint32_t inst) {
-    uint32_t tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    uint32_t res = tmp + (uint32_t)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoadd.w\n");
-} 
-void exec_AMOXOR_D(CPU* cpu, uint32_t inst) {
-    uint32_t tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    uint32_t res = tmp ^ (uint32_t)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoxor.w\n");
-} 
-void exec_AMOAND_D(CPU* cpu, uint32_t inst) {
-    uint32_t tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    uint32_t res = tmp & (uint32_t)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoand.w\n");
-} 
-void exec_AMOOR_D(CPU* cpu, uint32_t inst) {
-    uint32_t tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    uint32_t res = tmp | (uint32_t)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoor.w\n");
-} 
-void exec_AMOMIN_D(CPU* cpu, uint32_t inst) {} 
-void exec_AMOMAX_D(CPU* cpu, uint32_t inst) {} 
-void exec_AMOMINU_D(CPU* cpu, uint32_t inst) {} 
-void exec_AMOMAXU_D(CPU* cpu, uint32_t inst) {} 
-
-int cpu_execute(CPU *cpu, uint32_t inst) {
+// Zba/Zbb/Zbs bit-manipulation, each backed by the matching host builtin
+void exec_SH1ADD(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs2(inst)] + (cpu->regs[rs1(inst)] << 1);
+    print_op("sh1add\n");
+}
+void exec_SH2ADD(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs2(inst)] + (cpu->regs[rs1(inst)] << 2);
+    print_op("sh2add\n");
+}
+void exec_SH3ADD(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs2(inst)] + (cpu->regs[rs1(inst)] << 3);
+    print_op("sh3add\n");
+}
+void exec_ADD_UW(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs2(inst)] + (uint64_t)(uint32_t)cpu->regs[rs1(inst)];
+    print_op("add.uw\n");
+}
+void exec_SH1ADD_UW(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs2(inst)] + ((uint64_t)(uint32_t)cpu->regs[rs1(inst)] << 1);
+    print_op("sh1add.uw\n");
+}
+void exec_SH2ADD_UW(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs2(inst)] + ((uint64_t)(uint32_t)cpu->regs[rs1(inst)] << 2);
+    print_op("sh2add.uw\n");
+}
+void exec_SH3ADD_UW(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs2(inst)] + ((uint64_t)(uint32_t)cpu->regs[rs1(inst)] << 3);
+    print_op("sh3add.uw\n");
+}
+void exec_SLLI_UW(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = (uint64_t)(uint32_t)cpu->regs[rs1(inst)] << (imm_I(inst) & 0x3f);
+    print_op("slli.uw\n");
+}
+
+void exec_ANDN(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] & ~cpu->regs[rs2(inst)];
+    print_op("andn\n");
+}
+void exec_ORN(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] | ~cpu->regs[rs2(inst)];
+    print_op("orn\n");
+}
+void exec_XNOR(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = ~(cpu->regs[rs1(inst)] ^ cpu->regs[rs2(inst)]);
+    print_op("xnor\n");
+}
+void exec_CLZ(CPU* cpu, uint32_t inst) {
+    uint64_t x = cpu->regs[rs1(inst)];
+    cpu->regs[rd(inst)] = x ? __builtin_clzll(x) : 64;
+    print_op("clz\n");
+}
+void exec_CTZ(CPU* cpu, uint32_t inst) {
+    uint64_t x = cpu->regs[rs1(inst)];
+    cpu->regs[rd(inst)] = x ? __builtin_ctzll(x) : 64;
+    print_op("ctz\n");
+}
+void exec_CPOP(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = __builtin_popcountll(cpu->regs[rs1(inst)]);
+    print_op("cpop\n");
+}
+void exec_CLZW(CPU* cpu, uint32_t inst) {
+    uint32_t x = cpu->regs[rs1(inst)];
+    cpu->regs[rd(inst)] = x ? __builtin_clz(x) : 32;
+    print_op("clzw\n");
+}
+void exec_CTZW(CPU* cpu, uint32_t inst) {
+    uint32_t x = cpu->regs[rs1(inst)];
+    cpu->regs[rd(inst)] = x ? __builtin_ctz(x) : 32;
+    print_op("ctzw\n");
+}
+void exec_CPOPW(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = __builtin_popcount((uint32_t)cpu->regs[rs1(inst)]);
+    print_op("cpopw\n");
+}
+void exec_MAX(CPU* cpu, uint32_t inst) {
+    int64_t a = cpu->regs[rs1(inst)], b = cpu->regs[rs2(inst)];
+    cpu->regs[rd(inst)] = a > b ? a : b;
+    print_op("max\n");
+}
+void exec_MAXU(CPU* cpu, uint32_t inst) {
+    uint64_t a = cpu->regs[rs1(inst)], b = cpu->regs[rs2(inst)];
+    cpu->regs[rd(inst)] = a > b ? a : b;
+    print_op("maxu\n");
+}
+void exec_MIN(CPU* cpu, uint32_t inst) {
+    int64_t a = cpu->regs[rs1(inst)], b = cpu->regs[rs2(inst)];
+    cpu->regs[rd(inst)] = a < b ? a : b;
+    print_op("min\n");
+}
+void exec_MINU(CPU* cpu, uint32_t inst) {
+    uint64_t a = cpu->regs[rs1(inst)], b = cpu->regs[rs2(inst)];
+    cpu->regs[rd(inst)] = a < b ? a : b;
+    print_op("minu\n");
+}
+void exec_SEXT_B(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = (int64_t)(int8_t)cpu->regs[rs1(inst)];
+    print_op("sext.b\n");
+}
+void exec_SEXT_H(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = (int64_t)(int16_t)cpu->regs[rs1(inst)];
+    print_op("sext.h\n");
+}
+void exec_ZEXT_H(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = (uint16_t)cpu->regs[rs1(inst)];
+    print_op("zext.h\n");
+}
+void exec_ROL(CPU* cpu, uint32_t inst) {
+    uint64_t x = cpu->regs[rs1(inst)], s = cpu->regs[rs2(inst)] & 0x3f;
+    cpu->regs[rd(inst)] = (x << s) | (x >> ((64 - s) & 0x3f));
+    print_op("rol\n");
+}
+void exec_ROR(CPU* cpu, uint32_t inst) {
+    uint64_t x = cpu->regs[rs1(inst)], s = cpu->regs[rs2(inst)] & 0x3f;
+    cpu->regs[rd(inst)] = (x >> s) | (x << ((64 - s) & 0x3f));
+    print_op("ror\n");
+}
+void exec_RORI(CPU* cpu, uint32_t inst) {
+    uint64_t x = cpu->regs[rs1(inst)], s = imm_I(inst) & 0x3f;
+    cpu->regs[rd(inst)] = (x >> s) | (x << ((64 - s) & 0x3f));
+    print_op("rori\n");
+}
+void exec_ROLW(CPU* cpu, uint32_t inst) {
+    uint32_t x = cpu->regs[rs1(inst)], s = cpu->regs[rs2(inst)] & 0x1f;
+    cpu->regs[rd(inst)] = (int64_t)(int32_t)((x << s) | (x >> ((32 - s) & 0x1f)));
+    print_op("rolw\n");
+}
+void exec_RORW(CPU* cpu, uint32_t inst) {
+    uint32_t x = cpu->regs[rs1(inst)], s = cpu->regs[rs2(inst)] & 0x1f;
+    cpu->regs[rd(inst)] = (int64_t)(int32_t)((x >> s) | (x << ((32 - s) & 0x1f)));
+    print_op("rorw\n");
+}
+void exec_RORIW(CPU* cpu, uint32_t inst) {
+    uint32_t x = cpu->regs[rs1(inst)], s = shamt(inst);
+    cpu->regs[rd(inst)] = (int64_t)(int32_t)((x >> s) | (x << ((32 - s) & 0x1f)));
+    print_op("roriw\n");
+}
+void exec_ORC_B(CPU* cpu, uint32_t inst) {
+    // high bit of each byte of t is set iff that byte of x is non-zero
+    uint64_t x = cpu->regs[rs1(inst)];
+    uint64_t t = ((x & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | x;
+    cpu->regs[rd(inst)] = ((t & 0x8080808080808080ULL) >> 7) * 0xff;
+    print_op("orc.b\n");
+}
+void exec_REV8(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = __builtin_bswap64(cpu->regs[rs1(inst)]);
+    print_op("rev8\n");
+}
+
+void exec_BCLR(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] & ~(1ULL << (cpu->regs[rs2(inst)] & 0x3f));
+    print_op("bclr\n");
+}
+void exec_BCLRI(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] & ~(1ULL << (imm_I(inst) & 0x3f));
+    print_op("bclri\n");
+}
+void exec_BEXT(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = (cpu->regs[rs1(inst)] >> (cpu->regs[rs2(inst)] & 0x3f)) & 1;
+    print_op("bext\n");
+}
+void exec_BEXTI(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = (cpu->regs[rs1(inst)] >> (imm_I(inst) & 0x3f)) & 1;
+    print_op("bexti\n");
+}
+void exec_BINV(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] ^ (1ULL << (cpu->regs[rs2(inst)] & 0x3f));
+    print_op("binv\n");
+}
+void exec_BINVI(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] ^ (1ULL << (imm_I(inst) & 0x3f));
+    print_op("binvi\n");
+}
+void exec_BSET(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] | (1ULL << (cpu->regs[rs2(inst)] & 0x3f));
+    print_op("bset\n");
+}
+void exec_BSETI(CPU* cpu, uint32_t inst) {
+    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] | (1ULL << (imm_I(inst) & 0x3f));
+    print_op("bseti\n");
+}
+
+// Maps an instruction word to its handler, NULL when it is not implemented
+exec_fn cpu_decode(uint32_t inst) {
     int opcode = inst & 0x7f;           // opcode in bits 6..0
     int funct3 = (inst >> 12) & 0x7;    // funct3 in bits 14..12
     int funct7 = (inst >> 25) & 0x7f;   // funct7 in bits 31..25
-
-    cpu->regs[0] = 0;                   // x0 hardwired to 0 at each cycle
-
-    /*printf("%s\n%#.8lx -> Inst: %#.8x <OpCode: %#.2x, funct3:%#x, funct7:%#x> %s",*/
-            /*ANSI_YELLOW, cpu->pc-4, inst, opcode, funct3, funct7, ANSI_RESET); // DEBUG*/
-    printf("%s\n%#.8lx -> %s", ANSI_YELLOW, cpu->pc-4, ANSI_RESET); // DEBUG
+    int funct6 = (inst >> 26) & 0x3f;   // funct6 in bits 31..26 (RV64 immediate shifts)
 
     switch (opcode) {
-        case LUI:   exec_LUI(cpu, inst); break;
-        case AUIPC: exec_AUIPC(cpu, inst); break;
+        case LUI:   return exec_LUI;
+        case AUIPC: return exec_AUIPC;
 
-        case JAL:   exec_JAL(cpu, inst); break;
-        case JALR:  exec_JALR(cpu, inst); break;
+        case JAL:   return exec_JAL;
+        case JALR:  return exec_JALR;
 
         case B_TYPE:
             switch (funct3) {
-                case BEQ:   exec_BEQ(cpu, inst); break;
-                case BNE:   exec_BNE(cpu, inst); break;
-                case BLT:   exec_BLT(cpu, inst); break;
-                case BGE:   exec_BGE(cpu, inst); break;
-                case BLTU:  exec_BLTU(cpu, inst); break;
-                case BGEU:  exec_BGEU(cpu, inst); break;
+                case BEQ:   return exec_BEQ;
+                case BNE:   return exec_BNE;
+                case BLT:   return exec_BLT;
+                case BGE:   return exec_BGE;
+                case BLTU:  return exec_BLTU;
+                case BGEU:  return exec_BGEU;
                 default: ;
             } break;
 
         case LOAD:
             switch (funct3) {
-                case LB  :  exec_LB(cpu, inst); break;  
-                case LH  :  exec_LH(cpu, inst); break;  
-                case LW  :  exec_LW(cpu, inst); break;  
-                case LD  :  exec_LD(cpu, inst); break;  
-                case LBU :  exec_LBU(cpu, inst); break; 
-                case LHU :  exec_LHU(cpu, inst); break; 
-                case LWU :  exec_LWU(cpu, inst); break; 
+                case LB  :  return exec_LB;
+                case LH  :  return exec_LH;
+                case LW  :  return exec_LW;
+                case LD  :  return exec_LD;
+                case LBU :  return exec_LBU;
+                case LHU :  return exec_LHU;
+                case LWU :  return exec_LWU;
                 default: ;
             } break;
 
         case S_TYPE:
             switch (funct3) {
-                case SB  :  exec_SB(cpu, inst); break;  
-                case SH  :  exec_SH(cpu, inst); break;  
-                case SW  :  exec_SW(cpu, inst); break;  
-                case SD  :  exec_SD(cpu, inst); break;  
+                case SB  :  return exec_SB;
+                case SH  :  return exec_SH;
+                case SW  :  return exec_SW;
+                case SD  :  return exec_SD;
                 default: ;
             } break;
 
         case I_TYPE:  
             switch (funct3) {
-                case ADDI:  exec_ADDI(cpu, inst); break;
-                case SLLI:  exec_SLLI(cpu, inst); break;
-                case SLTI:  exec_SLTI(cpu, inst); break;
-                case SLTIU: exec_SLTIU(cpu, inst); break;
-                case XORI:  exec_XORI(cpu, inst); break;
+                case ADDI:  return exec_ADDI;
+                case SLLI:
+                    switch (funct6) {
+                        case BSETI: return exec_BSETI;
+                        case BCLRI: return exec_BCLRI;
+                        case BINVI: return exec_BINVI;
+                        case ZBB_UNARY:
+                            switch (rs2(inst)) {
+                                case CLZ:    return exec_CLZ;
+                                case CTZ:    return exec_CTZ;
+                                case CPOP:   return exec_CPOP;
+                                case SEXT_B: return exec_SEXT_B;
+                                case SEXT_H: return exec_SEXT_H;
+                                default: ;
+                            } break;
+                        default:    return exec_SLLI;
+                    } break;
+                case SLTI:  return exec_SLTI;
+                case SLTIU: return exec_SLTIU;
+                case XORI:  return exec_XORI;
                 case SRI:   
-                    switch (funct7) {
-                        case SRLI:  exec_SRLI(cpu, inst); break;
-                        case SRAI:  exec_SRAI(cpu, inst); break;
+                    switch (funct6) {
+                        case SRLI:  return exec_SRLI;
+                        case SRAI:  return exec_SRAI;
+                        case RORI:  return exec_RORI;
+                        case BEXTI: return exec_BEXTI;
+                        case ORC_B: return exec_ORC_B;
+                        case REV8:  return exec_REV8;
                         default: ;
                     } break;
-                case ORI:   exec_ORI(cpu, inst); break;
-                case ANDI:  exec_ANDI(cpu, inst); break;
-                default:
-                    fprintf(stderr, 
-                            "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct7:0x%x\n"
-                            , opcode, funct3, funct7);
-                    return 0;
+                case ORI:   return exec_ORI;
+                case ANDI:  return exec_ANDI;
+                default: ;
             } break;
 
         case R_TYPE:  
+            if (funct7 == MULDIV) {
+                switch (funct3) {
+                    case MUL:    return exec_MUL;
+                    case MULH:   return exec_MULH;
+                    case MULHSU: return exec_MULHSU;
+                    case MULHU:  return exec_MULHU;
+                    case DIV:    return exec_DIV;
+                    case DIVU:   return exec_DIVU;
+                    case REM:    return exec_REM;
+                    case REMU:   return exec_REMU;
+                    default: ;
+                }
+            }
             switch (funct3) {
                 case ADDSUB:
                     switch (funct7) {
-                        case ADD: exec_ADD(cpu, inst);
-                        case SUB: exec_ADD(cpu, inst);
+                        case ADD: return exec_ADD;
+                        case SUB: return exec_SUB;
                         default: ;
                     } break;
-                case SLL:  exec_SLL(cpu, inst); break;
-                case SLT:  exec_SLT(cpu, inst); break;
-                case SLTU: exec_SLTU(cpu, inst); break;
-                case XOR:  exec_XOR(cpu, inst); break;
+                case SLL:
+                    switch (funct7) {
+                        case ROL:  return exec_ROL;
+                        case BCLR: return exec_BCLR;
+                        case BINV: return exec_BINV;
+                        case BSET: return exec_BSET;
+                        default:   return exec_SLL;
+                    } break;
+                case SLT:
+                    switch (funct7) {
+                        case SH1ADD: return exec_SH1ADD;
+                        default:     return exec_SLT;
+                    } break;
+                case SLTU: return exec_SLTU;
+                case XOR:
+                    switch (funct7) {
+                        case SH2ADD: return exec_SH2ADD;
+                        case MIN:    return exec_MIN;
+                        case XNOR:   return exec_XNOR;
+                        default:     return exec_XOR;
+                    } break;
                 case SR:   
                     switch (funct7) {
-                        case SRL:  exec_SRL(cpu, inst); break;
-                        case SRA:  exec_SRA(cpu, inst); break;
+                        case SRL:  return exec_SRL;
+                        case SRA:  return exec_SRA;
+                        case MINU: return exec_MINU;
+                        case ROR:  return exec_ROR;
+                        case BEXT: return exec_BEXT;
                         default: ;
-                    }
-                case OR:   exec_OR(cpu, inst); break;
-                case AND:  exec_AND(cpu, inst); break;
-                default:
-                    fprintf(stderr, 
-                            "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct7:0x%x\n"
-                            , opcode, funct3, funct7);
-                    return 0;
+                    } break;
+                case OR:
+                    switch (funct7) {
+                        case SH3ADD: return exec_SH3ADD;
+                        case MAX:    return exec_MAX;
+                        case ORN:    return exec_ORN;
+                        default:     return exec_OR;
+                    } break;
+                case AND:
+                    switch (funct7) {
+                        case MAXU: return exec_MAXU;
+                        case ANDN: return exec_ANDN;
+                        default:   return exec_AND;
+                    } break;
+                default: ;
             } break;
 
-        case FENCE: exec_FENCE(cpu, inst); break;
+        case FENCE: return (funct3 == FENCE_I) ? exec_FENCE_I : exec_FENCE;
 
         case I_TYPE_64:
             switch (funct3) {
-                case ADDIW: exec_ADDIW(cpu, inst); break;
-                case SLLIW: exec_SLLIW(cpu, inst); break;
+                case ADDIW: return exec_ADDIW;
+                case SLLIW:
+                    switch (funct6) {
+                        case SLLI_UW: return exec_SLLI_UW;
+                        case ZBB_UNARY:
+                            switch (rs2(inst)) {
+                                case CLZ:  return exec_CLZW;
+                                case CTZ:  return exec_CTZW;
+                                case CPOP: return exec_CPOPW;
+                                default: ;
+                            } break;
+                        default:      return exec_SLLIW;
+                    } break;
                 case SRIW : 
                     switch (funct7) {
-                        case SRLIW: exec_SRLIW(cpu, inst); break;
-                        case SRAIW: exec_SRLIW(cpu, inst); break;
+                        case SRLIW: return exec_SRLIW;
+                        case SRAIW: return exec_SRAIW;
+                        case RORIW: return exec_RORIW;
+                        default: ;
                     } break;
+                default: ;
             } break;
 
         case R_TYPE_64:
             switch (funct3) {
                 case ADDSUB:
                     switch (funct7) {
-                        case ADDW:  exec_ADDW(cpu, inst); break;
-                        case SUBW:  exec_SUBW(cpu, inst); break;
-                        case MULW:  exec_MULW(cpu, inst); break;
+                        case ADDW:   return exec_ADDW;
+                        case SUBW:   return exec_SUBW;
+                        case MULW:   return exec_MULW;
+                        case ADD_UW: return exec_ADD_UW;
+                        default: ;
+                    } break;
+                case DIVW:
+                    switch (funct7) {
+                        case ZEXT_H:    return exec_ZEXT_H;
+                        case SH2ADD_UW: return exec_SH2ADD_UW;
+                        case MULDIV:    return exec_DIVW;
+                        default: ;
+                    } break;
+                case SLLW:
+                    switch (funct7) {
+                        case ROLW: return exec_ROLW;
+                        default:   return exec_SLLW;
                     } break;
-                case DIVW:  exec_DIVW(cpu, inst); break;
-                case SLLW:  exec_SLLW(cpu, inst); break;
+                case ZBA_SH1: return (funct7 == SH1ADD_UW) ? exec_SH1ADD_UW : NULL;
                 case SRW:
                     switch (funct7) {
-                        case SRLW:  exec_SRLW(cpu, inst); break;
-                        case SRAW:  exec_SRAW(cpu, inst); break;
-                        case DIVUW: exec_DIVUW(cpu, inst); break;
+                        case SRLW:  return exec_SRLW;
+                        case SRAW:  return exec_SRAW;
+                        case DIVUW: return exec_DIVUW;
+                        case RORW:  return exec_RORW;
+                        default: ;
                     } break;
-                case REMW:  exec_REMW(cpu, inst); break;
-                case REMUW: exec_REMUW(cpu, inst); break;
+                case REMW:
+                    switch (funct7) {
+                        case SH3ADD_UW: return exec_SH3ADD_UW;
+                        case MULDIV:    return exec_REMW;
+                        default: ;
+                    } break;
+                case REMUW: return (funct7 == MULDIV) ? exec_REMUW : NULL;
                 default: ;
             } break;
 
         case CSR:
             switch (funct3) {
-                case ECALLBREAK:    exec_ECALLBREAK(cpu, inst); break;
-                case CSRRW  :  exec_CSRRW(cpu, inst); break;  
-                case CSRRS  :  exec_CSRRS(cpu, inst); break;  
-                case CSRRC  :  exec_CSRRC(cpu, inst); break;  
-                case CSRRWI :  exec_CSRRWI(cpu, inst); break; 
-                case CSRRSI :  exec_CSRRSI(cpu, inst); break; 
-                case CSRRCI :  exec_CSRRCI(cpu, inst); break; 
-                default:
-                    fprintf(stderr, 
-                            "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct7:0x%x\n"
-                            , opcode, funct3, funct7);
-                    return 0;
+                case ECALLBREAK: return exec_ECALLBREAK;
+                case CSRRW  :  return exec_CSRRW;
+                case CSRRS  :  return exec_CSRRS;
+                case CSRRC  :  return exec_CSRRC;
+                case CSRRWI :  return exec_CSRRWI;
+                case CSRRSI :  return exec_CSRRSI;
+                case CSRRCI :  return exec_CSRRCI;
+                default: ;
             } break;
 
-        case AMO_W:
-            switch (funct7 >> 2) { // since, funct[1:0] = aq, rl
-                case LR_W      :  exec_LR_W(cpu, inst); break;  
-                case SC_W      :  exec_SC_W(cpu, inst); break;  
-                case AMOSWAP_W :  exec_AMOSWAP_W(cpu, inst); break;  
-                case AMOADD_W  :  exec_AMOADD_W(cpu, inst); break; 
-                case AMOXOR_W  :  exec_AMOXOR_W(cpu, inst); break; 
-                case AMOAND_W  :  exec_AMOAND_W(cpu, inst); break; 
-                case AMOOR_W   :  exec_AMOOR_W(cpu, inst); break; 
-                case AMOMIN_W  :  exec_AMOMIN_W(cpu, inst); break; 
-                case AMOMAX_W  :  exec_AMOMAX_W(cpu, inst); break; 
-                case AMOMINU_W :  exec_AMOMINU_W(cpu, inst); break; 
-                case AMOMAXU_W :  exec_AMOMAXU_W(cpu, inst); break; 
-                default:
-                    fprintf(stderr, 
-                            "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct7:0x%x\n"
-                            , opcode, funct3, funct7);
-                    return 0;
+        case AMO:
+            // funct7[1:0] are aq and rl, every access is already ordered
+            if (funct3 == AMO_W) {
+                switch (funct7 >> 2) {
+                    case LR_W      :  return exec_LR_W;
+                    case SC_W      :  return exec_SC_W;
+                    case AMOSWAP_W :  return exec_AMOSWAP_W;
+                    case AMOADD_W  :  return exec_AMOADD_W;
+                    case AMOXOR_W  :  return exec_AMOXOR_W;
+                    case AMOAND_W  :  return exec_AMOAND_W;
+                    case AMOOR_W   :  return exec_AMOOR_W;
+                    case AMOMIN_W  :  return exec_AMOMIN_W;
+                    case AMOMAX_W  :  return exec_AMOMAX_W;
+                    case AMOMINU_W :  return exec_AMOMINU_W;
+                    case AMOMAXU_W :  return exec_AMOMAXU_W;
+                    default: ;
+                }
+            } else if (funct3 == AMO_D) {
+                switch (funct7 >> 2) {
+                    case LR_D      :  return exec_LR_D;
+                    case SC_D      :  return exec_SC_D;
+                    case AMOSWAP_D :  return exec_AMOSWAP_D;
+                    case AMOADD_D  :  return exec_AMOADD_D;
+                    case AMOXOR_D  :  return exec_AMOXOR_D;
+                    case AMOAND_D  :  return exec_AMOAND_D;
+                    case AMOOR_D   :  return exec_AMOOR_D;
+                    case AMOMIN_D  :  return exec_AMOMIN_D;
+                    case AMOMAX_D  :  return exec_AMOMAX_D;
+                    case AMOMINU_D :  return exec_AMOMINU_D;
+                    case AMOMAXU_D :  return exec_AMOMAXU_D;
+                    default: ;
+                }
+            }
+            break;
+
+        case OP_V:      return exec_OP_V;
+        case LOAD_FP:   return exec_VLOAD;
+        case STORE_FP:  return exec_VSTORE;
+
+        default: ;
+    }
+    return NULL;
+}
+
+// RV32IMA with Zicsr: the RV64-only opcodes, bit-manipulation and vector
+// decode to NULL. Shift immediates have a 5-bit shamt and a full funct7.
+exec_fn cpu_decode32(uint32_t inst) {
+    int opcode = inst & 0x7f;           // opcode in bits 6..0
+    int funct3 = (inst >> 12) & 0x7;    // funct3 in bits 14..12
+    int funct7 = (inst >> 25) & 0x7f;   // funct7 in bits 31..25
+
+    switch (opcode) {
+        case LUI:   return exec32_LUI;
+        case AUIPC: return exec32_AUIPC;
+
+        case JAL:   return exec32_JAL;
+        case JALR:  return exec32_JALR;
+
+        case B_TYPE:
+            switch (funct3) {
+                case BEQ:   return exec32_BEQ;
+                case BNE:   return exec32_BNE;
+                case BLT:   return exec32_BLT;
+                case BGE:   return exec32_BGE;
+                case BLTU:  return exec32_BLTU;
+                case BGEU:  return exec32_BGEU;
+                default: ;
             } break;
 
-        case 0x00:
-            return 0;
+        case LOAD:
+            switch (funct3) {
+                case LB  :  return exec32_LB;
+                case LH  :  return exec32_LH;
+                case LW  :  return exec32_LW;
+                case LBU :  return exec32_LBU;
+                case LHU :  return exec32_LHU;
+                default: ;
+            } break;
+
+        case S_TYPE:
+            switch (funct3) {
+                case SB  :  return exec32_SB;
+                case SH  :  return exec32_SH;
+                case SW  :  return exec32_SW;
+                default: ;
+            } break;
+
+        case I_TYPE:
+            switch (funct3) {
+                case ADDI:  return exec32_ADDI;
+                case SLLI:  return (funct7 == 0) ? exec32_SLLI : NULL;
+                case SLTI:  return exec32_SLTI;
+                case SLTIU: return exec32_SLTIU;
+                case XORI:  return exec32_XORI;
+                case SRI:
+                    switch (funct7) {
+                        case SRL:   return exec32_SRLI;
+                        case SRA:   return exec32_SRAI;
+                        default: ;
+                    } break;
+                case ORI:   return exec32_ORI;
+                case ANDI:  return exec32_ANDI;
+                default: ;
+            } break;
+
+        case R_TYPE:
+            if (funct7 == MULDIV) {
+                switch (funct3) {
+                    case MUL:    return exec32_MUL;
+                    case MULH:   return exec32_MULH;
+                    case MULHSU: return exec32_MULHSU;
+                    case MULHU:  return exec32_MULHU;
+                    case DIV:    return exec32_DIV;
+                    case DIVU:   return exec32_DIVU;
+                    case REM:    return exec32_REM;
+                    case REMU:   return exec32_REMU;
+                    default: ;
+                }
+                break;
+            }
+            switch (funct3) {
+                case ADDSUB:
+                    switch (funct7) {
+                        case ADD: return exec32_ADD;
+                        case SUB: return exec32_SUB;
+                        default: ;
+                    } break;
+                case SLL:  return (funct7 == 0) ? exec32_SLL : NULL;
+                case SLT:  return (funct7 == 0) ? exec32_SLT : NULL;
+                case SLTU: return (funct7 == 0) ? exec32_SLTU : NULL;
+                case XOR:  return (funct7 == 0) ? exec32_XOR : NULL;
+                case SR:
+                    switch (funct7) {
+                        case SRL:  return exec32_SRL;
+                        case SRA:  return exec32_SRA;
+                        default: ;
+                    } break;
+                case OR:   return (funct7 == 0) ? exec32_OR : NULL;
+                case AND:  return (funct7 == 0) ? exec32_AND : NULL;
+                default: ;
+            } break;
+
+        case FENCE: return (funct3 == FENCE_I) ? exec_FENCE_I : exec_FENCE;
+
+        case CSR:
+            switch (funct3) {
+                case ECALLBREAK: return exec_ECALLBREAK;
+                case CSRRW  :  return exec32_CSRRW;
+                case CSRRS  :  return exec32_CSRRS;
+                case CSRRC  :  return exec32_CSRRC;
+                case CSRRWI :  return exec32_CSRRWI;
+                case CSRRSI :  return exec32_CSRRSI;
+                case CSRRCI :  return exec32_CSRRCI;
+                default: ;
+            } break;
+
+        // RV32 has only the word AMOs, their results fill the 32-bit register
+        case AMO:
+            if (funct3 != AMO_W)
+                break;
+            switch (funct7 >> 2) {
+                case LR_W      :  return exec32_LR_W;
+                case SC_W      :  return exec32_SC_W;
+                case AMOSWAP_W :  return exec32_AMOSWAP_W;
+                case AMOADD_W  :  return exec32_AMOADD_W;
+                case AMOXOR_W  :  return exec32_AMOXOR_W;
+                case AMOAND_W  :  return exec32_AMOAND_W;
+                case AMOOR_W   :  return exec32_AMOOR_W;
+                case AMOMIN_W  :  return exec32_AMOMIN_W;
+                case AMOMAX_W  :  return exec32_AMOMAX_W;
+                case AMOMINU_W :  return exec32_AMOMINU_W;
+                case AMOMAXU_W :  return exec32_AMOMAXU_W;
+                default: ;
+            } break;
+
+        default: ;
+    }
+    return NULL;
+}
+
+// Selects the handler set for a 32 or 64-bit guest. MXL in misa records
+// the width, so a snapshot brings it back.
+void cpu_set_xlen(CPU* cpu, int xlen) {
+    cpu->xlen = xlen;
+    cpu->decode = (xlen == 32) ? cpu_decode32 : cpu_decode;
+    cpu->csr[MISA] = (xlen == 32)
+        ? MISA_MXL32 | MISA_EXT('I') | MISA_EXT('M') | MISA_EXT('A')
+        : MISA_MXL64 | MISA_EXT('I') | MISA_EXT('M') | MISA_EXT('A') | MISA_EXT('V');
+}
+
+// Reports an instruction cpu_decode() had no handler for
+void cpu_illegal(CPU* cpu, uint32_t inst) {
+    cpu->stats.traps[CAUSE_ILLEGAL_INSN]++;
+    if ((inst & 0x7f) == 0x00)          // zeroed memory, treated as end of program
+        return;
+    fprintf(stderr, 
+            "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct7:0x%x\n"
+            , inst & 0x7f, (inst >> 12) & 0x7, (inst >> 25) & 0x7f);
+}
+
+// Stops the hart after its instruction raised bus.fault, counted as a trap
+int cpu_fault(CPU* cpu) {
+    cpu->stats.traps[cpu->bus.fault]++;
+    return 0;
+}
+
+int cpu_execute(CPU *cpu, uint32_t inst) {
+    exec_fn exec = cpu->decode(inst);
+
+    cpu->regs[0] = 0;                   // x0 hardwired to 0 at each cycle
+
+    /*printf("%s\n%#.8lx -> Inst: %#.8x <OpCode: %#.2x, funct3:%#x, funct7:%#x> %s",*/
+            /*ANSI_YELLOW, cpu->pc-4, inst, opcode, funct3, funct7, ANSI_RESET); // DEBUG*/
+    if (cpu_trace)
+        printf("%s\n%#.8lx -> %s", ANSI_YELLOW, cpu->pc-4, ANSI_RESET); // DEBUG
 
-        default:
-            fprintf(stderr, 
-                    "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct3:0x%x\n"
-                    , opcode, funct3, funct7);
-            return 0;
-            /*exit(1);*/
+    if (!exec) {
+        cpu_illegal(cpu, inst);
+        return 0;
     }
+    exec(cpu, inst);
+    if (cpu->bus.fault)
+        return cpu_fault(cpu);
     return 1;
 }
 
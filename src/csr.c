@@ -1,10 +1,59 @@
 #include "../includes/csr.h"
+#include "../includes/plic.h"
 #include <stdint.h>
+#include <time.h>
+
+static uint64_t host_ns(CPU* cpu) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec - cpu->clock_origin;
+}
+
+uint64_t cpu_time(CPU* cpu) {
+    if (cpu->icount)
+        return cpu->stats.instret / cpu->icount;
+    return host_ns(cpu) / (1000000000 / TIMEBASE_HZ);
+}
+
+// one cycle per instruction in icount mode, a nominal 1 GHz otherwise
+uint64_t cpu_cycle(CPU* cpu) {
+    if (cpu->icount)
+        return cpu->stats.instret;
+    return host_ns(cpu);
+}
 
 uint64_t csr_read(CPU* cpu, uint64_t csr) {
-    return (uint64_t)(uint32_t)cpu->csr[csr];
+    switch (csr) {
+        case CYCLE:     return cpu_cycle(cpu);
+        case TIME:      return cpu_time(cpu);
+        case INSTRET:   return cpu->stats.instret;
+        // upper halves for RV32, where the counters above read as their low 32 bits
+        case CYCLEH:    return cpu_cycle(cpu) >> 32;
+        case TIMEH:     return cpu_time(cpu) >> 32;
+        case INSTRETH:  return cpu->stats.instret >> 32;
+        case STIMECMP:  return cpu->csr[STIMECMP];
+        case MISA:      return cpu->csr[MISA];
+        case SIP:
+            // the timer is pending once time reaches stimecmp, which in
+            // icount mode is a fixed instruction count
+            return (uint32_t) cpu->csr[SIP]
+                | (cpu_time(cpu) >= cpu->csr[STIMECMP] ? SIP_STIP : 0);
+        default:        return cpu->xlen == 64 ? cpu->csr[csr] : (uint32_t) cpu->csr[csr];
+    }
 }
 
 void csr_write(CPU* cpu, uint64_t csr, uint64_t value) {
+    if (csr == FORKSRV)
+        cpu->marker = 1;
+    if (csr == CYCLE || csr == TIME || csr == INSTRET
+            || csr == CYCLEH || csr == TIMEH || csr == INSTRETH)
+        return;                 // read-only counters
+    if (csr == MISA)
+        return;                 // the width and extensions are fixed
+    if (csr == MIP || csr == SIP) {
+        // the external interrupt bits follow the PLIC, not the guest
+        uint64_t eip = MIP_MEIP | MIP_SEIP;
+        value = (value & ~eip) | (cpu->csr[csr] & eip);
+    }
     cpu->csr[csr] = value;
 }
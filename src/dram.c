@@ -1,28 +1,95 @@
 #include "../includes/dram.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+void dram_init(DRAM* dram, uint64_t base, uint64_t size) {
+    dram->base  = base;
+    dram->size  = size;
+    dram->pages = size >> DRAM_PAGE_SHIFT;
+    dram->mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    dram->code  = calloc((dram->pages + 63) / 64, sizeof(uint64_t));
+    dram->dirty = calloc((dram->pages + 63) / 64, sizeof(uint64_t));
+    dram->gen   = calloc(dram->pages, sizeof(uint32_t));
+    if (dram->mem == MAP_FAILED || !dram->code || !dram->dirty || !dram->gen) {
+        fprintf(stderr, "Memory error!");
+        exit(1);
+    }
+}
+
+void dram_free(DRAM* dram) {
+    munmap(dram->mem, dram->size);
+    free(dram->code);
+    free(dram->dirty);
+    free(dram->gen);
+}
+
+// the bitmaps cover RAM only, addresses outside it have no page to mark
+void dram_mark_code(DRAM* dram, uint64_t addr) {
+    if (!dram_contains(dram, addr, 1))
+        return;
+    uint64_t page = (addr - dram->base) >> DRAM_PAGE_SHIFT;
+    dram->code[page / 64] |= 1ULL << (page % 64);
+}
+
+uint32_t dram_page_gen(DRAM* dram, uint64_t addr) {
+    if (!dram_contains(dram, addr, 1))
+        return 0;
+    return dram->gen[(addr - dram->base) >> DRAM_PAGE_SHIFT];
+}
+
+static void dram_code_written(DRAM* dram, uint64_t page) {
+    dram->gen[page]++;
+    dram->code[page / 64] &= ~(1ULL << (page % 64));    // re-marked when decoded again
+}
+
+// Store path hook: marks the page dirty for checkpoints, and catches
+// writes to decoded code with a single bitmap test
+static inline void dram_written(DRAM* dram, uint64_t addr, uint64_t len) {
+    if (!dram_contains(dram, addr, len))
+        return;
+    uint64_t first = (addr - dram->base) >> DRAM_PAGE_SHIFT;
+    uint64_t last  = (addr - dram->base + len - 1) >> DRAM_PAGE_SHIFT;
+    for (uint64_t page = first; page <= last; page++) {
+        uint64_t bit = 1ULL << (page % 64);
+        dram->dirty[page / 64] |= bit;
+        if (dram->code[page / 64] & bit)
+            dram_code_written(dram, page);
+    }
+}
+
+void dram_touch(DRAM* dram, uint64_t addr, uint64_t len) {
+    if (len > 0)
+        dram_written(dram, addr, len);
+}
 
 uint64_t dram_load_8(DRAM* dram, uint64_t addr){
-    return (uint64_t) dram->mem[addr - DRAM_BASE];
+    return (uint64_t) dram->mem[addr - dram->base];
 }
 uint64_t dram_load_16(DRAM* dram, uint64_t addr){
-    return (uint64_t) dram->mem[addr-DRAM_BASE]
-        |  (uint64_t) dram->mem[addr-DRAM_BASE + 1] << 8;
+    return (uint64_t) dram->mem[addr - dram->base]
+        |  (uint64_t) dram->mem[addr - dram->base + 1] << 8;
 }
 uint64_t dram_load_32(DRAM* dram, uint64_t addr){
-    return (uint64_t) dram->mem[addr-DRAM_BASE]
-        |  (uint64_t) dram->mem[addr-DRAM_BASE + 1] << 8
-        |  (uint64_t) dram->mem[addr-DRAM_BASE + 2] << 16 
-        |  (uint64_t) dram->mem[addr-DRAM_BASE + 3] << 24;
+    return (uint64_t) dram->mem[addr - dram->base]
+        |  (uint64_t) dram->mem[addr - dram->base + 1] << 8
+        |  (uint64_t) dram->mem[addr - dram->base + 2] << 16 
+        |  (uint64_t) dram->mem[addr - dram->base + 3] << 24;
 }
 uint64_t dram_load_64(DRAM* dram, uint64_t addr){
-    return (uint64_t) dram->mem[addr-DRAM_BASE]
-        |  (uint64_t) dram->mem[addr-DRAM_BASE + 1] << 8
-        |  (uint64_t) dram->mem[addr-DRAM_BASE + 2] << 16
-        |  (uint64_t) dram->mem[addr-DRAM_BASE + 3] << 24
-        |  (uint64_t) dram->mem[addr-DRAM_BASE + 4] << 32
-        |  (uint64_t) dram->mem[addr-DRAM_BASE + 5] << 40 
-        |  (uint64_t) dram->mem[addr-DRAM_BASE + 6] << 48
-        |  (uint64_t) dram->mem[addr-DRAM_BASE + 7] << 56;
+    return (uint64_t) dram->mem[addr - dram->base]
+        |  (uint64_t) dram->mem[addr - dram->base + 1] << 8
+        |  (uint64_t) dram->mem[addr - dram->base + 2] << 16
+        |  (uint64_t) dram->mem[addr - dram->base + 3] << 24
+        |  (uint64_t) dram->mem[addr - dram->base + 4] << 32
+        |  (uint64_t) dram->mem[addr - dram->base + 5] << 40 
+        |  (uint64_t) dram->mem[addr - dram->base + 6] << 48
+        |  (uint64_t) dram->mem[addr - dram->base + 7] << 56;
 }
 
 uint64_t dram_load(DRAM* dram, uint64_t addr, uint64_t size) {
@@ -38,30 +105,31 @@ uint64_t dram_load(DRAM* dram, uint64_t addr, uint64_t size) {
 
 
 void dram_store_8(DRAM* dram, uint64_t addr, uint64_t value) {
-    dram->mem[addr-DRAM_BASE] = (uint8_t) (value & 0xff);
+    dram->mem[addr - dram->base] = (uint8_t) (value & 0xff);
 }
 void dram_store_16(DRAM* dram, uint64_t addr, uint64_t value) {
-    dram->mem[addr-DRAM_BASE] = (uint8_t) (value & 0xff);
-    dram->mem[addr-DRAM_BASE+1] = (uint8_t) ((value >> 8) & 0xff);
+    dram->mem[addr - dram->base] = (uint8_t) (value & 0xff);
+    dram->mem[addr - dram->base+1] = (uint8_t) ((value >> 8) & 0xff);
 }
 void dram_store_32(DRAM* dram, uint64_t addr, uint64_t value) {
-    dram->mem[addr-DRAM_BASE] = (uint8_t) (value & 0xff);
-    dram->mem[addr-DRAM_BASE + 1] = (uint8_t) ((value >> 8) & 0xff);
-    dram->mem[addr-DRAM_BASE + 2] = (uint8_t) ((value >> 16) & 0xff);
-    dram->mem[addr-DRAM_BASE + 3] = (uint8_t) ((value >> 24) & 0xff);
+    dram->mem[addr - dram->base] = (uint8_t) (value & 0xff);
+    dram->mem[addr - dram->base + 1] = (uint8_t) ((value >> 8) & 0xff);
+    dram->mem[addr - dram->base + 2] = (uint8_t) ((value >> 16) & 0xff);
+    dram->mem[addr - dram->base + 3] = (uint8_t) ((value >> 24) & 0xff);
 }
 void dram_store_64(DRAM* dram, uint64_t addr, uint64_t value) {
-    dram->mem[addr-DRAM_BASE] = (uint8_t) (value & 0xff);
-    dram->mem[addr-DRAM_BASE + 1] = (uint8_t) ((value >> 8) & 0xff);
-    dram->mem[addr-DRAM_BASE + 2] = (uint8_t) ((value >> 16) & 0xff);
-    dram->mem[addr-DRAM_BASE + 3] = (uint8_t) ((value >> 24) & 0xff);
-    dram->mem[addr-DRAM_BASE + 4] = (uint8_t) ((value >> 32) & 0xff);
-    dram->mem[addr-DRAM_BASE + 5] = (uint8_t) ((value >> 40) & 0xff);
-    dram->mem[addr-DRAM_BASE + 6] = (uint8_t) ((value >> 48) & 0xff);
-    dram->mem[addr-DRAM_BASE + 7] = (uint8_t) ((value >> 56) & 0xff);
+    dram->mem[addr - dram->base] = (uint8_t) (value & 0xff);
+    dram->mem[addr - dram->base + 1] = (uint8_t) ((value >> 8) & 0xff);
+    dram->mem[addr - dram->base + 2] = (uint8_t) ((value >> 16) & 0xff);
+    dram->mem[addr - dram->base + 3] = (uint8_t) ((value >> 24) & 0xff);
+    dram->mem[addr - dram->base + 4] = (uint8_t) ((value >> 32) & 0xff);
+    dram->mem[addr - dram->base + 5] = (uint8_t) ((value >> 40) & 0xff);
+    dram->mem[addr - dram->base + 6] = (uint8_t) ((value >> 48) & 0xff);
+    dram->mem[addr - dram->base + 7] = (uint8_t) ((value >> 56) & 0xff);
 }
 
 void dram_store(DRAM* dram, uint64_t addr, uint64_t size, uint64_t value) {
+    dram_written(dram, addr, size / 8);
     switch (size) {
         case 8:  dram_store_8(dram, addr, value);  break;
         case 16: dram_store_16(dram, addr, value); break;
@@ -70,3 +138,49 @@ void dram_store(DRAM* dram, uint64_t addr, uint64_t size, uint64_t value) {
         default: ;
     }
 }
+
+void dram_load_bytes(DRAM* dram, uint64_t addr, uint64_t len, void* dst) {
+    memcpy(dst, &dram->mem[addr - dram->base], len);
+}
+
+void dram_store_bytes(DRAM* dram, uint64_t addr, uint64_t len, const void* src) {
+    if (len == 0)
+        return;
+    dram_written(dram, addr, len);
+    memcpy(&dram->mem[addr - dram->base], src, len);
+}
+
+int dram_map_file(DRAM* dram, uint64_t addr, uint64_t len, int fd, uint64_t off) {
+    uint8_t* dst = dram->mem + (addr - dram->base);
+    if (len == 0)
+        return 0;
+    if (sysconf(_SC_PAGESIZE) == DRAM_PAGE_SIZE
+            && mmap(dst, len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_FIXED, fd, off) != MAP_FAILED)
+        return 0;
+    while (len > 0) {
+        ssize_t n = pread(fd, dst, len, off);
+        if (n <= 0)
+            return -1;
+        dst += n; len -= n; off += n;
+    }
+    return 0;
+}
+
+int dram_load_image(DRAM* dram, const char* path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "Unable to open file %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    // the page holding the end of the file reads as zeros past it
+    uint64_t len = (uint64_t) st.st_size < dram->size ? (uint64_t) st.st_size : dram->size;
+    int err = dram_map_file(dram, dram->base, len, fd, 0);
+    close(fd);
+    if (err < 0)
+        fprintf(stderr, "Unable to read file %s\n", path);
+    return err;
+}
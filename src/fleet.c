@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../includes/fleet.h"
+#include "../includes/snapshot.h"
+#include "../includes/loader.h"
+
+typedef struct FLEET_RUN {
+    CPU** cpus;
+    uint32_t guests;
+    uint32_t next;              // next guest to start, taken atomically
+} FLEET_RUN;
+
+// Same loop as main's, minus the devices and debugger fleets do not have
+static void guest_run(CPU* cpu) {
+    while (block_exec(cpu) && cpu->pc != 0)
+        cpu->marker = 0;
+    if (cpu->metrics.hart)
+        metrics_stop(cpu);
+}
+
+static void* fleet_worker(void* arg) {
+    FLEET_RUN* run = arg;
+    uint32_t i;
+    while ((i = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED)) < run->guests)
+        guest_run(run->cpus[i]);
+    return NULL;
+}
+
+static int guest_load(CPU* cpu, const FLEET* fleet) {
+    if (fleet->image)
+        return image_load(cpu, fleet->image);
+    for (int i = 0; i < fleet->nrestore; i++)
+        if (snapshot_restore(cpu, fleet->restore[i]) < 0)
+            return -1;
+    return 0;
+}
+
+int fleet_run(const FLEET* fleet) {
+    FLEET_RUN run = { .guests = fleet->guests };
+    BLOCK_SHARED* shared = block_shared_new();
+    METRICS_PAGE* page = NULL;
+    pthread_t threads[FLEET_THREADS_MAX];
+    uint32_t nthreads = fleet->threads;
+
+    if (nthreads == 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > fleet->guests)
+        nthreads = fleet->guests;
+    if (nthreads > FLEET_THREADS_MAX)
+        nthreads = FLEET_THREADS_MAX;
+
+    if (fleet->metrics && !(page = metrics_open(fleet->metrics, fleet->guests)))
+        return -1;
+    run.cpus = calloc(fleet->guests, sizeof(CPU*));
+    if (!run.cpus) {
+        fprintf(stderr, "Memory error!");
+        return -1;
+    }
+    // set up on this thread, cpu_init is not thread-safe
+    for (uint32_t i = 0; i < fleet->guests; i++) {
+        CPU* cpu = malloc(sizeof(CPU));
+        if (!cpu) {
+            fprintf(stderr, "Memory error!");
+            return -1;
+        }
+        cpu_init(cpu);
+        cpu->icount = fleet->icount;
+        cpu->blocks.shared = shared;
+        if (guest_load(cpu, fleet) < 0)
+            return -1;
+        if (page)
+            metrics_attach(cpu, page, i);
+        run.cpus[i] = cpu;
+    }
+
+    for (uint32_t t = 0; t < nthreads; t++) {
+        if (pthread_create(&threads[t], NULL, fleet_worker, &run) != 0) {
+            fprintf(stderr, "[-] ERROR-> cannot start fleet thread\n");
+            nthreads = t;
+            break;
+        }
+    }
+    if (nthreads == 0)
+        fleet_worker(&run);
+    for (uint32_t t = 0; t < nthreads; t++)
+        pthread_join(threads[t], NULL);
+
+    STATS total = { 0 };
+    for (uint32_t i = 0; i < fleet->guests; i++) {
+        CPU* cpu = run.cpus[i];
+        printf("guest %u: pc %#lx, a0 %#lx, %lu instructions\n", i, cpu->pc, cpu->regs[10],
+               cpu->stats.instret);
+        total.instret += cpu->stats.instret;
+        total.blocks_executed += cpu->stats.blocks_executed;
+        total.blocks_translated += cpu->stats.blocks_translated;
+        total.blocks_shared += cpu->stats.blocks_shared;
+        total.blocks_invalidated += cpu->stats.blocks_invalidated;
+    }
+    if (fleet->stats) {
+        fprintf(stderr, "guests               : %u on %u threads\n", fleet->guests, nthreads);
+        fprintf(stderr, "instructions retired : %lu\n", total.instret);
+        fprintf(stderr, "blocks executed      : %lu\n", total.blocks_executed);
+        fprintf(stderr, "blocks translated    : %lu\n", total.blocks_translated);
+        fprintf(stderr, "blocks shared        : %lu\n", total.blocks_shared);
+        fprintf(stderr, "blocks invalidated   : %lu\n", total.blocks_invalidated);
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../includes/forkserver.h"
+
+// Copies the current input into the guest buffer described by a0/a1
+static void load_input(CPU* cpu, const char* input) {
+    uint64_t addr = cpu->regs[10];
+    uint64_t cap  = cpu->regs[11];
+    ssize_t n = 0;
+
+    int fd = open(input, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "[-] ERROR-> cannot open input %s\n", input);
+        exit(1);
+    }
+    DRAM* dram = &cpu->bus.dram;
+    if (!dram_contains(dram, addr, 0))
+        cap = 0;
+    else if (cap > dram->size - (addr - dram->base))
+        cap = dram->size - (addr - dram->base);
+    if (cap > 0) {
+        // staged through a buffer so the store hook sees the write
+        uint8_t* buf = malloc(cap);
+        if (!buf) {
+            fprintf(stderr, "Memory error!");
+            exit(1);
+        }
+        n = read(fd, buf, cap);
+        if (n > 0)
+            bus_store_bytes(&(cpu->bus), addr, n, buf);
+        else
+            n = 0;
+        free(buf);
+    }
+    close(fd);
+    cpu->regs[10] = n;
+}
+
+void forkserver_run(CPU* cpu, const char* input) {
+    uint32_t msg = 0;
+    int status;
+
+    // tell the driver we are up; without one, just keep running the guest
+    if (write(FORKSRV_ST_FD, &msg, 4) != 4) {
+        fprintf(stderr, "[-] fork server: no driver on fd %d, running once\n", FORKSRV_ST_FD);
+        if (input)
+            load_input(cpu, input);
+        return;
+    }
+    fflush(stdout);
+    fflush(stderr);
+
+    while (read(FORKSRV_CTL_FD, &msg, 4) == 4) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "[-] ERROR-> fork server: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(FORKSRV_CTL_FD);
+            close(FORKSRV_ST_FD);
+            if (input)
+                load_input(cpu, input);
+            return;
+        }
+        uint32_t child = pid;
+        if (write(FORKSRV_ST_FD, &child, 4) != 4)
+            exit(1);
+        if (waitpid(pid, &status, 0) < 0)
+            exit(1);
+        if (write(FORKSRV_ST_FD, &status, 4) != 4)
+            exit(1);
+    }
+    exit(0);
+}
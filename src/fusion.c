@@ -0,0 +1,196 @@
+#include <stdint.h>
+#include "../includes/cpu.h"
+#include "../includes/block.h"
+#include "../includes/opcodes.h"
+
+// Macro-op fusion. Each superinstruction leaves the same architectural
+// state as running its two instructions one after the other: the first
+// instruction's result is always written back, and pc only moves past the
+// pair once the second instruction has completed.
+
+const char* fuse_names[FUSE_COUNT] = {
+    [FUSE_LUI_ADDI]   = "lui+addi",
+    [FUSE_AUIPC_ADDI] = "auipc+addi",
+    [FUSE_AUIPC_JALR] = "auipc+jalr",
+    [FUSE_AUIPC_LOAD] = "auipc+load",
+    [FUSE_SLLI_SRLI]  = "slli+srli",
+    [FUSE_CMP_BRANCH] = "slt+branch",
+};
+
+#define OPCODE(inst)    ((inst) & 0x7f)
+#define FUNCT3(inst)    (((inst) >> 12) & 0x7)
+#define FUNCT6(inst)    ((inst) >> 26)
+#define FUNCT7(inst)    ((inst) >> 25)
+
+//=====================================================================================
+//   Fused Handlers
+//=====================================================================================
+
+// lui+addi[w], auipc+addi: the pair folds into a constant
+static void exec_CONST(CPU* cpu, const INSN* in) {
+    cpu->regs[in->rd] = in->imm;
+    cpu->pc += 8;
+}
+
+static void exec_AUIPC_JALR(CPU* cpu, const INSN* in) {
+    cpu->regs[in->rd] = in->imm;
+    cpu->regs[in->rd2] = cpu->pc + 8;   // link written last, rd2 may equal rd
+    cpu->pc = in->imm2;
+}
+
+// pc points past the load before it runs, as if the pair were stepped
+static void exec_AUIPC_LW(CPU* cpu, const INSN* in) {
+    cpu->regs[in->rd] = in->imm;
+    cpu->pc += 8;
+    cpu->regs[in->rd2] = (int64_t)(int32_t) bus_load(&(cpu->bus), in->imm2, 32);
+}
+
+static void exec_AUIPC_LWU(CPU* cpu, const INSN* in) {
+    cpu->regs[in->rd] = in->imm;
+    cpu->pc += 8;
+    cpu->regs[in->rd2] = bus_load(&(cpu->bus), in->imm2, 32);
+}
+
+static void exec_AUIPC_LD(CPU* cpu, const INSN* in) {
+    cpu->regs[in->rd] = in->imm;
+    cpu->pc += 8;
+    cpu->regs[in->rd2] = bus_load(&(cpu->bus), in->imm2, 64);
+}
+
+static void exec_SLLI_SRLI(CPU* cpu, const INSN* in) {
+    cpu->regs[in->rd] = (cpu->regs[in->rs1] << in->op) >> in->imm2;
+    cpu->pc += 8;
+}
+
+// compare+branch: op holds the flag value that takes the branch
+#define CMP_BRANCH(name, cond)                                  \
+static void exec_##name##_BRANCH(CPU* cpu, const INSN* in) {    \
+    uint64_t a = cpu->regs[in->rs1];                            \
+    uint64_t b = cpu->regs[in->rs2];                            \
+    uint64_t imm = in->imm;                                     \
+    uint64_t flag = (cond) ? 1 : 0;                             \
+    (void) b; (void) imm;                                       \
+    cpu->regs[in->rd] = flag;                                   \
+    cpu->pc = (flag == in->op) ? in->imm2 : cpu->pc + 8;        \
+}
+
+CMP_BRANCH(SLT,   (int64_t) a < (int64_t) b)
+CMP_BRANCH(SLTU,  a < b)
+CMP_BRANCH(SLTI,  (int64_t) a < (int64_t) imm)
+CMP_BRANCH(SLTIU, a < imm)
+
+//=====================================================================================
+//   Pair Matching
+//=====================================================================================
+
+static int is_addi_on(uint32_t inst, uint64_t r) {
+    return OPCODE(inst) == I_TYPE && FUNCT3(inst) == ADDI
+        && rd(inst) == r && rs1(inst) == r;
+}
+
+static int is_addiw_on(uint32_t inst, uint64_t r) {
+    return OPCODE(inst) == I_TYPE_64 && FUNCT3(inst) == ADDIW
+        && rd(inst) == r && rs1(inst) == r;
+}
+
+// beqz/bnez r (either operand order); *taken gets the flag value that branches
+static int is_zero_branch_on(uint32_t inst, uint64_t r, uint8_t* taken) {
+    if (OPCODE(inst) != B_TYPE || (FUNCT3(inst) != BEQ && FUNCT3(inst) != BNE))
+        return 0;
+    if (!((rs1(inst) == r && rs2(inst) == 0) || (rs1(inst) == 0 && rs2(inst) == r)))
+        return 0;
+    *taken = FUNCT3(inst) == BNE;
+    return 1;
+}
+
+int fuse_pair(INSN* a, const INSN* b, uint64_t pc) {
+    uint32_t i1 = a->inst;
+    uint32_t i2 = b->inst;
+    uint64_t r = rd(i1);
+    fused_fn fused = NULL;
+
+    // every pair hands its value over through rd of the first instruction
+    if (r == 0 || !b->exec)
+        return 0;
+
+    a->rd = r;
+    switch (OPCODE(i1)) {
+        case LUI:
+            if (is_addi_on(i2, r)) {
+                a->imm = imm_U(i1) + imm_I(i2);
+            } else if (is_addiw_on(i2, r)) {
+                a->imm = (int64_t)(int32_t)(imm_U(i1) + imm_I(i2));
+            } else {
+                break;
+            }
+            a->kind = FUSE_LUI_ADDI;
+            fused = exec_CONST;
+            break;
+
+        case AUIPC: {
+            uint64_t hi = pc + imm_U(i1);
+            a->imm = hi;
+            if (is_addi_on(i2, r)) {
+                a->imm = hi + imm_I(i2);
+                a->kind = FUSE_AUIPC_ADDI;
+                fused = exec_CONST;
+            } else if (OPCODE(i2) == JALR && FUNCT3(i2) == 0 && rs1(i2) == r) {
+                a->imm2 = (hi + imm_I(i2)) & ~(uint64_t)1;
+                if (a->imm2 & 0x3)
+                    break;          // leave the misaligned jump to exec_JALR
+                a->rd2 = rd(i2);
+                a->kind = FUSE_AUIPC_JALR;
+                fused = exec_AUIPC_JALR;
+            } else if (OPCODE(i2) == LOAD && rs1(i2) == r) {
+                a->imm2 = hi + imm_I(i2);
+                a->rd2 = rd(i2);
+                a->kind = FUSE_AUIPC_LOAD;
+                switch (FUNCT3(i2)) {
+                    case LW:  fused = exec_AUIPC_LW; break;
+                    case LWU: fused = exec_AUIPC_LWU; break;
+                    case LD:  fused = exec_AUIPC_LD; break;
+                    default: ;
+                }
+            }
+            break;
+        }
+
+        case I_TYPE:
+            if (FUNCT3(i1) == SLLI && FUNCT6(i1) == 0) {
+                if (OPCODE(i2) == I_TYPE && FUNCT3(i2) == SRI && FUNCT6(i2) == SRLI
+                        && rd(i2) == r && rs1(i2) == r) {
+                    a->rs1 = rs1(i1);
+                    a->op = imm_I(i1) & 0x3f;
+                    a->imm2 = imm_I(i2) & 0x3f;
+                    a->kind = FUSE_SLLI_SRLI;
+                    fused = exec_SLLI_SRLI;
+                }
+            } else if ((FUNCT3(i1) == SLTI || FUNCT3(i1) == SLTIU)
+                    && is_zero_branch_on(i2, r, &a->op)) {
+                a->rs1 = rs1(i1);
+                a->imm = imm_I(i1);
+                a->imm2 = pc + 4 + imm_B(i2);
+                a->kind = FUSE_CMP_BRANCH;
+                fused = FUNCT3(i1) == SLTI ? exec_SLTI_BRANCH : exec_SLTIU_BRANCH;
+            }
+            break;
+
+        case R_TYPE:
+            if ((FUNCT3(i1) == SLT || FUNCT3(i1) == SLTU) && FUNCT7(i1) == 0
+                    && is_zero_branch_on(i2, r, &a->op)) {
+                a->rs1 = rs1(i1);
+                a->rs2 = rs2(i1);
+                a->imm2 = pc + 4 + imm_B(i2);
+                a->kind = FUSE_CMP_BRANCH;
+                fused = FUNCT3(i1) == SLT ? exec_SLT_BRANCH : exec_SLTU_BRANCH;
+            }
+            break;
+
+        default: ;
+    }
+
+    if (!fused)
+        return 0;
+    a->fused = fused;
+    return 1;
+}
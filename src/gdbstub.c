@@ -0,0 +1,572 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "../includes/gdbstub.h"
+#include "../includes/user.h"
+
+#define GDB_PACKET_SIZE 0x4000
+
+static const char target_xml[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\">"
+    "<architecture>riscv:rv64</architecture>"
+    "<feature name=\"org.gnu.gdb.riscv.cpu\">"
+    "<reg name=\"zero\" bitsize=\"64\" type=\"int\" regnum=\"0\"/>"
+    "<reg name=\"ra\" bitsize=\"64\" type=\"code_ptr\"/>"
+    "<reg name=\"sp\" bitsize=\"64\" type=\"data_ptr\"/>"
+    "<reg name=\"gp\" bitsize=\"64\" type=\"data_ptr\"/>"
+    "<reg name=\"tp\" bitsize=\"64\" type=\"data_ptr\"/>"
+    "<reg name=\"t0\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t1\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t2\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"fp\" bitsize=\"64\" type=\"data_ptr\"/>"
+    "<reg name=\"s1\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a0\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a1\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a2\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a3\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a4\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a5\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a6\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a7\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s2\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s3\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s4\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s5\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s6\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s7\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s8\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s9\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s10\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s11\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t3\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t4\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t5\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t6\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"pc\" bitsize=\"64\" type=\"code_ptr\"/>"
+    "</feature>"
+    "</target>";
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static int hexval(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses hex digits at *s, advancing past them
+static uint64_t parse_hex(const char** s) {
+    uint64_t v = 0;
+    while (hexval(**s) >= 0)
+        v = (v << 4) | hexval(*(*s)++);
+    return v;
+}
+
+// Registers go over the wire as target-endian (little) byte strings
+static char* put_reg(char* out, uint64_t v) {
+    for (int i = 0; i < 8; i++, v >>= 8) {
+        *out++ = hexdigits[(v >> 4) & 0xf];
+        *out++ = hexdigits[v & 0xf];
+    }
+    return out;
+}
+
+static int get_reg(const char** s, uint64_t* v) {
+    *v = 0;
+    for (int i = 0; i < 8; i++) {
+        int hi = hexval((*s)[0]), lo = hexval((*s)[1]);
+        if (hi < 0 || lo < 0)
+            return -1;
+        *v |= (uint64_t)(hi << 4 | lo) << (8 * i);
+        *s += 2;
+    }
+    return 0;
+}
+
+//=====================================================================================
+//   Packet I/O
+//=====================================================================================
+
+static int read_byte(GDB* g) {
+    uint8_t c;
+    return read(g->fd, &c, 1) == 1 ? c : -1;
+}
+
+static int write_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0)
+            return -1;
+        buf += n; len -= n;
+    }
+    return 0;
+}
+
+static int send_packet(GDB* g, const char* data) {
+    static char buf[GDB_PACKET_SIZE + 4];
+    size_t len = strlen(data);
+    uint8_t sum = 0;
+
+    if (len >= GDB_PACKET_SIZE) {   // replies are built to fit, never cut one short
+        fprintf(stderr, "[-] ERROR-> gdb reply of %zu bytes too long\n", len);
+        return -1;
+    }
+    buf[0] = '$';
+    for (size_t i = 0; i < len; i++) {
+        buf[i + 1] = data[i];
+        sum += (uint8_t) data[i];
+    }
+    buf[len + 1] = '#';
+    buf[len + 2] = hexdigits[sum >> 4];
+    buf[len + 3] = hexdigits[sum & 0xf];
+    if (write_all(g->fd, buf, len + 4) < 0)
+        return -1;
+    if (g->noack)
+        return 0;
+    int c = read_byte(g);      // gdb answers '+', a '-' asks for a resend we do not keep
+    return c < 0 ? -1 : 0;
+}
+
+// Reads the next packet into buf, NUL terminated. Returns its length,
+// -GDB_SIGINT for a bare ^C, or -1 once the debugger is gone.
+static int recv_packet(GDB* g, char* buf) {
+    for (;;) {
+        int c;
+        do {
+            c = read_byte(g);
+            if (c < 0)
+                return -1;
+            if (c == 0x03)
+                return -GDB_SIGINT;
+        } while (c != '$');
+
+        int len = 0;
+        uint8_t sum = 0;
+        while ((c = read_byte(g)) >= 0 && c != '#') {
+            if (len < GDB_PACKET_SIZE - 1)
+                buf[len++] = c;
+            sum += c;
+        }
+        int hi = read_byte(g), lo = read_byte(g);
+        if (c < 0 || hi < 0 || lo < 0)
+            return -1;
+        buf[len] = '\0';
+        if (g->noack)
+            return len;
+        if (hexval(hi) << 4 == (sum & 0xf0) && hexval(lo) == (sum & 0xf)) {
+            write_all(g->fd, "+", 1);
+            return len;
+        }
+        write_all(g->fd, "-", 1);
+    }
+}
+
+//=====================================================================================
+//   Breakpoints
+//=====================================================================================
+
+int gdb_breakpoint(const GDB* gdb, uint64_t pc) {
+    for (uint32_t i = 0; i < gdb->nbreak; i++)
+        if (gdb->breaks[i] == pc)
+            return 1;
+    return 0;
+}
+
+// A breakpoint entry runs after block_exec has moved pc, and counts no
+// instruction, so the guest stops exactly before the breakpointed one
+void gdb_break_exec(CPU* cpu, uint32_t inst) {
+    cpu->pc -= 4;
+    cpu->gdb->stop = GDB_SIGTRAP;
+}
+
+// Blocks decoded with the old breakpoint set are dropped
+static int set_breakpoint(CPU* cpu, uint64_t addr, int insert) {
+    GDB* g = cpu->gdb;
+    for (uint32_t i = 0; i < g->nbreak; i++) {
+        if (g->breaks[i] != addr)
+            continue;
+        if (!insert) {
+            g->breaks[i] = g->breaks[--g->nbreak];
+            block_flush(&cpu->blocks);
+        }
+        return 0;
+    }
+    if (!insert)
+        return 0;
+    if (g->nbreak == GDB_MAX_BREAKPOINTS)
+        return -1;
+    g->breaks[g->nbreak++] = addr;
+    block_flush(&cpu->blocks);
+    return 0;
+}
+
+//=====================================================================================
+//   Commands
+//=====================================================================================
+
+static void read_registers(CPU* cpu, char* out) {
+    for (int i = 0; i < 32; i++)
+        out = put_reg(out, i ? cpu->regs[i] : 0);
+    out = put_reg(out, cpu->pc);
+    *out = '\0';
+}
+
+static int write_registers(CPU* cpu, const char* s) {
+    uint64_t regs[33];
+    for (int i = 0; i < 33; i++)
+        if (get_reg(&s, &regs[i]) < 0)
+            return -1;
+    memcpy(&cpu->regs[1], &regs[1], 31 * sizeof(uint64_t));
+    cpu->pc = regs[32];
+    return 0;
+}
+
+static uint64_t* reg_slot(CPU* cpu, uint64_t n) {
+    if (n >= 1 && n < 32)
+        return &cpu->regs[n];
+    return n == 32 ? &cpu->pc : NULL;
+}
+
+// m addr,len: memory outside RAM reads as an error rather than a bus access
+static void read_memory(CPU* cpu, const char* s, char* out) {
+    uint64_t addr = parse_hex(&s);
+    uint64_t len = (*s == ',') ? (s++, parse_hex(&s)) : 0;
+    uint8_t buf[(GDB_PACKET_SIZE - 1) / 2];
+
+    if (len > sizeof(buf))
+        len = sizeof(buf);          // two hex digits a byte and the NUL fit out
+    if (!dram_contains(&cpu->bus.dram, addr, len)) {
+        strcpy(out, "E14");
+        return;
+    }
+    dram_load_bytes(&cpu->bus.dram, addr, len, buf);
+    for (uint64_t i = 0; i < len; i++) {
+        *out++ = hexdigits[buf[i] >> 4];
+        *out++ = hexdigits[buf[i] & 0xf];
+    }
+    *out = '\0';
+}
+
+// M addr,len:bytes, goes through the page generations so patched code is redecoded
+static int write_memory(CPU* cpu, const char* s) {
+    uint64_t addr = parse_hex(&s);
+    if (*s++ != ',')
+        return -1;
+    uint64_t len = parse_hex(&s);
+    if (*s++ != ':' || len > GDB_PACKET_SIZE / 2 || !dram_contains(&cpu->bus.dram, addr, len))
+        return -1;
+
+    uint8_t buf[GDB_PACKET_SIZE / 2];
+    for (uint64_t i = 0; i < len; i++) {
+        int hi = hexval(s[2 * i]), lo = hexval(s[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+            return -1;
+        buf[i] = hi << 4 | lo;
+    }
+    dram_store_bytes(&cpu->bus.dram, addr, len, buf);
+    return 0;
+}
+
+// qXfer:features:read:target.xml:offset,length
+static void read_features(const char* s, char* out) {
+    const char* annex = "target.xml:";
+    if (strncmp(s, annex, strlen(annex)) != 0) {
+        strcpy(out, "E00");
+        return;
+    }
+    s += strlen(annex);
+    uint64_t off = parse_hex(&s);
+    uint64_t len = (*s == ',') ? (s++, parse_hex(&s)) : 0;
+    uint64_t size = sizeof(target_xml) - 1;
+
+    if (off >= size) {
+        strcpy(out, "l");
+        return;
+    }
+    if (len > GDB_PACKET_SIZE - 2)
+        len = GDB_PACKET_SIZE - 2;
+    if (len > size - off)
+        len = size - off;
+    out[0] = (off + len == size) ? 'l' : 'm';
+    memcpy(out + 1, target_xml + off, len);
+    out[len + 1] = '\0';
+}
+
+static void gdb_close(CPU* cpu) {
+    close(cpu->gdb->fd);
+    free(cpu->gdb);
+    cpu->gdb = NULL;
+    block_flush(&cpu->blocks);         // drop the breakpoint entries
+}
+
+static int exit_status(CPU* cpu) {
+    return cpu->user ? cpu->user->exit_code : (int)(cpu->regs[10] & 0xff);
+}
+
+// Step one instruction for 's', or off a breakpoint before 'c'.
+// Returns 0 if the guest stopped for good.
+static int step(CPU* cpu) {
+    if (!block_step(cpu))
+        return 0;
+    return cpu->pc != 0;
+}
+
+// S or, after a watchpoint, T with the watch kind and data address
+static void stop_reply(CPU* cpu, char* out) {
+    WATCHES* w = &cpu->watch;
+    if (!w->hit) {
+        sprintf(out, "S%02x", cpu->gdb->stop);
+        return;
+    }
+    int kind = w->list[w->hit - 1].kind;
+    sprintf(out, "T%02x%s:%lx;", GDB_SIGTRAP,
+            kind == WATCH_ACCESS ? "awatch" : kind == WATCH_READ ? "rwatch" : "watch", w->hit_addr);
+    w->hit = 0;
+}
+
+// Z2/Z3/Z4 types, write, read and access watchpoints
+static const int watch_kinds[] = { 0, 0, WATCH_WRITE, WATCH_READ, WATCH_ACCESS };
+
+// Serves packets until the guest is resumed. Returns 0 to end the run.
+static int serve(CPU* cpu) {
+    static char in[GDB_PACKET_SIZE];
+    static char out[GDB_PACKET_SIZE];
+    GDB* g = cpu->gdb;
+
+    if (g->stop > 0) {
+        stop_reply(cpu, out);
+        if (send_packet(g, out) < 0)
+            goto gone;
+    }
+    g->stop = 0;
+
+    for (;;) {
+        int len = recv_packet(g, in);
+        if (len == -1)
+            goto gone;
+        if (len < 0) {                  // ^C while already stopped
+            send_packet(g, "S02");
+            continue;
+        }
+
+        const char* arg = in + 1;
+        uint64_t n, v;
+        out[0] = '\0';
+        switch (in[0]) {
+            case '?':
+                strcpy(out, "S05");
+                break;
+            case 'g':
+                read_registers(cpu, out);
+                break;
+            case 'G':
+                strcpy(out, write_registers(cpu, arg) < 0 ? "E01" : "OK");
+                break;
+            case 'p':
+                n = parse_hex(&arg);
+                if (n == 0)
+                    put_reg(out, 0)[0] = '\0';
+                else if (reg_slot(cpu, n))
+                    put_reg(out, *reg_slot(cpu, n))[0] = '\0';
+                else
+                    strcpy(out, "E01");
+                break;
+            case 'P':
+                n = parse_hex(&arg);
+                if (*arg++ != '=' || get_reg(&arg, &v) < 0)
+                    strcpy(out, "E01");
+                else {
+                    if (reg_slot(cpu, n))
+                        *reg_slot(cpu, n) = v;      // writes to zero are dropped
+                    strcpy(out, "OK");
+                }
+                break;
+            case 'm':
+                watch_open(cpu);        // the debugger sees through watchpoints
+                read_memory(cpu, arg, out);
+                watch_close(cpu);
+                break;
+            case 'M':
+                watch_open(cpu);
+                strcpy(out, write_memory(cpu, arg) < 0 ? "E14" : "OK");
+                watch_close(cpu);
+                break;
+            case 'c':
+                if (*arg)
+                    cpu->pc = parse_hex(&arg);
+                if (gdb_breakpoint(g, cpu->pc) && !step(cpu))
+                    return 0;
+                return 1;
+            case 's':
+                if (*arg)
+                    cpu->pc = parse_hex(&arg);
+                if (!step(cpu))
+                    return 0;
+                g->stop = GDB_SIGTRAP;
+                stop_reply(cpu, out);
+                g->stop = 0;
+                break;
+            case 'Z':
+            case 'z':
+                // software and hardware breakpoints are the same block-cache entry
+                if (arg[0] < '0' || arg[0] > '4' || arg[1] != ',')
+                    break;
+                n = arg[0] - '0';
+                arg += 2;
+                v = parse_hex(&arg);
+                if (n < 2) {
+                    strcpy(out, set_breakpoint(cpu, v, in[0] == 'Z') < 0 ? "E0e" : "OK");
+                } else {
+                    uint64_t len = (*arg == ',') ? (arg++, parse_hex(&arg)) : 1;
+                    int err = (in[0] == 'Z') ? watch_add(cpu, v, len, watch_kinds[n])
+                                             : watch_remove(cpu, v, len, watch_kinds[n]);
+                    strcpy(out, err < 0 ? "E0e" : "OK");
+                }
+                break;
+            case 'q':
+                if (strncmp(arg, "Supported", 9) == 0)
+                    snprintf(out, sizeof(out), "PacketSize=%x;qXfer:features:read+;"
+                             "QStartNoAckMode+", GDB_PACKET_SIZE);
+                else if (strncmp(arg, "Xfer:features:read:", 19) == 0)
+                    read_features(arg + 19, out);
+                else if (strcmp(arg, "Attached") == 0)
+                    strcpy(out, "1");
+                else if (strcmp(arg, "fThreadInfo") == 0)
+                    strcpy(out, "m1");
+                else if (strcmp(arg, "sThreadInfo") == 0)
+                    strcpy(out, "l");
+                else if (strcmp(arg, "C") == 0)
+                    strcpy(out, "QC1");
+                break;
+            case 'Q':
+                if (strcmp(arg, "StartNoAckMode") == 0) {
+                    send_packet(g, "OK");
+                    g->noack = 1;
+                    continue;
+                }
+                break;
+            case 'H':
+            case 'T':
+                strcpy(out, "OK");
+                break;
+            case 'D':
+                send_packet(g, "OK");
+                gdb_close(cpu);
+                return 1;
+            case 'k':
+                gdb_close(cpu);
+                return 0;
+            default: ;                  // empty reply, not supported
+        }
+        if (send_packet(g, out) < 0)
+            goto gone;
+    }
+
+gone:
+    fprintf(stderr, "[-] ERROR-> gdb connection lost, continuing without it\n");
+    gdb_close(cpu);
+    return 1;
+}
+
+// Non-blocking check for a ^C sent while the guest runs
+static int interrupted(GDB* g) {
+    struct pollfd p = { .fd = g->fd, .events = POLLIN };
+    if (poll(&p, 1, 0) <= 0)
+        return 0;
+    int c = read_byte(g);
+    return c == 0x03 || c < 0;
+}
+
+int gdb_poll(CPU* cpu) {
+    GDB* g = cpu->gdb;
+    if (!g->stop) {
+        if (++g->poll < GDB_POLL_BLOCKS)
+            return 1;
+        g->poll = 0;
+        if (!interrupted(g))
+            return 1;
+        g->stop = GDB_SIGINT;
+    }
+    return serve(cpu);
+}
+
+void gdb_exit(CPU* cpu) {
+    char buf[8];
+    snprintf(buf, sizeof(buf), "W%02x", exit_status(cpu) & 0xff);
+    send_packet(cpu->gdb, buf);
+    gdb_close(cpu);
+}
+
+//=====================================================================================
+//   Connection
+//=====================================================================================
+
+int gdb_start(CPU* cpu, const char* addr) {
+    int fd, conn;
+
+    if (strchr(addr, '/')) {
+        struct sockaddr_un un = { .sun_family = AF_UNIX };
+        if (strlen(addr) >= sizeof(un.sun_path)) {
+            fprintf(stderr, "[-] ERROR-> gdb socket path too long\n");
+            return -1;
+        }
+        strcpy(un.sun_path, addr);
+        unlink(addr);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr*) &un, sizeof(un)) < 0)
+            goto fail;
+    } else {
+        struct sockaddr_in in = { .sin_family = AF_INET };
+        int one = 1;
+        in.sin_port = htons(atoi(addr));
+        in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            goto fail;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr*) &in, sizeof(in)) < 0)
+            goto fail;
+    }
+    if (listen(fd, 1) < 0)
+        goto fail;
+
+    fprintf(stderr, "[+] waiting for gdb on %s\n", addr);
+    conn = accept(fd, NULL, NULL);
+    close(fd);
+    if (conn < 0) {
+        fprintf(stderr, "[-] ERROR-> gdb accept failed\n");
+        return -1;
+    }
+    if (!strchr(addr, '/')) {
+        int one = 1;
+        setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    GDB* g = calloc(1, sizeof(GDB));
+    if (!g) {
+        fprintf(stderr, "Memory error!");
+        close(conn);
+        return -1;
+    }
+    g->fd = conn;
+    g->stop = -1;               // stopped at entry, gdb asks why with '?'
+    cpu->gdb = g;
+    return 0;
+
+fail:
+    fprintf(stderr, "[-] ERROR-> cannot listen for gdb on %s\n", addr);
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
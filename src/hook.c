@@ -0,0 +1,225 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/cpu.h"
+#include "../includes/csr.h"
+#include "../includes/hook.h"
+#include "../includes/loader.h"
+
+const char* hook_names[HOOK_COUNT] = {
+    [HOOK_MEMCPY]  = "memcpy",
+    [HOOK_MEMMOVE] = "memmove",
+    [HOOK_MEMSET]  = "memset",
+    [HOOK_MEMCMP]  = "memcmp",
+    [HOOK_STRLEN]  = "strlen",
+    [HOOK_STRCMP]  = "strcmp",
+};
+
+int hook_install(CPU* cpu, const char* path, const char* allow, int verify) {
+    HOOKS* hooks = &cpu->hooks;
+    ELF_FILE elf;
+    if (elf_open(&elf, path) < 0)
+        return -1;
+
+    char* list = strdup(allow);
+    for (char* name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        int all = strcmp(name, "all") == 0, found = all;
+        for (int i = 0; i < HOOK_COUNT; i++) {
+            if (!all && strcmp(name, hook_names[i]) != 0)
+                continue;
+            found = 1;
+            hooks->pc[i] = elf_symbol(&elf, hook_names[i]);
+        }
+        if (!found) {
+            fprintf(stderr, "[-] ERROR-> no host version of %s\n", name);
+            free(list);
+            elf_close(&elf);
+            return -1;
+        }
+    }
+    free(list);
+    elf_close(&elf);
+
+    hooks->n = 0;
+    for (int i = 0; i < HOOK_COUNT; i++)
+        if (hooks->pc[i])
+            hooks->n++;
+    hooks->verify = verify;
+    return 0;
+}
+
+static int hook_at(const HOOKS* hooks, uint64_t pc) {
+    for (int i = 0; i < HOOK_COUNT; i++)
+        if (hooks->pc[i] == pc)
+            return i;
+    return -1;
+}
+
+int hook_find(const HOOKS* hooks, uint64_t pc) {
+    if (hooks->n == 0 || hooks->verify)
+        return -1;
+    return hook_at(hooks, pc);
+}
+
+//=====================================================================================
+//   Host versions
+//=====================================================================================
+
+// Host address of guest [addr, addr + len), NULL unless it is all guest RAM
+static uint8_t* host_ptr(CPU* cpu, uint64_t addr, uint64_t len) {
+    DRAM* dram = &cpu->bus.dram;
+    if (!dram_contains(dram, addr, len))
+        return NULL;
+    return dram->mem + (addr - dram->base);
+}
+
+// Length of the string at addr, -1 when it runs off the end of guest RAM
+static int64_t guest_strlen(CPU* cpu, uint64_t addr) {
+    DRAM* dram = &cpu->bus.dram;
+    uint8_t* s = host_ptr(cpu, addr, 1);
+    if (!s)
+        return -1;
+    uint8_t* end = memchr(s, 0, dram->size - (addr - dram->base));
+    return end ? end - s : -1;
+}
+
+// Runs routine fn on the host with the guest's a0-a2, result is the new a0.
+// Returns 0, or the access fault cause when an argument points outside
+// guest RAM: a store fault for a destination, a load fault for a source.
+static int hook_call(CPU* cpu, int fn, int64_t* result) {
+    uint64_t a0 = cpu->regs[10], a1 = cpu->regs[11], a2 = cpu->regs[12];
+    uint8_t *p, *q;
+    int64_t len;
+
+    // a zero length touches nothing, whatever the pointers are
+    if (a2 == 0 && fn != HOOK_STRLEN && fn != HOOK_STRCMP) {
+        *result = (fn == HOOK_MEMCMP) ? 0 : a0;
+        return 0;
+    }
+    switch (fn) {
+        case HOOK_MEMCPY:
+        case HOOK_MEMMOVE:
+            if (!(p = host_ptr(cpu, a0, a2)))
+                return CAUSE_STORE_ACCESS;
+            if (!(q = host_ptr(cpu, a1, a2)))
+                return CAUSE_LOAD_ACCESS;
+            memmove(p, q, a2);          // also right for an overlapping memcpy
+            dram_touch(&cpu->bus.dram, a0, a2);
+            *result = a0;
+            return 0;
+        case HOOK_MEMSET:
+            if (!(p = host_ptr(cpu, a0, a2)))
+                return CAUSE_STORE_ACCESS;
+            memset(p, a1 & 0xff, a2);
+            dram_touch(&cpu->bus.dram, a0, a2);
+            *result = a0;
+            return 0;
+        case HOOK_MEMCMP:
+            if (!(p = host_ptr(cpu, a0, a2)) || !(q = host_ptr(cpu, a1, a2)))
+                return CAUSE_LOAD_ACCESS;
+            *result = memcmp(p, q, a2);
+            return 0;
+        case HOOK_STRLEN:
+            if ((len = guest_strlen(cpu, a0)) < 0)
+                return CAUSE_LOAD_ACCESS;
+            *result = len;
+            return 0;
+        case HOOK_STRCMP:
+            if (guest_strlen(cpu, a0) < 0 || guest_strlen(cpu, a1) < 0)
+                return CAUSE_LOAD_ACCESS;
+            *result = strcmp((char*) host_ptr(cpu, a0, 1), (char*) host_ptr(cpu, a1, 1));
+            return 0;
+        default:
+            return CAUSE_ILLEGAL_INSN;
+    }
+}
+
+// A bad pointer faults like the guest routine's own access would have
+void hook_exec(CPU* cpu, uint32_t inst) {
+    int64_t result;
+    cpu->stats.hooked[inst]++;
+    int cause = hook_call(cpu, inst, &result);
+    if (cause) {
+        fprintf(stderr, "[-] ERROR-> %s called with an address outside memory\n", hook_names[inst]);
+        cpu->bus.fault = cause;
+        return;
+    }
+    cpu->regs[10] = result;
+    cpu->pc = cpu->regs[1];             // return to ra
+}
+
+//=====================================================================================
+//   Verification
+//=====================================================================================
+
+static int sign(int64_t v) {
+    return (v > 0) - (v < 0);
+}
+
+// At an entry: works out what the call should leave behind, without
+// touching guest memory
+static void hook_expect(CPU* cpu, int fn) {
+    HOOKS* hooks = &cpu->hooks;
+    uint64_t a0 = cpu->regs[10], a1 = cpu->regs[11], a2 = cpu->regs[12];
+    uint8_t* src;
+
+    hooks->len = 0;
+    switch (fn) {
+        case HOOK_MEMCPY:
+        case HOOK_MEMMOVE:
+        case HOOK_MEMSET:
+            if (a2 > HOOK_VERIFY_MAX || !host_ptr(cpu, a0, a2))
+                return;
+            if (fn == HOOK_MEMSET) {
+                memset(hooks->expect_buf, a1 & 0xff, a2);
+            } else {
+                if (!(src = host_ptr(cpu, a1, a2)))
+                    return;
+                memcpy(hooks->expect_buf, src, a2);
+            }
+            hooks->dst = a0;
+            hooks->len = a2;
+            hooks->expect = a0;
+            break;
+        default:
+            if (hook_call(cpu, fn, &hooks->expect))
+                return;
+    }
+    hooks->pending = fn + 1;
+    hooks->ret = cpu->regs[1];
+    hooks->sp = cpu->regs[2];
+}
+
+void hook_verify(CPU* cpu) {
+    HOOKS* hooks = &cpu->hooks;
+
+    if (!hooks->pending) {
+        int fn = hook_at(hooks, cpu->pc);
+        if (fn < 0)
+            return;
+        if (!hooks->expect_buf && !(hooks->expect_buf = malloc(HOOK_VERIFY_MAX))) {
+            fprintf(stderr, "Memory error!");
+            exit(1);
+        }
+        cpu->stats.hooked[fn]++;
+        hook_expect(cpu, fn);
+        return;
+    }
+    if (cpu->pc != hooks->ret || cpu->regs[2] != hooks->sp)
+        return;
+
+    // returned: compare the interpreted call with the host's
+    int fn = hooks->pending - 1;
+    int64_t got = cpu->regs[10];
+    int ok = (fn == HOOK_MEMCMP || fn == HOOK_STRCMP) ? sign(got) == sign(hooks->expect)
+                                                      : got == hooks->expect;
+    if (hooks->len && memcmp(host_ptr(cpu, hooks->dst, hooks->len), hooks->expect_buf, hooks->len))
+        ok = 0;
+    if (!ok) {
+        cpu->stats.hook_mismatches++;
+        fprintf(stderr, "[-] ERROR-> %s returning to %#lx: guest result differs from the host's\n",
+                hook_names[fn], hooks->ret);
+    }
+    hooks->pending = 0;
+}
@@ -0,0 +1,213 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include "../includes/loader.h"
+#include "../includes/cpu.h"
+
+#define PAGE_DOWN(x)    ((x) & ~(uint64_t)(DRAM_PAGE_SIZE - 1))
+#define PAGE_UP(x)      PAGE_DOWN((x) + DRAM_PAGE_SIZE - 1)
+
+// Program header i, widened to the 64-bit layout
+static int elf_phdr(ELF_FILE* elf, uint64_t i, Elf64_Phdr* ph) {
+    if (elf->elf_class == ELFCLASS64) {
+        Elf64_Ehdr* eh = (Elf64_Ehdr*) elf->data;
+        uint64_t off = eh->e_phoff + i * eh->e_phentsize;
+        if (off + sizeof(Elf64_Phdr) > elf->size)
+            return -1;
+        memcpy(ph, elf->data + off, sizeof(Elf64_Phdr));
+    } else {
+        Elf32_Ehdr* eh = (Elf32_Ehdr*) elf->data;
+        Elf32_Phdr p;
+        uint64_t off = eh->e_phoff + i * eh->e_phentsize;
+        if (off + sizeof(Elf32_Phdr) > elf->size)
+            return -1;
+        memcpy(&p, elf->data + off, sizeof(Elf32_Phdr));
+        ph->p_type   = p.p_type;
+        ph->p_flags  = p.p_flags;
+        ph->p_offset = p.p_offset;
+        ph->p_vaddr  = p.p_vaddr;
+        ph->p_paddr  = p.p_paddr;
+        ph->p_filesz = p.p_filesz;
+        ph->p_memsz  = p.p_memsz;
+        ph->p_align  = p.p_align;
+    }
+    return 0;
+}
+
+// Section header i, widened to the 64-bit layout
+static int elf_shdr(ELF_FILE* elf, uint64_t i, Elf64_Shdr* sh) {
+    if (elf->elf_class == ELFCLASS64) {
+        Elf64_Ehdr* eh = (Elf64_Ehdr*) elf->data;
+        uint64_t off = eh->e_shoff + i * eh->e_shentsize;
+        if (i >= eh->e_shnum || off + sizeof(Elf64_Shdr) > elf->size)
+            return -1;
+        memcpy(sh, elf->data + off, sizeof(Elf64_Shdr));
+    } else {
+        Elf32_Ehdr* eh = (Elf32_Ehdr*) elf->data;
+        Elf32_Shdr s;
+        uint64_t off = eh->e_shoff + i * eh->e_shentsize;
+        if (i >= eh->e_shnum || off + sizeof(Elf32_Shdr) > elf->size)
+            return -1;
+        memcpy(&s, elf->data + off, sizeof(Elf32_Shdr));
+        sh->sh_type    = s.sh_type;
+        sh->sh_link    = s.sh_link;
+        sh->sh_offset  = s.sh_offset;
+        sh->sh_size    = s.sh_size;
+        sh->sh_entsize = s.sh_entsize;
+    }
+    return 0;
+}
+
+int elf_open(ELF_FILE* elf, const char* path) {
+    memset(elf, 0, sizeof(*elf));
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Unable to open file %s\n", path);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    elf->size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    elf->data = malloc(elf->size + 1);
+    if (!elf->data || fread(elf->data, 1, elf->size, file) != elf->size) {
+        fprintf(stderr, "Unable to read file %s\n", path);
+        fclose(file);
+        elf_close(elf);
+        return -1;
+    }
+    fclose(file);
+
+    Elf64_Ehdr* eh = (Elf64_Ehdr*) elf->data;
+    if (elf->size < sizeof(Elf64_Ehdr) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0
+            || eh->e_ident[EI_DATA] != ELFDATA2LSB) {
+        fprintf(stderr, "[-] ERROR-> %s is not a little-endian ELF file\n", path);
+        elf_close(elf);
+        return -1;
+    }
+    elf->elf_class = eh->e_ident[EI_CLASS];
+    if (elf->elf_class == ELFCLASS64) {
+        elf->entry     = eh->e_entry;
+        elf->phnum     = eh->e_phnum;
+        elf->phentsize = eh->e_phentsize;
+    } else if (elf->elf_class == ELFCLASS32) {
+        Elf32_Ehdr* eh32 = (Elf32_Ehdr*) elf->data;
+        elf->entry     = eh32->e_entry;
+        elf->phnum     = eh32->e_phnum;
+        elf->phentsize = eh32->e_phentsize;
+    } else {
+        fprintf(stderr, "[-] ERROR-> %s: unknown ELF class\n", path);
+        elf_close(elf);
+        return -1;
+    }
+    if (eh->e_machine != EM_RISCV || eh->e_type != ET_EXEC) {
+        fprintf(stderr, "[-] ERROR-> %s is not a static RISC-V executable\n", path);
+        elf_close(elf);
+        return -1;
+    }
+
+    // extent of the loadable image, and where the program headers land
+    uint64_t phoff = (elf->elf_class == ELFCLASS64) ? eh->e_phoff : ((Elf32_Ehdr*) eh)->e_phoff;
+    elf->lo = UINT64_MAX;
+    for (uint64_t i = 0; i < elf->phnum; i++) {
+        Elf64_Phdr ph;
+        if (elf_phdr(elf, i, &ph) < 0) {
+            fprintf(stderr, "[-] ERROR-> %s: truncated program headers\n", path);
+            elf_close(elf);
+            return -1;
+        }
+        if (ph.p_type == PT_PHDR)
+            elf->phdr = ph.p_vaddr;
+        if (ph.p_type != PT_LOAD)
+            continue;
+        if (PAGE_DOWN(ph.p_vaddr) < elf->lo)
+            elf->lo = PAGE_DOWN(ph.p_vaddr);
+        if (PAGE_UP(ph.p_vaddr + ph.p_memsz) > elf->hi)
+            elf->hi = PAGE_UP(ph.p_vaddr + ph.p_memsz);
+        if (!elf->phdr && phoff >= ph.p_offset && phoff < ph.p_offset + ph.p_filesz)
+            elf->phdr = ph.p_vaddr + (phoff - ph.p_offset);
+    }
+    if (elf->lo == UINT64_MAX) {
+        fprintf(stderr, "[-] ERROR-> %s has no loadable segments\n", path);
+        elf_close(elf);
+        return -1;
+    }
+    return 0;
+}
+
+int elf_load(ELF_FILE* elf, BUS* bus) {
+    for (uint64_t i = 0; i < elf->phnum; i++) {
+        Elf64_Phdr ph;
+        elf_phdr(elf, i, &ph);
+        if (ph.p_type != PT_LOAD || ph.p_filesz == 0)
+            continue;
+        if (ph.p_offset + ph.p_filesz > elf->size || ph.p_filesz > ph.p_memsz
+                || !dram_contains(&bus->dram, ph.p_vaddr, ph.p_memsz)) {
+            fprintf(stderr, "[-] ERROR-> bad PT_LOAD segment at %#lx\n", ph.p_vaddr);
+            return -1;
+        }
+        bus_store_bytes(bus, ph.p_vaddr, ph.p_filesz, elf->data + ph.p_offset);
+    }
+    return 0;
+}
+
+uint64_t elf_symbol(ELF_FILE* elf, const char* name) {
+    uint64_t shnum = (elf->elf_class == ELFCLASS64) ? ((Elf64_Ehdr*) elf->data)->e_shnum
+                                                    : ((Elf32_Ehdr*) elf->data)->e_shnum;
+    for (uint64_t i = 0; i < shnum; i++) {
+        Elf64_Shdr sh, strtab;
+        if (elf_shdr(elf, i, &sh) < 0 || sh.sh_type != SHT_SYMTAB || sh.sh_entsize == 0
+                || elf_shdr(elf, sh.sh_link, &strtab) < 0
+                || sh.sh_offset + sh.sh_size > elf->size
+                || strtab.sh_offset + strtab.sh_size > elf->size)
+            continue;
+        const char* names = (const char*) elf->data + strtab.sh_offset;
+        uint64_t len = strlen(name);
+        for (uint64_t off = sh.sh_offset; off + sh.sh_entsize <= sh.sh_offset + sh.sh_size;
+                off += sh.sh_entsize) {
+            uint64_t value, name_off;
+            int type;
+            if (elf->elf_class == ELFCLASS64) {
+                Elf64_Sym* sym = (Elf64_Sym*)(elf->data + off);
+                value = sym->st_value; name_off = sym->st_name; type = ELF64_ST_TYPE(sym->st_info);
+            } else {
+                Elf32_Sym* sym = (Elf32_Sym*)(elf->data + off);
+                value = sym->st_value; name_off = sym->st_name; type = ELF32_ST_TYPE(sym->st_info);
+            }
+            if (type == STT_FUNC && value && name_off < strtab.sh_size
+                    && len < strtab.sh_size - name_off
+                    && memcmp(names + name_off, name, len + 1) == 0)
+                return value;
+        }
+    }
+    return 0;
+}
+
+void elf_close(ELF_FILE* elf) {
+    free(elf->data);
+    elf->data = NULL;
+}
+
+int image_load(CPU* cpu, const char* path) {
+    unsigned char ident[SELFMAG] = { 0 };
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Unable to open file %s\n", path);
+        return -1;
+    }
+    size_t len = fread(ident, 1, SELFMAG, file);
+    fclose(file);
+    if (len < SELFMAG || memcmp(ident, ELFMAG, SELFMAG) != 0)
+        return dram_load_image(&cpu->bus.dram, path);
+
+    ELF_FILE elf;
+    if (elf_open(&elf, path) < 0)
+        return -1;
+    int err = elf_load(&elf, &(cpu->bus));
+    cpu->pc = elf.entry;
+    cpu_set_xlen(cpu, elf.elf_class == ELFCLASS32 ? 32 : 64);
+    elf_close(&elf);
+    return err;
+}
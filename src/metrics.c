@@ -0,0 +1,117 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../includes/metrics.h"
+#include "../includes/cpu.h"
+#include "../includes/plic.h"
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void put(uint64_t* p, uint64_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+METRICS_PAGE* metrics_open(const char* spec, uint32_t nharts) {
+    uint64_t size = sizeof(METRICS_PAGE) + (uint64_t)nharts * sizeof(METRICS_HART);
+    int fd = strncmp(spec, "shm:", 4) == 0
+        ? shm_open(spec + 4, O_RDWR | O_CREAT, 0644)
+        : open(spec, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "[-] ERROR-> cannot open metrics %s\n", spec);
+        return NULL;
+    }
+    // emptied first, nothing from an earlier run survives
+    if (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0) {
+        fprintf(stderr, "[-] ERROR-> cannot size metrics %s\n", spec);
+        close(fd);
+        return NULL;
+    }
+    METRICS_PAGE* page = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        fprintf(stderr, "[-] ERROR-> cannot map metrics %s\n", spec);
+        return NULL;
+    }
+    page->version = METRICS_VERSION;
+    page->pid = getpid();
+    page->nharts = nharts;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(page->magic, METRICS_MAGIC, sizeof(page->magic));
+    return page;
+}
+
+void metrics_attach(CPU* cpu, METRICS_PAGE* page, uint32_t i) {
+    BUS* bus = &cpu->bus;
+    for (uint32_t d = 0; i == 0 && d < bus->nmmio; d++) {
+        MMIO* m = &bus->mmio[d];
+        for (uint32_t q = 0; q < m->nqueues && page->nqueues < METRICS_QUEUES; q++)
+            snprintf(page->queue[page->nqueues++].name, sizeof(page->queue[0].name),
+                     "%s@%lx.%u", m->name ? m->name : "dev", m->base, q);
+    }
+    cpu->metrics.hart = &page->hart[i];
+    cpu->metrics.page = i == 0 ? page : NULL;
+    cpu->metrics.polls = 0;
+    cpu->metrics.interval_ns = now_ns();
+    cpu->metrics.interval_instret = cpu->stats.instret;
+    put(&cpu->metrics.hart->running, 1);
+    metrics_update(cpu);
+}
+
+// Queue depths go into the header, listed in metrics_attach's order
+static void metrics_queues(CPU* cpu) {
+    METRICS_PAGE* page = cpu->metrics.page;
+    BUS* bus = &cpu->bus;
+    uint32_t n = 0;
+    for (uint32_t d = 0; d < bus->nmmio; d++) {
+        MMIO* m = &bus->mmio[d];
+        for (uint32_t q = 0; q < m->nqueues && n < METRICS_QUEUES; q++, n++) {
+            uint32_t size = 0;
+            uint32_t depth = m->queue_depth(m->dev, q, &size);
+            __atomic_store_n(&page->queue[n].depth, depth, __ATOMIC_RELAXED);
+            __atomic_store_n(&page->queue[n].size, size, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void metrics_update(CPU* cpu) {
+    METRICS* m = &cpu->metrics;
+    METRICS_HART* h = m->hart;
+    STATS* s = &cpu->stats;
+    uint64_t now = now_ns();
+
+    m->polls = 0;
+    put(&h->instret, s->instret);
+    put(&h->blocks_executed, s->blocks_executed);
+    put(&h->blocks_translated, s->blocks_translated);
+    if (cpu->bus.timing) {
+        put(&h->tlb_hits, cpu->bus.timing->tlb.hits);
+        put(&h->tlb_misses, cpu->bus.timing->tlb.misses);
+    }
+    for (int i = 0; i < METRICS_TRAPS; i++)
+        put(&h->traps[i], s->traps[i]);
+    if (cpu->bus.plic)
+        put(&h->interrupts, cpu->bus.plic->claims);
+    put(&h->wfi, s->wfi);
+    if (now - m->interval_ns >= METRICS_INTERVAL_NS) {
+        put(&h->ips, (double)(s->instret - m->interval_instret) * 1e9 / (now - m->interval_ns));
+        m->interval_ns = now;
+        m->interval_instret = s->instret;
+    }
+    if (m->page)
+        metrics_queues(cpu);
+    put(&h->updated_ns, now);
+}
+
+void metrics_stop(CPU* cpu) {
+    metrics_update(cpu);
+    put(&cpu->metrics.hart->ips, 0);
+    put(&cpu->metrics.hart->running, 0);
+}
@@ -0,0 +1,137 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../includes/bus.h"
+#include "../includes/csr.h"
+#include "../includes/plic.h"
+
+static const uint64_t plic_eip[PLIC_CONTEXTS] = { MIP_MEIP, MIP_SEIP };
+
+// Highest-priority source above the threshold, lowest id on a tie
+static uint32_t plic_best(PLIC* plic, uint32_t ctx) {
+    uint64_t eligible = plic->pending & plic->enable[ctx];
+    for (uint32_t p = PLIC_PRIORITY_MAX; eligible && p > plic->threshold[ctx]; p--) {
+        uint64_t m = eligible & plic->level[p];
+        if (m)
+            return __builtin_ctzll(m);
+    }
+    return 0;
+}
+
+// Recomputes each context's candidate, the hart only hears about changes
+static void plic_update(PLIC* plic) {
+    plic->pending = plic->line & ~plic->claimed;
+    for (uint32_t ctx = 0; ctx < PLIC_CONTEXTS; ctx++) {
+        uint32_t best = plic_best(plic, ctx);
+        if (best == plic->best[ctx])
+            continue;
+        plic->best[ctx] = best;
+        uint64_t eip = plic_eip[ctx];
+        if (best) {
+            plic->csr[MIP] |= eip;
+            if (eip == MIP_SEIP)
+                plic->csr[SIP] |= eip;
+        } else {
+            plic->csr[MIP] &= ~eip;
+            plic->csr[SIP] &= ~(eip & MIP_SEIP);
+        }
+    }
+}
+
+void plic_set(PLIC* plic, uint32_t irq, int high) {
+    uint64_t bit = 1ULL << irq;
+    if (irq == 0 || irq >= PLIC_SOURCES || !!(plic->line & bit) == !!high)
+        return;
+    plic->line ^= bit;
+    plic_update(plic);
+}
+
+static uint32_t plic_claim(PLIC* plic, uint32_t ctx) {
+    uint32_t irq = plic_best(plic, ctx);
+    if (irq) {
+        plic->claimed |= 1ULL << irq;
+        plic->claims++;
+        plic_update(plic);
+    }
+    return irq;
+}
+
+static uint64_t plic_load(void* dev, uint64_t off, uint64_t size) {
+    PLIC* plic = dev;
+    (void) size;
+    if (off < PLIC_PENDING)
+        return off / 4 < PLIC_SOURCES ? plic->priority[off / 4] : 0;
+    if (off < PLIC_ENABLE)
+        return off - PLIC_PENDING < 8 ? (uint32_t)(plic->pending >> (8 * (off - PLIC_PENDING))) : 0;
+    if (off < PLIC_CONTEXT) {
+        uint32_t ctx = (off - PLIC_ENABLE) / 0x80;
+        uint32_t word = (off - PLIC_ENABLE) % 0x80;
+        return ctx < PLIC_CONTEXTS && word < 8 ? (uint32_t)(plic->enable[ctx] >> (8 * word)) : 0;
+    }
+    uint32_t ctx = (off - PLIC_CONTEXT) / 0x1000;
+    if (ctx >= PLIC_CONTEXTS)
+        return 0;
+    switch ((off - PLIC_CONTEXT) % 0x1000) {
+        case 0:             return plic->threshold[ctx];
+        case PLIC_CLAIM:    return plic_claim(plic, ctx);
+        default:            return 0;
+    }
+}
+
+static void plic_store(void* dev, uint64_t off, uint64_t size, uint64_t value) {
+    PLIC* plic = dev;
+    (void) size;
+    if (off < PLIC_PENDING) {
+        uint32_t irq = off / 4;
+        if (irq == 0 || irq >= PLIC_SOURCES)
+            return;
+        uint32_t p = value > PLIC_PRIORITY_MAX ? PLIC_PRIORITY_MAX : value;
+        plic->level[plic->priority[irq]] &= ~(1ULL << irq);
+        plic->level[p] |= 1ULL << irq;
+        plic->priority[irq] = p;
+    } else if (off < PLIC_ENABLE) {
+        return;                     // pending is read-only
+    } else if (off < PLIC_CONTEXT) {
+        uint32_t ctx = (off - PLIC_ENABLE) / 0x80;
+        uint32_t word = (off - PLIC_ENABLE) % 0x80;
+        if (ctx >= PLIC_CONTEXTS || word >= 8 || (word & 3))
+            return;
+        uint64_t mask = 0xffffffffULL << (8 * word);
+        plic->enable[ctx] = (plic->enable[ctx] & ~mask) | ((value << (8 * word)) & mask & ~1ULL);
+    } else {
+        uint32_t ctx = (off - PLIC_CONTEXT) / 0x1000;
+        uint32_t reg = (off - PLIC_CONTEXT) % 0x1000;
+        if (ctx >= PLIC_CONTEXTS)
+            return;
+        if (reg == 0)
+            plic->threshold[ctx] = value > PLIC_PRIORITY_MAX ? PLIC_PRIORITY_MAX : value;
+        else if (reg == PLIC_CLAIM && value < PLIC_SOURCES)
+            plic->claimed &= ~(1ULL << value);      // complete, a line still high pends again
+        else
+            return;
+    }
+    plic_update(plic);
+}
+
+int plic_init(BUS* bus, uint64_t* csr) {
+    PLIC* plic = calloc(1, sizeof(PLIC));
+    if (!plic) {
+        fprintf(stderr, "Memory error!");
+        return -1;
+    }
+    plic->csr = csr;
+    plic->level[0] = ~1ULL;         // every source starts at priority 0, never taken
+    MMIO m = {
+        .base = PLIC_BASE,
+        .size = PLIC_SIZE,
+        .dev = plic,
+        .load = plic_load,
+        .store = plic_store,
+    };
+    if (bus_map(bus, &m) < 0) {
+        free(plic);
+        return -1;
+    }
+    bus->plic = plic;
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/cpu.h"
+#include "../includes/replay.h"
+
+int replay_open(REPLAY* r, const char* path, int mode) {
+    char magic[8];
+    uint32_t version;
+
+    r->mode = mode;
+    r->nregions = 0;
+    r->events = 0;
+    r->log = fopen(path, mode == REPLAY_RECORD ? "wb" : "rb");
+    if (!r->log) {
+        fprintf(stderr, "[-] ERROR-> cannot open replay log %s\n", path);
+        return -1;
+    }
+    if (mode == REPLAY_RECORD) {
+        version = REPLAY_VERSION;
+        fwrite(REPLAY_MAGIC, 1, 8, r->log);
+        fwrite(&version, sizeof(version), 1, r->log);
+        return 0;
+    }
+    if (fread(magic, 1, 8, r->log) != 8 || memcmp(magic, REPLAY_MAGIC, 8) != 0
+            || fread(&version, sizeof(version), 1, r->log) != 1 || version != REPLAY_VERSION) {
+        fprintf(stderr, "[-] ERROR-> %s is not a replay log\n", path);
+        fclose(r->log);
+        return -1;
+    }
+    return 0;
+}
+
+void replay_close(REPLAY* r) {
+    if (r->log && fclose(r->log) != 0)
+        fprintf(stderr, "[-] ERROR-> failed writing replay log\n");
+    r->log = NULL;
+    r->mode = REPLAY_OFF;
+}
+
+void replay_region(REPLAY* r, uint64_t addr, uint64_t len) {
+    if (r->mode != REPLAY_RECORD || len == 0)
+        return;
+    if (r->nregions == REPLAY_MAX_REGIONS) {
+        fprintf(stderr, "[-] ERROR-> too many regions in one replay event\n");
+        exit(1);
+    }
+    r->regions[r->nregions++] = (REPLAY_REGION){ addr, len };
+}
+
+void replay_clip(REPLAY* r, uint64_t len) {
+    uint32_t i = 0;
+    for (; i < r->nregions && len > 0; i++) {
+        if (r->regions[i].len > len)
+            r->regions[i].len = len;
+        len -= r->regions[i].len;
+    }
+    r->nregions = i;
+}
+
+void replay_record(CPU* cpu, uint32_t kind, uint64_t nr) {
+    REPLAY* r = &cpu->replay;
+    DRAM* dram = &cpu->bus.dram;
+    REPLAY_EVENT ev = {
+        .instret  = cpu->stats.instret,
+        .kind     = kind,
+        .nregions = r->nregions,
+        .nr       = nr,
+        .a0       = cpu->regs[10],
+        .a1       = cpu->regs[11],
+    };
+    fwrite(&ev, sizeof(ev), 1, r->log);
+    for (uint32_t i = 0; i < r->nregions; i++) {
+        fwrite(&r->regions[i], sizeof(REPLAY_REGION), 1, r->log);
+        fwrite(dram->mem + (r->regions[i].addr - dram->base), 1, r->regions[i].len, r->log);
+    }
+    r->nregions = 0;
+    r->events++;
+}
+
+int replay_play(CPU* cpu, uint32_t kind, uint64_t nr) {
+    REPLAY* r = &cpu->replay;
+    DRAM* dram = &cpu->bus.dram;
+    REPLAY_EVENT ev;
+
+    if (fread(&ev, sizeof(ev), 1, r->log) != 1) {
+        fprintf(stderr, "[-] ERROR-> replay log ended at instret %lu\n", cpu->stats.instret);
+        return -1;
+    }
+    if (ev.kind != kind || ev.nr != nr || ev.instret != cpu->stats.instret) {
+        fprintf(stderr, "[-] ERROR-> replay diverged at instret %lu: expected event %u/%lu "
+                "at instret %lu, got %u/%lu\n", cpu->stats.instret, ev.kind, ev.nr,
+                ev.instret, kind, nr);
+        return -1;
+    }
+    for (uint32_t i = 0; i < ev.nregions; i++) {
+        REPLAY_REGION reg;
+        if (fread(&reg, sizeof(reg), 1, r->log) != 1
+                || !dram_contains(dram, reg.addr, reg.len)
+                || fread(dram->mem + (reg.addr - dram->base), 1, reg.len, r->log) != reg.len) {
+            fprintf(stderr, "[-] ERROR-> corrupt replay log\n");
+            return -1;
+        }
+        dram_touch(dram, reg.addr, reg.len);
+    }
+    cpu->regs[10] = ev.a0;
+    cpu->regs[11] = ev.a1;
+    r->events++;
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "../includes/sbi.h"
+#include "../includes/csr.h"
+#include "../includes/replay.h"
+
+// Single hart, no MMU and no interrupt delivery: IPIs and sfence are
+// no-ops, remote fence.i flushes the block cache and the timer request is
+// kept in stimecmp.
+
+static int sbi_probe(uint64_t ext) {
+    switch (ext) {
+        case SBI_EXT_LEGACY_TIMER ... SBI_EXT_LEGACY_SHUTDOWN:
+        case SBI_EXT_BASE:
+        case SBI_EXT_TIME:
+        case SBI_EXT_IPI:
+        case SBI_EXT_RFENCE:
+        case SBI_EXT_HSM:
+        case SBI_EXT_SRST:
+        case SBI_EXT_DBCN:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int64_t sbi_getchar(void) {
+    uint8_t c;
+    return (read(STDIN_FILENO, &c, 1) == 1) ? c : -1;
+}
+
+static void sbi_stop(CPU* cpu) {
+    fflush(stdout);
+    cpu->pc = 0;                // stops the run loop
+}
+
+// Debug console write/read: a0 bytes at guest address a1 (a2 is the high
+// half on RV32 only). Long requests are cut short, the guest retries.
+static int64_t sbi_console(CPU* cpu, uint64_t fid, uint64_t* a, int64_t* value) {
+    uint8_t buf[256];
+    uint64_t addr = a[1];
+    uint64_t len = a[0] < sizeof(buf) ? a[0] : sizeof(buf);
+
+    switch (fid) {
+        case 0:                 // console_write
+            if (!dram_contains(&cpu->bus.dram, addr, len))
+                return SBI_ERR_INVALID_PARAM;
+            bus_load_bytes(&(cpu->bus), addr, len, buf);
+            *value = fwrite(buf, 1, len, stdout);
+            fflush(stdout);
+            return SBI_SUCCESS;
+        case 1: {               // console_read
+            if (!dram_contains(&cpu->bus.dram, addr, len))
+                return SBI_ERR_INVALID_PARAM;
+            ssize_t n = read(STDIN_FILENO, buf, len);
+            if (n < 0)
+                return SBI_ERR_FAILED;
+            bus_store_bytes(&(cpu->bus), addr, n, buf);
+            replay_region(&cpu->replay, addr, n);
+            *value = n;
+            return SBI_SUCCESS;
+        }
+        case 2:                 // console_write_byte
+            putchar(a[0] & 0xff);
+            fflush(stdout);
+            return SBI_SUCCESS;
+        default:
+            return SBI_ERR_NOT_SUPPORTED;
+    }
+}
+
+// Legacy v0.1 calls return their result in a0 alone
+static void sbi_legacy(CPU* cpu, uint64_t ext, uint64_t* a) {
+    int64_t ret = SBI_SUCCESS;
+    switch (ext) {
+        case SBI_EXT_LEGACY_TIMER:    csr_write(cpu, STIMECMP, a[0]); break;
+        case SBI_EXT_LEGACY_PUTCHAR:  putchar(a[0] & 0xff); fflush(stdout); break;
+        case SBI_EXT_LEGACY_GETCHAR:  ret = sbi_getchar(); break;
+        case SBI_EXT_LEGACY_FENCE_I:  cpu->blocks.flush_pending = 1; break;
+        case SBI_EXT_LEGACY_SHUTDOWN: sbi_stop(cpu); break;
+        default: ;                    // ipi and sfence have nothing to do
+    }
+    a[0] = ret;
+}
+
+static void sbi_dispatch(CPU* cpu) {
+    uint64_t* a = &cpu->regs[10];       // a0-a5 arguments, a0/a1 error/value
+    uint64_t ext = cpu->regs[17];       // a7
+    uint64_t fid = cpu->regs[16];       // a6
+    int64_t err = SBI_SUCCESS, value = 0;
+
+    if (ext <= SBI_EXT_LEGACY_SHUTDOWN) {
+        sbi_legacy(cpu, ext, a);
+        return;
+    }
+
+    switch (ext) {
+        case SBI_EXT_BASE:
+            switch (fid) {
+                case 0: value = SBI_SPEC_VERSION; break;
+                case 1: value = SBI_IMPL_ID; break;
+                case 2: value = SBI_IMPL_VERSION; break;
+                case 3: value = sbi_probe(a[0]); break;
+                case 4: case 5: case 6: value = 0; break;  // mvendorid, marchid, mimpid
+                default: err = SBI_ERR_NOT_SUPPORTED;
+            }
+            break;
+
+        case SBI_EXT_TIME:
+            if (fid == 0)
+                csr_write(cpu, STIMECMP, a[0]);
+            else
+                err = SBI_ERR_NOT_SUPPORTED;
+            break;
+
+        case SBI_EXT_IPI:
+            break;
+
+        case SBI_EXT_RFENCE:
+            if (fid == 0)
+                cpu->blocks.flush_pending = 1;      // remote fence.i
+            else if (fid > 6)
+                err = SBI_ERR_NOT_SUPPORTED;
+            break;
+
+        case SBI_EXT_HSM:
+            switch (fid) {
+                case 0:         // hart_start
+                    err = (a[0] == 0) ? SBI_ERR_ALREADY_AVAILABLE : SBI_ERR_INVALID_PARAM;
+                    break;
+                case 1:         // hart_stop
+                    sbi_stop(cpu);
+                    break;
+                case 2:         // hart_get_status, hart 0 is always started
+                    if (a[0] == 0)
+                        value = 0;
+                    else
+                        err = SBI_ERR_INVALID_PARAM;
+                    break;
+                case 3:         // hart_suspend, resumes at once like wfi
+                    break;
+                default:
+                    err = SBI_ERR_NOT_SUPPORTED;
+            }
+            break;
+
+        case SBI_EXT_SRST:
+            if (fid == 0 && a[0] <= 2)
+                sbi_stop(cpu);      // shutdown, cold or warm reboot
+            else
+                err = SBI_ERR_INVALID_PARAM;
+            break;
+
+        case SBI_EXT_DBCN:
+            err = sbi_console(cpu, fid, a, &value);
+            break;
+
+        default:
+            err = SBI_ERR_NOT_SUPPORTED;
+    }
+    a[0] = err;
+    a[1] = value;
+}
+
+void sbi_call(CPU* cpu) {
+    uint64_t ext = cpu->regs[17];
+    // console input is the only host-dependent result, it is logged for replay
+    int input = ext == SBI_EXT_LEGACY_GETCHAR || (ext == SBI_EXT_DBCN && cpu->regs[16] == 1);
+
+    cpu->stats.sbi_calls++;
+    if (input && cpu->replay.mode == REPLAY_PLAY) {
+        if (replay_play(cpu, REPLAY_SBI, ext) < 0)
+            cpu->pc = 0;
+        return;
+    }
+    cpu->replay.nregions = 0;
+    sbi_dispatch(cpu);
+    if (input && cpu->replay.mode == REPLAY_RECORD)
+        replay_record(cpu, REPLAY_SBI, ext);
+}
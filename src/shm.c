@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../includes/bus.h"
+
+static int overlaps(uint64_t a, uint64_t alen, uint64_t b, uint64_t blen) {
+    return a < b + blen && b < a + alen;
+}
+
+int shm_map(BUS* bus, const char* spec) {
+    char path[4096];
+    char* end;
+    uint64_t base = strtoull(spec, &end, 0);
+    uint64_t size = (*end == ',') ? strtoull(end + 1, &end, 0) : 0;
+    int doorbell = -1;
+
+    if (*end != ',' || size == 0) {
+        fprintf(stderr, "[-] ERROR-> bad region %s, expected addr,size,path[,fd]\n", spec);
+        return -1;
+    }
+    const char* name = end + 1;
+    const char* comma = strrchr(name, ',');
+    size_t len = comma ? (size_t)(comma - name) : strlen(name);
+    if (len == 0 || len >= sizeof(path)) {
+        fprintf(stderr, "[-] ERROR-> bad region path in %s\n", spec);
+        return -1;
+    }
+    memcpy(path, name, len);
+    path[len] = '\0';
+    if (comma) {
+        doorbell = strtol(comma + 1, &end, 0);
+        if (*end || doorbell < 0 || fcntl(doorbell, F_GETFD) < 0) {
+            fprintf(stderr, "[-] ERROR-> doorbell fd %s is not open\n", comma + 1);
+            return -1;
+        }
+    }
+
+    DRAM* dram = &bus->dram;
+    uint64_t span = size + (doorbell >= 0 ? SHM_DOORBELL : 0);
+    if (bus->nshm == SHM_MAX) {
+        fprintf(stderr, "[-] ERROR-> at most %d shared regions\n", SHM_MAX);
+        return -1;
+    }
+    if (base + span < base || overlaps(base, span, dram->base, dram->size)) {
+        fprintf(stderr, "[-] ERROR-> region %#lx+%#lx overlaps guest RAM\n", base, size);
+        return -1;
+    }
+    for (uint32_t i = 0; i < bus->nshm; i++) {
+        SHM* s = &bus->shm[i];
+        if (overlaps(base, span, s->base, s->size + (s->doorbell >= 0 ? SHM_DOORBELL : 0))) {
+            fprintf(stderr, "[-] ERROR-> region %#lx+%#lx overlaps another\n", base, size);
+            return -1;
+        }
+    }
+
+    int fd = strncmp(path, "shm:", 4) == 0
+        ? shm_open(path + 4, O_RDWR | O_CREAT, 0600)
+        : open(path, O_RDWR | O_CREAT, 0600);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "[-] ERROR-> cannot open region %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    // grown to the region size, never truncated under a host tool
+    if ((uint64_t) st.st_size < size && ftruncate(fd, size) < 0) {
+        fprintf(stderr, "[-] ERROR-> cannot size region %s\n", path);
+        close(fd);
+        return -1;
+    }
+    uint8_t* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "[-] ERROR-> cannot map region %s\n", path);
+        return -1;
+    }
+
+    bus->shm[bus->nshm++] = (SHM){ .base = base, .size = size, .mem = mem, .doorbell = doorbell };
+    return 0;
+}
+
+SHM* shm_find(BUS* bus, uint64_t addr, uint64_t len) {
+    for (uint32_t i = 0; i < bus->nshm; i++) {
+        SHM* s = &bus->shm[i];
+        if (addr < s->base)
+            continue;
+        uint64_t off = addr - s->base;
+        // wholly in the mapping, or wholly in the doorbell, never across
+        if (off < s->size)
+            return len <= s->size - off ? s : NULL;
+        if (s->doorbell >= 0 && off - s->size < SHM_DOORBELL
+                && len <= SHM_DOORBELL - (off - s->size))
+            return s;
+    }
+    return NULL;
+}
+
+// Single host accesses (the guest is little-endian like the hosts we run
+// on), so an aligned guest store reaches a polling host tool in one piece
+uint64_t shm_load(SHM* shm, uint64_t addr, uint64_t size) {
+    uint64_t off = addr - shm->base;
+    if (off >= shm->size)
+        return 0;                   // the doorbell reads as zero
+    switch (size) {
+        case 8:  return shm->mem[off];
+        case 16: { uint16_t v; memcpy(&v, shm->mem + off, 2); return v; }
+        case 32: { uint32_t v; memcpy(&v, shm->mem + off, 4); return v; }
+        case 64: { uint64_t v; memcpy(&v, shm->mem + off, 8); return v; }
+        default: return 0;
+    }
+}
+
+void shm_store(SHM* shm, uint64_t addr, uint64_t size, uint64_t value) {
+    uint64_t off = addr - shm->base;
+    if (off >= shm->size) {
+        // eventfd counters take any value but zero, a zero store still rings
+        uint64_t n = value ? value : 1;
+        if (write(shm->doorbell, &n, sizeof(n)) != sizeof(n))
+            fprintf(stderr, "[-] ERROR-> doorbell write failed\n");
+        return;
+    }
+    switch (size) {
+        case 8:  shm->mem[off] = value; break;
+        case 16: { uint16_t v = value; memcpy(shm->mem + off, &v, 2); break; }
+        case 32: { uint32_t v = value; memcpy(shm->mem + off, &v, 4); break; }
+        case 64: memcpy(shm->mem + off, &value, 8); break;
+        default: ;
+    }
+}
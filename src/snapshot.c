@@ -0,0 +1,212 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "../includes/snapshot.h"
+#include "../includes/csr.h"
+
+#define PAGE_ALIGN(x)   (((x) + DRAM_PAGE_SIZE - 1) & ~(uint64_t)(DRAM_PAGE_SIZE - 1))
+
+// Hart state as stored on disk
+typedef struct SNAPSHOT_CPU {
+    uint64_t regs[32];
+    uint64_t pc;
+    uint64_t csr[4096];
+    struct VPU vpu;
+    uint64_t instret;           // the guest's clocks run on from here
+    uint64_t icount;
+    uint64_t clock_ns;          // host ns since the run's time 0
+} SNAPSHOT_CPU;
+
+static uint64_t host_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_all(int fd, const void* buf, uint64_t len, uint64_t off) {
+    const uint8_t* p = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n <= 0)
+            return -1;
+        p += n; len -= n; off += n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void* buf, uint64_t len, uint64_t off) {
+    uint8_t* p = buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, off);
+        if (n <= 0)
+            return -1;
+        p += n; len -= n; off += n;
+    }
+    return 0;
+}
+
+int snapshot_save(CPU* cpu, const char* path, int full) {
+    DRAM* dram = &cpu->bus.dram;
+    SNAPSHOT_HEADER h;
+    SNAPSHOT_CPU* state;
+    uint32_t* index = NULL;
+    char tmp[4096];
+    int err = 0;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.version      = SNAPSHOT_VERSION;
+    h.flags        = full ? SNAPSHOT_FULL : 0;
+    h.dram_base    = dram->base;
+    h.dram_size    = dram->size;
+    h.page_size    = DRAM_PAGE_SIZE;
+    h.cpu_offset   = DRAM_PAGE_SIZE;
+    h.cpu_size     = sizeof(SNAPSHOT_CPU);
+
+    uint64_t off = PAGE_ALIGN(h.cpu_offset + h.cpu_size);
+    if (full) {
+        h.npages = dram->pages;
+    } else {
+        index = malloc(dram->pages * sizeof(uint32_t));
+        if (!index) {
+            fprintf(stderr, "Memory error!");
+            return -1;
+        }
+        for (uint32_t page = 0; page < dram->pages; page++)
+            if (dram->dirty[page / 64] & (1ULL << (page % 64)))
+                index[h.npages++] = page;
+        h.index_offset = off;
+        off = PAGE_ALIGN(off + h.npages * sizeof(uint32_t));
+    }
+    h.ram_offset = off;
+
+    state = malloc(sizeof(SNAPSHOT_CPU));
+    if (!state) {
+        fprintf(stderr, "Memory error!");
+        free(index);
+        return -1;
+    }
+    memcpy(state->regs, cpu->regs, sizeof(state->regs));
+    state->pc = cpu->pc;
+    memcpy(state->csr, cpu->csr, sizeof(state->csr));
+    state->vpu = cpu->vpu;
+    state->instret = cpu->stats.instret;
+    state->icount = cpu->icount;
+    state->clock_ns = host_now() - cpu->clock_origin;
+
+    // written aside and renamed, a restored machine may still map the old file
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "[-] ERROR-> cannot create snapshot %s\n", path);
+        free(state);
+        free(index);
+        return -1;
+    }
+
+    err |= write_all(fd, &h, sizeof(h), 0);
+    err |= write_all(fd, state, sizeof(SNAPSHOT_CPU), h.cpu_offset);
+    if (full) {
+        err |= write_all(fd, dram->mem, dram->size, h.ram_offset);
+    } else {
+        err |= write_all(fd, index, h.npages * sizeof(uint32_t), h.index_offset);
+        for (uint64_t i = 0; i < h.npages && !err; i++)
+            err |= write_all(fd, dram->mem + ((uint64_t)index[i] << DRAM_PAGE_SHIFT),
+                             DRAM_PAGE_SIZE, h.ram_offset + i * DRAM_PAGE_SIZE);
+    }
+    err |= close(fd);
+    if (!err)
+        err = rename(tmp, path);
+    free(state);
+    free(index);
+
+    if (err) {
+        fprintf(stderr, "[-] ERROR-> failed writing snapshot %s\n", path);
+        unlink(tmp);
+        return -1;
+    }
+    memset(dram->dirty, 0, (dram->pages + 63) / 64 * sizeof(uint64_t));
+    return 0;
+}
+
+int snapshot_restore(CPU* cpu, const char* path) {
+    DRAM* dram = &cpu->bus.dram;
+    SNAPSHOT_HEADER h;
+    SNAPSHOT_CPU* state = NULL;
+    uint32_t* index = NULL;
+    int err = -1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "[-] ERROR-> cannot open snapshot %s\n", path);
+        return -1;
+    }
+
+    if (read_all(fd, &h, sizeof(h), 0) < 0
+            || memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0
+            || h.version != SNAPSHOT_VERSION
+            || h.page_size != DRAM_PAGE_SIZE
+            || h.cpu_size != sizeof(SNAPSHOT_CPU)
+            || (h.dram_size & (DRAM_PAGE_SIZE - 1))
+            || h.npages > (h.dram_size >> DRAM_PAGE_SHIFT)) {
+        fprintf(stderr, "[-] ERROR-> %s is not a compatible snapshot\n", path);
+        goto out;
+    }
+
+    state = malloc(sizeof(SNAPSHOT_CPU));
+    if (!state || read_all(fd, state, sizeof(SNAPSHOT_CPU), h.cpu_offset) < 0)
+        goto bad;
+
+    // take on the snapshot's memory layout
+    if (h.dram_base != dram->base || h.dram_size != dram->size) {
+        dram_free(dram);
+        dram_init(dram, h.dram_base, h.dram_size);
+    }
+
+    if (h.flags & SNAPSHOT_FULL) {
+        if (dram_map_file(dram, dram->base, dram->size, fd, h.ram_offset) < 0)
+            goto bad;
+    } else {
+        index = malloc(h.npages * sizeof(uint32_t) + 1);
+        if (!index || read_all(fd, index, h.npages * sizeof(uint32_t), h.index_offset) < 0)
+            goto bad;
+        for (uint64_t i = 0; i < h.npages; i++) {
+            if (index[i] >= dram->pages
+                    || dram_map_file(dram, dram->base + ((uint64_t)index[i] << DRAM_PAGE_SHIFT),
+                                     DRAM_PAGE_SIZE, fd, h.ram_offset + i * DRAM_PAGE_SIZE) < 0)
+                goto bad;
+        }
+    }
+
+    memcpy(cpu->regs, state->regs, sizeof(cpu->regs));
+    cpu->pc = state->pc;
+    memcpy(cpu->csr, state->csr, sizeof(cpu->csr));
+    cpu->vpu = state->vpu;
+    // time, cycle and instret continue rather than restart; -I on the
+    // command line wins over the snapshot's rate
+    cpu->stats.instret = state->instret;
+    if (!cpu->icount)
+        cpu->icount = state->icount;
+    cpu->clock_origin = host_now() - state->clock_ns;
+    // misa carries the guest's width, snapshots from before RV32 have none and are RV64
+    cpu_set_xlen(cpu, ((cpu->csr[MISA] >> 30) & 3) == 1 ? 32 : 64);
+
+    // nothing decoded survives, and the restored image is the new checkpoint base
+    block_flush(&cpu->blocks);
+    memset(dram->code, 0, (dram->pages + 63) / 64 * sizeof(uint64_t));
+    memset(dram->dirty, 0, (dram->pages + 63) / 64 * sizeof(uint64_t));
+    err = 0;
+    goto out;
+
+bad:
+    fprintf(stderr, "[-] ERROR-> failed reading snapshot %s\n", path);
+out:
+    free(state);
+    free(index);
+    close(fd);
+    return err;
+}
@@ -0,0 +1,31 @@
+#include <stdio.h>
+#include "../includes/stats.h"
+
+static double hit_rate(uint64_t hits, uint64_t misses) {
+    return (hits + misses) ? 100.0 * hits / (hits + misses) : 0.0;
+}
+
+void stats_print(const STATS* stats, FILE* out) {
+    fprintf(out, "instructions retired : %lu\n", stats->instret);
+    fprintf(out, "blocks executed      : %lu\n", stats->blocks_executed);
+    fprintf(out, "blocks translated    : %lu\n", stats->blocks_translated);
+    fprintf(out, "blocks shared        : %lu\n", stats->blocks_shared);
+    fprintf(out, "blocks invalidated   : %lu\n", stats->blocks_invalidated);
+    fprintf(out, "blocks optimised     : %lu\n", stats->blocks_optimised);
+    fprintf(out, "cache flushes        : %lu\n", stats->cache_flushes);
+    fprintf(out, "return stack         : %lu hits, %lu misses (%.1f%%)\n",
+            stats->ras_hits, stats->ras_misses, hit_rate(stats->ras_hits, stats->ras_misses));
+    fprintf(out, "indirect targets     : %lu hits, %lu misses (%.1f%%)\n",
+            stats->ibtc_hits, stats->ibtc_misses, hit_rate(stats->ibtc_hits, stats->ibtc_misses));
+    fprintf(out, "sbi calls            : %lu\n", stats->sbi_calls);
+    for (int i = 0; i < FUSE_COUNT; i++)
+        fprintf(out, "fused %-14s : %lu\n", fuse_names[i], stats->fused[i]);
+    for (int i = 0; i < HOOK_COUNT; i++)
+        fprintf(out, "hooked %-13s : %lu\n", hook_names[i], stats->hooked[i]);
+    fprintf(out, "hook mismatches      : %lu\n", stats->hook_mismatches);
+    fprintf(out, "watch faults         : %lu\n", stats->watch_faults);
+    for (int i = 0; i < STATS_TRAPS; i++)
+        if (stats->traps[i])
+            fprintf(out, "traps, cause %-7d : %lu\n", i, stats->traps[i]);
+    fprintf(out, "wfi executed         : %lu\n", stats->wfi);
+}
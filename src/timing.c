@@ -0,0 +1,218 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/timing.h"
+
+#define LINE_SHIFT  6       // 64-byte lines
+#define PAGE_SHIFT  12
+
+//=====================================================================================
+//   Caches
+//=====================================================================================
+
+static void cache_geometry(CACHE* c, const char* name, uint64_t lines, uint32_t ways, uint32_t shift) {
+    c->name  = name;
+    c->ways  = ways;
+    c->sets  = lines / ways;
+    c->shift = shift;
+}
+
+static int cache_alloc(CACHE* c) {
+    if (c->ways == 0 || c->sets == 0 || (c->sets & (c->sets - 1))) {
+        fprintf(stderr, "[-] ERROR-> %s: set count must be a power of two\n", c->name);
+        return -1;
+    }
+    c->tags  = calloc((uint64_t) c->sets * c->ways, sizeof(uint64_t));
+    c->stamp = calloc((uint64_t) c->sets * c->ways, sizeof(uint64_t));
+    if (!c->tags || !c->stamp) {
+        fprintf(stderr, "Memory error!");
+        return -1;
+    }
+    return 0;
+}
+
+// Looks up the line holding addr, filling it on a miss. Returns 1 on a hit.
+static int cache_access(CACHE* c, uint64_t addr, int count) {
+    uint64_t line = (addr >> c->shift) + 1;
+    uint64_t* tags  = c->tags  + (line & (c->sets - 1)) * c->ways;
+    uint64_t* stamp = c->stamp + (line & (c->sets - 1)) * c->ways;
+    uint32_t victim = 0;
+
+    c->clock++;
+    for (uint32_t w = 0; w < c->ways; w++) {
+        if (tags[w] == line) {
+            stamp[w] = c->clock;
+            c->hits += count;
+            return 1;
+        }
+        if (stamp[w] < stamp[victim])
+            victim = w;
+    }
+    tags[victim] = line;
+    stamp[victim] = c->clock;
+    c->misses += count;
+    return 0;
+}
+
+//=====================================================================================
+//   Configuration
+//=====================================================================================
+
+static uint64_t parse_size(const char* s, char** end) {
+    uint64_t v = strtoull(s, end, 0);
+    if (**end == 'k' || **end == 'K') { v <<= 10; (*end)++; }
+    else if (**end == 'm' || **end == 'M') { v <<= 20; (*end)++; }
+    return v;
+}
+
+int timing_config(TIMING* t, const char* spec) {
+    memset(t, 0, sizeof(*t));
+    cache_geometry(&t->l1i, "l1i", (32 << 10) >> LINE_SHIFT, 8, LINE_SHIFT);
+    cache_geometry(&t->l1d, "l1d", (32 << 10) >> LINE_SHIFT, 8, LINE_SHIFT);
+    cache_geometry(&t->l2,  "l2",  (1 << 20) >> LINE_SHIFT, 16, LINE_SHIFT);
+    cache_geometry(&t->tlb, "tlb", 64, 4, PAGE_SHIFT);
+    t->l2_lat  = 12;
+    t->mem_lat = 100;
+    t->tlb_lat = 20;
+    if (!spec)
+        return 0;
+
+    char* list = strdup(spec);
+    int err = 0;
+    for (char* item = strtok(list, ","); item && !err; item = strtok(NULL, ",")) {
+        char* val = strchr(item, '=');
+        char* end;
+        if (!val) {
+            err = 1;
+            break;
+        }
+        *val++ = 0;
+        CACHE* c = !strcmp(item, "l1i") ? &t->l1i : !strcmp(item, "l1d") ? &t->l1d
+                 : !strcmp(item, "l2") ? &t->l2 : !strcmp(item, "tlb") ? &t->tlb : NULL;
+        if (c) {
+            uint64_t size = parse_size(val, &end);
+            uint32_t ways = (*end == '/') ? strtoul(end + 1, &end, 0) : 0;
+            if (*end || ways == 0)
+                err = 1;
+            else
+                cache_geometry(c, c->name, c == &t->tlb ? size : size >> LINE_SHIFT, ways, c->shift);
+        } else if (!strcmp(item, "l2lat")) {
+            t->l2_lat = strtoul(val, &end, 0);
+            err = *end != 0;
+        } else if (!strcmp(item, "memlat")) {
+            t->mem_lat = strtoul(val, &end, 0);
+            err = *end != 0;
+        } else if (!strcmp(item, "tlblat")) {
+            t->tlb_lat = strtoul(val, &end, 0);
+            err = *end != 0;
+        } else {
+            err = 1;
+        }
+    }
+    free(list);
+    if (err) {
+        fprintf(stderr, "[-] ERROR-> bad cache configuration %s\n", spec);
+        return -1;
+    }
+    return 0;
+}
+
+static void timing_enter(TIMING* t, int phase, uint64_t start) {
+    uint64_t len = (phase == TIMING_FAST) ? t->ff : (phase == TIMING_WARM) ? t->warm : t->detail;
+    t->phase = phase;
+    t->phase_end = start + len;
+    if (phase == TIMING_DETAIL)
+        t->samples++;
+}
+
+int timing_init(TIMING* t, const char* sampling) {
+    char* end;
+    t->ff = strtoull(sampling, &end, 0);
+    if (*end == ':') t->warm = strtoull(end + 1, &end, 0);
+    if (*end == ':') t->detail = strtoull(end + 1, &end, 0);
+    if (*end || (t->ff && !t->detail)) {
+        fprintf(stderr, "[-] ERROR-> sampling must be ff:warm:detail or 0\n");
+        return -1;
+    }
+    if (cache_alloc(&t->l1i) < 0 || cache_alloc(&t->l1d) < 0
+            || cache_alloc(&t->l2) < 0 || cache_alloc(&t->tlb) < 0)
+        return -1;
+
+    if (t->ff == 0) {
+        t->phase = TIMING_DETAIL;       // no sampling, the whole run in detail
+        t->phase_end = UINT64_MAX;
+        t->samples = 1;
+    } else {
+        timing_enter(t, TIMING_FAST, 0);
+    }
+    return 0;
+}
+
+//=====================================================================================
+//   Accesses
+//=====================================================================================
+
+// One line through L1 (and L2 on a miss), returns the cycles it added
+static uint32_t timing_line(TIMING* t, CACHE* l1, uint64_t addr, int count) {
+    uint32_t cycles = 0;
+    if (!cache_access(&t->tlb, addr, count))
+        cycles += t->tlb_lat;
+    if (!cache_access(l1, addr, count)) {
+        cycles += t->l2_lat;
+        if (!cache_access(&t->l2, addr, count))
+            cycles += t->mem_lat;
+    }
+    return cycles;
+}
+
+void timing_data(TIMING* t, uint64_t addr, uint64_t len) {
+    int count = t->phase == TIMING_DETAIL;
+    uint64_t last = (addr + (len ? len : 1) - 1) >> LINE_SHIFT;
+    for (uint64_t line = addr >> LINE_SHIFT; line <= last; line++) {
+        uint32_t cycles = timing_line(t, &t->l1d, line << LINE_SHIFT, count);
+        if (count)
+            t->cycles += cycles;
+    }
+}
+
+void timing_block(TIMING* t, uint64_t pc, uint32_t count, uint64_t instret) {
+    // phase boundaries fall between blocks
+    while (instret - count >= t->phase_end) {
+        switch (t->phase) {
+            case TIMING_FAST:   timing_enter(t, TIMING_WARM, t->phase_end); break;
+            case TIMING_WARM:   timing_enter(t, TIMING_DETAIL, t->phase_end); break;
+            default:            timing_enter(t, TIMING_FAST, t->phase_end); break;
+        }
+    }
+    if (t->phase == TIMING_FAST)
+        return;
+
+    int detail = t->phase == TIMING_DETAIL;
+    uint64_t last = (pc + 4 * (uint64_t) count - 1) >> LINE_SHIFT;
+    for (uint64_t line = pc >> LINE_SHIFT; line <= last; line++) {
+        uint32_t cycles = timing_line(t, &t->l1i, line << LINE_SHIFT, detail);
+        if (detail)
+            t->cycles += cycles;
+    }
+    if (detail) {
+        t->insns += count;
+        t->cycles += count;
+    }
+}
+
+static void cache_print(const CACHE* c, FILE* out) {
+    uint64_t n = c->hits + c->misses;
+    fprintf(out, "%-20s : %lu hits, %lu misses (%.2f%% miss)\n", c->name,
+            c->hits, c->misses, n ? 100.0 * c->misses / n : 0.0);
+}
+
+void timing_print(const TIMING* t, FILE* out) {
+    fprintf(out, "detailed samples     : %lu, %lu instructions\n", t->samples, t->insns);
+    fprintf(out, "estimated cycles     : %lu\n", t->cycles);
+    fprintf(out, "estimated CPI        : %.3f\n", t->insns ? (double) t->cycles / t->insns : 0.0);
+    cache_print(&t->l1i, out);
+    cache_print(&t->l1d, out);
+    cache_print(&t->l2, out);
+    cache_print(&t->tlb, out);
+}
@@ -0,0 +1,571 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <elf.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <sys/utsname.h>
+#include "../includes/user.h"
+#include "../includes/loader.h"
+#include "../includes/replay.h"
+#include "../includes/csr.h"
+
+#define PAGE_UP(x)  (((x) + DRAM_PAGE_SIZE - 1) & ~(uint64_t)(DRAM_PAGE_SIZE - 1))
+
+// riscv64 syscall numbers (asm-generic)
+#define RV_SYS_getcwd           17
+#define RV_SYS_dup              23
+#define RV_SYS_dup3             24
+#define RV_SYS_fcntl            25
+#define RV_SYS_ioctl            29
+#define RV_SYS_mkdirat          34
+#define RV_SYS_unlinkat         35
+#define RV_SYS_faccessat        48
+#define RV_SYS_chdir            49
+#define RV_SYS_openat           56
+#define RV_SYS_close            57
+#define RV_SYS_lseek            62
+#define RV_SYS_read             63
+#define RV_SYS_write            64
+#define RV_SYS_readv            65
+#define RV_SYS_writev           66
+#define RV_SYS_pread64          67
+#define RV_SYS_pwrite64         68
+#define RV_SYS_readlinkat       78
+#define RV_SYS_newfstatat       79
+#define RV_SYS_fstat            80
+#define RV_SYS_exit             93
+#define RV_SYS_exit_group       94
+#define RV_SYS_set_tid_address  96
+#define RV_SYS_futex            98
+#define RV_SYS_set_robust_list  99
+#define RV_SYS_clock_gettime    113
+#define RV_SYS_sched_yield      124
+#define RV_SYS_sigaltstack      132
+#define RV_SYS_rt_sigaction     134
+#define RV_SYS_rt_sigprocmask   135
+#define RV_SYS_uname            160
+#define RV_SYS_getrusage        165
+#define RV_SYS_gettimeofday     169
+#define RV_SYS_getpid           172
+#define RV_SYS_getppid          173
+#define RV_SYS_getuid           174
+#define RV_SYS_geteuid          175
+#define RV_SYS_getgid           176
+#define RV_SYS_getegid          177
+#define RV_SYS_gettid           178
+#define RV_SYS_brk              214
+#define RV_SYS_munmap           215
+#define RV_SYS_mmap             222
+#define RV_SYS_mprotect         226
+#define RV_SYS_madvise          233
+#define RV_SYS_prlimit64        261
+#define RV_SYS_getrandom        278
+
+// struct stat as laid out by the riscv64 kernel
+typedef struct RV_STAT {
+    uint64_t dev;
+    uint64_t ino;
+    uint32_t mode;
+    uint32_t nlink;
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t rdev;
+    uint64_t pad1;
+    int64_t  size;
+    int32_t  blksize;
+    int32_t  pad2;
+    int64_t  blocks;
+    int64_t  atime_sec, atime_nsec;
+    int64_t  mtime_sec, mtime_nsec;
+    int64_t  ctime_sec, ctime_nsec;
+    uint32_t unused4, unused5;
+} RV_STAT;
+
+//=====================================================================================
+//   Loader
+//=====================================================================================
+
+static uint64_t push_bytes(CPU* cpu, uint64_t sp, const void* src, uint64_t len) {
+    sp -= len;
+    bus_store_bytes(&(cpu->bus), sp, len, src);
+    return sp;
+}
+
+int user_load(CPU* cpu, const char* path, int argc, char** argv, char** envp) {
+    ELF_FILE elf;
+    if (elf_open(&elf, path) < 0)
+        return -1;
+    if (elf.elf_class != ELFCLASS64 || elf.hi - elf.lo > USER_MEM_SIZE / 2) {
+        fprintf(stderr, "[-] ERROR-> %s: need an RV64 image smaller than %llu MiB\n",
+                path, USER_MEM_SIZE / 2 >> 20);
+        elf_close(&elf);
+        return -1;
+    }
+
+    // guest memory starts at the image, the stack sits at the very top
+    DRAM* dram = &cpu->bus.dram;
+    dram_free(dram);
+    dram_init(dram, elf.lo, USER_MEM_SIZE);
+    if (elf_load(&elf, &(cpu->bus)) < 0) {
+        elf_close(&elf);
+        return -1;
+    }
+
+    USER* user = calloc(1, sizeof(USER));
+    if (!user) {
+        fprintf(stderr, "Memory error!");
+        exit(1);
+    }
+    user->brk_start = user->brk = elf.hi;
+    user->stack_lo  = dram->base + dram->size - USER_STACK_SIZE;
+    user->mmap_base = user->stack_lo;
+    cpu->user = user;
+
+    // strings first, then the argc/argv/envp/auxv vector below them
+    int envc = 0;
+    while (envp && envp[envc])
+        envc++;
+    uint64_t* argv_addr = malloc((argc + envc + 1) * sizeof(uint64_t));
+    if (!argv_addr) {
+        fprintf(stderr, "Memory error!");
+        exit(1);
+    }
+    uint64_t sp = dram->base + dram->size;
+    for (int i = 0; i < argc; i++)
+        sp = argv_addr[i] = push_bytes(cpu, sp, argv[i], strlen(argv[i]) + 1);
+    for (int i = 0; i < envc; i++)
+        sp = argv_addr[argc + i] = push_bytes(cpu, sp, envp[i], strlen(envp[i]) + 1);
+    uint8_t random[16];
+    for (int i = 0; i < 16; i++)
+        random[i] = rand();
+    uint64_t at_random = sp = push_bytes(cpu, sp & ~(uint64_t)15, random, sizeof(random));
+
+    uint64_t auxv[][2] = {
+        { AT_PHDR,   elf.phdr },
+        { AT_PHENT,  elf.phentsize },
+        { AT_PHNUM,  elf.phnum },
+        { AT_PAGESZ, DRAM_PAGE_SIZE },
+        { AT_BASE,   0 },
+        { AT_FLAGS,  0 },
+        { AT_ENTRY,  elf.entry },
+        { AT_UID,    getuid() },
+        { AT_EUID,   geteuid() },
+        { AT_GID,    getgid() },
+        { AT_EGID,   getegid() },
+        { AT_HWCAP,  (1 << ('I' - 'A')) | (1 << ('M' - 'A')) | (1 << ('A' - 'A')) },
+        { AT_CLKTCK, 100 },
+        { AT_SECURE, 0 },
+        { AT_RANDOM, at_random },
+        { AT_NULL,   0 },
+    };
+    uint64_t naux = sizeof(auxv) / sizeof(auxv[0]);
+    uint64_t words = 1 + (argc + 1) + (envc + 1) + 2 * naux;
+    sp = (sp - words * 8) & ~(uint64_t)15;
+
+    uint64_t p = sp;
+    bus_store(&(cpu->bus), p, 64, argc); p += 8;
+    for (int i = 0; i < argc; i++, p += 8)
+        bus_store(&(cpu->bus), p, 64, argv_addr[i]);
+    bus_store(&(cpu->bus), p, 64, 0); p += 8;
+    for (int i = 0; i < envc; i++, p += 8)
+        bus_store(&(cpu->bus), p, 64, argv_addr[argc + i]);
+    bus_store(&(cpu->bus), p, 64, 0); p += 8;
+    for (uint64_t i = 0; i < naux; i++, p += 16) {
+        bus_store(&(cpu->bus), p, 64, auxv[i][0]);
+        bus_store(&(cpu->bus), p + 8, 64, auxv[i][1]);
+    }
+    free(argv_addr);
+
+    memset(cpu->regs, 0, sizeof(cpu->regs));
+    cpu->regs[2] = sp;
+    cpu->pc = elf.entry;
+    elf_close(&elf);
+
+    // the stack holds the host's environment, replay takes the recorded one
+    uint64_t top = dram->base + dram->size;
+    if (cpu->replay.mode == REPLAY_RECORD) {
+        cpu->regs[10] = sp;
+        replay_region(&cpu->replay, sp, top - sp);
+        replay_record(cpu, REPLAY_START, 0);
+        cpu->regs[10] = 0;
+    } else if (cpu->replay.mode == REPLAY_PLAY) {
+        memset(dram->mem + (user->stack_lo - dram->base), 0, top - user->stack_lo);
+        if (replay_play(cpu, REPLAY_START, 0) < 0)
+            return -1;
+        cpu->regs[2] = cpu->regs[10];
+        cpu->regs[10] = cpu->regs[11] = 0;
+    }
+    return 0;
+}
+
+//=====================================================================================
+//   Syscalls
+//=====================================================================================
+
+// Host address of guest [addr, addr + len), NULL unless it is all guest RAM
+static void* guest_ptr(CPU* cpu, uint64_t addr, uint64_t len) {
+    DRAM* dram = &cpu->bus.dram;
+    if (!dram_contains(dram, addr, len))
+        return NULL;
+    return dram->mem + (addr - dram->base);
+}
+
+// Guest buffer the host is about to write into
+static void* guest_out(CPU* cpu, uint64_t addr, uint64_t len) {
+    void* p = guest_ptr(cpu, addr, len);
+    if (p) {
+        dram_touch(&cpu->bus.dram, addr, len);
+        replay_region(&cpu->replay, addr, len);
+        if (cpu->bus.watch)
+            watch_access(cpu->bus.watch, addr, len, WATCH_WRITE);
+    }
+    return p;
+}
+
+static const char* guest_str(CPU* cpu, uint64_t addr) {
+    DRAM* dram = &cpu->bus.dram;
+    if (!dram_contains(dram, addr, 1))
+        return NULL;
+    const char* s = (const char*) dram->mem + (addr - dram->base);
+    if (!memchr(s, 0, dram->size - (addr - dram->base)))
+        return NULL;
+    return s;
+}
+
+static int64_t host_ret(int64_t r) {
+    return (r < 0) ? -errno : r;
+}
+
+// icount mode: every clock reads the instruction-driven time, from 0
+static uint64_t virtual_ns(CPU* cpu) {
+    return cpu_time(cpu) * (1000000000 / TIMEBASE_HZ);
+}
+
+static int64_t sys_iov(CPU* cpu, int fd, uint64_t iov_addr, uint64_t n, int write) {
+    if (n > IOV_MAX)
+        return -EINVAL;
+    struct iovec iov[n ? n : 1];
+    uint64_t* giov = guest_ptr(cpu, iov_addr, n * 16);
+    if (!giov)
+        return -EFAULT;
+    for (uint64_t i = 0; i < n; i++) {
+        iov[i].iov_len  = giov[2 * i + 1];
+        iov[i].iov_base = write ? guest_ptr(cpu, giov[2 * i], iov[i].iov_len)
+                                : guest_out(cpu, giov[2 * i], iov[i].iov_len);
+        if (!iov[i].iov_base && iov[i].iov_len)
+            return -EFAULT;
+    }
+    return host_ret(write ? writev(fd, iov, n) : readv(fd, iov, n));
+}
+
+static int64_t sys_stat(CPU* cpu, int64_t r, struct stat* st, uint64_t addr) {
+    if (r < 0)
+        return -errno;
+    RV_STAT* out = guest_out(cpu, addr, sizeof(RV_STAT));
+    if (!out)
+        return -EFAULT;
+    memset(out, 0, sizeof(RV_STAT));
+    out->dev        = st->st_dev;
+    out->ino        = st->st_ino;
+    out->mode       = st->st_mode;
+    out->nlink      = st->st_nlink;
+    out->uid        = st->st_uid;
+    out->gid        = st->st_gid;
+    out->rdev       = st->st_rdev;
+    out->size       = st->st_size;
+    out->blksize    = st->st_blksize;
+    out->blocks     = st->st_blocks;
+    out->atime_sec  = st->st_atim.tv_sec;
+    out->atime_nsec = st->st_atim.tv_nsec;
+    out->mtime_sec  = st->st_mtim.tv_sec;
+    out->mtime_nsec = st->st_mtim.tv_nsec;
+    out->ctime_sec  = st->st_ctim.tv_sec;
+    out->ctime_nsec = st->st_ctim.tv_nsec;
+    return 0;
+}
+
+static int64_t sys_brk(CPU* cpu, uint64_t addr) {
+    USER* user = cpu->user;
+    if (addr < user->brk_start || addr > user->mmap_base)
+        return user->brk;
+    if (addr > user->brk) {
+        // the range may have been handed out before, so clear it
+        memset(guest_out(cpu, user->brk, addr - user->brk), 0, addr - user->brk);
+    }
+    user->brk = addr;
+    return user->brk;
+}
+
+static int64_t sys_mmap(CPU* cpu, uint64_t addr, uint64_t len, int flags, int fd, uint64_t off) {
+    USER* user = cpu->user;
+    if (len == 0)
+        return -EINVAL;
+    len = PAGE_UP(len);
+    if (flags & MAP_FIXED) {
+        if (!guest_ptr(cpu, addr, len) || (addr & (DRAM_PAGE_SIZE - 1)))
+            return -ENOMEM;
+    } else {
+        if (user->mmap_base - user->brk < len)
+            return -ENOMEM;
+        addr = user->mmap_base - len;
+        user->mmap_base = addr;
+    }
+    uint8_t* p = guest_out(cpu, addr, len);
+    memset(p, 0, len);
+    if (!(flags & MAP_ANONYMOUS) && pread(fd, p, len, off) < 0)
+        return -errno;
+    return addr;
+}
+
+static int64_t sys_munmap(CPU* cpu, uint64_t addr, uint64_t len) {
+    USER* user = cpu->user;
+    // only the most recent mapping gives its space back
+    if (addr == user->mmap_base && addr + PAGE_UP(len) <= user->stack_lo)
+        user->mmap_base += PAGE_UP(len);
+    return 0;
+}
+
+// Calls whose result depends on the host, these are recorded and replayed.
+// The rest only touch emulator state and simply run again on replay.
+static int host_call(CPU* cpu, uint64_t nr) {
+    switch (nr) {
+        case RV_SYS_exit:
+        case RV_SYS_exit_group:
+        case RV_SYS_brk:
+        case RV_SYS_munmap:
+        case RV_SYS_futex:
+        case RV_SYS_set_robust_list:
+        case RV_SYS_sched_yield:
+        case RV_SYS_sigaltstack:
+        case RV_SYS_rt_sigaction:
+        case RV_SYS_rt_sigprocmask:
+        case RV_SYS_mprotect:
+        case RV_SYS_madvise:
+            return 0;
+        case RV_SYS_mmap:
+            return !(cpu->regs[13] & MAP_ANONYMOUS);
+        default:
+            return 1;
+    }
+}
+
+// Calls that return how many bytes of their buffers they filled
+static int fills_buffer(uint64_t nr) {
+    return nr == RV_SYS_read || nr == RV_SYS_pread64 || nr == RV_SYS_readv
+        || nr == RV_SYS_readlinkat || nr == RV_SYS_getrandom;
+}
+
+static void user_replay(CPU* cpu, uint64_t nr) {
+    uint64_t* a = &cpu->regs[10];
+    if (nr == RV_SYS_mmap)              // same placement, the file data is in the log
+        sys_mmap(cpu, a[0], a[1], a[3] | MAP_ANONYMOUS, -1, 0);
+    void* p = guest_ptr(cpu, a[1], a[2]);
+    if (nr == RV_SYS_write && (a[0] == 1 || a[0] == 2) && p) {
+        FILE* out = (a[0] == 1) ? stdout : stderr;      // console echo, the log has the result
+        fwrite(p, 1, a[2], out);
+        fflush(out);
+    }
+    if (replay_play(cpu, REPLAY_SYSCALL, nr) < 0)
+        cpu->pc = 0;
+}
+
+void user_syscall(CPU* cpu) {
+    uint64_t* a = &cpu->regs[10];       // a0-a5 arguments, a0 result
+    uint64_t nr = cpu->regs[17];        // a7 syscall number
+    int host = host_call(cpu, nr);
+    int64_t r;
+
+    if (host && cpu->replay.mode == REPLAY_PLAY) {
+        user_replay(cpu, nr);
+        return;
+    }
+    cpu->replay.nregions = 0;
+
+    switch (nr) {
+        case RV_SYS_read: {
+            void* p = guest_out(cpu, a[1], a[2]);
+            r = p ? host_ret(read(a[0], p, a[2])) : -EFAULT;
+            break;
+        }
+        case RV_SYS_write: {
+            void* p = guest_ptr(cpu, a[1], a[2]);
+            r = p ? host_ret(write(a[0], p, a[2])) : -EFAULT;
+            break;
+        }
+        case RV_SYS_pread64: {
+            void* p = guest_out(cpu, a[1], a[2]);
+            r = p ? host_ret(pread(a[0], p, a[2], a[3])) : -EFAULT;
+            break;
+        }
+        case RV_SYS_pwrite64: {
+            void* p = guest_ptr(cpu, a[1], a[2]);
+            r = p ? host_ret(pwrite(a[0], p, a[2], a[3])) : -EFAULT;
+            break;
+        }
+        case RV_SYS_readv:  r = sys_iov(cpu, a[0], a[1], a[2], 0); break;
+        case RV_SYS_writev: r = sys_iov(cpu, a[0], a[1], a[2], 1); break;
+        case RV_SYS_openat: {
+            const char* path = guest_str(cpu, a[1]);
+            r = path ? host_ret(openat(a[0], path, a[2], a[3])) : -EFAULT;
+            break;
+        }
+        case RV_SYS_close:  r = host_ret(close(a[0])); break;
+        case RV_SYS_lseek:  r = host_ret(lseek(a[0], a[1], a[2])); break;
+        case RV_SYS_dup:    r = host_ret(dup(a[0])); break;
+        case RV_SYS_dup3:   r = host_ret(dup3(a[0], a[1], a[2])); break;
+        case RV_SYS_fcntl:  r = host_ret(fcntl(a[0], a[1], a[2])); break;
+        case RV_SYS_ioctl:
+            // terminal queries only, so isatty() and line buffering work
+            if (a[1] == TCGETS || a[1] == TIOCGWINSZ) {
+                void* p = guest_out(cpu, a[2], 64);
+                r = p ? host_ret(ioctl(a[0], a[1], p)) : -EFAULT;
+            } else {
+                r = -ENOTTY;
+            }
+            break;
+        case RV_SYS_fstat: {
+            struct stat st;
+            r = sys_stat(cpu, fstat(a[0], &st), &st, a[1]);
+            break;
+        }
+        case RV_SYS_newfstatat: {
+            struct stat st;
+            const char* path = guest_str(cpu, a[1]);
+            r = path ? sys_stat(cpu, fstatat(a[0], path, &st, a[3]), &st, a[2]) : -EFAULT;
+            break;
+        }
+        case RV_SYS_faccessat: {
+            const char* path = guest_str(cpu, a[1]);
+            r = path ? host_ret(faccessat(a[0], path, a[2], 0)) : -EFAULT;
+            break;
+        }
+        case RV_SYS_readlinkat: {
+            const char* path = guest_str(cpu, a[1]);
+            void* p = guest_out(cpu, a[2], a[3]);
+            r = (path && p) ? host_ret(readlinkat(a[0], path, p, a[3])) : -EFAULT;
+            break;
+        }
+        case RV_SYS_unlinkat: {
+            const char* path = guest_str(cpu, a[1]);
+            r = path ? host_ret(unlinkat(a[0], path, a[2])) : -EFAULT;
+            break;
+        }
+        case RV_SYS_mkdirat: {
+            const char* path = guest_str(cpu, a[1]);
+            r = path ? host_ret(mkdirat(a[0], path, a[2])) : -EFAULT;
+            break;
+        }
+        case RV_SYS_chdir: {
+            const char* path = guest_str(cpu, a[0]);
+            r = path ? host_ret(chdir(path)) : -EFAULT;
+            break;
+        }
+        case RV_SYS_getcwd: {
+            char* p = guest_out(cpu, a[0], a[1]);
+            r = !p ? -EFAULT : getcwd(p, a[1]) ? (int64_t) strlen(p) + 1 : -errno;
+            break;
+        }
+        case RV_SYS_exit:
+        case RV_SYS_exit_group:
+            cpu->user->exit_code = a[0] & 0xff;
+            cpu->pc = 0;                // stops the run loop
+            r = 0;
+            break;
+        case RV_SYS_clock_gettime: {
+            struct timespec* ts = guest_out(cpu, a[1], sizeof(struct timespec));
+            if (ts && cpu->icount) {
+                uint64_t ns = virtual_ns(cpu);
+                ts->tv_sec = ns / 1000000000;
+                ts->tv_nsec = ns % 1000000000;
+                r = 0;
+            } else {
+                r = ts ? host_ret(clock_gettime(a[0], ts)) : -EFAULT;
+            }
+            break;
+        }
+        case RV_SYS_gettimeofday: {
+            struct timeval* tv = guest_out(cpu, a[0], sizeof(struct timeval));
+            if (tv && cpu->icount) {
+                uint64_t ns = virtual_ns(cpu);
+                tv->tv_sec = ns / 1000000000;
+                tv->tv_usec = ns % 1000000000 / 1000;
+                r = 0;
+            } else {
+                r = tv ? host_ret(gettimeofday(tv, NULL)) : -EFAULT;
+            }
+            break;
+        }
+        case RV_SYS_uname: {
+            struct utsname* u = guest_out(cpu, a[0], sizeof(struct utsname));
+            r = u ? host_ret(uname(u)) : -EFAULT;
+            if (r == 0)
+                strcpy(u->machine, "riscv64");
+            break;
+        }
+        case RV_SYS_getrandom: {
+            void* p = guest_out(cpu, a[0], a[1]);
+            r = p ? host_ret(getrandom(p, a[1], a[2])) : -EFAULT;
+            break;
+        }
+        case RV_SYS_prlimit64:
+            if (a[3]) {
+                struct rlimit* rl = guest_out(cpu, a[3], sizeof(struct rlimit));
+                r = rl ? host_ret(getrlimit(a[1], rl)) : -EFAULT;
+            } else {
+                r = 0;
+            }
+            break;
+        case RV_SYS_getrusage: {
+            struct rusage* ru = guest_out(cpu, a[1], sizeof(struct rusage));
+            r = ru ? host_ret(getrusage(a[0], ru)) : -EFAULT;
+            break;
+        }
+        case RV_SYS_brk:    r = sys_brk(cpu, a[0]); break;
+        case RV_SYS_mmap:   r = sys_mmap(cpu, a[0], a[1], a[3], a[4], a[5]); break;
+        case RV_SYS_munmap: r = sys_munmap(cpu, a[0], a[1]); break;
+        case RV_SYS_getpid:
+        case RV_SYS_gettid:
+        case RV_SYS_set_tid_address:
+            r = getpid();
+            break;
+        case RV_SYS_getppid: r = getppid(); break;
+        case RV_SYS_getuid:  r = getuid(); break;
+        case RV_SYS_geteuid: r = geteuid(); break;
+        case RV_SYS_getgid:  r = getgid(); break;
+        case RV_SYS_getegid: r = getegid(); break;
+        // single-threaded guest with no signal delivery, these succeed as no-ops
+        case RV_SYS_futex:
+        case RV_SYS_set_robust_list:
+        case RV_SYS_sched_yield:
+        case RV_SYS_sigaltstack:
+        case RV_SYS_rt_sigaction:
+        case RV_SYS_rt_sigprocmask:
+        case RV_SYS_mprotect:
+        case RV_SYS_madvise:
+            r = 0;
+            break;
+        default:
+            fprintf(stderr, "[-] unimplemented syscall %lu\n", nr);
+            r = -ENOSYS;
+    }
+    a[0] = r;
+
+    if (host && cpu->replay.mode == REPLAY_RECORD) {
+        if (fills_buffer(nr))
+            replay_clip(&cpu->replay, r > 0 ? r : 0);
+        replay_record(cpu, REPLAY_SYSCALL, nr);
+    }
+}
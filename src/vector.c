@@ -0,0 +1,1124 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "../includes/cpu.h"
+#include "../includes/csr.h"
+#include "../includes/opcodes.h"
+#include "../includes/vector.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VECTOR_X86
+#endif
+
+// Every vector instruction is executed by one call into a kernel that works on
+// a whole run of vl elements. The kernel tables start out with portable C
+// loops and vector_init() swaps in SSE/AVX2 versions when the host has them.
+
+#define VREG(cpu, r)    ((cpu)->vpu.v[r])
+#define VGROUP_BYTES    (8 * VLEN_BYTES)    // largest register group (LMUL=8)
+
+enum {
+    VOP_ADD, VOP_SUB, VOP_AND, VOP_OR, VOP_XOR,
+    VOP_SLL, VOP_SRL, VOP_SRA,
+    VOP_MINU, VOP_MIN, VOP_MAXU, VOP_MAX,
+    VOP_MUL, VOP_MULH, VOP_MULHU,
+    VOP_DIVU, VOP_DIV, VOP_REMU, VOP_REM,
+    VOP_FADD, VOP_FSUB, VOP_FMUL, VOP_FDIV, VOP_FMIN, VOP_FMAX,
+    VOP_COUNT
+};
+
+enum {
+    VCMP_EQ, VCMP_NE, VCMP_LTU, VCMP_LT, VCMP_LEU, VCMP_LE, VCMP_GTU, VCMP_GT,
+    VCMP_FEQ, VCMP_FNE, VCMP_FLT, VCMP_FLE,
+    VCMP_COUNT
+};
+
+enum {
+    VRED_SUM, VRED_AND, VRED_OR, VRED_XOR,
+    VRED_MINU, VRED_MIN, VRED_MAXU, VRED_MAX,
+    VRED_FSUM, VRED_FOSUM, VRED_FMIN, VRED_FMAX,
+    VRED_COUNT
+};
+
+// vd[i] = vs2[i] op vs1[i] for i < n
+typedef void (*vbinop_fn)(void* vd, const void* vs2, const void* vs1, size_t n);
+// bit i of vd = vs2[i] cmp vs1[i] for i < n
+typedef void (*vcmp_fn)(uint8_t* vd, const void* vs2, const void* vs1, size_t n);
+// acc = acc op vs2[i] for i < n
+typedef uint64_t (*vred_fn)(const void* vs2, size_t n, uint64_t acc);
+
+//=====================================================================================
+// Portable kernels
+//=====================================================================================
+
+// element expressions, x = vs2[i] and y = vs1[i]
+#define E_ADD(U,S,B)    (x + y)
+#define E_SUB(U,S,B)    (x - y)
+#define E_AND(U,S,B)    (x & y)
+#define E_OR(U,S,B)     (x | y)
+#define E_XOR(U,S,B)    (x ^ y)
+#define E_SLL(U,S,B)    (x << (y & (B - 1)))
+#define E_SRL(U,S,B)    (x >> (y & (B - 1)))
+#define E_SRA(U,S,B)    ((S)x >> (y & (B - 1)))
+#define E_MINU(U,S,B)   (x < y ? x : y)
+#define E_MIN(U,S,B)    ((S)x < (S)y ? x : y)
+#define E_MAXU(U,S,B)   (x > y ? x : y)
+#define E_MAX(U,S,B)    ((S)x > (S)y ? x : y)
+#define E_MUL(U,S,B)    ((uint64_t)x * (uint64_t)y)
+#define E_MULH(U,S,B)   (((__int128)(S)x * (__int128)(S)y) >> B)
+#define E_MULHU(U,S,B)  (((unsigned __int128)x * (unsigned __int128)y) >> B)
+#define E_DIVU(U,S,B)   (y == 0 ? (U)~(U)0 : x / y)
+#define E_DIV(U,S,B)    (y == 0 ? (U)~(U)0 : \
+                        ((S)y == -1 && x == (U)((U)1 << (B - 1))) ? x : (U)((S)x / (S)y))
+#define E_REMU(U,S,B)   (y == 0 ? x : x % y)
+#define E_REM(U,S,B)    (y == 0 ? x : (S)y == -1 ? 0 : (U)((S)x % (S)y))
+
+#define E_EQ(U,S,B)     (x == y)
+#define E_NE(U,S,B)     (x != y)
+#define E_LTU(U,S,B)    (x < y)
+#define E_LT(U,S,B)     ((S)x < (S)y)
+#define E_LEU(U,S,B)    (x <= y)
+#define E_LE(U,S,B)     ((S)x <= (S)y)
+#define E_GTU(U,S,B)    (x > y)
+#define E_GT(U,S,B)     ((S)x > (S)y)
+
+#define SCALAR_BINOP(name, U, S, B, E)                                      \
+static void name(void* vd, const void* va, const void* vb, size_t n) {      \
+    U* d = vd; const U* a = va; const U* b = vb;                            \
+    for (size_t i = 0; i < n; i++) {                                        \
+        U x = a[i], y = b[i];                                               \
+        d[i] = (U)(E(U,S,B));                                               \
+    }                                                                       \
+}
+
+#define SCALAR_CMP(name, U, S, B, E)                                        \
+static void name(uint8_t* m, const void* va, const void* vb, size_t n) {    \
+    const U* a = va; const U* b = vb;                                       \
+    for (size_t i = 0; i < n; i++) {                                        \
+        U x = a[i], y = b[i];                                               \
+        if (E(U,S,B)) m[i >> 3] |= (uint8_t)(1 << (i & 7));                 \
+        else          m[i >> 3] &= (uint8_t)~(1 << (i & 7));                \
+    }                                                                       \
+}
+
+#define SCALAR_RED(name, U, S, B, E)                                        \
+static uint64_t name(const void* va, size_t n, uint64_t acc) {              \
+    const U* a = va; U r = (U)acc;                                          \
+    for (size_t i = 0; i < n; i++) {                                        \
+        U x = r, y = a[i];                                                  \
+        r = (U)(E(U,S,B));                                                  \
+    }                                                                       \
+    return r;                                                               \
+}
+
+#define DEF_INT(KIND, name, E)                                              \
+    KIND(name##_8,  uint8_t,  int8_t,   8, E)                               \
+    KIND(name##_16, uint16_t, int16_t, 16, E)                               \
+    KIND(name##_32, uint32_t, int32_t, 32, E)                               \
+    KIND(name##_64, uint64_t, int64_t, 64, E)
+
+DEF_INT(SCALAR_BINOP, vadd,   E_ADD)
+DEF_INT(SCALAR_BINOP, vsub,   E_SUB)
+DEF_INT(SCALAR_BINOP, vand,   E_AND)
+DEF_INT(SCALAR_BINOP, vor,    E_OR)
+DEF_INT(SCALAR_BINOP, vxor,   E_XOR)
+DEF_INT(SCALAR_BINOP, vsll,   E_SLL)
+DEF_INT(SCALAR_BINOP, vsrl,   E_SRL)
+DEF_INT(SCALAR_BINOP, vsra,   E_SRA)
+DEF_INT(SCALAR_BINOP, vminu,  E_MINU)
+DEF_INT(SCALAR_BINOP, vmin,   E_MIN)
+DEF_INT(SCALAR_BINOP, vmaxu,  E_MAXU)
+DEF_INT(SCALAR_BINOP, vmax,   E_MAX)
+DEF_INT(SCALAR_BINOP, vmul,   E_MUL)
+DEF_INT(SCALAR_BINOP, vmulh,  E_MULH)
+DEF_INT(SCALAR_BINOP, vmulhu, E_MULHU)
+DEF_INT(SCALAR_BINOP, vdivu,  E_DIVU)
+DEF_INT(SCALAR_BINOP, vdiv,   E_DIV)
+DEF_INT(SCALAR_BINOP, vremu,  E_REMU)
+DEF_INT(SCALAR_BINOP, vrem,   E_REM)
+
+DEF_INT(SCALAR_CMP, vmseq,  E_EQ)
+DEF_INT(SCALAR_CMP, vmsne,  E_NE)
+DEF_INT(SCALAR_CMP, vmsltu, E_LTU)
+DEF_INT(SCALAR_CMP, vmslt,  E_LT)
+DEF_INT(SCALAR_CMP, vmsleu, E_LEU)
+DEF_INT(SCALAR_CMP, vmsle,  E_LE)
+DEF_INT(SCALAR_CMP, vmsgtu, E_GTU)
+DEF_INT(SCALAR_CMP, vmsgt,  E_GT)
+
+DEF_INT(SCALAR_RED, vredsum,  E_ADD)
+DEF_INT(SCALAR_RED, vredand,  E_AND)
+DEF_INT(SCALAR_RED, vredor,   E_OR)
+DEF_INT(SCALAR_RED, vredxor,  E_XOR)
+DEF_INT(SCALAR_RED, vredminu, E_MINU)
+DEF_INT(SCALAR_RED, vredmin,  E_MIN)
+DEF_INT(SCALAR_RED, vredmaxu, E_MAXU)
+DEF_INT(SCALAR_RED, vredmax,  E_MAX)
+
+// floating point kernels, F is float or double and U the same-sized integer
+#define SCALAR_FBINOP(name, F, expr)                                        \
+static void name(void* vd, const void* va, const void* vb, size_t n) {      \
+    F* d = vd; const F* a = va; const F* b = vb;                            \
+    for (size_t i = 0; i < n; i++) {                                        \
+        F x = a[i], y = b[i];                                               \
+        d[i] = (expr);                                                      \
+    }                                                                       \
+}
+
+#define SCALAR_FCMP(name, F, expr)                                          \
+static void name(uint8_t* m, const void* va, const void* vb, size_t n) {    \
+    const F* a = va; const F* b = vb;                                       \
+    for (size_t i = 0; i < n; i++) {                                        \
+        F x = a[i], y = b[i];                                               \
+        if (expr) m[i >> 3] |= (uint8_t)(1 << (i & 7));                     \
+        else      m[i >> 3] &= (uint8_t)~(1 << (i & 7));                    \
+    }                                                                       \
+}
+
+#define SCALAR_FRED(name, F, U, expr)                                       \
+static uint64_t name(const void* va, size_t n, uint64_t acc) {              \
+    const F* a = va; U bits = (U)acc; F r;                                  \
+    memcpy(&r, &bits, sizeof(F));                                           \
+    for (size_t i = 0; i < n; i++) {                                        \
+        F x = r, y = a[i];                                                  \
+        r = (expr);                                                         \
+    }                                                                       \
+    memcpy(&bits, &r, sizeof(F));                                           \
+    return bits;                                                            \
+}
+
+SCALAR_FBINOP(vfadd_32, float,  x + y)
+SCALAR_FBINOP(vfadd_64, double, x + y)
+SCALAR_FBINOP(vfsub_32, float,  x - y)
+SCALAR_FBINOP(vfsub_64, double, x - y)
+SCALAR_FBINOP(vfmul_32, float,  x * y)
+SCALAR_FBINOP(vfmul_64, double, x * y)
+SCALAR_FBINOP(vfdiv_32, float,  x / y)
+SCALAR_FBINOP(vfdiv_64, double, x / y)
+SCALAR_FBINOP(vfmin_32, float,  fminf(x, y))
+SCALAR_FBINOP(vfmin_64, double, fmin(x, y))
+SCALAR_FBINOP(vfmax_32, float,  fmaxf(x, y))
+SCALAR_FBINOP(vfmax_64, double, fmax(x, y))
+
+SCALAR_FCMP(vmfeq_32, float,  x == y)
+SCALAR_FCMP(vmfeq_64, double, x == y)
+SCALAR_FCMP(vmfne_32, float,  x != y)
+SCALAR_FCMP(vmfne_64, double, x != y)
+SCALAR_FCMP(vmflt_32, float,  x < y)
+SCALAR_FCMP(vmflt_64, double, x < y)
+SCALAR_FCMP(vmfle_32, float,  x <= y)
+SCALAR_FCMP(vmfle_64, double, x <= y)
+
+SCALAR_FRED(vfredsum_32, float,  uint32_t, x + y)
+SCALAR_FRED(vfredsum_64, double, uint64_t, x + y)
+SCALAR_FRED(vfredmin_32, float,  uint32_t, fminf(x, y))
+SCALAR_FRED(vfredmin_64, double, uint64_t, fmin(x, y))
+SCALAR_FRED(vfredmax_32, float,  uint32_t, fmaxf(x, y))
+SCALAR_FRED(vfredmax_64, double, uint64_t, fmax(x, y))
+
+#define INT_KERNELS(name)   { name##_8, name##_16, name##_32, name##_64 }
+#define FP_KERNELS(name)    { NULL, NULL, name##_32, name##_64 }
+
+static vbinop_fn vk_binop[VOP_COUNT][4] = {
+    [VOP_ADD]   = INT_KERNELS(vadd),
+    [VOP_SUB]   = INT_KERNELS(vsub),
+    [VOP_AND]   = INT_KERNELS(vand),
+    [VOP_OR]    = INT_KERNELS(vor),
+    [VOP_XOR]   = INT_KERNELS(vxor),
+    [VOP_SLL]   = INT_KERNELS(vsll),
+    [VOP_SRL]   = INT_KERNELS(vsrl),
+    [VOP_SRA]   = INT_KERNELS(vsra),
+    [VOP_MINU]  = INT_KERNELS(vminu),
+    [VOP_MIN]   = INT_KERNELS(vmin),
+    [VOP_MAXU]  = INT_KERNELS(vmaxu),
+    [VOP_MAX]   = INT_KERNELS(vmax),
+    [VOP_MUL]   = INT_KERNELS(vmul),
+    [VOP_MULH]  = INT_KERNELS(vmulh),
+    [VOP_MULHU] = INT_KERNELS(vmulhu),
+    [VOP_DIVU]  = INT_KERNELS(vdivu),
+    [VOP_DIV]   = INT_KERNELS(vdiv),
+    [VOP_REMU]  = INT_KERNELS(vremu),
+    [VOP_REM]   = INT_KERNELS(vrem),
+    [VOP_FADD]  = FP_KERNELS(vfadd),
+    [VOP_FSUB]  = FP_KERNELS(vfsub),
+    [VOP_FMUL]  = FP_KERNELS(vfmul),
+    [VOP_FDIV]  = FP_KERNELS(vfdiv),
+    [VOP_FMIN]  = FP_KERNELS(vfmin),
+    [VOP_FMAX]  = FP_KERNELS(vfmax),
+};
+
+static vcmp_fn vk_cmp[VCMP_COUNT][4] = {
+    [VCMP_EQ]   = INT_KERNELS(vmseq),
+    [VCMP_NE]   = INT_KERNELS(vmsne),
+    [VCMP_LTU]  = INT_KERNELS(vmsltu),
+    [VCMP_LT]   = INT_KERNELS(vmslt),
+    [VCMP_LEU]  = INT_KERNELS(vmsleu),
+    [VCMP_LE]   = INT_KERNELS(vmsle),
+    [VCMP_GTU]  = INT_KERNELS(vmsgtu),
+    [VCMP_GT]   = INT_KERNELS(vmsgt),
+    [VCMP_FEQ]  = FP_KERNELS(vmfeq),
+    [VCMP_FNE]  = FP_KERNELS(vmfne),
+    [VCMP_FLT]  = FP_KERNELS(vmflt),
+    [VCMP_FLE]  = FP_KERNELS(vmfle),
+};
+
+static vred_fn vk_red[VRED_COUNT][4] = {
+    [VRED_SUM]   = INT_KERNELS(vredsum),
+    [VRED_AND]   = INT_KERNELS(vredand),
+    [VRED_OR]    = INT_KERNELS(vredor),
+    [VRED_XOR]   = INT_KERNELS(vredxor),
+    [VRED_MINU]  = INT_KERNELS(vredminu),
+    [VRED_MIN]   = INT_KERNELS(vredmin),
+    [VRED_MAXU]  = INT_KERNELS(vredmaxu),
+    [VRED_MAX]   = INT_KERNELS(vredmax),
+    [VRED_FSUM]  = FP_KERNELS(vfredsum),
+    [VRED_FOSUM] = FP_KERNELS(vfredsum),    // always the ordered C loop
+    [VRED_FMIN]  = FP_KERNELS(vfredmin),
+    [VRED_FMAX]  = FP_KERNELS(vfredmax),
+};
+
+//=====================================================================================
+// Host SIMD kernels
+//=====================================================================================
+
+#ifdef VECTOR_X86
+
+// Processes whole host vectors, then hands the remaining tail to the C kernel
+#define SIMD_BINOP(name, attr, T, LOAD, STORE, OP, tail)                    \
+static attr void name(void* vd, const void* va, const void* vb, size_t n) { \
+    T* d = vd; const T* a = va; const T* b = vb;                            \
+    const size_t lanes = LANES / sizeof(T);                                 \
+    size_t i = 0;                                                           \
+    for (; i + lanes <= n; i += lanes)                                      \
+        STORE(d + i, OP(LOAD(a + i), LOAD(b + i)));                         \
+    if (i < n)                                                              \
+        tail(d + i, a + i, b + i, n - i);                                   \
+}
+
+#define SIMD_REDSUM(name, attr, T, VT, LOAD, ADD, ZERO)                     \
+static attr uint64_t name(const void* va, size_t n, uint64_t acc) {         \
+    const T* a = va;                                                        \
+    const size_t lanes = LANES / sizeof(T);                                 \
+    VT sum = ZERO();                                                        \
+    T part[LANES / sizeof(T)];                                              \
+    T r;                                                                    \
+    size_t i = 0;                                                           \
+    memcpy(&r, &acc, sizeof(T));                                            \
+    for (; i + lanes <= n; i += lanes)                                      \
+        sum = ADD(sum, LOAD(a + i));                                        \
+    memcpy(part, &sum, sizeof(part));                                       \
+    for (size_t k = 0; k < lanes; k++)                                      \
+        r += part[k];                                                       \
+    for (; i < n; i++)                                                      \
+        r += a[i];                                                          \
+    uint64_t bits = 0;                                                      \
+    memcpy(&bits, &r, sizeof(T));                                           \
+    return bits;                                                            \
+}
+
+#define SSE2        __attribute__((target("sse2")))
+#define SSE41       __attribute__((target("sse4.1")))
+#define AVX2        __attribute__((target("avx2")))
+
+// 128-bit kernels
+#define LANES 16
+#define LDI(p)      _mm_loadu_si128((const __m128i*)(p))
+#define STI(p, v)   _mm_storeu_si128((__m128i*)(p), v)
+#define LDPS(p)     _mm_loadu_ps(p)
+#define STPS(p, v)  _mm_storeu_ps(p, v)
+#define LDPD(p)     _mm_loadu_pd(p)
+#define STPD(p, v)  _mm_storeu_pd(p, v)
+
+SIMD_BINOP(sse2_vadd_8,   SSE2, uint8_t,  LDI, STI, _mm_add_epi8,  vadd_8)
+SIMD_BINOP(sse2_vadd_16,  SSE2, uint16_t, LDI, STI, _mm_add_epi16, vadd_16)
+SIMD_BINOP(sse2_vadd_32,  SSE2, uint32_t, LDI, STI, _mm_add_epi32, vadd_32)
+SIMD_BINOP(sse2_vadd_64,  SSE2, uint64_t, LDI, STI, _mm_add_epi64, vadd_64)
+SIMD_BINOP(sse2_vsub_8,   SSE2, uint8_t,  LDI, STI, _mm_sub_epi8,  vsub_8)
+SIMD_BINOP(sse2_vsub_16,  SSE2, uint16_t, LDI, STI, _mm_sub_epi16, vsub_16)
+SIMD_BINOP(sse2_vsub_32,  SSE2, uint32_t, LDI, STI, _mm_sub_epi32, vsub_32)
+SIMD_BINOP(sse2_vsub_64,  SSE2, uint64_t, LDI, STI, _mm_sub_epi64, vsub_64)
+SIMD_BINOP(sse2_vand_8,   SSE2, uint8_t,  LDI, STI, _mm_and_si128, vand_8)
+SIMD_BINOP(sse2_vand_16,  SSE2, uint16_t, LDI, STI, _mm_and_si128, vand_16)
+SIMD_BINOP(sse2_vand_32,  SSE2, uint32_t, LDI, STI, _mm_and_si128, vand_32)
+SIMD_BINOP(sse2_vand_64,  SSE2, uint64_t, LDI, STI, _mm_and_si128, vand_64)
+SIMD_BINOP(sse2_vor_8,    SSE2, uint8_t,  LDI, STI, _mm_or_si128,  vor_8)
+SIMD_BINOP(sse2_vor_16,   SSE2, uint16_t, LDI, STI, _mm_or_si128,  vor_16)
+SIMD_BINOP(sse2_vor_32,   SSE2, uint32_t, LDI, STI, _mm_or_si128,  vor_32)
+SIMD_BINOP(sse2_vor_64,   SSE2, uint64_t, LDI, STI, _mm_or_si128,  vor_64)
+SIMD_BINOP(sse2_vxor_8,   SSE2, uint8_t,  LDI, STI, _mm_xor_si128, vxor_8)
+SIMD_BINOP(sse2_vxor_16,  SSE2, uint16_t, LDI, STI, _mm_xor_si128, vxor_16)
+SIMD_BINOP(sse2_vxor_32,  SSE2, uint32_t, LDI, STI, _mm_xor_si128, vxor_32)
+SIMD_BINOP(sse2_vxor_64,  SSE2, uint64_t, LDI, STI, _mm_xor_si128, vxor_64)
+SIMD_BINOP(sse2_vmul_16,  SSE2, uint16_t, LDI, STI, _mm_mullo_epi16, vmul_16)
+SIMD_BINOP(sse2_vminu_8,  SSE2, uint8_t,  LDI, STI, _mm_min_epu8,  vminu_8)
+SIMD_BINOP(sse2_vmaxu_8,  SSE2, uint8_t,  LDI, STI, _mm_max_epu8,  vmaxu_8)
+SIMD_BINOP(sse2_vmin_16,  SSE2, uint16_t, LDI, STI, _mm_min_epi16, vmin_16)
+SIMD_BINOP(sse2_vmax_16,  SSE2, uint16_t, LDI, STI, _mm_max_epi16, vmax_16)
+SIMD_BINOP(sse2_vfadd_32, SSE2, float,    LDPS, STPS, _mm_add_ps,  vfadd_32)
+SIMD_BINOP(sse2_vfadd_64, SSE2, double,   LDPD, STPD, _mm_add_pd,  vfadd_64)
+SIMD_BINOP(sse2_vfsub_32, SSE2, float,    LDPS, STPS, _mm_sub_ps,  vfsub_32)
+SIMD_BINOP(sse2_vfsub_64, SSE2, double,   LDPD, STPD, _mm_sub_pd,  vfsub_64)
+SIMD_BINOP(sse2_vfmul_32, SSE2, float,    LDPS, STPS, _mm_mul_ps,  vfmul_32)
+SIMD_BINOP(sse2_vfmul_64, SSE2, double,   LDPD, STPD, _mm_mul_pd,  vfmul_64)
+SIMD_BINOP(sse2_vfdiv_32, SSE2, float,    LDPS, STPS, _mm_div_ps,  vfdiv_32)
+SIMD_BINOP(sse2_vfdiv_64, SSE2, double,   LDPD, STPD, _mm_div_pd,  vfdiv_64)
+
+SIMD_BINOP(sse41_vmul_32,  SSE41, uint32_t, LDI, STI, _mm_mullo_epi32, vmul_32)
+SIMD_BINOP(sse41_vmin_8,   SSE41, uint8_t,  LDI, STI, _mm_min_epi8,  vmin_8)
+SIMD_BINOP(sse41_vmax_8,   SSE41, uint8_t,  LDI, STI, _mm_max_epi8,  vmax_8)
+SIMD_BINOP(sse41_vminu_16, SSE41, uint16_t, LDI, STI, _mm_min_epu16, vminu_16)
+SIMD_BINOP(sse41_vmaxu_16, SSE41, uint16_t, LDI, STI, _mm_max_epu16, vmaxu_16)
+SIMD_BINOP(sse41_vmin_32,  SSE41, uint32_t, LDI, STI, _mm_min_epi32, vmin_32)
+SIMD_BINOP(sse41_vmax_32,  SSE41, uint32_t, LDI, STI, _mm_max_epi32, vmax_32)
+SIMD_BINOP(sse41_vminu_32, SSE41, uint32_t, LDI, STI, _mm_min_epu32, vminu_32)
+SIMD_BINOP(sse41_vmaxu_32, SSE41, uint32_t, LDI, STI, _mm_max_epu32, vmaxu_32)
+
+SIMD_REDSUM(sse2_vredsum_32,  SSE2, uint32_t, __m128i, LDI,  _mm_add_epi32, _mm_setzero_si128)
+SIMD_REDSUM(sse2_vredsum_64,  SSE2, uint64_t, __m128i, LDI,  _mm_add_epi64, _mm_setzero_si128)
+SIMD_REDSUM(sse2_vfredsum_32, SSE2, float,    __m128,  LDPS, _mm_add_ps,    _mm_setzero_ps)
+SIMD_REDSUM(sse2_vfredsum_64, SSE2, double,   __m128d, LDPD, _mm_add_pd,    _mm_setzero_pd)
+
+#undef LANES
+#undef LDI
+#undef STI
+#undef LDPS
+#undef STPS
+#undef LDPD
+#undef STPD
+
+// 256-bit kernels
+#define LANES 32
+#define LDI(p)      _mm256_loadu_si256((const __m256i*)(p))
+#define STI(p, v)   _mm256_storeu_si256((__m256i*)(p), v)
+#define LDPS(p)     _mm256_loadu_ps(p)
+#define STPS(p, v)  _mm256_storeu_ps(p, v)
+#define LDPD(p)     _mm256_loadu_pd(p)
+#define STPD(p, v)  _mm256_storeu_pd(p, v)
+
+SIMD_BINOP(avx2_vadd_8,    AVX2, uint8_t,  LDI, STI, _mm256_add_epi8,  vadd_8)
+SIMD_BINOP(avx2_vadd_16,   AVX2, uint16_t, LDI, STI, _mm256_add_epi16, vadd_16)
+SIMD_BINOP(avx2_vadd_32,   AVX2, uint32_t, LDI, STI, _mm256_add_epi32, vadd_32)
+SIMD_BINOP(avx2_vadd_64,   AVX2, uint64_t, LDI, STI, _mm256_add_epi64, vadd_64)
+SIMD_BINOP(avx2_vsub_8,    AVX2, uint8_t,  LDI, STI, _mm256_sub_epi8,  vsub_8)
+SIMD_BINOP(avx2_vsub_16,   AVX2, uint16_t, LDI, STI, _mm256_sub_epi16, vsub_16)
+SIMD_BINOP(avx2_vsub_32,   AVX2, uint32_t, LDI, STI, _mm256_sub_epi32, vsub_32)
+SIMD_BINOP(avx2_vsub_64,   AVX2, uint64_t, LDI, STI, _mm256_sub_epi64, vsub_64)
+SIMD_BINOP(avx2_vand_8,    AVX2, uint8_t,  LDI, STI, _mm256_and_si256, vand_8)
+SIMD_BINOP(avx2_vand_16,   AVX2, uint16_t, LDI, STI, _mm256_and_si256, vand_16)
+SIMD_BINOP(avx2_vand_32,   AVX2, uint32_t, LDI, STI, _mm256_and_si256, vand_32)
+SIMD_BINOP(avx2_vand_64,   AVX2, uint64_t, LDI, STI, _mm256_and_si256, vand_64)
+SIMD_BINOP(avx2_vor_8,     AVX2, uint8_t,  LDI, STI, _mm256_or_si256,  vor_8)
+SIMD_BINOP(avx2_vor_16,    AVX2, uint16_t, LDI, STI, _mm256_or_si256,  vor_16)
+SIMD_BINOP(avx2_vor_32,    AVX2, uint32_t, LDI, STI, _mm256_or_si256,  vor_32)
+SIMD_BINOP(avx2_vor_64,    AVX2, uint64_t, LDI, STI, _mm256_or_si256,  vor_64)
+SIMD_BINOP(avx2_vxor_8,    AVX2, uint8_t,  LDI, STI, _mm256_xor_si256, vxor_8)
+SIMD_BINOP(avx2_vxor_16,   AVX2, uint16_t, LDI, STI, _mm256_xor_si256, vxor_16)
+SIMD_BINOP(avx2_vxor_32,   AVX2, uint32_t, LDI, STI, _mm256_xor_si256, vxor_32)
+SIMD_BINOP(avx2_vxor_64,   AVX2, uint64_t, LDI, STI, _mm256_xor_si256, vxor_64)
+SIMD_BINOP(avx2_vmul_16,   AVX2, uint16_t, LDI, STI, _mm256_mullo_epi16, vmul_16)
+SIMD_BINOP(avx2_vmul_32,   AVX2, uint32_t, LDI, STI, _mm256_mullo_epi32, vmul_32)
+SIMD_BINOP(avx2_vmin_8,    AVX2, uint8_t,  LDI, STI, _mm256_min_epi8,  vmin_8)
+SIMD_BINOP(avx2_vmax_8,    AVX2, uint8_t,  LDI, STI, _mm256_max_epi8,  vmax_8)
+SIMD_BINOP(avx2_vminu_8,   AVX2, uint8_t,  LDI, STI, _mm256_min_epu8,  vminu_8)
+SIMD_BINOP(avx2_vmaxu_8,   AVX2, uint8_t,  LDI, STI, _mm256_max_epu8,  vmaxu_8)
+SIMD_BINOP(avx2_vmin_16,   AVX2, uint16_t, LDI, STI, _mm256_min_epi16, vmin_16)
+SIMD_BINOP(avx2_vmax_16,   AVX2, uint16_t, LDI, STI, _mm256_max_epi16, vmax_16)
+SIMD_BINOP(avx2_vminu_16,  AVX2, uint16_t, LDI, STI, _mm256_min_epu16, vminu_16)
+SIMD_BINOP(avx2_vmaxu_16,  AVX2, uint16_t, LDI, STI, _mm256_max_epu16, vmaxu_16)
+SIMD_BINOP(avx2_vmin_32,   AVX2, uint32_t, LDI, STI, _mm256_min_epi32, vmin_32)
+SIMD_BINOP(avx2_vmax_32,   AVX2, uint32_t, LDI, STI, _mm256_max_epi32, vmax_32)
+SIMD_BINOP(avx2_vminu_32,  AVX2, uint32_t, LDI, STI, _mm256_min_epu32, vminu_32)
+SIMD_BINOP(avx2_vmaxu_32,  AVX2, uint32_t, LDI, STI, _mm256_max_epu32, vmaxu_32)
+SIMD_BINOP(avx2_vfadd_32,  AVX2, float,    LDPS, STPS, _mm256_add_ps,  vfadd_32)
+SIMD_BINOP(avx2_vfadd_64,  AVX2, double,   LDPD, STPD, _mm256_add_pd,  vfadd_64)
+SIMD_BINOP(avx2_vfsub_32,  AVX2, float,    LDPS, STPS, _mm256_sub_ps,  vfsub_32)
+SIMD_BINOP(avx2_vfsub_64,  AVX2, double,   LDPD, STPD, _mm256_sub_pd,  vfsub_64)
+SIMD_BINOP(avx2_vfmul_32,  AVX2, float,    LDPS, STPS, _mm256_mul_ps,  vfmul_32)
+SIMD_BINOP(avx2_vfmul_64,  AVX2, double,   LDPD, STPD, _mm256_mul_pd,  vfmul_64)
+SIMD_BINOP(avx2_vfdiv_32,  AVX2, float,    LDPS, STPS, _mm256_div_ps,  vfdiv_32)
+SIMD_BINOP(avx2_vfdiv_64,  AVX2, double,   LDPD, STPD, _mm256_div_pd,  vfdiv_64)
+
+SIMD_REDSUM(avx2_vredsum_32,  AVX2, uint32_t, __m256i, LDI,  _mm256_add_epi32, _mm256_setzero_si256)
+SIMD_REDSUM(avx2_vredsum_64,  AVX2, uint64_t, __m256i, LDI,  _mm256_add_epi64, _mm256_setzero_si256)
+SIMD_REDSUM(avx2_vfredsum_32, AVX2, float,    __m256,  LDPS, _mm256_add_ps,    _mm256_setzero_ps)
+SIMD_REDSUM(avx2_vfredsum_64, AVX2, double,   __m256d, LDPD, _mm256_add_pd,    _mm256_setzero_pd)
+
+#undef LANES
+#undef LDI
+#undef STI
+#undef LDPS
+#undef STPS
+#undef LDPD
+#undef STPD
+
+#define SET_INT_KERNELS(table, op, prefix, name)                            \
+    table[op][0] = prefix##_##name##_8;  table[op][1] = prefix##_##name##_16; \
+    table[op][2] = prefix##_##name##_32; table[op][3] = prefix##_##name##_64;
+
+static void vector_use_sse2(void) {
+    SET_INT_KERNELS(vk_binop, VOP_ADD, sse2, vadd)
+    SET_INT_KERNELS(vk_binop, VOP_SUB, sse2, vsub)
+    SET_INT_KERNELS(vk_binop, VOP_AND, sse2, vand)
+    SET_INT_KERNELS(vk_binop, VOP_OR,  sse2, vor)
+    SET_INT_KERNELS(vk_binop, VOP_XOR, sse2, vxor)
+    vk_binop[VOP_MUL][1]  = sse2_vmul_16;
+    vk_binop[VOP_MINU][0] = sse2_vminu_8;
+    vk_binop[VOP_MAXU][0] = sse2_vmaxu_8;
+    vk_binop[VOP_MIN][1]  = sse2_vmin_16;
+    vk_binop[VOP_MAX][1]  = sse2_vmax_16;
+    vk_binop[VOP_FADD][2] = sse2_vfadd_32; vk_binop[VOP_FADD][3] = sse2_vfadd_64;
+    vk_binop[VOP_FSUB][2] = sse2_vfsub_32; vk_binop[VOP_FSUB][3] = sse2_vfsub_64;
+    vk_binop[VOP_FMUL][2] = sse2_vfmul_32; vk_binop[VOP_FMUL][3] = sse2_vfmul_64;
+    vk_binop[VOP_FDIV][2] = sse2_vfdiv_32; vk_binop[VOP_FDIV][3] = sse2_vfdiv_64;
+    vk_red[VRED_SUM][2]  = sse2_vredsum_32;  vk_red[VRED_SUM][3]  = sse2_vredsum_64;
+    vk_red[VRED_FSUM][2] = sse2_vfredsum_32; vk_red[VRED_FSUM][3] = sse2_vfredsum_64;
+}
+
+static void vector_use_sse41(void) {
+    vk_binop[VOP_MUL][2]  = sse41_vmul_32;
+    vk_binop[VOP_MIN][0]  = sse41_vmin_8;
+    vk_binop[VOP_MAX][0]  = sse41_vmax_8;
+    vk_binop[VOP_MINU][1] = sse41_vminu_16;
+    vk_binop[VOP_MAXU][1] = sse41_vmaxu_16;
+    vk_binop[VOP_MIN][2]  = sse41_vmin_32;
+    vk_binop[VOP_MAX][2]  = sse41_vmax_32;
+    vk_binop[VOP_MINU][2] = sse41_vminu_32;
+    vk_binop[VOP_MAXU][2] = sse41_vmaxu_32;
+}
+
+static void vector_use_avx2(void) {
+    SET_INT_KERNELS(vk_binop, VOP_ADD, avx2, vadd)
+    SET_INT_KERNELS(vk_binop, VOP_SUB, avx2, vsub)
+    SET_INT_KERNELS(vk_binop, VOP_AND, avx2, vand)
+    SET_INT_KERNELS(vk_binop, VOP_OR,  avx2, vor)
+    SET_INT_KERNELS(vk_binop, VOP_XOR, avx2, vxor)
+    vk_binop[VOP_MUL][1]  = avx2_vmul_16;
+    vk_binop[VOP_MUL][2]  = avx2_vmul_32;
+    vk_binop[VOP_MIN][0]  = avx2_vmin_8;   vk_binop[VOP_MAX][0]  = avx2_vmax_8;
+    vk_binop[VOP_MINU][0] = avx2_vminu_8;  vk_binop[VOP_MAXU][0] = avx2_vmaxu_8;
+    vk_binop[VOP_MIN][1]  = avx2_vmin_16;  vk_binop[VOP_MAX][1]  = avx2_vmax_16;
+    vk_binop[VOP_MINU][1] = avx2_vminu_16; vk_binop[VOP_MAXU][1] = avx2_vmaxu_16;
+    vk_binop[VOP_MIN][2]  = avx2_vmin_32;  vk_binop[VOP_MAX][2]  = avx2_vmax_32;
+    vk_binop[VOP_MINU][2] = avx2_vminu_32; vk_binop[VOP_MAXU][2] = avx2_vmaxu_32;
+    vk_binop[VOP_FADD][2] = avx2_vfadd_32; vk_binop[VOP_FADD][3] = avx2_vfadd_64;
+    vk_binop[VOP_FSUB][2] = avx2_vfsub_32; vk_binop[VOP_FSUB][3] = avx2_vfsub_64;
+    vk_binop[VOP_FMUL][2] = avx2_vfmul_32; vk_binop[VOP_FMUL][3] = avx2_vfmul_64;
+    vk_binop[VOP_FDIV][2] = avx2_vfdiv_32; vk_binop[VOP_FDIV][3] = avx2_vfdiv_64;
+    vk_red[VRED_SUM][2]  = avx2_vredsum_32;  vk_red[VRED_SUM][3]  = avx2_vredsum_64;
+    vk_red[VRED_FSUM][2] = avx2_vfredsum_32; vk_red[VRED_FSUM][3] = avx2_vfredsum_64;
+}
+
+#endif // VECTOR_X86
+
+void vector_init(void) {
+    static int initialised = 0;
+    if (initialised)
+        return;
+    initialised = 1;
+#ifdef VECTOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        vector_use_sse2();
+    if (__builtin_cpu_supports("sse4.1"))
+        vector_use_sse41();
+    if (__builtin_cpu_supports("avx2"))
+        vector_use_avx2();
+#endif
+}
+
+//=====================================================================================
+// Element and mask helpers
+//=====================================================================================
+
+static inline int vmask_bit(const uint8_t* m, size_t i) {
+    return (m[i >> 3] >> (i & 7)) & 1;
+}
+
+static inline void vmask_set(uint8_t* m, size_t i, int bit) {
+    if (bit) m[i >> 3] |= (uint8_t)(1 << (i & 7));
+    else     m[i >> 3] &= (uint8_t)~(1 << (i & 7));
+}
+
+static uint64_t velem(const uint8_t* base, int sew, size_t i) {
+    switch (sew) {
+        case 8:  return base[i];
+        case 16: { uint16_t v; memcpy(&v, base + 2*i, 2); return v; }
+        case 32: { uint32_t v; memcpy(&v, base + 4*i, 4); return v; }
+        default: { uint64_t v; memcpy(&v, base + 8*i, 8); return v; }
+    }
+}
+
+static void velem_set(uint8_t* base, int sew, size_t i, uint64_t value) {
+    switch (sew) {
+        case 8:  base[i] = (uint8_t)value; break;
+        case 16: { uint16_t v = value; memcpy(base + 2*i, &v, 2); } break;
+        case 32: { uint32_t v = value; memcpy(base + 4*i, &v, 4); } break;
+        default: memcpy(base + 8*i, &value, 8); break;
+    }
+}
+
+static inline uint64_t vsext(uint64_t value, int sew) {
+    int sh = 64 - sew;
+    return (uint64_t)((int64_t)(value << sh) >> sh);
+}
+
+static void vsplat(uint8_t* dst, int sew, uint64_t value, size_t n) {
+    switch (sew) {
+        case 8:  memset(dst, (uint8_t)value, n); break;
+        case 16: for (size_t i = 0; i < n; i++) ((uint16_t*)dst)[i] = value; break;
+        case 32: for (size_t i = 0; i < n; i++) ((uint32_t*)dst)[i] = value; break;
+        default: for (size_t i = 0; i < n; i++) ((uint64_t*)dst)[i] = value; break;
+    }
+}
+
+static inline int vsew_index(int sew) {
+    return sew == 8 ? 0 : sew == 16 ? 1 : sew == 32 ? 2 : 3;
+}
+
+static inline int vsew(CPU* cpu) {
+    return 8 << ((cpu->csr[VTYPE] >> 3) & 0x7);
+}
+
+// VLMAX for a vtype value, 0 when the encoding is reserved or unsupported
+static uint64_t vlmax(uint64_t vtype) {
+    uint64_t vsew  = (vtype >> 3) & 0x7;
+    uint64_t vlmul = vtype & 0x7;
+    if (vsew > 3 || vlmul == 4 || (vtype >> 8) != 0)
+        return 0;
+    uint64_t max = VLEN / (8 << vsew);
+    return vlmul < 4 ? max << vlmul : max >> (8 - vlmul);
+}
+
+// Reserved encodings raise an illegal instruction, the hart stops before the next one
+static void vector_illegal(CPU* cpu, uint32_t inst) {
+    fprintf(stderr, "[-] ERROR-> vector inst:0x%08x, funct3:0x%x, funct6:0x%x\n",
+            inst, (inst >> 12) & 0x7, inst >> 26);
+    if (!cpu->bus.fault)
+        cpu->bus.fault = CAUSE_ILLEGAL_INSN;
+}
+
+// Registers in a group of eew-bit elements under the current vtype,
+// EMUL = EEW / SEW * LMUL and at least one. 0 when EMUL is out of range.
+static uint32_t vgroup_regs(CPU* cpu, int eew) {
+    int vlmul = cpu->csr[VTYPE] & 0x7;
+    int emul = (vlmul < 4 ? vlmul : vlmul - 8) + __builtin_ctz(eew) - __builtin_ctz(vsew(cpu));
+    if (emul > 3 || emul < -3)
+        return 0;
+    return emul > 0 ? 1u << emul : 1;
+}
+
+// A group of n registers must start at a multiple of n, so it never runs past v31
+static inline int vgroup_ok(uint32_t reg, uint32_t n) {
+    return n && (reg & (n - 1)) == 0;
+}
+
+// Copies the elements of src that are active under v0 into vd
+static void vmerge_active(CPU* cpu, uint8_t* vd, const uint8_t* src, int sew, size_t vl) {
+    const uint8_t* mask = VREG(cpu, 0);
+    for (size_t i = 0; i < vl; i++)
+        if (vmask_bit(mask, i))
+            velem_set(vd, sew, i, velem(src, sew, i));
+}
+
+// Writes vl mask bits from src into vd, only where mask is set (NULL = all)
+static void vmask_write(uint8_t* vd, const uint8_t* src, const uint8_t* mask, size_t vl) {
+    size_t full = vl >> 3;
+    for (size_t k = 0; k < full; k++) {
+        uint8_t m = mask ? mask[k] : 0xff;
+        vd[k] = (src[k] & m) | (vd[k] & ~m);
+    }
+    if (vl & 7) {
+        uint8_t m = (uint8_t)((1 << (vl & 7)) - 1);
+        if (mask)
+            m &= mask[full];
+        vd[full] = (src[full] & m) | (vd[full] & ~m);
+    }
+}
+
+//=====================================================================================
+// Instruction groups
+//=====================================================================================
+
+static void vbinary(CPU* cpu, uint32_t inst, int op, uint32_t vd,
+        const uint8_t* a, const uint8_t* b, int vm) {
+    int sew = vsew(cpu);
+    size_t vl = cpu->csr[VL];
+    vbinop_fn fn = vk_binop[op][vsew_index(sew)];
+    if (!fn) {
+        vector_illegal(cpu, inst);
+        return;
+    }
+    if (vm) {
+        fn(VREG(cpu, vd), a, b, vl);
+        return;
+    }
+    uint8_t tmp[VGROUP_BYTES] __attribute__((aligned(32)));
+    fn(tmp, a, b, vl);
+    vmerge_active(cpu, VREG(cpu, vd), tmp, sew, vl);
+}
+
+static void vcompare(CPU* cpu, uint32_t inst, int cmp, uint32_t vd,
+        const uint8_t* a, const uint8_t* b, int vm) {
+    size_t vl = cpu->csr[VL];
+    vcmp_fn fn = vk_cmp[cmp][vsew_index(vsew(cpu))];
+    if (!fn) {
+        vector_illegal(cpu, inst);
+        return;
+    }
+    uint8_t bits[VLEN_BYTES] = {0};
+    fn(bits, a, b, vl);
+    vmask_write(VREG(cpu, vd), bits, vm ? NULL : VREG(cpu, 0), vl);
+}
+
+static void vreduce(CPU* cpu, uint32_t inst, int red, uint32_t vd,
+        uint32_t vs2, uint32_t vs1, int vm) {
+    int sew = vsew(cpu);
+    size_t vl = cpu->csr[VL];
+    vred_fn fn = vk_red[red][vsew_index(sew)];
+    if (!fn) {
+        vector_illegal(cpu, inst);
+        return;
+    }
+    if (vl == 0)
+        return;
+    uint64_t acc = velem(VREG(cpu, vs1), sew, 0);
+    const uint8_t* src = VREG(cpu, vs2);
+    if (vm) {
+        acc = fn(src, vl, acc);
+    } else {
+        for (size_t i = 0; i < vl; i++)
+            if (vmask_bit(VREG(cpu, 0), i))
+                acc = fn(src + i * (sew / 8), 1, acc);
+    }
+    velem_set(VREG(cpu, vd), sew, 0, acc);
+}
+
+// vd = vs1 * vs2 + vd, with vs1 already splatted for the .vx form
+static void vmultiply_add(CPU* cpu, uint32_t inst, int mul, int add, uint32_t vd,
+        const uint8_t* a, const uint8_t* b, int vm) {
+    int sew = vsew(cpu);
+    size_t vl = cpu->csr[VL];
+    vbinop_fn fmul = vk_binop[mul][vsew_index(sew)];
+    vbinop_fn fadd = vk_binop[add][vsew_index(sew)];
+    if (!fmul || !fadd) {
+        vector_illegal(cpu, inst);
+        return;
+    }
+    uint8_t tmp[VGROUP_BYTES] __attribute__((aligned(32)));
+    fmul(tmp, a, b, vl);
+    if (vm) {
+        fadd(VREG(cpu, vd), VREG(cpu, vd), tmp, vl);
+        return;
+    }
+    fadd(tmp, VREG(cpu, vd), tmp, vl);
+    vmerge_active(cpu, VREG(cpu, vd), tmp, sew, vl);
+}
+
+static void vmerge(CPU* cpu, uint32_t vd, const uint8_t* vs2, const uint8_t* b, int vm) {
+    int sew = vsew(cpu);
+    size_t vl = cpu->csr[VL];
+    if (vm) {   // vmv.v.*
+        memmove(VREG(cpu, vd), b, vl * (sew / 8));
+        return;
+    }
+    for (size_t i = 0; i < vl; i++)
+        velem_set(VREG(cpu, vd), sew, i,
+                vmask_bit(VREG(cpu, 0), i) ? velem(b, sew, i) : velem(vs2, sew, i));
+}
+
+static void exec_VSETVL(CPU* cpu, uint32_t inst) {
+    uint64_t rd  = (inst >> 7) & 0x1f;
+    uint64_t rs1 = (inst >> 15) & 0x1f;
+    uint64_t vtype, avl;
+    int imm_avl = 0;
+
+    if (!(inst >> 31)) {                    // vsetvli
+        vtype = (inst >> 20) & 0x7ff;
+        avl = cpu->regs[rs1];
+    } else if (((inst >> 30) & 0x3) == 0x3) { // vsetivli
+        vtype = (inst >> 20) & 0x3ff;
+        avl = rs1;
+        imm_avl = 1;
+    } else {                                // vsetvl
+        vtype = cpu->regs[(inst >> 20) & 0x1f];
+        avl = cpu->regs[rs1];
+    }
+
+    uint64_t max = vlmax(vtype);
+    uint64_t vl;
+    if (!max) {
+        cpu->csr[VTYPE] = VTYPE_VILL;
+        vl = 0;
+    } else {
+        if (imm_avl || rs1 != 0)
+            vl = avl < max ? avl : max;
+        else if (rd != 0)
+            vl = max;
+        else
+            vl = cpu->csr[VL] < max ? cpu->csr[VL] : max;
+        cpu->csr[VTYPE] = vtype;
+    }
+    cpu->csr[VL] = vl;
+    cpu->csr[VSTART] = 0;
+    cpu->regs[rd] = vl;
+    print_op("vsetvl\n");
+}
+
+static void exec_OPI(CPU* cpu, uint32_t inst, int funct3) {
+    uint32_t funct6 = inst >> 26;
+    int      vm  = (inst >> 25) & 1;
+    uint32_t vd  = (inst >> 7) & 0x1f;
+    uint32_t vs1 = (inst >> 15) & 0x1f;
+    uint32_t vs2 = (inst >> 20) & 0x1f;
+    int sew = vsew(cpu);
+    const uint8_t* a = VREG(cpu, vs2);
+    const uint8_t* b = VREG(cpu, vs1);
+    uint8_t splat[VGROUP_BYTES] __attribute__((aligned(32)));
+
+    // compares write a single mask register, everything else a group.
+    // vrsub has no .vv form.
+    uint32_t g = vgroup_regs(cpu, sew);
+    int compare = funct6 >= VMSEQ && funct6 <= VMSGT;
+    if ((funct3 == OPIVV && (funct6 == VRSUB || !vgroup_ok(vs1, g)))
+            || !vgroup_ok(vs2, g) || (!compare && !vgroup_ok(vd, g))) {
+        vector_illegal(cpu, inst);
+        return;
+    }
+
+    if (funct3 != OPIVV) {
+        uint64_t s;
+        if (funct3 == OPIVX)
+            s = cpu->regs[vs1];
+        else if (funct6 == VSLL || funct6 == VSRL || funct6 == VSRA)
+            s = vs1;                        // shifts take uimm5
+        else
+            s = vsext(vs1, 5);              // everything else takes simm5
+        vsplat(splat, sew, s, cpu->csr[VL]);
+        b = splat;
+    }
+
+    switch (funct6) {
+        case VADD:   vbinary(cpu, inst, VOP_ADD,  vd, a, b, vm); break;
+        case VSUB:   vbinary(cpu, inst, VOP_SUB,  vd, a, b, vm); break;
+        case VRSUB:  vbinary(cpu, inst, VOP_SUB,  vd, b, a, vm); break;
+        case VMINU:  vbinary(cpu, inst, VOP_MINU, vd, a, b, vm); break;
+        case VMIN:   vbinary(cpu, inst, VOP_MIN,  vd, a, b, vm); break;
+        case VMAXU:  vbinary(cpu, inst, VOP_MAXU, vd, a, b, vm); break;
+        case VMAX:   vbinary(cpu, inst, VOP_MAX,  vd, a, b, vm); break;
+        case VAND:   vbinary(cpu, inst, VOP_AND,  vd, a, b, vm); break;
+        case VOR:    vbinary(cpu, inst, VOP_OR,   vd, a, b, vm); break;
+        case VXOR:   vbinary(cpu, inst, VOP_XOR,  vd, a, b, vm); break;
+        case VSLL:   vbinary(cpu, inst, VOP_SLL,  vd, a, b, vm); break;
+        case VSRL:   vbinary(cpu, inst, VOP_SRL,  vd, a, b, vm); break;
+        case VSRA:   vbinary(cpu, inst, VOP_SRA,  vd, a, b, vm); break;
+        case VMERGE: vmerge(cpu, vd, a, b, vm); break;
+        case VMSEQ:  vcompare(cpu, inst, VCMP_EQ,  vd, a, b, vm); break;
+        case VMSNE:  vcompare(cpu, inst, VCMP_NE,  vd, a, b, vm); break;
+        case VMSLTU: vcompare(cpu, inst, VCMP_LTU, vd, a, b, vm); break;
+        case VMSLT:  vcompare(cpu, inst, VCMP_LT,  vd, a, b, vm); break;
+        case VMSLEU: vcompare(cpu, inst, VCMP_LEU, vd, a, b, vm); break;
+        case VMSLE:  vcompare(cpu, inst, VCMP_LE,  vd, a, b, vm); break;
+        case VMSGTU: vcompare(cpu, inst, VCMP_GTU, vd, a, b, vm); break;
+        case VMSGT:  vcompare(cpu, inst, VCMP_GT,  vd, a, b, vm); break;
+        default: vector_illegal(cpu, inst); return;
+    }
+    print_op("opivv/x/i\n");
+}
+
+static void exec_mask_logical(CPU* cpu, uint32_t inst, uint32_t funct6,
+        uint32_t vd, uint32_t vs2, uint32_t vs1) {
+    size_t vl = cpu->csr[VL];
+    const uint8_t* a = VREG(cpu, vs2);
+    const uint8_t* b = VREG(cpu, vs1);
+    uint8_t bits[VLEN_BYTES];
+    for (size_t k = 0; k < (vl + 7) / 8; k++) {
+        switch (funct6) {
+            case VMANDN: bits[k] = a[k] & ~b[k];    break;
+            case VMAND:  bits[k] = a[k] & b[k];     break;
+            case VMOR:   bits[k] = a[k] | b[k];     break;
+            case VMXOR:  bits[k] = a[k] ^ b[k];     break;
+            case VMORN:  bits[k] = a[k] | ~b[k];    break;
+            case VMNAND: bits[k] = ~(a[k] & b[k]);  break;
+            case VMNOR:  bits[k] = ~(a[k] | b[k]);  break;
+            case VMXNOR: bits[k] = ~(a[k] ^ b[k]);  break;
+            default: vector_illegal(cpu, inst); return;
+        }
+    }
+    vmask_write(VREG(cpu, vd), bits, NULL, vl);
+}
+
+static void exec_OPM(CPU* cpu, uint32_t inst, int funct3) {
+    uint32_t funct6 = inst >> 26;
+    int      vm  = (inst >> 25) & 1;
+    uint32_t vd  = (inst >> 7) & 0x1f;
+    uint32_t vs1 = (inst >> 15) & 0x1f;
+    uint32_t vs2 = (inst >> 20) & 0x1f;
+    int sew = vsew(cpu);
+    size_t vl = cpu->csr[VL];
+    const uint8_t* a = VREG(cpu, vs2);
+    const uint8_t* b = VREG(cpu, vs1);
+    uint8_t splat[VGROUP_BYTES] __attribute__((aligned(32)));
+    uint32_t g = vgroup_regs(cpu, sew);
+
+    if (funct3 == OPMVX) {
+        if (funct6 == VWXUNARY0) {          // vmv.s.x
+            if (vl > 0)
+                velem_set(VREG(cpu, vd), sew, 0, cpu->regs[vs1]);
+            print_op("vmv.s.x\n");
+            return;
+        }
+        vsplat(splat, sew, cpu->regs[vs1], vl);
+        b = splat;
+    } else {
+        // reductions read a vs2 group, the mask and scalar forms single registers
+        if ((funct6 <= VREDMAX && !vgroup_ok(vs2, g))
+                || (funct6 == VMUNARY0 && !vgroup_ok(vd, g))) {
+            vector_illegal(cpu, inst);
+            return;
+        }
+        switch (funct6) {
+            case VREDSUM:  vreduce(cpu, inst, VRED_SUM,  vd, vs2, vs1, vm); goto done;
+            case VREDAND:  vreduce(cpu, inst, VRED_AND,  vd, vs2, vs1, vm); goto done;
+            case VREDOR:   vreduce(cpu, inst, VRED_OR,   vd, vs2, vs1, vm); goto done;
+            case VREDXOR:  vreduce(cpu, inst, VRED_XOR,  vd, vs2, vs1, vm); goto done;
+            case VREDMINU: vreduce(cpu, inst, VRED_MINU, vd, vs2, vs1, vm); goto done;
+            case VREDMIN:  vreduce(cpu, inst, VRED_MIN,  vd, vs2, vs1, vm); goto done;
+            case VREDMAXU: vreduce(cpu, inst, VRED_MAXU, vd, vs2, vs1, vm); goto done;
+            case VREDMAX:  vreduce(cpu, inst, VRED_MAX,  vd, vs2, vs1, vm); goto done;
+            case VWXUNARY0: {
+                const uint8_t* mask = VREG(cpu, 0);
+                uint64_t rd = vd;
+                if (vs1 == VMV_X_S) {
+                    cpu->regs[rd] = vsext(velem(a, sew, 0), sew);
+                } else if (vs1 == VCPOP) {
+                    uint64_t count = 0;
+                    for (size_t i = 0; i < vl; i++)
+                        count += vmask_bit(a, i) & (vm || vmask_bit(mask, i));
+                    cpu->regs[rd] = count;
+                } else if (vs1 == VFIRST) {
+                    int64_t first = -1;
+                    for (size_t i = 0; i < vl && first < 0; i++)
+                        if (vmask_bit(a, i) && (vm || vmask_bit(mask, i)))
+                            first = i;
+                    cpu->regs[rd] = first;
+                } else {
+                    vector_illegal(cpu, inst);
+                    return;
+                }
+            } goto done;
+            case VMUNARY0:
+                if (vs1 != VID) {
+                    vector_illegal(cpu, inst);
+                    return;
+                }
+                for (size_t i = 0; i < vl; i++)
+                    if (vm || vmask_bit(VREG(cpu, 0), i))
+                        velem_set(VREG(cpu, vd), sew, i, i);
+                goto done;
+            case VMANDN: case VMAND: case VMOR: case VMXOR:
+            case VMORN: case VMNAND: case VMNOR: case VMXNOR:
+                exec_mask_logical(cpu, inst, funct6, vd, vs2, vs1);
+                goto done;
+            default: ;
+        }
+    }
+
+    if ((funct3 == OPMVV && !vgroup_ok(vs1, g)) || !vgroup_ok(vs2, g) || !vgroup_ok(vd, g)) {
+        vector_illegal(cpu, inst);
+        return;
+    }
+    switch (funct6) {
+        case VDIVU:  vbinary(cpu, inst, VOP_DIVU,  vd, a, b, vm); break;
+        case VDIV:   vbinary(cpu, inst, VOP_DIV,   vd, a, b, vm); break;
+        case VREMU:  vbinary(cpu, inst, VOP_REMU,  vd, a, b, vm); break;
+        case VREM:   vbinary(cpu, inst, VOP_REM,   vd, a, b, vm); break;
+        case VMULHU: vbinary(cpu, inst, VOP_MULHU, vd, a, b, vm); break;
+        case VMUL:   vbinary(cpu, inst, VOP_MUL,   vd, a, b, vm); break;
+        case VMULH:  vbinary(cpu, inst, VOP_MULH,  vd, a, b, vm); break;
+        case VMACC:  vmultiply_add(cpu, inst, VOP_MUL, VOP_ADD, vd, b, a, vm); break;
+        default: vector_illegal(cpu, inst); return;
+    }
+done:
+    print_op("opmvv/x\n");
+}
+
+static void exec_OPF(CPU* cpu, uint32_t inst) {
+    uint32_t funct6 = inst >> 26;
+    int      vm  = (inst >> 25) & 1;
+    uint32_t vd  = (inst >> 7) & 0x1f;
+    uint32_t vs1 = (inst >> 15) & 0x1f;
+    uint32_t vs2 = (inst >> 20) & 0x1f;
+    const uint8_t* a = VREG(cpu, vs2);
+    const uint8_t* b = VREG(cpu, vs1);
+
+    // reductions take single vd and vs1, compares a single vd
+    uint32_t g = vgroup_regs(cpu, vsew(cpu));
+    int reduce = funct6 == VFREDUSUM || funct6 == VFREDOSUM
+              || funct6 == VFREDMIN || funct6 == VFREDMAX;
+    int compare = funct6 >= VMFEQ && funct6 <= VMFNE;
+    if (!vgroup_ok(vs2, g) || (!reduce && !vgroup_ok(vs1, g))
+            || (!reduce && !compare && !vgroup_ok(vd, g))) {
+        vector_illegal(cpu, inst);
+        return;
+    }
+
+    switch (funct6) {
+        case VFADD:     vbinary(cpu, inst, VOP_FADD, vd, a, b, vm); break;
+        case VFSUB:     vbinary(cpu, inst, VOP_FSUB, vd, a, b, vm); break;
+        case VFMUL:     vbinary(cpu, inst, VOP_FMUL, vd, a, b, vm); break;
+        case VFDIV:     vbinary(cpu, inst, VOP_FDIV, vd, a, b, vm); break;
+        case VFMIN:     vbinary(cpu, inst, VOP_FMIN, vd, a, b, vm); break;
+        case VFMAX:     vbinary(cpu, inst, VOP_FMAX, vd, a, b, vm); break;
+        case VFMACC:    vmultiply_add(cpu, inst, VOP_FMUL, VOP_FADD, vd, b, a, vm); break;
+        case VFREDUSUM: vreduce(cpu, inst, VRED_FSUM,  vd, vs2, vs1, vm); break;
+        case VFREDOSUM: vreduce(cpu, inst, VRED_FOSUM, vd, vs2, vs1, vm); break;
+        case VFREDMIN:  vreduce(cpu, inst, VRED_FMIN,  vd, vs2, vs1, vm); break;
+        case VFREDMAX:  vreduce(cpu, inst, VRED_FMAX,  vd, vs2, vs1, vm); break;
+        case VMFEQ:     vcompare(cpu, inst, VCMP_FEQ, vd, a, b, vm); break;
+        case VMFNE:     vcompare(cpu, inst, VCMP_FNE, vd, a, b, vm); break;
+        case VMFLT:     vcompare(cpu, inst, VCMP_FLT, vd, a, b, vm); break;
+        case VMFLE:     vcompare(cpu, inst, VCMP_FLE, vd, a, b, vm); break;
+        default: vector_illegal(cpu, inst); return;
+    }
+    print_op("opfvv\n");
+}
+
+void exec_OP_V(CPU* cpu, uint32_t inst) {
+    int funct3 = (inst >> 12) & 0x7;
+
+    if (funct3 == OPCFG) {
+        exec_VSETVL(cpu, inst);
+        return;
+    }
+    if (cpu->csr[VTYPE] & VTYPE_VILL) {
+        vector_illegal(cpu, inst);
+        return;
+    }
+    switch (funct3) {
+        case OPIVV: case OPIVX: case OPIVI: exec_OPI(cpu, inst, funct3); break;
+        case OPMVV: case OPMVX:             exec_OPM(cpu, inst, funct3); break;
+        case OPFVV:                         exec_OPF(cpu, inst); break;
+        default: vector_illegal(cpu, inst);     // OPFVF needs the F registers
+    }
+    cpu->csr[VSTART] = 0;
+}
+
+//=====================================================================================
+// Loads and stores
+//=====================================================================================
+
+static int vwidth_eew(int width) {
+    switch (width) {
+        case VE8:  return 8;
+        case VE16: return 16;
+        case VE32: return 32;
+        case VE64: return 64;
+        default:   return 0;   // scalar FP load/store
+    }
+}
+
+static void vmemory(CPU* cpu, uint32_t inst, int store) {
+    int      eew   = vwidth_eew((inst >> 12) & 0x7);
+    uint32_t vd    = (inst >> 7) & 0x1f;   // vs3 for stores
+    uint32_t rs1   = (inst >> 15) & 0x1f;
+    uint32_t umop  = (inst >> 20) & 0x1f;  // lumop/sumop, rs2 or vs2
+    int      vm    = (inst >> 25) & 1;
+    int      mop   = (inst >> 26) & 0x3;
+    int      nf    = inst >> 29;
+    uint64_t base  = cpu->regs[rs1];
+    size_t   vl    = cpu->csr[VL];
+    uint8_t* v     = VREG(cpu, vd);
+    const uint8_t* mask = VREG(cpu, 0);
+
+    if (!eew) {
+        fprintf(stderr, "[-] ERROR-> scalar FP load/store not implemented: 0x%08x\n", inst);
+        cpu->bus.fault = CAUSE_ILLEGAL_INSN;
+        return;
+    }
+
+    if (mop == VMOP_UNIT && umop == VUMOP_WHOLE) {
+        // nf + 1 of 1, 2, 4 or 8 registers, starting at a multiple of that
+        if ((nf & (nf + 1)) != 0 || !vgroup_ok(vd, nf + 1)) {
+            vector_illegal(cpu, inst);
+            return;
+        }
+        uint64_t len = (uint64_t)(nf + 1) * VLEN_BYTES;
+        if (store) bus_store_bytes(&(cpu->bus), base, len, v);
+        else       bus_load_bytes(&(cpu->bus), base, len, v);
+        return;
+    }
+    if (cpu->csr[VTYPE] & VTYPE_VILL || nf != 0) {
+        vector_illegal(cpu, inst);
+        return;
+    }
+    if (mop == VMOP_UNIT && umop == VUMOP_MASK) {
+        if (store) bus_store_bytes(&(cpu->bus), base, (vl + 7) / 8, v);
+        else       bus_load_bytes(&(cpu->bus), base, (vl + 7) / 8, v);
+        return;
+    }
+
+    // data groups are EMUL registers for eew, indexed accesses keep SEW data and eew indices
+    int indexed = mop == VMOP_INDEXED_U || mop == VMOP_INDEXED_O;
+    if (!vgroup_ok(vd, vgroup_regs(cpu, indexed ? vsew(cpu) : eew))
+            || (indexed && !vgroup_ok(umop, vgroup_regs(cpu, eew)))) {
+        vector_illegal(cpu, inst);
+        return;
+    }
+
+    switch (mop) {
+        case VMOP_UNIT:
+            if (umop != VUMOP_UNIT) {
+                vector_illegal(cpu, inst);
+                return;
+            }
+            if (vm) {
+                if (store) bus_store_bytes(&(cpu->bus), base, vl * (eew / 8), v);
+                else       bus_load_bytes(&(cpu->bus), base, vl * (eew / 8), v);
+                break;
+            }
+            for (size_t i = 0; i < vl; i++) {
+                if (!vmask_bit(mask, i))
+                    continue;
+                uint64_t addr = base + i * (eew / 8);
+                if (store) bus_store(&(cpu->bus), addr, eew, velem(v, eew, i));
+                else       velem_set(v, eew, i, bus_load(&(cpu->bus), addr, eew));
+            }
+            break;
+        case VMOP_STRIDED: {
+            uint64_t stride = cpu->regs[umop];
+            for (size_t i = 0; i < vl; i++) {
+                if (!vm && !vmask_bit(mask, i))
+                    continue;
+                uint64_t addr = base + i * stride;
+                if (store) bus_store(&(cpu->bus), addr, eew, velem(v, eew, i));
+                else       velem_set(v, eew, i, bus_load(&(cpu->bus), addr, eew));
+            }
+        } break;
+        case VMOP_INDEXED_U:
+        case VMOP_INDEXED_O: {
+            // index elements are eew wide, data elements are sew wide
+            int sew = vsew(cpu);
+            const uint8_t* index = VREG(cpu, umop);
+            for (size_t i = 0; i < vl; i++) {
+                if (!vm && !vmask_bit(mask, i))
+                    continue;
+                uint64_t addr = base + velem(index, eew, i);
+                if (store) bus_store(&(cpu->bus), addr, sew, velem(v, sew, i));
+                else       velem_set(v, sew, i, bus_load(&(cpu->bus), addr, sew));
+            }
+        } break;
+    }
+    cpu->csr[VSTART] = 0;
+}
+
+void exec_VLOAD(CPU* cpu, uint32_t inst) {
+    vmemory(cpu, inst, 0);
+    print_op("vload\n");
+}
+
+void exec_VSTORE(CPU* cpu, uint32_t inst) {
+    vmemory(cpu, inst, 1);
+    print_op("vstore\n");
+}
@@ -0,0 +1,285 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "../includes/virtio.h"
+
+#define VIRTIO_MAGIC_VALUE  0x74726976      // "virt"
+#define VIRTIO_VENDOR       0x554d4551      // "QEMU", what drivers expect to see
+
+#define VRING_DESC_F_NEXT           1
+#define VRING_DESC_F_WRITE          2
+#define VRING_AVAIL_F_NO_INTERRUPT  1
+
+// Ring fields are little-endian like the hosts we run on
+static void* guest(VIRTIO* vio, uint64_t addr, uint64_t len) {
+    if (!dram_contains(vio->dram, addr, len))
+        return NULL;
+    return vio->dram->mem + (addr - vio->dram->base);
+}
+
+static uint16_t rd16(VIRTIO* vio, uint64_t addr) {
+    uint16_t v = 0;
+    void* p = guest(vio, addr, 2);
+    if (p)
+        memcpy(&v, p, 2);
+    return v;
+}
+
+static void wr16(VIRTIO* vio, uint64_t addr, uint16_t v) {
+    void* p = guest(vio, addr, 2);
+    if (p) {
+        memcpy(p, &v, 2);
+        virtio_written(vio, p, 2);
+    }
+}
+
+// The interrupt line follows InterruptStatus
+static void virtio_irq(VIRTIO* vio) {
+    if (vio->plic)
+        plic_set(vio->plic, vio->irq, vio->isr != 0);
+}
+
+void virtio_written(VIRTIO* vio, const void* p, uint64_t len) {
+    dram_touch(vio->dram, vio->dram->base + ((const uint8_t*) p - vio->dram->mem), len);
+}
+
+uint32_t virtio_iov_slice(const struct iovec* iov, uint32_t n, uint64_t skip, uint64_t len,
+                          struct iovec* out) {
+    uint32_t m = 0;
+    for (uint32_t i = 0; i < n && len > 0; i++) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        uint64_t part = iov[i].iov_len - skip;
+        if (part > len)
+            part = len;
+        out[m].iov_base = (uint8_t*) iov[i].iov_base + skip;
+        out[m].iov_len  = part;
+        skip = 0;
+        len -= part;
+        m++;
+    }
+    return m;
+}
+
+//=====================================================================================
+//   Virtqueues
+//=====================================================================================
+
+// avail: flags, idx, ring[num], used_event
+// used:  flags, idx, ring[num] of {id, len}, avail_event
+#define AVAIL_IDX(q)        ((q)->avail + 2)
+#define AVAIL_RING(q, i)    ((q)->avail + 4 + 2 * ((i) % (q)->num))
+#define USED_EVENT(q)       ((q)->avail + 4 + 2 * (q)->num)
+#define USED_IDX(q)         ((q)->used + 2)
+#define USED_RING(q, i)     ((q)->used + 4 + 8 * ((i) % (q)->num))
+#define AVAIL_EVENT(q)      ((q)->used + 4 + 8 * (q)->num)
+
+uint16_t virtq_pending(VIRTIO* vio, VIRTQ* q) {
+    if (!q->ready || !q->num)
+        return 0;
+    uint16_t idx = rd16(vio, AVAIL_IDX(q));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);    // ring entries after the index
+    return idx - q->last_avail;
+}
+
+int virtq_peek(VIRTIO* vio, VIRTQ* q, uint16_t i, VIRTQ_CHAIN* c) {
+    uint16_t d = rd16(vio, AVAIL_RING(q, q->last_avail + i));
+    c->head = d;
+    c->nout = c->nin = 0;
+
+    for (uint32_t n = 0; n < VIRTIO_CHAIN_MAX; n++) {
+        uint8_t* desc = guest(vio, q->desc + 16 * (d % q->num), 16);
+        if (!desc || d >= q->num)
+            return -1;
+        uint64_t addr; uint32_t len; uint16_t flags, next;
+        memcpy(&addr, desc, 8);
+        memcpy(&len, desc + 8, 4);
+        memcpy(&flags, desc + 12, 2);
+        memcpy(&next, desc + 14, 2);
+
+        void* p = guest(vio, addr, len);
+        if (!p)
+            return -1;
+        if (flags & VRING_DESC_F_WRITE) {
+            c->iov[c->nout + c->nin++] = (struct iovec){ p, len };
+        } else {
+            if (c->nin)
+                return -1;          // readable after writable
+            c->iov[c->nout++] = (struct iovec){ p, len };
+        }
+        if (!(flags & VRING_DESC_F_NEXT))
+            return 0;
+        d = next;
+    }
+    return -1;
+}
+
+void virtq_push(VIRTIO* vio, VIRTQ* q, uint16_t head, uint32_t len) {
+    uint8_t* e = guest(vio, USED_RING(q, q->used_idx), 8);
+    if (e) {
+        uint32_t id = head;
+        memcpy(e, &id, 4);
+        memcpy(e + 4, &len, 4);
+        virtio_written(vio, e, 8);
+    }
+    q->used_idx++;
+}
+
+// used_event crossed between the last interrupt and now (virtio spec vring_need_event)
+static int need_event(uint16_t event, uint16_t now, uint16_t old) {
+    return (uint16_t)(now - event - 1) < (uint16_t)(now - old);
+}
+
+void virtq_publish(VIRTIO* vio, VIRTQ* q, uint16_t consumed) {
+    int event_idx = vio->driver_features & VIRTIO_RING_F_EVENT_IDX;
+
+    q->last_avail += consumed;
+    __atomic_thread_fence(__ATOMIC_RELEASE);    // used entries before the index
+    wr16(vio, USED_IDX(q), q->used_idx);
+    if (event_idx)
+        wr16(vio, AVAIL_EVENT(q), q->last_avail);   // kick us for anything newer
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    int notify;
+    if (event_idx)
+        notify = need_event(rd16(vio, USED_EVENT(q)), q->used_idx, q->signalled);
+    else
+        notify = q->used_idx != q->signalled
+            && !(rd16(vio, q->avail) & VRING_AVAIL_F_NO_INTERRUPT);
+    if (!notify)
+        return;
+    q->signalled = q->used_idx;
+    vio->isr |= VIRTIO_INT_USED;
+    virtio_irq(vio);
+}
+
+//=====================================================================================
+//   MMIO registers
+//=====================================================================================
+
+static void virtio_reset(VIRTIO* vio) {
+    vio->driver_features = 0;
+    vio->features_sel = vio->driver_features_sel = 0;
+    vio->queue_sel = 0;
+    vio->status = 0;
+    vio->isr = 0;
+    memset(vio->q, 0, sizeof(vio->q));
+    virtio_irq(vio);
+    if (vio->reset)
+        vio->reset(vio);
+}
+
+static uint64_t virtio_load(void* dev, uint64_t off, uint64_t size) {
+    VIRTIO* vio = dev;
+    VIRTQ* q = &vio->q[vio->queue_sel];
+
+    if (off >= VIRTIO_CONFIG) {
+        uint64_t v = 0;
+        off -= VIRTIO_CONFIG;
+        if (off + size / 8 <= vio->config_len)
+            memcpy(&v, vio->config + off, size / 8);
+        return v;
+    }
+    switch (off) {
+        case VIRTIO_MAGIC:              return VIRTIO_MAGIC_VALUE;
+        case VIRTIO_VERSION:            return 2;
+        case VIRTIO_DEVICE_ID:          return vio->device_id;
+        case VIRTIO_VENDOR_ID:          return VIRTIO_VENDOR;
+        case VIRTIO_DEVICE_FEATURES:
+            return vio->features_sel < 2 ? (uint32_t)(vio->features >> (32 * vio->features_sel)) : 0;
+        case VIRTIO_QUEUE_NUM_MAX:      return vio->queue_sel < vio->nqueues ? VIRTIO_QUEUE_SIZE : 0;
+        case VIRTIO_QUEUE_READY:        return vio->queue_sel < vio->nqueues ? q->ready : 0;
+        case VIRTIO_INTERRUPT_STATUS:   return vio->isr;
+        case VIRTIO_STATUS:             return vio->status;
+        case VIRTIO_CONFIG_GENERATION:  return 0;
+        default:                        return 0;
+    }
+}
+
+static void set_low(uint64_t* r, uint64_t v)  { *r = (*r & ~0xffffffffULL) | (uint32_t) v; }
+static void set_high(uint64_t* r, uint64_t v) { *r = (*r & 0xffffffffULL) | (v << 32); }
+
+static void virtio_store(void* dev, uint64_t off, uint64_t size, uint64_t value) {
+    VIRTIO* vio = dev;
+    VIRTQ* q = &vio->q[vio->queue_sel];
+    int has_queue = vio->queue_sel < vio->nqueues;
+
+    switch (off) {
+        case VIRTIO_DEVICE_FEATURES_SEL: vio->features_sel = value; break;
+        case VIRTIO_DRIVER_FEATURES_SEL: vio->driver_features_sel = value; break;
+        case VIRTIO_DRIVER_FEATURES:
+            if (vio->driver_features_sel == 0)
+                set_low(&vio->driver_features, value & vio->features);
+            else if (vio->driver_features_sel == 1)
+                set_high(&vio->driver_features, value & (vio->features >> 32));
+            break;
+        case VIRTIO_QUEUE_SEL:
+            if (value < VIRTIO_QUEUE_MAX)
+                vio->queue_sel = value;
+            break;
+        case VIRTIO_QUEUE_NUM:
+            // the ring arithmetic wants a power of two
+            if (has_queue && value && value <= VIRTIO_QUEUE_SIZE && !(value & (value - 1)))
+                q->num = value;
+            break;
+        case VIRTIO_QUEUE_READY:        if (has_queue) q->ready = value & 1; break;
+        case VIRTIO_QUEUE_DESC_LOW:     if (has_queue) set_low(&q->desc, value); break;
+        case VIRTIO_QUEUE_DESC_HIGH:    if (has_queue) set_high(&q->desc, value); break;
+        case VIRTIO_QUEUE_DRIVER_LOW:   if (has_queue) set_low(&q->avail, value); break;
+        case VIRTIO_QUEUE_DRIVER_HIGH:  if (has_queue) set_high(&q->avail, value); break;
+        case VIRTIO_QUEUE_DEVICE_LOW:   if (has_queue) set_low(&q->used, value); break;
+        case VIRTIO_QUEUE_DEVICE_HIGH:  if (has_queue) set_high(&q->used, value); break;
+        case VIRTIO_QUEUE_NOTIFY:
+            if (value < vio->nqueues && vio->q[value].ready && vio->notify)
+                vio->notify(vio, value);
+            break;
+        case VIRTIO_INTERRUPT_ACK:
+            vio->isr &= ~value;
+            virtio_irq(vio);
+            break;
+        case VIRTIO_STATUS:
+            if (value == 0)
+                virtio_reset(vio);
+            else
+                vio->status = value;
+            break;
+        default: ;
+    }
+}
+
+static uint32_t virtio_queue_depth(void* dev, uint32_t queue, uint32_t* size) {
+    VIRTIO* vio = dev;
+    *size = vio->q[queue].num;
+    return virtq_pending(vio, &vio->q[queue]);
+}
+
+int virtio_attach(BUS* bus, VIRTIO* vio, void (*poll)(void* dev)) {
+    static uint32_t slots;
+    if (slots == VIRTIO_MMIO_MAX) {
+        fprintf(stderr, "[-] ERROR-> at most %d virtio devices\n", VIRTIO_MMIO_MAX);
+        return -1;
+    }
+    vio->dram = &bus->dram;
+    vio->plic = bus->plic;
+    vio->irq = slots + 1;
+    virtio_reset(vio);
+    MMIO m = {
+        .base = VIRTIO_MMIO_BASE + VIRTIO_MMIO_SIZE * slots,
+        .size = VIRTIO_MMIO_SIZE,
+        .dev = vio,
+        .load = virtio_load,
+        .store = virtio_store,
+        .poll = poll,
+        .compatible = "virtio,mmio",
+        .irq = vio->irq,
+        .name = vio->name,
+        .nqueues = vio->nqueues,
+        .queue_depth = virtio_queue_depth,
+    };
+    if (bus_map(bus, &m) < 0)
+        return -1;
+    slots++;
+    return 0;
+}
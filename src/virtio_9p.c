@@ -0,0 +1,1046 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/uio.h>
+#include "../includes/virtio_9p.h"
+
+#define VIRTIO_9P_MOUNT_TAG     (1ULL << 0)
+
+// message types, each reply is its request + 1
+#define P9_RLERROR      7
+#define P9_TSTATFS      8
+#define P9_TLOPEN       12
+#define P9_TLCREATE     14
+#define P9_TSYMLINK     16
+#define P9_TRENAME      20
+#define P9_TREADLINK    22
+#define P9_TGETATTR     24
+#define P9_TSETATTR     26
+#define P9_TREADDIR     40
+#define P9_TFSYNC       50
+#define P9_TMKDIR       72
+#define P9_TRENAMEAT    74
+#define P9_TUNLINKAT    76
+#define P9_TVERSION     100
+#define P9_TATTACH      104
+#define P9_TFLUSH       108
+#define P9_TWALK        110
+#define P9_TREAD        116
+#define P9_TWRITE       118
+#define P9_TCLUNK       120
+#define P9_TREMOVE      122
+
+#define P9_HDR          7       // size[4] type[1] tag[2]
+#define P9_IOHDR        11      // Rread: header, count[4]
+#define P9_TWRITE_HDR   23      // Twrite: header, fid[4] offset[8] count[4]
+#define P9_REQ_MAX      8192    // request bytes copied out, Twrite data stays in place
+#define P9_WALK_MAX     16
+#define P9_FID_BUCKETS  256
+
+#define P9_QID_DIR      0x80
+#define P9_QID_SYMLINK  0x02
+#define P9_GETATTR_BASIC    0x7ff
+#define P9_AT_REMOVEDIR     0x200
+
+// Tsetattr valid bits
+#define P9_SETATTR_MODE         0x001
+#define P9_SETATTR_UID          0x002
+#define P9_SETATTR_GID          0x004
+#define P9_SETATTR_SIZE         0x008
+#define P9_SETATTR_ATIME        0x010
+#define P9_SETATTR_MTIME        0x020
+#define P9_SETATTR_ATIME_SET    0x080
+#define P9_SETATTR_MTIME_SET    0x100
+
+typedef struct P9_FID {
+    uint32_t fid;
+    int fd;                     // -1 until Tlopen or Tlcreate
+    DIR* dir;                   // Treaddir stream, owns fd once opened
+    char* path;                 // relative to the share's root, "" for the root
+    struct P9_FID* next;
+} P9_FID;
+
+// A message being parsed or built; err is set once a field overruns it
+typedef struct P9_MSG {
+    uint8_t* buf;
+    uint32_t len, pos;
+    int err;
+} P9_MSG;
+
+// A taken chain waiting for a worker, or a worker's answer to it
+typedef struct P9_JOB {
+    VIRTQ_CHAIN chain;
+    uint32_t len;               // reply bytes written
+    uint32_t gen;               // device generation it was taken in
+} P9_JOB;
+
+typedef struct VIRTIO_9P {
+    VIRTIO vio;
+    int rootfd;                 // O_PATH fd of the shared directory
+    uint8_t config[2 + 256];    // tag_len, tag
+    uint32_t msize;
+    pthread_mutex_t fids_lock;
+    P9_FID* fids[P9_FID_BUCKETS];
+    uint8_t* req;               // buffers for requests served on the hart's thread
+    uint8_t* reply;
+    // worker pool, requests in todo and answers in done, both under lock
+    uint32_t nthreads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    uint32_t gen;               // bumped on device reset, stale answers are dropped
+    P9_JOB todo[VIRTIO_QUEUE_SIZE];
+    P9_JOB done[VIRTIO_QUEUE_SIZE];
+    uint32_t todo_head, todo_tail, done_head, done_tail;
+} VIRTIO_9P;
+
+//=====================================================================================
+//   Message Fields
+//=====================================================================================
+
+static uint64_t get(P9_MSG* m, int n) {
+    uint64_t v = 0;
+    if (m->pos + n > m->len) {
+        m->err = 1;
+        return 0;
+    }
+    for (int i = 0; i < n; i++)
+        v |= (uint64_t) m->buf[m->pos + i] << (8 * i);
+    m->pos += n;
+    return v;
+}
+
+// Strings are moved over their length field and terminated in place
+static char* get_str(P9_MSG* m) {
+    uint32_t n = get(m, 2);
+    if (m->err || m->pos + n > m->len) {
+        m->err = 1;
+        return "";
+    }
+    char* s = (char*) m->buf + m->pos - 2;
+    memmove(s, s + 2, n);
+    s[n] = 0;
+    m->pos += n;
+    return s;
+}
+
+static void put(P9_MSG* m, uint64_t v, int n) {
+    if (m->pos + n > m->len) {
+        m->err = 1;
+        return;
+    }
+    for (int i = 0; i < n; i++)
+        m->buf[m->pos + i] = v >> (8 * i);
+    m->pos += n;
+}
+
+static void put_str(P9_MSG* m, const char* s) {
+    uint32_t n = strlen(s);
+    put(m, n, 2);
+    if (m->err || m->pos + n > m->len) {
+        m->err = 1;
+        return;
+    }
+    memcpy(m->buf + m->pos, s, n);
+    m->pos += n;
+}
+
+static void put_qid(P9_MSG* m, const struct stat* st) {
+    put(m, S_ISDIR(st->st_mode) ? P9_QID_DIR : S_ISLNK(st->st_mode) ? P9_QID_SYMLINK : 0, 1);
+    put(m, 0, 4);                   // version
+    put(m, st->st_ino, 8);
+}
+
+//=====================================================================================
+//   Fids
+//=====================================================================================
+
+static P9_FID* fid_get(VIRTIO_9P* p9, uint32_t fid) {
+    pthread_mutex_lock(&p9->fids_lock);
+    P9_FID* f = p9->fids[fid % P9_FID_BUCKETS];
+    while (f && f->fid != fid)
+        f = f->next;
+    pthread_mutex_unlock(&p9->fids_lock);
+    return f;
+}
+
+// Takes ownership of path. Returns NULL if fid is in use.
+static P9_FID* fid_new(VIRTIO_9P* p9, uint32_t fid, char* path) {
+    if (fid_get(p9, fid)) {
+        free(path);
+        return NULL;
+    }
+    P9_FID* f = malloc(sizeof(P9_FID));
+    if (!f) {
+        fprintf(stderr, "Memory error!");
+        exit(1);
+    }
+    *f = (P9_FID){ .fid = fid, .fd = -1, .path = path };
+    pthread_mutex_lock(&p9->fids_lock);
+    f->next = p9->fids[fid % P9_FID_BUCKETS];
+    p9->fids[fid % P9_FID_BUCKETS] = f;
+    pthread_mutex_unlock(&p9->fids_lock);
+    return f;
+}
+
+static void fid_close(P9_FID* f) {
+    if (f->dir)
+        closedir(f->dir);
+    else if (f->fd >= 0)
+        close(f->fd);
+    f->dir = NULL;
+    f->fd = -1;
+}
+
+static int fid_free(VIRTIO_9P* p9, uint32_t fid) {
+    pthread_mutex_lock(&p9->fids_lock);
+    P9_FID** link = &p9->fids[fid % P9_FID_BUCKETS];
+    while (*link && (*link)->fid != fid)
+        link = &(*link)->next;
+    P9_FID* f = *link;
+    if (f)
+        *link = f->next;
+    pthread_mutex_unlock(&p9->fids_lock);
+    if (!f)
+        return EBADF;
+    fid_close(f);
+    free(f->path);
+    free(f);
+    return 0;
+}
+
+static void fid_free_all(VIRTIO_9P* p9) {
+    for (int i = 0; i < P9_FID_BUCKETS; i++)
+        while (p9->fids[i])
+            fid_free(p9, p9->fids[i]->fid);
+}
+
+// dir/name for one path element; ".." stops at the share's root
+static char* path_join(const char* dir, const char* name) {
+    char* p;
+    if (strchr(name, '/') || !*name)
+        return NULL;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        p = strdup(dir);
+        char* slash = p && name[1] ? strrchr(p, '/') : NULL;
+        if (slash)
+            *slash = 0;                 // "a/b" leaves "a"
+        else if (p && name[1])
+            *p = 0;                     // "a" leaves the root
+    } else if (asprintf(&p, "%s%s%s", dir, *dir ? "/" : "", name) < 0) {
+        p = NULL;
+    }
+    if (!p) {
+        fprintf(stderr, "Memory error!");
+        exit(1);
+    }
+    return p;
+}
+
+// Opens the directory holding path's last element, one element at a time
+// from the root without following symlinks, so no name the guest makes can
+// lead out of the share. Points *name at that element ("." for the root)
+// and returns the fd, or -errno.
+static int path_parent(VIRTIO_9P* p9, const char* path, const char** name) {
+    const char* last = strrchr(path, '/');
+    char elem[NAME_MAX + 1];
+    int fd = fcntl(p9->rootfd, F_DUPFD_CLOEXEC, 0);
+
+    *name = !*path ? "." : last ? last + 1 : path;
+    for (const char* p = path; fd >= 0 && last && p < last; ) {
+        const char* end = strchr(p, '/');
+        size_t n = end - p;
+        if (n > NAME_MAX) {
+            close(fd);
+            return -ENAMETOOLONG;
+        }
+        memcpy(elem, p, n);
+        elem[n] = 0;
+        int next = openat(fd, elem, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        int err = errno;
+        close(fd);
+        if (next < 0)
+            return -err;                // a symlink fails with ENOTDIR
+        fd = next;
+        p = end + 1;
+    }
+    return fd < 0 ? -errno : fd;
+}
+
+static int path_stat(VIRTIO_9P* p9, const char* path, struct stat* st) {
+    const char* name;
+    int dfd = path_parent(p9, path, &name);
+    if (dfd < 0)
+        return -dfd;
+    int err = fstatat(dfd, name, st, AT_SYMLINK_NOFOLLOW) < 0 ? errno : 0;
+    close(dfd);
+    return err;
+}
+
+//=====================================================================================
+//   Requests
+//=====================================================================================
+
+// Open flags that mean the same on the host, the rest are dropped
+#define P9_OPEN_FLAGS   (O_ACCMODE | O_TRUNC | O_APPEND | O_EXCL | O_DIRECTORY \
+                         | O_NOFOLLOW | O_SYNC | O_DSYNC)
+
+static int p9_version(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out) {
+    uint32_t msize = get(in, 4);
+    const char* version = get_str(in);
+    if (in->err)
+        return EPROTO;
+    fid_free_all(p9);
+    p9->msize = msize < P9_MSIZE ? msize : P9_MSIZE;
+    put(out, p9->msize, 4);
+    put_str(out, strcmp(version, "9P2000.L") == 0 ? "9P2000.L" : "unknown");
+    return 0;
+}
+
+static int p9_attach(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out) {
+    uint32_t fid = get(in, 4);
+    struct stat st;
+    if (in->err)
+        return EPROTO;
+    if (fstat(p9->rootfd, &st) < 0)
+        return errno;
+    if (!fid_new(p9, fid, strdup("")))
+        return EBADF;
+    put_qid(out, &st);
+    return 0;
+}
+
+static int p9_walk(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out) {
+    uint32_t fid = get(in, 4);
+    uint32_t newfid = get(in, 4);
+    uint32_t nwname = get(in, 2);
+    P9_FID* f = fid_get(p9, fid);
+    struct stat st;
+    uint32_t i;
+
+    if (in->err || nwname > P9_WALK_MAX)
+        return EPROTO;
+    if (!f)
+        return EBADF;
+    char* path = strdup(f->path);
+    uint32_t count = out->pos;
+    put(out, 0, 2);
+    for (i = 0; i < nwname; i++) {
+        const char* name = get_str(in);
+        char* next = in->err ? NULL : path_join(path, name);
+        int err = next ? path_stat(p9, next, &st) : ENOENT;
+        if (err) {
+            free(next);
+            if (i == 0) {
+                free(path);
+                return err;
+            }
+            break;
+        }
+        free(path);
+        path = next;
+        put_qid(out, &st);
+    }
+    out->buf[count] = i;
+    out->buf[count + 1] = i >> 8;
+
+    // a partial walk only reports how far it got
+    if (i < nwname) {
+        free(path);
+    } else if (newfid == fid) {
+        free(f->path);
+        f->path = path;
+    } else if (!fid_new(p9, newfid, path)) {
+        return EBADF;
+    }
+    return 0;
+}
+
+static int p9_getattr(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    struct stat st;
+    if (!f)
+        return EBADF;
+    int err = path_stat(p9, f->path, &st);
+    if (err)
+        return err;
+    put(out, P9_GETATTR_BASIC, 8);
+    put_qid(out, &st);
+    put(out, st.st_mode, 4);
+    put(out, st.st_uid, 4);
+    put(out, st.st_gid, 4);
+    put(out, st.st_nlink, 8);
+    put(out, st.st_rdev, 8);
+    put(out, st.st_size, 8);
+    put(out, st.st_blksize, 8);
+    put(out, st.st_blocks, 8);
+    put(out, st.st_atim.tv_sec, 8);
+    put(out, st.st_atim.tv_nsec, 8);
+    put(out, st.st_mtim.tv_sec, 8);
+    put(out, st.st_mtim.tv_nsec, 8);
+    put(out, st.st_ctim.tv_sec, 8);
+    put(out, st.st_ctim.tv_nsec, 8);
+    put(out, 0, 8 * 4);             // btime, gen, data_version
+    return 0;
+}
+
+static int p9_setattr(VIRTIO_9P* p9, P9_MSG* in) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    uint32_t valid = get(in, 4);
+    uint32_t mode = get(in, 4);
+    uint32_t uid = get(in, 4);
+    uint32_t gid = get(in, 4);
+    uint64_t size = get(in, 8);
+    struct timespec ts[2];
+    ts[0].tv_sec = get(in, 8);
+    ts[0].tv_nsec = get(in, 8);
+    ts[1].tv_sec = get(in, 8);
+    ts[1].tv_nsec = get(in, 8);
+
+    if (in->err)
+        return EPROTO;
+    if (!f)
+        return EBADF;
+    const char* name;
+    int dfd = path_parent(p9, f->path, &name);
+    int err = 0;
+    if (dfd < 0)
+        return -dfd;
+    if ((valid & P9_SETATTR_MODE) && fchmodat(dfd, name, mode, AT_SYMLINK_NOFOLLOW) < 0)
+        err = errno;
+    if (!err && (valid & (P9_SETATTR_UID | P9_SETATTR_GID))
+            && fchownat(dfd, name, (valid & P9_SETATTR_UID) ? uid : (uid_t) -1,
+                        (valid & P9_SETATTR_GID) ? gid : (gid_t) -1, AT_SYMLINK_NOFOLLOW) < 0)
+        err = errno;
+    if (!err && (valid & P9_SETATTR_SIZE)) {
+        int fd = openat(dfd, name, O_WRONLY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0 || ftruncate(fd, size) < 0)
+            err = errno;
+        if (fd >= 0)
+            close(fd);
+    }
+    if (!err && (valid & (P9_SETATTR_ATIME | P9_SETATTR_MTIME))) {
+        if (!(valid & P9_SETATTR_ATIME))
+            ts[0].tv_nsec = UTIME_OMIT;
+        else if (!(valid & P9_SETATTR_ATIME_SET))
+            ts[0].tv_nsec = UTIME_NOW;
+        if (!(valid & P9_SETATTR_MTIME))
+            ts[1].tv_nsec = UTIME_OMIT;
+        else if (!(valid & P9_SETATTR_MTIME_SET))
+            ts[1].tv_nsec = UTIME_NOW;
+        if (utimensat(dfd, name, ts, AT_SYMLINK_NOFOLLOW) < 0)
+            err = errno;
+    }
+    close(dfd);
+    return err;
+}
+
+static int p9_lopen(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    uint32_t flags = get(in, 4);
+    struct stat st;
+    if (in->err)
+        return EPROTO;
+    if (!f)
+        return EBADF;
+    const char* name;
+    int dfd = path_parent(p9, f->path, &name);
+    if (dfd < 0)
+        return -dfd;
+    int fd = openat(dfd, name, (flags & P9_OPEN_FLAGS) | O_NOFOLLOW | O_CLOEXEC);
+    int err = errno;
+    close(dfd);
+    if (fd < 0)
+        return err;
+    fid_close(f);
+    f->fd = fd;
+    fstat(fd, &st);
+    put_qid(out, &st);
+    put(out, 0, 4);                 // iounit, the client goes by msize
+    return 0;
+}
+
+static int p9_lcreate(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    const char* name = get_str(in);
+    uint32_t flags = get(in, 4);
+    uint32_t mode = get(in, 4);
+    struct stat st;
+    if (in->err)
+        return EPROTO;
+    if (!f)
+        return EBADF;
+    char* path = path_join(f->path, name);
+    if (!path)
+        return EINVAL;
+    int dfd = path_parent(p9, path, &name);
+    int fd = dfd < 0 ? dfd : openat(dfd, name, (flags & P9_OPEN_FLAGS) | O_CREAT | O_NOFOLLOW
+                                    | O_CLOEXEC, mode & 07777);
+    int err = dfd < 0 ? -dfd : errno;
+    if (dfd >= 0)
+        close(dfd);
+    if (fd < 0) {
+        free(path);
+        return err;
+    }
+    // the fid now stands for the new file
+    fid_close(f);
+    free(f->path);
+    f->path = path;
+    f->fd = fd;
+    fstat(fd, &st);
+    put_qid(out, &st);
+    put(out, 0, 4);
+    return 0;
+}
+
+// File data goes from the file straight into the chain's writable buffers,
+// after the reply header; *inplace tells the caller only that header is left
+static int p9_read(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out, VIRTQ_CHAIN* c, int* inplace) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    uint64_t offset = get(in, 8);
+    uint64_t count = get(in, 4);
+    struct iovec iov[VIRTIO_CHAIN_MAX];
+    if (in->err)
+        return EPROTO;
+    if (!f || f->fd < 0)
+        return EBADF;
+    if (count > p9->msize - P9_IOHDR)
+        count = p9->msize - P9_IOHDR;
+    uint32_t n = virtio_iov_slice(c->iov + c->nout, c->nin, P9_IOHDR, count, iov);
+    ssize_t got = n ? preadv(f->fd, iov, n, offset) : 0;
+    if (got < 0)
+        return errno;
+    put(out, got, 4);
+    out->pos += got;
+    *inplace = 1;
+    return 0;
+}
+
+// Data is taken from the chain's readable buffers, past the request fields
+static int p9_write(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out, VIRTQ_CHAIN* c) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    uint64_t offset = get(in, 8);
+    uint64_t count = get(in, 4);
+    struct iovec iov[VIRTIO_CHAIN_MAX];
+    if (in->err)
+        return EPROTO;
+    if (!f || f->fd < 0)
+        return EBADF;
+    uint32_t n = virtio_iov_slice(c->iov, c->nout, P9_TWRITE_HDR, count, iov);
+    ssize_t done = n ? pwritev(f->fd, iov, n, offset) : 0;
+    if (done < 0)
+        return errno;
+    put(out, done, 4);
+    return 0;
+}
+
+static int p9_readdir(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    uint64_t offset = get(in, 8);
+    uint32_t count = get(in, 4);
+    if (in->err)
+        return EPROTO;
+    if (!f || f->fd < 0)
+        return EBADF;
+    if (!f->dir && !(f->dir = fdopendir(f->fd)))
+        return errno;
+    if (offset == 0)
+        rewinddir(f->dir);
+    else
+        seekdir(f->dir, offset);
+
+    if (count > out->len - out->pos - 4)
+        count = out->len - out->pos - 4;
+    uint32_t start = out->pos + 4;
+    out->pos = start;
+    for (;;) {
+        long before = telldir(f->dir);
+        struct dirent* d = readdir(f->dir);
+        if (!d)
+            break;
+        uint32_t size = 13 + 8 + 1 + 2 + strlen(d->d_name);
+        if (out->pos + size - start > count) {
+            seekdir(f->dir, before);    // next Treaddir starts here
+            break;
+        }
+        put(out, d->d_type == DT_DIR ? P9_QID_DIR : d->d_type == DT_LNK ? P9_QID_SYMLINK : 0, 1);
+        put(out, 0, 4);
+        put(out, d->d_ino, 8);
+        put(out, telldir(f->dir), 8);
+        put(out, d->d_type, 1);
+        put_str(out, d->d_name);
+    }
+    uint32_t end = out->pos;
+    out->pos = start - 4;
+    put(out, end - start, 4);
+    out->pos = end;
+    return 0;
+}
+
+static int p9_statfs(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    struct statfs s;
+    if (!f)
+        return EBADF;
+    const char* name;
+    int dfd = path_parent(p9, f->path, &name);
+    if (dfd < 0)
+        return -dfd;
+    int fd = openat(dfd, name, O_PATH | O_NOFOLLOW | O_CLOEXEC);
+    int err = fd < 0 || fstatfs(fd, &s) < 0 ? errno : 0;
+    close(dfd);
+    if (fd >= 0)
+        close(fd);
+    if (err)
+        return err;
+    uint64_t fsid;
+    memcpy(&fsid, &s.f_fsid, sizeof(fsid));
+    put(out, s.f_type, 4);
+    put(out, s.f_bsize, 4);
+    put(out, s.f_blocks, 8);
+    put(out, s.f_bfree, 8);
+    put(out, s.f_bavail, 8);
+    put(out, s.f_files, 8);
+    put(out, s.f_ffree, 8);
+    put(out, fsid, 8);
+    put(out, s.f_namelen, 4);
+    return 0;
+}
+
+// Tmkdir and Tsymlink: make name in the fid's directory and return its qid
+static int p9_make(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out, uint8_t type) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    const char* name = get_str(in);
+    const char* target = type == P9_TSYMLINK ? get_str(in) : NULL;
+    uint32_t mode = type == P9_TMKDIR ? get(in, 4) : 0;
+    struct stat st;
+    int err = 0;
+    if (in->err)
+        return EPROTO;
+    if (!f)
+        return EBADF;
+    char* path = path_join(f->path, name);
+    if (!path)
+        return EINVAL;
+    int dfd = path_parent(p9, path, &name);
+    if (dfd < 0)
+        err = -dfd;
+    else if ((target ? symlinkat(target, dfd, name) : mkdirat(dfd, name, mode & 07777)) < 0
+            || fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+        err = errno;
+    else
+        put_qid(out, &st);
+    if (dfd >= 0)
+        close(dfd);
+    free(path);
+    return err;
+}
+
+// Path of name in directory fid dfid, NULL with *err set on failure
+static char* p9_child(VIRTIO_9P* p9, uint32_t dfid, const char* name, int* err) {
+    P9_FID* d = fid_get(p9, dfid);
+    char* path = d ? path_join(d->path, name) : NULL;
+    if (!path)
+        *err = d ? EINVAL : EBADF;
+    return path;
+}
+
+static int p9_unlinkat(VIRTIO_9P* p9, P9_MSG* in) {
+    uint32_t dfid = get(in, 4);
+    const char* name = get_str(in);
+    uint32_t flags = get(in, 4);
+    int err = 0;
+    if (in->err)
+        return EPROTO;
+    char* path = p9_child(p9, dfid, name, &err);
+    int dfd = path ? path_parent(p9, path, &name) : 0;
+    if (dfd < 0)
+        err = -dfd;
+    else if (path && unlinkat(dfd, name, (flags & P9_AT_REMOVEDIR) ? AT_REMOVEDIR : 0) < 0)
+        err = errno;
+    if (path && dfd >= 0)
+        close(dfd);
+    free(path);
+    return err;
+}
+
+static int path_rename(VIRTIO_9P* p9, const char* from, const char* to) {
+    const char *oldname, *newname;
+    int olddfd = path_parent(p9, from, &oldname);
+    int newdfd = olddfd < 0 ? olddfd : path_parent(p9, to, &newname);
+    int err = olddfd < 0 ? -olddfd : newdfd < 0 ? -newdfd : 0;
+    if (!err && renameat(olddfd, oldname, newdfd, newname) < 0)
+        err = errno;
+    if (olddfd >= 0)
+        close(olddfd);
+    if (newdfd >= 0)
+        close(newdfd);
+    return err;
+}
+
+static int p9_renameat(VIRTIO_9P* p9, P9_MSG* in) {
+    uint32_t olddfid = get(in, 4);
+    const char* oldname = get_str(in);
+    uint32_t newdfid = get(in, 4);
+    const char* newname = get_str(in);
+    int err = 0;
+    if (in->err)
+        return EPROTO;
+    char* from = p9_child(p9, olddfid, oldname, &err);
+    char* to = from ? p9_child(p9, newdfid, newname, &err) : NULL;
+    if (to)
+        err = path_rename(p9, from, to);
+    free(from);
+    free(to);
+    return err;
+}
+
+static int p9_rename(VIRTIO_9P* p9, P9_MSG* in) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    uint32_t dfid = get(in, 4);
+    const char* name = get_str(in);
+    int err = 0;
+    if (in->err)
+        return EPROTO;
+    if (!f)
+        return EBADF;
+    char* to = p9_child(p9, dfid, name, &err);
+    if (!to)
+        return err;
+    if ((err = path_rename(p9, f->path, to))) {
+        free(to);
+        return err;
+    }
+    free(f->path);
+    f->path = to;
+    return 0;
+}
+
+static int p9_readlink(VIRTIO_9P* p9, P9_MSG* in, P9_MSG* out) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    char target[PATH_MAX];
+    if (!f)
+        return EBADF;
+    const char* name;
+    int dfd = path_parent(p9, f->path, &name);
+    if (dfd < 0)
+        return -dfd;
+    ssize_t n = readlinkat(dfd, name, target, sizeof(target) - 1);
+    int err = errno;
+    close(dfd);
+    if (n < 0)
+        return err;
+    target[n] = 0;
+    put_str(out, target);
+    return 0;
+}
+
+static int p9_fsync(VIRTIO_9P* p9, P9_MSG* in) {
+    P9_FID* f = fid_get(p9, get(in, 4));
+    uint32_t datasync = get(in, 4);
+    if (!f || f->fd < 0)
+        return EBADF;
+    if ((datasync ? fdatasync(f->fd) : fsync(f->fd)) < 0)
+        return errno;
+    return 0;
+}
+
+static int p9_remove(VIRTIO_9P* p9, P9_MSG* in) {
+    uint32_t fid = get(in, 4);
+    P9_FID* f = fid_get(p9, fid);
+    struct stat st;
+    const char* name;
+    int err = 0;
+    if (!f)
+        return EBADF;
+    int dfd = path_parent(p9, f->path, &name);
+    if (dfd < 0)
+        err = -dfd;
+    else if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0
+            || unlinkat(dfd, name, S_ISDIR(st.st_mode) ? AT_REMOVEDIR : 0) < 0)
+        err = errno;
+    if (dfd >= 0)
+        close(dfd);
+    fid_free(p9, fid);              // clunked even when the remove fails
+    return err;
+}
+
+// Serves the request in chain c, returns the reply length. The reply is
+// written to guest RAM but not yet marked dirty, see p9_written().
+static uint32_t p9_handle(VIRTIO_9P* p9, VIRTQ_CHAIN* c, uint8_t* reqbuf, uint8_t* replybuf) {
+    struct iovec* iov = c->iov + c->nout;
+    uint64_t room = 0;
+    uint32_t len = 0;
+
+    for (uint32_t i = 0; i < c->nin; i++)
+        room += iov[i].iov_len;
+    for (uint32_t i = 0; i < c->nout && len < P9_REQ_MAX; i++) {
+        uint32_t part = iov[i].iov_len < P9_REQ_MAX - len ? iov[i].iov_len : P9_REQ_MAX - len;
+        memcpy(reqbuf + len, c->iov[i].iov_base, part);
+        len += part;
+    }
+    if (room < P9_HDR + 4)
+        return 0;                   // nowhere to put even an error
+
+    P9_MSG in = { reqbuf, len, 0, 0 };
+    uint32_t size = get(&in, 4);
+    uint8_t type = get(&in, 1);
+    uint16_t tag = get(&in, 2);
+    if (!in.err && size < in.len)
+        in.len = size;
+    P9_MSG out = { replybuf, room < p9->msize ? room : p9->msize, P9_HDR, 0 };
+    int inplace = 0;
+    int err;
+
+    switch (in.err ? 0 : type) {
+        case P9_TVERSION:   err = p9_version(p9, &in, &out); break;
+        case P9_TATTACH:    err = p9_attach(p9, &in, &out); break;
+        case P9_TWALK:      err = p9_walk(p9, &in, &out); break;
+        case P9_TGETATTR:   err = p9_getattr(p9, &in, &out); break;
+        case P9_TSETATTR:   err = p9_setattr(p9, &in); break;
+        case P9_TLOPEN:     err = p9_lopen(p9, &in, &out); break;
+        case P9_TLCREATE:   err = p9_lcreate(p9, &in, &out); break;
+        case P9_TREAD:      err = p9_read(p9, &in, &out, c, &inplace); break;
+        case P9_TWRITE:     err = p9_write(p9, &in, &out, c); break;
+        case P9_TREADDIR:   err = p9_readdir(p9, &in, &out); break;
+        case P9_TCLUNK:     err = fid_free(p9, get(&in, 4)); break;
+        case P9_TREMOVE:    err = p9_remove(p9, &in); break;
+        case P9_TSTATFS:    err = p9_statfs(p9, &in, &out); break;
+        case P9_TMKDIR:
+        case P9_TSYMLINK:   err = p9_make(p9, &in, &out, type); break;
+        case P9_TUNLINKAT:  err = p9_unlinkat(p9, &in); break;
+        case P9_TRENAMEAT:  err = p9_renameat(p9, &in); break;
+        case P9_TRENAME:    err = p9_rename(p9, &in); break;
+        case P9_TREADLINK:  err = p9_readlink(p9, &in, &out); break;
+        case P9_TFSYNC:     err = p9_fsync(p9, &in); break;
+        case P9_TFLUSH:     err = 0; break;     // requests are never left half done
+        default:            err = EOPNOTSUPP;   // xattrs, locks and links among them
+    }
+    if (!err && out.err)
+        err = EMSGSIZE;
+    if (err) {
+        inplace = 0;
+        out.pos = P9_HDR;
+        put(&out, err, 4);
+        type = P9_RLERROR - 1;
+    }
+
+    uint32_t total = out.pos;
+    out.pos = 0;
+    put(&out, total, 4);
+    put(&out, type + 1, 1);
+    put(&out, tag, 2);
+
+    // scatter what was built here, Rread's data is already in place
+    uint32_t built = inplace ? P9_IOHDR : total;
+    for (uint32_t i = 0, off = 0; i < c->nin && off < built; i++) {
+        uint32_t part = iov[i].iov_len < built - off ? iov[i].iov_len : built - off;
+        memcpy(iov[i].iov_base, replybuf + off, part);
+        off += part;
+    }
+    return total;
+}
+
+//=====================================================================================
+//   Device
+//=====================================================================================
+
+// Marks the reply dirty and completes the chain, on the hart's thread only
+static void p9_complete(VIRTIO* vio, VIRTQ_CHAIN* c, uint32_t len) {
+    struct iovec* iov = c->iov + c->nout;
+    uint64_t left = len;
+    for (uint32_t i = 0; i < c->nin && left; i++) {
+        uint64_t part = left < iov[i].iov_len ? left : iov[i].iov_len;
+        virtio_written(vio, iov[i].iov_base, part);
+        left -= part;
+    }
+    virtq_push(vio, &vio->q[0], c->head, len);
+}
+
+static void* p9_worker(void* arg) {
+    VIRTIO_9P* p9 = arg;
+    uint8_t* req = malloc(P9_REQ_MAX);
+    uint8_t* reply = malloc(P9_MSIZE);
+    if (!req || !reply) {
+        fprintf(stderr, "Memory error!");
+        exit(1);
+    }
+    for (;;) {
+        pthread_mutex_lock(&p9->lock);
+        while (p9->todo_head == p9->todo_tail)
+            pthread_cond_wait(&p9->wake, &p9->lock);
+        P9_JOB job = p9->todo[p9->todo_head++ % VIRTIO_QUEUE_SIZE];
+        pthread_mutex_unlock(&p9->lock);
+
+        job.len = p9_handle(p9, &job.chain, req, reply);
+
+        pthread_mutex_lock(&p9->lock);
+        p9->done[p9->done_tail % VIRTIO_QUEUE_SIZE] = job;
+        __atomic_store_n(&p9->done_tail, p9->done_tail + 1, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&p9->lock);
+    }
+    return NULL;
+}
+
+// Every pending chain is taken at once. At most num chains are ever in
+// flight, so the job rings cannot overflow.
+static void p9_notify(VIRTIO* vio, uint32_t queue) {
+    VIRTIO_9P* p9 = vio->dev;
+    VIRTQ* q = &vio->q[queue];
+    VIRTQ_CHAIN c;
+    uint16_t pending = virtq_pending(vio, q);
+
+    if (pending == 0)
+        return;
+    if (p9->nthreads)
+        pthread_mutex_lock(&p9->lock);
+    for (uint16_t i = 0; i < pending; i++) {
+        if (virtq_peek(vio, q, i, &c) < 0) {
+            virtq_push(vio, q, c.head, 0);
+        } else if (p9->nthreads) {
+            P9_JOB* job = &p9->todo[p9->todo_tail++ % VIRTIO_QUEUE_SIZE];
+            job->chain = c;
+            job->gen = p9->gen;
+        } else {
+            p9_complete(vio, &c, p9_handle(p9, &c, p9->req, p9->reply));
+        }
+    }
+    if (p9->nthreads) {
+        pthread_cond_broadcast(&p9->wake);
+        pthread_mutex_unlock(&p9->lock);
+    }
+    virtq_publish(vio, q, pending);
+}
+
+// Publishes whatever the workers have finished since the last poll
+static void p9_poll(void* dev) {
+    VIRTIO* vio = dev;
+    VIRTIO_9P* p9 = vio->dev;
+    uint32_t n = 0;
+
+    // checked without the lock, the run loop polls far more often than workers finish
+    if (!p9->nthreads || p9->done_head == __atomic_load_n(&p9->done_tail, __ATOMIC_ACQUIRE))
+        return;
+    pthread_mutex_lock(&p9->lock);
+    for (; p9->done_head != p9->done_tail; p9->done_head++) {
+        P9_JOB* job = &p9->done[p9->done_head % VIRTIO_QUEUE_SIZE];
+        if (job->gen != p9->gen || !vio->q[0].num)
+            continue;               // taken before a device reset
+        p9_complete(vio, &job->chain, job->len);
+        n++;
+    }
+    pthread_mutex_unlock(&p9->lock);
+    if (n)
+        virtq_publish(vio, &vio->q[0], 0);
+}
+
+// Fork-server children have no workers and serve requests themselves;
+// requests still with the parent's workers are not answered
+static VIRTIO_9P* shares[VIRTIO_MMIO_MAX];
+static uint32_t nshares;
+
+static void p9_atfork_child(void) {
+    for (uint32_t i = 0; i < nshares; i++) {
+        shares[i]->nthreads = 0;
+        pthread_mutex_init(&shares[i]->fids_lock, NULL);
+        pthread_mutex_init(&shares[i]->lock, NULL);
+    }
+}
+
+static void p9_reset(VIRTIO* vio) {
+    VIRTIO_9P* p9 = vio->dev;
+    if (p9->nthreads)
+        pthread_mutex_lock(&p9->lock);
+    p9->gen++;
+    if (p9->nthreads)
+        pthread_mutex_unlock(&p9->lock);
+}
+
+int virtio_9p_init(BUS* bus, const char* spec) {
+    char path[PATH_MAX], tag[256] = "hostshare";
+    uint32_t threads = 0;
+    const char* comma = strchr(spec, ',');
+    size_t len = comma ? (size_t)(comma - spec) : strlen(spec);
+
+    if (len == 0 || len >= sizeof(path)) {
+        fprintf(stderr, "[-] ERROR-> bad 9p share %s\n", spec);
+        return -1;
+    }
+    memcpy(path, spec, len);
+    path[len] = 0;
+    if (comma) {
+        const char* t = comma + 1;
+        const char* end = strchr(t, ',');
+        size_t tlen = end ? (size_t)(end - t) : strlen(t);
+        char* rest;
+        if (tlen == 0 || tlen >= sizeof(tag)) {
+            fprintf(stderr, "[-] ERROR-> bad 9p share %s\n", spec);
+            return -1;
+        }
+        memcpy(tag, t, tlen);
+        tag[tlen] = 0;
+        if (end) {
+            threads = strtoul(end + 1, &rest, 0);
+            if (*rest || threads > P9_THREADS_MAX) {
+                fprintf(stderr, "[-] ERROR-> 9p threads must be 0 to %d\n", P9_THREADS_MAX);
+                return -1;
+            }
+        }
+    }
+
+    VIRTIO_9P* p9 = calloc(1, sizeof(VIRTIO_9P));
+    if (!p9 || !(p9->req = malloc(P9_REQ_MAX)) || !(p9->reply = malloc(P9_MSIZE))) {
+        fprintf(stderr, "Memory error!");
+        return -1;
+    }
+    p9->rootfd = open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (p9->rootfd < 0) {
+        fprintf(stderr, "[-] ERROR-> cannot share %s, not a directory\n", path);
+        return -1;
+    }
+    p9->msize = P9_MSIZE;
+    pthread_mutex_init(&p9->fids_lock, NULL);
+    pthread_mutex_init(&p9->lock, NULL);
+    pthread_cond_init(&p9->wake, NULL);
+
+    p9->config[0] = strlen(tag);
+    memcpy(p9->config + 2, tag, strlen(tag));
+
+    VIRTIO* vio = &p9->vio;
+    vio->device_id = VIRTIO_ID_9P;
+    vio->name = "9p";
+    vio->features = VIRTIO_F_VERSION_1 | VIRTIO_RING_F_EVENT_IDX | VIRTIO_9P_MOUNT_TAG;
+    vio->nqueues = 1;
+    vio->config = p9->config;
+    vio->config_len = 2 + strlen(tag);
+    vio->dev = p9;
+    vio->notify = p9_notify;
+    vio->reset = p9_reset;
+    if (virtio_attach(bus, vio, p9_poll) < 0)
+        return -1;
+
+    for (uint32_t i = 0; i < threads; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, p9_worker, p9) != 0) {
+            fprintf(stderr, "[-] ERROR-> cannot start 9p worker\n");
+            return -1;
+        }
+        pthread_detach(t);
+    }
+    p9->nthreads = threads;
+    if (threads && nshares++ == 0)
+        pthread_atfork(NULL, NULL, p9_atfork_child);
+    if (threads)
+        shares[nshares - 1] = p9;
+    return 0;
+}
@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../includes/virtio_net.h"
+
+#define VIRTIO_NET_F_MAC        (1ULL << 5)
+#define VIRTIO_NET_F_STATUS     (1ULL << 16)
+#define VIRTIO_NET_S_LINK_UP    1
+
+#define NET_RXQ     0
+#define NET_TXQ     1
+
+typedef struct VIRTIO_NET {
+    VIRTIO vio;
+    int fd;                         // datagram socket
+    uint8_t config[10];             // mac[6], status, max_virtqueue_pairs
+    // preallocated batch state, no allocation per frame
+    struct mmsghdr msgs[NET_BATCH];
+    struct iovec iovs[NET_BATCH][VIRTIO_CHAIN_MAX];
+    VIRTQ_CHAIN chains[NET_BATCH];
+    uint8_t* hdrs[NET_BATCH];       // where each RX chain's header goes
+} VIRTIO_NET;
+
+static const uint8_t net_mac[6] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+
+// Guest to host: every pending TX chain is sent, a batch per sendmmsg.
+// Frames the socket cannot take are dropped, as on a full wire.
+static void net_tx(VIRTIO* vio, uint32_t queue) {
+    VIRTIO_NET* net = vio->dev;
+    VIRTQ* q = &vio->q[queue];
+    uint16_t pending;
+
+    while ((pending = virtq_pending(vio, q)) > 0) {
+        uint32_t n = pending < NET_BATCH ? pending : NET_BATCH;
+        uint32_t frames = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            VIRTQ_CHAIN* c = &net->chains[i];
+            if (virtq_peek(vio, q, i, c) < 0) {
+                c->nout = 0;        // completed without being sent
+                continue;
+            }
+            struct msghdr* h = &net->msgs[frames].msg_hdr;
+            memset(h, 0, sizeof(*h));
+            h->msg_iov = net->iovs[frames];
+            h->msg_iovlen = virtio_iov_slice(c->iov, c->nout, NET_HDR_SIZE, UINT64_MAX,
+                                             net->iovs[frames]);
+            frames++;
+        }
+        if (frames > 0)
+            sendmmsg(net->fd, net->msgs, frames, MSG_DONTWAIT);
+        for (uint32_t i = 0; i < n; i++)
+            virtq_push(vio, q, net->chains[i].head, 0);
+        virtq_publish(vio, q, n);
+    }
+}
+
+// Host to guest: as many datagrams as there are RX chains, one recvmmsg
+static void net_rx(void* dev) {
+    VIRTIO* vio = dev;
+    VIRTIO_NET* net = vio->dev;
+    VIRTQ* q = &vio->q[NET_RXQ];
+
+    if (!(vio->status & 0x4))       // DRIVER_OK
+        return;
+    for (;;) {
+        uint16_t pending = virtq_pending(vio, q);
+        uint32_t n = pending < NET_BATCH ? pending : NET_BATCH;
+        uint32_t bufs = 0;
+
+        for (uint32_t i = 0; i < n; i++, bufs++) {
+            VIRTQ_CHAIN* c = &net->chains[i];
+            if (virtq_peek(vio, q, i, c) < 0 || c->nin == 0
+                    || c->iov[c->nout].iov_len < NET_HDR_SIZE)
+                break;              // stop at a bad chain, the ones before still go
+            struct iovec* in = c->iov + c->nout;
+            struct msghdr* h = &net->msgs[i].msg_hdr;
+            memset(h, 0, sizeof(*h));
+            net->hdrs[i] = in[0].iov_base;
+            h->msg_iov = net->iovs[i];
+            h->msg_iovlen = virtio_iov_slice(in, c->nin, NET_HDR_SIZE, UINT64_MAX, net->iovs[i]);
+        }
+        if (bufs == 0)
+            return;
+
+        int got = recvmmsg(net->fd, net->msgs, bufs, MSG_DONTWAIT, NULL);
+        if (got <= 0)
+            return;
+        for (int i = 0; i < got; i++) {
+            uint32_t len = net->msgs[i].msg_len;
+            uint8_t* hdr = net->hdrs[i];
+            memset(hdr, 0, NET_HDR_SIZE);
+            hdr[10] = 1;            // num_buffers
+            virtio_written(vio, hdr, NET_HDR_SIZE);
+            // the frame was scattered over the chain's writable buffers
+            struct iovec* in = net->chains[i].iov + net->chains[i].nout;
+            uint64_t left = NET_HDR_SIZE + len;
+            for (uint32_t j = 0; j < net->chains[i].nin && left; j++) {
+                uint64_t part = left < in[j].iov_len ? left : in[j].iov_len;
+                virtio_written(vio, in[j].iov_base, part);
+                left -= part;
+            }
+            virtq_push(vio, q, net->chains[i].head, NET_HDR_SIZE + len);
+        }
+        virtq_publish(vio, q, got);
+        if ((uint32_t) got < bufs)
+            return;                 // socket drained
+    }
+}
+
+static void net_notify(VIRTIO* vio, uint32_t queue) {
+    if (queue == NET_TXQ)
+        net_tx(vio, queue);
+    else
+        net_rx(vio);                // new RX buffers, deliver what is waiting
+}
+
+static int net_socket(const char* backend) {
+    if (strncmp(backend, "fd:", 3) == 0) {
+        char* end;
+        int fd = strtol(backend + 3, &end, 0);
+        if (*end || fd < 0 || fcntl(fd, F_GETFD) < 0)
+            return -1;
+        return fd;
+    }
+
+    struct sockaddr_un un = { .sun_family = AF_UNIX };
+    if (strlen(backend) >= sizeof(un.sun_path))
+        return -1;
+    strcpy(un.sun_path, backend);
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return -1;
+    // an autobound abstract address, so the peer can answer
+    struct sockaddr_un self = { .sun_family = AF_UNIX };
+    if (bind(fd, (struct sockaddr*) &self, sizeof(sa_family_t)) < 0
+            || connect(fd, (struct sockaddr*) &un, sizeof(un)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int virtio_net_init(BUS* bus, const char* backend) {
+    VIRTIO_NET* net = calloc(1, sizeof(VIRTIO_NET));
+    if (!net) {
+        fprintf(stderr, "Memory error!");
+        return -1;
+    }
+    net->fd = net_socket(backend);
+    if (net->fd < 0) {
+        fprintf(stderr, "[-] ERROR-> cannot open network backend %s\n", backend);
+        free(net);
+        return -1;
+    }
+
+    memcpy(net->config, net_mac, sizeof(net_mac));
+    net->config[6] = VIRTIO_NET_S_LINK_UP;
+    net->config[8] = 1;             // one queue pair
+
+    VIRTIO* vio = &net->vio;
+    vio->device_id = VIRTIO_ID_NET;
+    vio->name = "net";
+    vio->features = VIRTIO_F_VERSION_1 | VIRTIO_RING_F_EVENT_IDX
+        | VIRTIO_NET_F_MAC | VIRTIO_NET_F_STATUS;
+    vio->nqueues = 2;
+    vio->config = net->config;
+    vio->config_len = sizeof(net->config);
+    vio->dev = net;
+    vio->notify = net_notify;
+    return virtio_attach(bus, vio, net_rx);
+}
@@ -0,0 +1,210 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../includes/cpu.h"
+#include "../includes/gdbstub.h"
+
+static CPU* watch_cpu;          // for the signal handler
+static uint64_t host_page;
+
+static int overlaps(const WATCH* w, uint64_t addr, uint64_t len) {
+    return addr < w->addr + w->len && w->addr < addr + len;
+}
+
+// Strictest protection any watch asks for on the host page at addr
+static int page_prot(const WATCHES* w, uint64_t addr) {
+    int prot = PROT_READ | PROT_WRITE;
+    for (uint32_t i = 0; i < w->n; i++) {
+        if (!overlaps(&w->list[i], addr, host_page))
+            continue;
+        if (w->list[i].kind & WATCH_READ)
+            return PROT_NONE;
+        prot = PROT_READ;
+    }
+    return prot;
+}
+
+static void protect(CPU* cpu, int open) {
+    DRAM* dram = &cpu->bus.dram;
+    WATCHES* w = &cpu->watch;
+    for (uint32_t i = 0; i < w->n; i++) {
+        uint64_t first = (w->list[i].addr - dram->base) & ~(host_page - 1);
+        uint64_t last  = (w->list[i].addr + w->list[i].len - 1 - dram->base) & ~(host_page - 1);
+        for (uint64_t off = first; off <= last; off += host_page)
+            mprotect(dram->mem + off, host_page,
+                     open ? PROT_READ | PROT_WRITE : page_prot(w, dram->base + off));
+    }
+}
+
+void watch_open(CPU* cpu) {
+    if (!cpu->watch.n)
+        return;
+    if (cpu->watch.open++ == 0)
+        protect(cpu, 1);
+    cpu->bus.watch = &cpu->watch;
+}
+
+void watch_close(CPU* cpu) {
+    if (!cpu->watch.n)
+        return;
+    if (--cpu->watch.open == 0) {
+        protect(cpu, 0);
+        cpu->bus.watch = NULL;
+    }
+}
+
+// Faults on watched pages unwind to block_exec. Elsewhere host code
+// (debugger memory access, fork server input) gets the pages opened
+// unchecked until the next block; anything else is a real crash.
+static void segv_handler(int sig, siginfo_t* info, void* uc) {
+    CPU* cpu = watch_cpu;
+    DRAM* dram = &cpu->bus.dram;
+    uint8_t* p = info->si_addr;
+    int watched = 0;
+
+    if (p >= dram->mem && p < dram->mem + dram->size) {
+        uint64_t addr = dram->base + ((p - dram->mem) & ~(host_page - 1));
+        for (uint32_t i = 0; i < cpu->watch.n && !watched; i++)
+            watched = overlaps(&cpu->watch.list[i], addr, host_page);
+    }
+    if (!watched || cpu->watch.open) {
+        signal(SIGSEGV, SIG_DFL);       // returns into the fault and dies of it
+        return;
+    }
+    if (cpu->watch.in_block) {
+        cpu->watch.in_block = 0;
+        siglongjmp(cpu->watch.env, 1);
+    }
+    cpu->watch.open++;
+    cpu->watch.stray = 1;
+    protect(cpu, 1);
+}
+
+static int install(CPU* cpu) {
+    if (watch_cpu)
+        return 0;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = segv_handler;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;      // left by siglongjmp, keep it unblocked
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGSEGV, &sa, NULL) < 0)
+        return -1;
+    host_page = sysconf(_SC_PAGESIZE);
+    watch_cpu = cpu;
+    return 0;
+}
+
+int watch_add(CPU* cpu, uint64_t addr, uint64_t len, int kind) {
+    WATCHES* w = &cpu->watch;
+    if (len == 0 || !kind || !dram_contains(&cpu->bus.dram, addr, len)) {
+        fprintf(stderr, "[-] ERROR-> watch %#lx+%lu is not in guest RAM\n", addr, len);
+        return -1;
+    }
+    // virtio devices write guest RAM from host threads, which a protected page would kill
+    if (cpu->bus.nmmio) {
+        fprintf(stderr, "[-] ERROR-> watchpoints cannot be used with -n or -9\n");
+        return -1;
+    }
+    if (w->n == WATCH_MAX || install(cpu) < 0) {
+        fprintf(stderr, "[-] ERROR-> no room for watch at %#lx\n", addr);
+        return -1;
+    }
+    if (!w->open)
+        protect(cpu, 1);
+    w->list[w->n++] = (WATCH){ .addr = addr, .len = len, .kind = kind };
+    if (!w->open)
+        protect(cpu, 0);
+    return 0;
+}
+
+int watch_remove(CPU* cpu, uint64_t addr, uint64_t len, int kind) {
+    WATCHES* w = &cpu->watch;
+    for (uint32_t i = 0; i < w->n; i++) {
+        if (w->list[i].addr != addr || w->list[i].len != len || w->list[i].kind != kind)
+            continue;
+        if (!w->open)
+            protect(cpu, 1);
+        w->list[i] = w->list[--w->n];
+        if (!w->open)
+            protect(cpu, 0);
+        if (w->n == 0) {
+            w->open = w->stray = 0;
+            cpu->bus.watch = NULL;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+int watch_parse(CPU* cpu, const char* spec) {
+    char* end;
+    uint64_t addr = strtoull(spec, &end, 0);
+    uint64_t len = 0;
+    int kind = WATCH_WRITE;
+
+    if (*end == ',')
+        len = strtoull(end + 1, &end, 0);
+    if (*end == ',') {
+        switch (end[1]) {
+            case 'w': kind = WATCH_WRITE; break;
+            case 'r': kind = WATCH_READ; break;
+            case 'a': kind = WATCH_ACCESS; break;
+            default: kind = 0;
+        }
+        end += 2;
+    }
+    if (*end || len == 0 || kind == 0) {
+        fprintf(stderr, "[-] ERROR-> bad watch %s, expected addr,len[,r|w|a]\n", spec);
+        return -1;
+    }
+    return watch_add(cpu, addr, len, kind);
+}
+
+void watch_access(WATCHES* w, uint64_t addr, uint64_t len, int kind) {
+    if (w->hit)
+        return;
+    for (uint32_t i = 0; i < w->n; i++) {
+        if ((w->list[i].kind & kind) && overlaps(&w->list[i], addr, len)) {
+            w->hit = i + 1;
+            w->hit_kind = kind;
+            w->hit_addr = addr > w->list[i].addr ? addr : w->list[i].addr;
+            return;
+        }
+    }
+}
+
+void watch_report(CPU* cpu, uint64_t pc) {
+    WATCHES* w = &cpu->watch;
+    if (!w->hit)
+        return;
+    if (cpu->gdb) {
+        cpu->gdb->stop = GDB_SIGTRAP;   // the stop reply names the watch
+        return;
+    }
+    fprintf(stderr, "[+] watch %#lx+%lu: %s at %#lx by pc %#lx\n",
+            w->list[w->hit - 1].addr, w->list[w->hit - 1].len,
+            w->hit_kind == WATCH_WRITE ? "write" : "read", w->hit_addr, pc);
+    w->hit = 0;
+}
+
+// cpu->pc is already past the faulting instruction, loads and stores
+// come after the pc update in every handler, fused ones included
+int watch_fault(CPU* cpu, BLOCK* b) {
+    uint64_t pc = cpu->pc - 4;
+
+    // instret was charged for the whole block
+    cpu->stats.instret -= (b->pc + 4 * b->count - pc) / 4;
+    cpu->pc = pc;
+    cpu->stats.watch_faults++;
+
+    watch_open(cpu);
+    int ok = block_step(cpu);
+    watch_close(cpu);
+    watch_report(cpu, pc);
+    return ok;
+}
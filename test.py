@@ -3,6 +3,12 @@
 import sys
 import re
 import os
+import glob
+import importlib.util
+import shutil
+import struct
+import subprocess
+import tempfile
 
 
 def make_tests(rv_tests_dir, dest_dir):
@@ -25,10 +31,153 @@ def make_tests(rv_tests_dir, dest_dir):
                 
 
 
+# Each tests/<name>.s describes its own run in comments:
+#   # args: <extra emulator options>  ({tmp} is a scratch directory, {fd}
+#                                      the write end of a pipe it inherits,
+#                                      {image} places the image, else last)
+#   # expect: <reg>=<value> ...        (final register dump)
+#   # stderr: <text>                   (must appear in the -s statistics)
+#   # stdout: <text>                   (must appear in the guest's output)
+#   # exit: N                          (the emulator's exit status)
+#   # doorbell: <value> ...            (64-bit words written to {fd})
+#   # snapshot: N                      (checkpoint every N instructions, then
+#                                        restore them and compare the result)
+#   # host: <name>.py                  (check(emu, image, tmp) in that file
+#                                        drives the run, returns the errors)
+# and runs from the tests/<name>.bin or tests/<name>.elf image beside it.
+def run(emu, args, fds=()):
+    p = subprocess.run([emu, "-q", "-s"] + args, pass_fds=fds,
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=60)
+    out = p.stdout.decode(errors="replace")
+    regs = dict(re.findall(r"(\w+):\s*(0x[0-9a-f]+|00)", out))
+    err = " ".join(p.stderr.decode(errors="replace").split())
+    return regs, err, out, p.returncode
+
+
+def retired(err):
+    m = re.search(r"instructions retired : (\d+)", err)
+    return m.group(1) if m else None
+
+
+def check_regs(regs, expect):
+    return ["%s = %s, expected %#x" % (reg, regs.get(reg), v)
+            for reg, v in expect.items()
+            if reg not in regs or int(regs[reg], 16) != v]
+
+
+def check_run(emu, src, image, tmp):
+    args, expect, stderr, stdout = [], {}, [], []
+    doorbell, period, host, status = None, None, None, None
+    for line in open(src):
+        m = re.match(r"#\s*(args|expect|stderr|stdout|exit|doorbell|snapshot|host):\s*(.*)",
+                line)
+        if not m:
+            continue
+        key, val = m.group(1), m.group(2).strip()
+        if key == "args":
+            args += val.split()
+        elif key == "expect":
+            for reg, v in (f.split("=") for f in val.split()):
+                expect[reg] = int(v, 0)
+        elif key == "stderr":
+            stderr.append(" ".join(val.split()))
+        elif key == "stdout":
+            stdout.append(val)
+        elif key == "exit":
+            status = int(val, 0)
+        elif key == "doorbell":
+            doorbell = [int(v, 0) for v in val.split()]
+        elif key == "snapshot":
+            period = val
+        else:
+            host = val
+
+    if host:
+        spec = importlib.util.spec_from_file_location(
+                host[:-3], os.path.join(os.path.dirname(src), host))
+        mod = importlib.util.module_from_spec(spec)
+        spec.loader.exec_module(mod)
+        return mod.check(emu, image, tmp)
+
+    rfd, wfd = os.pipe()
+    args = [a.replace("{tmp}", tmp).replace("{fd}", str(wfd)) for a in args]
+    if "{image}" in args:
+        args[args.index("{image}")] = image
+    else:
+        args.append(image)
+    try:
+        regs, err, out, rc = run(emu, args, (wfd,))
+    finally:
+        os.close(wfd)
+    rung = os.read(rfd, 4096)
+    os.close(rfd)
+
+    errors = check_regs(regs, expect)
+    for text in stderr:
+        if text not in err:
+            errors.append("no \"%s\" in statistics" % text)
+    for text in stdout:
+        if text not in out:
+            errors.append("no \"%s\" in the output" % text)
+    if status is not None and rc != status:
+        errors.append("exit status %d, expected %d" % (rc, status))
+    if doorbell is not None:
+        got = list(struct.unpack("<%dQ" % (len(rung) // 8), rung))
+        if got != doorbell:
+            errors.append("doorbell rang %s, expected %s" % (got, doorbell))
+
+    if period:
+        snap = os.path.join(tmp, "snap")
+        run(emu, args[:-1] + ["-w", snap, "-p", period, image])
+        ckpts = sorted(glob.glob(snap + ".*"),
+                key=lambda f: int(f.split(".")[-1]))
+        if not ckpts:
+            errors.append("no checkpoints written")
+        restore = []
+        for f in ckpts:
+            restore += ["-r", f]
+        again, again_err = run(emu, args[:-1] + restore)[:2]
+        if again != regs or retired(again_err) != retired(err):
+            errors.append("restoring %d checkpoints ends differently"
+                    % len(ckpts))
+    return errors
+
+
+def check_test(emu, src):
+    name = os.path.splitext(src)[0]
+    image = name + ".elf" if os.path.exists(name + ".elf") else name + ".bin"
+    if not os.path.exists(image):
+        errors = ["no image, run make in tests"]
+    else:
+        tmp = tempfile.mkdtemp()
+        try:
+            errors = check_run(emu, src, image, tmp)
+        except Exception as e:
+            errors = ["%s: %s" % (type(e).__name__, e)]
+        finally:
+            shutil.rmtree(tmp)
+
+    print("%-10s %s" % (os.path.basename(name),
+            "ok" if not errors else "FAIL"))
+    for e in errors:
+        print("    " + e)
+    return not errors
+
+
+def check_tests(emu, tests_dir):
+    results = [check_test(emu, src)
+            for src in sorted(glob.glob(os.path.join(tests_dir, "*.s")))
+            if re.search(r"^# (expect|stdout|stderr|exit|host):", open(src).read(), re.M)]
+    print("%d/%d passed" % (sum(results), len(results)))
+    return all(results)
+
 
 if __name__ == "__main__":
+    if len(sys.argv) == 2 and sys.argv[1] == "check":
+        exit(0 if check_tests("./main", "tests") else 1)
     if len(sys.argv) != 3:
         print ("Usage: ./test.py <riscv-tests-dir> <destination>")
+        print ("       ./test.py check")
         exit(1)
     rv_tests_dir = sys.argv[1] + "/isa"
     dest_dir = sys.argv[2]
@@ -0,0 +1,100 @@
+# Host side of tests/9p.s: a 9P2000.L session against a scratch share,
+# including names that try to leave it through symlinks and ".."
+import errno
+import os
+import struct
+import subprocess
+
+REGION = 0x40000000
+REPLIES = 0x10000
+RLERROR = 7
+
+
+def s(text):
+    text = text.encode()
+    return struct.pack("<H", len(text)) + text
+
+
+def check(emu, image, tmp):
+    share = os.path.join(tmp, "share")
+    outside = os.path.join(tmp, "outside")
+    os.makedirs(os.path.join(share, "sub"))
+    os.makedirs(outside)
+    open(os.path.join(share, "hello.txt"), "w").write("hello from the host\n")
+    os.symlink("hello.txt", os.path.join(share, "link"))
+    os.symlink(outside, os.path.join(share, "sub", "up"))
+
+    # (type, body, expected reply type or -errno, None when checked below)
+    reqs = [
+        (100, struct.pack("<I", 8192) + s("9P2000.L"), 101),
+        (104, struct.pack("<III", 1, 0xffffffff, 0) + s("root") + s("")
+                + struct.pack("<I", 0), 105),
+        (110, struct.pack("<IIH", 1, 2, 1) + s("hello.txt"), 111),
+        (12, struct.pack("<II", 2, os.O_RDONLY), 13),
+        (116, struct.pack("<IQI", 2, 6, 100), None),                # 4
+        (110, struct.pack("<IIH", 1, 3, 1) + s("sub"), 111),
+        (14, struct.pack("<I", 3) + s("new.txt")
+                + struct.pack("<III", os.O_RDWR, 0o644, 0), 15),
+        (118, struct.pack("<IQI", 3, 0, 11) + b"written ok\n", 119),
+        (110, struct.pack("<IIH", 1, 4, 1) + s("link"), 111),
+        (22, struct.pack("<I", 4), None),                           # 9
+        (12, struct.pack("<II", 4, os.O_RDONLY), -errno.ELOOP),
+        (110, struct.pack("<IIH", 1, 5, 3) + s("sub") + s("..") + s(".."),
+                None),                                              # 11
+        (110, struct.pack("<IIH", 1, 6, 2) + s("sub") + s("up"), 111),
+        (72, struct.pack("<I", 6) + s("evil") + struct.pack("<II", 0o755, 0),
+                -errno.ENOTDIR),
+        (110, struct.pack("<IIH", 1, 7, 2) + s("link") + s("x"), None),
+        (72, struct.pack("<I", 1) + s("made") + struct.pack("<II", 0o755, 0),
+                73),
+        (74, struct.pack("<I", 1) + s("made") + struct.pack("<I", 1)
+                + s("moved"), 75),
+        (76, struct.pack("<I", 1) + s("moved") + struct.pack("<I", 0x200), 77),
+        (110, struct.pack("<IIH", 1, 8, 1) + s("nothere"), -errno.ENOENT),
+        (110, struct.pack("<IIH", 1, 9, 1) + s("a/b"), -errno.ENOENT),
+        (120, struct.pack("<I", 2), 121),
+        (116, struct.pack("<IQI", 2, 0, 10), -errno.EBADF),
+    ]
+    data = b""
+    for i, (t, body, _) in enumerate(reqs):
+        msg = struct.pack("<IBH", 7 + len(body), t, 0xffff if t == 100 else i)
+        msg = struct.pack("<II", len(msg) + len(body), 0) + msg + body
+        data += msg + b"\0" * (-len(msg) % 8)
+    data += b"\0" * 8
+    region = os.path.join(tmp, "region")
+    open(region, "wb").write(data.ljust(REPLIES + len(reqs) * 4096, b"\0"))
+
+    subprocess.run([emu, "-q", "-m", "%#x,%#x,%s" % (REGION,
+            REPLIES + len(reqs) * 4096, region), "-9", share, image],
+            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=60)
+    out = open(region, "rb").read()
+
+    errors = []
+    replies = []
+    for i, (t, _, want) in enumerate(reqs):
+        r = out[REPLIES + i * 4096:REPLIES + (i + 1) * 4096]
+        size, typ, tag = struct.unpack("<IBH", r[:7])
+        body = r[7:size]
+        got = -struct.unpack("<I", body[:4])[0] if typ == RLERROR else typ
+        if want is not None and got != want:
+            errors.append("request %d (type %d): got %d, expected %d"
+                    % (i, t, got, want))
+        replies.append((typ, body))
+
+    root = replies[1][1][:13]
+    if replies[4][1] != struct.pack("<I", 14) + b"from the host\n":
+        errors.append("read returned %r" % replies[4][1])
+    if replies[9][1] != s("hello.txt"):
+        errors.append("readlink returned %r" % replies[9][1])
+    if replies[11][1][:2] != b"\3\0" or replies[11][1][28:41] != root:
+        errors.append("sub/../.. did not stop at the root")
+    if replies[14][1][:2] != b"\1\0":
+        errors.append("walk went through a symlink")
+    path = os.path.join(share, "sub", "new.txt")
+    if not os.path.exists(path) or open(path).read() != "written ok\n":
+        errors.append("sub/new.txt was not written")
+    if sorted(os.listdir(share)) != ["hello.txt", "link", "sub"]:
+        errors.append("share holds %s" % sorted(os.listdir(share)))
+    if os.listdir(outside):
+        errors.append("created %s outside the share" % os.listdir(outside))
+    return errors
@@ -0,0 +1,97 @@
+# Driven by 9p.py with -9 and -m: copies the requests the host left at
+# the start of the mapped region into RAM, sends them through the 9p
+# queue one at a time, and copies each 4 KiB reply slot back to the
+# region at +64K. Requests are len[4] pad[4] message, 8-byte aligned,
+# ending with a zero length.
+# host: 9p.py
+    .text
+    .globl _start
+_start:
+    li s0, 0x10001000           # virtio-mmio 9p
+    li s1, 0x80080000           # descriptors, avail at +0x100, used at +0x200
+    li s2, 0x800a0000           # reply slots
+    li s3, 0x80090000           # requests
+    li s5, 0x40000000           # shared region
+    li s4, 0
+
+    mv t0, s5
+    mv t2, s3
+    li t1, 0x10000
+    add t1, t0, t1
+1:  ld t3, 0(t0)
+    sd t3, 0(t2)
+    addi t0, t0, 8
+    addi t2, t2, 8
+    bltu t0, t1, 1b
+
+    li t0, 3
+    sw t0, 0x70(s0)             # ACKNOWLEDGE | DRIVER
+    li t0, 1
+    sw t0, 0x24(s0)
+    sw t0, 0x20(s0)             # VERSION_1
+    sw zero, 0x24(s0)
+    sw t0, 0x20(s0)             # MOUNT_TAG
+    li t0, 11
+    sw t0, 0x70(s0)             # FEATURES_OK
+    sw zero, 0x30(s0)
+    li t0, 8
+    sw t0, 0x38(s0)
+    sw s1, 0x80(s0)
+    sw zero, 0x84(s0)
+    addi t0, s1, 0x100
+    sw t0, 0x90(s0)
+    sw zero, 0x94(s0)
+    addi t0, s1, 0x200
+    sw t0, 0xa0(s0)
+    sw zero, 0xa4(s0)
+    li t0, 1
+    sw t0, 0x44(s0)
+    li t0, 15
+    sw t0, 0x70(s0)             # DRIVER_OK
+
+loop:
+    lw t0, 0(s3)
+    beqz t0, done
+    addi t1, s3, 8
+    sd t1, 0(s1)                # desc 0: the request
+    sw t0, 8(s1)
+    li t2, 1
+    sh t2, 12(s1)               # NEXT
+    sh t2, 14(s1)               # -> desc 1
+    slli t3, s4, 12
+    add t3, s2, t3
+    sd t3, 16(s1)               # desc 1: this request's reply slot
+    li t2, 0x1000
+    sw t2, 24(s1)
+    li t2, 2
+    sh t2, 28(s1)               # WRITE
+    andi t2, s4, 7
+    slli t2, t2, 1
+    add t2, s1, t2
+    sh zero, 0x104(t2)          # avail ring entry, head 0
+    addi t4, s4, 1
+    fence
+    sh t4, 0x102(s1)            # avail idx
+    fence
+    sw zero, 0x50(s0)           # notify
+2:  lhu t2, 0x202(s1)           # used idx
+    bne t2, t4, 2b
+    mv s4, t4
+    addi t0, t0, 15
+    andi t0, t0, -8
+    add s3, s3, t0
+    j loop
+
+done:
+    li t0, 0x10000
+    add t0, s5, t0
+    slli t1, s4, 12
+    add t1, s2, t1
+    mv t2, s2
+3:  ld t3, 0(t2)
+    sd t3, 0(t0)
+    addi t2, t2, 8
+    addi t0, t0, 8
+    bltu t2, t1, 3b
+    lui t5, 0
+    jr t5
@@ -0,0 +1,48 @@
+# RV64 A extension: the .W forms sign-extend what they load, LR/SC
+# pairs succeed once per reservation, and a misaligned AMO raises a
+# store/AMO address misaligned exception before t4 is written.
+# expect: a0=0xfffffffffffffffe a1=3 a2=3 a3=0xfffffffffffffff9
+# expect: a4=0xfffffffffffffff9 a5=0x64 a6=0xfffffffffffffffe a7=0x64
+# expect: s1=0 s2=1 s3=0xfffffffffffffffe s4=0xffffffffffffffff s5=0
+# expect: s6=0 s7=0xfffffffffffffffb s8=0xfffffffffffffffb s10=0 t4=0
+# stderr: traps, cause 6 : 1
+    .text
+    .globl _start
+_start:
+    la s0, data
+    li t0, -2
+    sw t0, 0(s0)
+    li t1, 5
+    amoadd.w a0, t1, (s0)       # mem = 3
+    lw a1, 0(s0)
+    li t1, -7
+    amomin.w a2, t1, (s0)       # mem = -7
+    amominu.w a3, t1, (s0)
+    li t1, 100
+    amomax.w a4, t1, (s0)       # mem = 100
+    amomaxu.w a5, t0, (s0)      # mem = 0xfffffffe
+    amoswap.w a6, t1, (s0)      # mem = 100
+    lr.w a7, (s0)
+    sc.w s1, t0, (s0)           # mem = -2
+    sc.w s2, t1, (s0)           # no reservation left
+    lw s3, 0(s0)
+    addi s9, s0, 8
+    li t2, -1
+    sd t2, 0(s9)
+    li t1, 1
+    amoadd.d s4, t1, (s9)       # mem = 0
+    ld s5, 0(s9)
+    li t1, -5
+    amomin.d s6, t1, (s9)       # mem = -5
+    ld s7, 0(s9)
+    lr.d s8, (s9)
+    sc.d s10, t1, (s9)
+    addi s11, s0, 2
+    amoadd.w t3, t1, (s11)      # misaligned
+    li t4, 1
+    lui t5, 0
+    jr t5
+
+    .balign 8
+data:
+    .dword 0, 0
@@ -0,0 +1,59 @@
+# Host side of tests/coverage.s: AFL-style coverage into shared memory
+import ctypes
+import os
+import struct
+import subprocess
+
+CTL_FD, ST_FD = 198, 199
+MAP_SIZE = 1 << 16
+IPC_PRIVATE, IPC_CREAT, IPC_RMID = 0, 0o1000, 0
+
+
+def check(emu, image, tmp):
+    libc = ctypes.CDLL(None, use_errno=True)
+    libc.shmat.restype = ctypes.c_void_p
+    shmid = libc.shmget(IPC_PRIVATE, MAP_SIZE, IPC_CREAT | 0o600)
+    if shmid < 0:
+        return ["shmget failed"]
+    addr = libc.shmat(shmid, None, 0)
+    libc.shmctl(shmid, IPC_RMID, None)      # goes once both sides detach
+
+    path = os.path.join(tmp, "input")
+    open(path, "wb").close()
+    ctl_r, ctl_w = os.pipe()
+    st_r, st_w = os.pipe()
+    os.dup2(ctl_r, CTL_FD)
+    os.dup2(st_w, ST_FD)
+    env = dict(os.environ, __AFL_SHM_ID=str(shmid))
+    p = subprocess.Popen([emu, "-q", "-c", "-F", "-f", path, image], env=env,
+            pass_fds=(CTL_FD, ST_FD), stdout=subprocess.DEVNULL,
+            stderr=subprocess.DEVNULL)
+    for fd in (ctl_r, st_w, CTL_FD, ST_FD):
+        os.close(fd)
+
+    def edges(data):
+        ctypes.memset(addr, 0, MAP_SIZE)
+        open(path, "wb").write(data)
+        os.write(ctl_w, b"\0\0\0\0")
+        os.read(st_r, 4)                    # pid
+        os.read(st_r, 4)                    # status, once the child is done
+        m = ctypes.string_at(addr, MAP_SIZE)
+        return {i for i in range(MAP_SIZE) if m[i]}
+
+    errors = []
+    try:
+        if len(os.read(st_r, 4)) != 4:
+            return ["no hello from the fork server"]
+        a, b, again = edges(b"abc"), edges(b"xyz"), edges(b"abc")
+        if not a or not b:
+            errors.append("no edges recorded")
+        if a == b:
+            errors.append("both paths left the same edges")
+        if a != again:
+            errors.append("the same input left different edges")
+    finally:
+        os.close(ctl_w)
+        os.close(st_r)
+        p.wait(timeout=10)
+        libc.shmdt(ctypes.c_void_p(addr))
+    return errors
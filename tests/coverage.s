@@ -0,0 +1,24 @@
+# Driven by coverage.py: a fork server with -c and __AFL_SHM_ID, where
+# an input starting with 'a' takes one path and anything else another,
+# so the edge maps of the two kinds of input differ.
+# host: coverage.py
+    .text
+    .globl _start
+_start:
+    la a0, buf
+    li a1, 64
+    ebreak
+    la s0, buf
+    lbu t0, 0(s0)
+    li t1, 0x61
+    beq t0, t1, 1f
+    li a0, 2
+    j 2f
+1:  li a0, 1
+    addi a0, a0, 0
+2:  lui t5, 0
+    jr t5
+
+    .balign 8
+buf:
+    .space 64
@@ -0,0 +1,59 @@
+# CSR read/modify/write forms and the counters under -I, where cycle,
+# time and instret follow the instruction count instead of the host:
+# a 100-pass loop of 3 instructions plus the reads around it, and one
+# timer tick per 10 instructions. Writes to the counters are ignored.
+# Supervisor CSRs keep all 64 bits, and the last CSR numbers are
+# storage of their own rather than the vector registers after them.
+# args: -I 10
+# expect: a0=0x12345678 a1=0x1234567f a2=0x12345670 a3=0x1234567f
+# expect: s2=0x130 s3=0x130 s4=0x1e s6=1
+# expect: s7=0xffffffc000001234 s8=0xffffffff80200000 s9=0x55 s10=0 s11=0
+    .text
+    .globl _start
+_start:
+    li t0, 0x12345678
+    csrw mscratch, t0
+    csrr a0, mscratch
+    csrsi mscratch, 7
+    csrr a1, mscratch
+    csrrci a3, mscratch, 0xf
+    csrr a2, mscratch
+    rdinstret s0
+    rdcycle s1
+    rdtime s5
+    li t1, 0
+1:  addi t1, t1, 1
+    li t2, 100
+    blt t1, t2, 1b
+    rdinstret s2
+    rdcycle s3
+    rdtime s4
+    sub s2, s2, s0
+    sub s3, s3, s1
+    sub s4, s4, s5
+    csrw cycle, zero
+    rdcycle t3
+    sltu s6, s1, t3             # still counting up
+
+    li t0, 0xffffffc000001234
+    csrw sscratch, t0
+    csrr s7, sscratch
+    li t0, 0xffffffff80200000
+    csrw stvec, t0
+    csrr s8, stvec
+    li t0, 4
+    vsetvli t0, t0, e64, m1, ta, ma
+    vmv.v.i v2, 0
+    li t0, 0x55
+    csrw 0xff0, t0
+    csrr s9, 0xff0
+    la t1, vbuf
+    vse64.v v2, (t1)
+    ld s10, 8(t1)               # v2 untouched
+    ld s11, 16(t1)
+    lui t5, 0
+    jr t5
+
+    .balign 8
+vbuf:
+    .dword 0, 0, 0, 0
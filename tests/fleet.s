@@ -0,0 +1,28 @@
+# Four guests on two threads, each adding 3 to a counter in its image
+# a thousand times. Image pages are shared until written, so every guest
+# must count to 3000 on its own copy. The counter has a page to itself
+# so the stores leave the shared translations alone.
+# args: -N 4,2
+# stdout: guest 0: pc 0, a0 0xbb8, 5006 instructions
+# stdout: guest 1: pc 0, a0 0xbb8, 5006 instructions
+# stdout: guest 2: pc 0, a0 0xbb8, 5006 instructions
+# stdout: guest 3: pc 0, a0 0xbb8, 5006 instructions
+# stderr: guests : 4 on 2 threads
+# stderr: instructions retired : 20024
+# stderr: blocks invalidated : 0
+    .text
+    .globl _start
+_start:
+    la s0, counter
+    li t0, 1000
+1:  ld t1, 0(s0)
+    addi t1, t1, 3
+    sd t1, 0(s0)
+    addi t0, t0, -1
+    bnez t0, 1b
+    ld a0, 0(s0)
+    lui t5, 0
+    jr t5
+    .balign 4096                # its own page, not the code's
+counter:
+    .dword 0
@@ -0,0 +1,42 @@
+# Host side of tests/forkserver.s: plays the fuzzer end of -F
+import os
+import struct
+import subprocess
+
+CTL_FD, ST_FD = 198, 199
+
+
+def check(emu, image, tmp):
+    path = os.path.join(tmp, "input")
+    open(path, "wb").close()
+    ctl_r, ctl_w = os.pipe()
+    st_r, st_w = os.pipe()
+    os.dup2(ctl_r, CTL_FD)
+    os.dup2(st_w, ST_FD)
+    p = subprocess.Popen([emu, "-q", "-F", "-f", path, image],
+            pass_fds=(CTL_FD, ST_FD), stdout=subprocess.DEVNULL,
+            stderr=subprocess.DEVNULL)
+    for fd in (ctl_r, st_w, CTL_FD, ST_FD):
+        os.close(fd)
+
+    errors = []
+    try:
+        if len(os.read(st_r, 4)) != 4:
+            return ["no hello from the fork server"]
+        for i in range(20):
+            data = bytes([i * 7 % 50]) * (i % 5 + 1)
+            open(path, "wb").write(data)
+            os.write(ctl_w, b"\0\0\0\0")
+            pid = struct.unpack("<I", os.read(st_r, 4))[0]
+            status = struct.unpack("<I", os.read(st_r, 4))[0]
+            want = (sum(data) + len(data)) & 0xff
+            if pid == 0 or not os.WIFEXITED(status) \
+                    or os.WEXITSTATUS(status) != want:
+                errors.append("input %d: status %#x, expected exit %d"
+                        % (i, status, want))
+    finally:
+        os.close(ctl_w)
+        os.close(st_r)
+        if p.wait(timeout=10) != 0:
+            errors.append("fork server exited with %d" % p.returncode)
+    return errors
@@ -0,0 +1,35 @@
+# Driven by forkserver.py through the AFL fork-server pipes with -F -f:
+# each child gets the input file in the buffer at a0 and exits with the
+# byte sum plus the length. A counter in RAM is bumped by every child;
+# it must read 0 each time since children start from the parent's RAM.
+# host: forkserver.py
+    .text
+    .globl _start
+_start:
+    la a0, buf
+    li a1, 256
+    ebreak                      # fork server starts here
+    la s0, buf
+    mv s1, a0                   # input length
+    li t0, 0
+1:  beqz a0, 2f
+    lbu t1, 0(s0)
+    add t0, t0, t1
+    addi s0, s0, 1
+    addi a0, a0, -1
+    j 1b
+2:  la t2, count
+    ld t3, 0(t2)
+    addi t4, t3, 1
+    sd t4, 0(t2)
+    slli t3, t3, 7              # a stale count spoils the status
+    add a0, t0, s1
+    add a0, a0, t3
+    lui t5, 0
+    jr t5
+
+    .balign 8
+count:
+    .dword 0
+buf:
+    .space 256
@@ -0,0 +1,46 @@
+# Every fusible pair in a loop hot enough to be optimised, so most
+# passes run the fused forms; the results must match the ones the
+# unfused instructions give.
+# expect: a0=0xe200ab2ced491721 s1=0x12345678 s2=0xfedcba9876543210 s3=0x76543210
+# expect: s4=0xfffffffffedcba98 s5=0x7fffffff s6=7 s8=0xfedcba9876543210
+    .text
+    .globl _start
+_start:
+    li s0, 5000
+    li a0, 0
+loop:
+    lui s1, 0x12345
+    addi s1, s1, 0x678          # lui+addi
+    add a0, a0, s1
+2:  auipc t0, %pcrel_hi(data)
+    addi t0, t0, %pcrel_lo(2b)  # auipc+addi
+    ld s8, 0(t0)
+3:  auipc t1, %pcrel_hi(data)
+    ld s2, %pcrel_lo(3b)(t1)    # auipc+ld
+    add a0, a0, s2
+4:  auipc t2, %pcrel_hi(data)
+    lwu s3, %pcrel_lo(4b)(t2)   # auipc+lwu
+    add a0, a0, s3
+5:  auipc t2, %pcrel_hi(data + 4)
+    lw s4, %pcrel_lo(5b)(t2)    # auipc+lw
+    add a0, a0, s4
+    lui s5, 0x80000
+    addiw s5, s5, -1            # lui+addiw
+    slli t3, a0, 7
+    srli t3, t3, 3              # slli+srli
+    xor a0, a0, t3
+    slt t4, a0, s5
+    bnez t4, 1f                 # slt+branch
+    addi a0, a0, 13
+1:  call f                      # auipc+jalr
+    addi s0, s0, -1
+    bnez s0, loop
+    lui t5, 0
+    jr t5
+f:
+    li s6, 7
+    ret
+
+    .balign 8
+data:
+    .dword 0xfedcba9876543210
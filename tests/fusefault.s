@@ -0,0 +1,14 @@
+# Fleet guests fuse their translations before the first run, so here the
+# auipc+ld pair is fused from the start. The load faults: auipc's result
+# must still be written and pc left just past the load, as when stepped.
+# args: -N 1
+# stdout: guest 0: pc 0x8000000c, a0 0x90000004
+    .text
+    .globl _start
+_start:
+    li a1, 5
+    auipc a0, 0x10000           # outside RAM
+    ld a1, 0(a0)
+    li a1, 6
+    lui t5, 0
+    jr t5
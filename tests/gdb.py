@@ -0,0 +1,86 @@
+# Host side of tests/gdb.s: plays gdb against -g on a unix socket
+import os
+import socket
+import struct
+import subprocess
+import time
+
+
+class Remote:
+    def __init__(self, path):
+        self.s = socket.socket(socket.AF_UNIX)
+        for _ in range(100):
+            try:
+                self.s.connect(path)
+                break
+            except OSError:
+                time.sleep(0.05)
+        self.f = self.s.makefile("rb")
+
+    def send(self, data):
+        ck = "%02x" % (sum(data.encode()) & 0xff)
+        self.s.sendall(("$%s#%s" % (data, ck)).encode())
+        if self.f.read(1) != b"+":
+            raise RuntimeError("no ack for " + data)
+        return self.recv()
+
+    def recv(self):
+        while self.f.read(1) != b"$":
+            pass
+        data = b""
+        while True:
+            c = self.f.read(1)
+            if c in (b"#", b""):
+                break
+            data += c
+        self.f.read(2)
+        self.s.sendall(b"+")
+        return data.decode()
+
+
+def reg(r, n):
+    return struct.unpack("<Q", bytes.fromhex(r.send("p%x" % n)))[0]
+
+
+def check(emu, image, tmp):
+    path = os.path.join(tmp, "gdb")
+    p = subprocess.Popen([emu, "-q", "-g", path, image],
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    errors = []
+    try:
+        r = Remote(path)
+        if r.send("?") != "S05":
+            errors.append("not stopped at entry")
+        r.send("Z0,80000040,4")
+        r.send("c")
+        if reg(r, 0x20) != 0x80000040 or reg(r, 10) != 0:
+            errors.append("breakpoint on loop not hit")
+        r.send("s")
+        if reg(r, 0x20) != 0x80000044 or reg(r, 10) != 1:
+            errors.append("step did not run one addi")
+
+        # asks for more than a reply holds, gets what fits
+        image_bytes = open(image, "rb").read()
+        reply = r.send("m80000000,4000")
+        if len(reply) % 2 or len(reply) >= 0x4000:
+            errors.append("m reply of %d hex digits" % len(reply))
+        data = bytes.fromhex(reply)
+        if not reply or data != (image_bytes + bytes(len(data)))[:len(data)]:
+            errors.append("m reply does not match the image")
+        if r.send("m800ffff8,10") != "E14":
+            errors.append("m past the end of RAM did not fail")
+
+        r.send("P%x=%s" % (10, struct.pack("<Q", 98).hex()))
+        r.send("z0,80000040,4")
+        if r.send("c") != "W64":
+            errors.append("guest did not exit with a0 = 100")
+    finally:
+        try:
+            out = p.communicate(timeout=10)[0].decode()
+        except subprocess.TimeoutExpired:
+            p.kill()
+            out = ""
+            errors.append("emulator still running")
+    if "a0: 0x64" not in out:
+        errors.append("final a0 is not 0x64")
+    return errors
@@ -0,0 +1,16 @@
+# Driven by gdb.py over the remote protocol: a breakpoint on loop, a
+# single step, a register write, and a memory read as large as a reply
+# can hold. The guest then counts a0 up to 100 and exits with it.
+# host: gdb.py
+    .text
+    .globl _start
+_start:
+    li a0, 0
+    li t0, 100
+    j loop
+    .org 0x40
+loop:                           # 0x80000040
+    addi a0, a0, 1
+    blt a0, t0, loop
+    lui t5, 0
+    jr t5
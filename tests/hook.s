@@ -0,0 +1,115 @@
+# Run with -u -H all: the library routines below are replaced by host
+# calls. Zero-length calls return without looking at their pointers,
+# wherever they point; a memset into unmapped memory then raises a
+# store access fault instead of ending the run, so exit 42 is never
+# reached and the status stays 0.
+# args: -H all -u
+# stdout: zero-length ok
+# stderr: hooked memset : 3
+# stderr: traps, cause 7 : 1
+# exit: 0
+    .text
+    .globl _start
+_start:
+    li s0, 0                    # failed checks
+    li a0, 0
+    li a1, 0
+    li a2, 0
+    call memcpy                 # memcpy(NULL, NULL, 0)
+    snez t0, a0
+    add s0, s0, t0
+    li a0, -16
+    li a1, 0
+    li a2, 0
+    call memset                 # memset(end, 0, 0)
+    addi t0, a0, 16
+    snez t0, t0
+    add s0, s0, t0
+    li a0, 8
+    li a1, 16
+    li a2, 0
+    call memcmp
+    snez t0, a0
+    add s0, s0, t0
+    la s1, buf
+    mv a0, s1
+    li a1, 0x78
+    li a2, 5
+    call memset
+    mv a0, s1
+    call strlen
+    addi t0, a0, -5
+    snez t0, t0
+    add s0, s0, t0
+    bnez s0, 1f
+    li a0, 1
+    la a1, msg
+    li a2, 16
+    li a7, 64                   # write
+    ecall
+1:  li a0, 16
+    li a1, 0
+    li a2, 8
+    call memset                 # faults
+    li a0, 42
+    li a7, 93                   # exit
+    ecall
+
+    .globl memset
+    .type memset, @function
+memset:
+    mv t0, a0
+1:  beqz a2, 2f
+    sb a1, 0(t0)
+    addi t0, t0, 1
+    addi a2, a2, -1
+    j 1b
+2:  ret
+
+    .globl memcpy
+    .type memcpy, @function
+memcpy:
+    mv t0, a0
+1:  beqz a2, 2f
+    lbu t1, 0(a1)
+    sb t1, 0(t0)
+    addi t0, t0, 1
+    addi a1, a1, 1
+    addi a2, a2, -1
+    j 1b
+2:  ret
+
+    .globl memcmp
+    .type memcmp, @function
+memcmp:
+1:  beqz a2, 2f
+    lbu t0, 0(a0)
+    lbu t1, 0(a1)
+    bne t0, t1, 3f
+    addi a0, a0, 1
+    addi a1, a1, 1
+    addi a2, a2, -1
+    j 1b
+2:  li a0, 0
+    ret
+3:  sub a0, t0, t1
+    ret
+
+    .globl strlen
+    .type strlen, @function
+strlen:
+    mv t0, a0
+1:  lbu t1, 0(t0)
+    beqz t1, 2f
+    addi t0, t0, 1
+    j 1b
+2:  sub a0, t0, a0
+    ret
+
+    .section .rodata
+msg:
+    .ascii "zero-length ok\n\0"
+
+    .bss
+buf:
+    .space 64
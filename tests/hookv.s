@@ -0,0 +1,28 @@
+# Run with -u -H strlen -V: strlen is interpreted and checked against the
+# host's. This one counts the terminator too, so the check reports one
+# mismatch and the guest exits with its own answer, 6.
+# args: -H strlen -V -u
+# stderr: hooked strlen : 1
+# stderr: hook mismatches : 1
+# exit: 6
+    .text
+    .globl _start
+_start:
+    la a0, msg
+    call strlen
+    li a7, 93                   # exit
+    ecall
+
+    .globl strlen
+    .type strlen, @function
+strlen:
+    mv t0, a0
+1:  lbu t1, 0(t0)
+    addi t0, t0, 1
+    bnez t1, 1b
+    sub a0, t0, a0              # one too many
+    ret
+
+    .section .rodata
+msg:
+    .asciz "hello"
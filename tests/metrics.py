@@ -0,0 +1,46 @@
+# Host side of tests/metrics.s: reads the -M page with the layout from
+# includes/metrics.h, and with rvstat when it was built next to the emulator
+import os
+import struct
+import subprocess
+
+HEADER = struct.Struct("<8sIIII")
+QUEUE = struct.Struct("<24sII")
+QUEUES, TRAPS = 16, 16
+HART = struct.Struct("<5Q%dQ5Q" % TRAPS)
+FIELDS = ["instret", "blocks_executed", "blocks_translated", "tlb_hits",
+        "tlb_misses"] + ["cause%d" % c for c in range(TRAPS)] + [
+        "interrupts", "wfi", "ips", "updated_ns", "running"]
+
+
+def check(emu, image, tmp):
+    page = os.path.join(tmp, "page")
+    p = subprocess.run([emu, "-q", "-s", "-M", page, image],
+            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, timeout=60)
+    err = " ".join(p.stderr.decode(errors="replace").split())
+    data = open(page, "rb").read()
+
+    errors = []
+    magic, version, pid, nharts, nqueues = HEADER.unpack_from(data)
+    if (magic, version, pid, nharts, nqueues) != (b"RVMETRIC", 2, pid, 1, 0) \
+            or pid == 0:
+        errors.append("header %s" % [magic, version, pid, nharts, nqueues])
+    hart = dict(zip(FIELDS, HART.unpack_from(data,
+            HEADER.size + QUEUES * QUEUE.size)))
+    want = {"instret": 903, "wfi": 300, "cause2": 1, "running": 0}
+    for name, v in want.items():
+        if hart[name] != v:
+            errors.append("%s = %d, expected %d" % (name, hart[name], v))
+    # the page and -s count the same things
+    for name, text in (("blocks_executed", "blocks executed"),
+            ("blocks_translated", "blocks translated")):
+        if "%s : %d" % (text, hart[name]) not in err:
+            errors.append("%s = %d, not what -s printed" % (name, hart[name]))
+
+    rvstat = os.path.join(os.path.dirname(emu), "rvstat")
+    if os.path.exists(rvstat):
+        out = subprocess.run([rvstat, "-i", "10", "-n", "1", page],
+                stdout=subprocess.PIPE, timeout=10).stdout.decode()
+        if "pid %u, 1 hart" % pid not in out or "(stopped)" not in out:
+            errors.append("rvstat printed %r" % out)
+    return errors
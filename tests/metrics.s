@@ -0,0 +1,13 @@
+# Driven by metrics.py with -M: 300 WFIs, then an illegal instruction.
+# The page left behind must hold the final counters at the offsets the
+# layout in metrics.h gives them.
+# host: metrics.py
+    .text
+    .globl _start
+_start:
+    li t1, 300
+1:  wfi
+    addi t1, t1, -1
+    bnez t1, 1b
+    li a0, 42
+    .word 0                     # illegal, stops the hart
@@ -0,0 +1,41 @@
+# Host side of tests/net.s: the peer end of the guest's network
+import re
+import socket
+import subprocess
+import threading
+
+
+def check(emu, image, tmp):
+    a, b = socket.socketpair(socket.AF_UNIX, socket.SOCK_DGRAM)
+    got = []
+
+    def peer():
+        b.settimeout(10)
+        for _ in range(2):
+            got.append(b.recv(2048))
+        b.send(b"pong-0123456789")
+        b.send(b"x" * 100)
+
+    t = threading.Thread(target=peer)
+    t.start()
+    try:
+        p = subprocess.run([emu, "-q", "-n", "fd:%d" % a.fileno(), image],
+                pass_fds=(a.fileno(),), stdout=subprocess.PIPE,
+                stderr=subprocess.DEVNULL, timeout=60)
+    finally:
+        a.close()
+        t.join(10)
+        b.close()
+
+    errors = []
+    if got != [b"ping-one", b"ping-two"]:
+        errors.append("peer got %s" % got)
+    regs = dict(re.findall(r"(\w+):\s*(0x[0-9a-f]+|00)",
+            p.stdout.decode(errors="replace")))
+    # magic, net device, both frames sent and received, 12-byte header
+    expect = {"a1": 0x74726976, "a2": 1, "s4": 2, "s5": 2, "s6": 27,
+            "s7": 112, "s8": 0x3231302d676e6f70, "s9": 1}
+    for reg, v in expect.items():
+        if reg not in regs or int(regs[reg], 16) != v:
+            errors.append("%s = %s, expected %#x" % (reg, regs.get(reg), v))
+    return errors
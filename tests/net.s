@@ -0,0 +1,129 @@
+# Driven by net.py over a datagram socketpair with -n fd:N: a bare
+# virtio-net driver sends one frame from a single descriptor and one
+# split across a header and a payload descriptor, then posts two receive
+# buffers and waits for the peer's two frames. The header is not on the
+# wire, received lengths include it.
+# host: net.py
+    .text
+    .globl _start
+# s0 = virtio-mmio base, s1 = TX rings, s2 = RX rings, s3 = buffers
+_start:
+    li s0, 0x10001000
+    li s1, 0x80010000
+    li s2, 0x80011000
+    li s3, 0x80012000
+    lw a1, 0(s0)                # magic
+    lw a2, 8(s0)                # device id
+    li t0, 3
+    sw t0, 0x70(s0)             # ACKNOWLEDGE | DRIVER
+    li t0, 1
+    sw t0, 0x24(s0)             # driver features sel 1
+    sw t0, 0x20(s0)             # VERSION_1
+    sw zero, 0x24(s0)
+    li t0, 0x20000020           # MAC | EVENT_IDX
+    sw t0, 0x20(s0)
+    li t0, 11
+    sw t0, 0x70(s0)             # FEATURES_OK
+
+    # queue 1, TX
+    li t0, 1
+    sw t0, 0x30(s0)
+    li t0, 8
+    sw t0, 0x38(s0)
+    sw s1, 0x80(s0)
+    sw zero, 0x84(s0)
+    addi t0, s1, 0x100
+    sw t0, 0x90(s0)
+    sw zero, 0x94(s0)
+    addi t0, s1, 0x200
+    sw t0, 0xa0(s0)
+    sw zero, 0xa4(s0)
+    li t0, 1
+    sw t0, 0x44(s0)
+    # queue 0, RX
+    sw zero, 0x30(s0)
+    li t0, 8
+    sw t0, 0x38(s0)
+    sw s2, 0x80(s0)
+    sw zero, 0x84(s0)
+    addi t0, s2, 0x100
+    sw t0, 0x90(s0)
+    sw zero, 0x94(s0)
+    addi t0, s2, 0x200
+    sw t0, 0xa0(s0)
+    sw zero, 0xa4(s0)
+    li t0, 1
+    sw t0, 0x44(s0)
+    li t0, 15
+    sw t0, 0x70(s0)             # DRIVER_OK
+
+    # TX frame A: one descriptor, header + "ping-one"
+    li t0, 0x2d676e6970         # "ping-"
+    sd t0, 12(s3)
+    li t0, 0x656e6f             # "one"
+    sw t0, 17(s3)
+    sd s3, 0(s1)                # desc 0 addr
+    li t0, 20
+    sw t0, 8(s1)                # len
+    sh zero, 12(s1)             # flags
+    # TX frame B: header and payload in two descriptors
+    addi t1, s3, 0x100
+    sd t1, 16(s1)               # desc 1 = header
+    li t0, 12
+    sw t0, 24(s1)
+    li t0, 1
+    sh t0, 28(s1)               # NEXT
+    li t0, 2
+    sh t0, 30(s1)               # -> desc 2
+    addi t1, s3, 0x200
+    li t0, 0x6f77742d676e6970   # "ping-two"
+    sd t0, 0(t1)
+    sd t1, 32(s1)
+    li t0, 8
+    sw t0, 40(s1)
+    sh zero, 44(s1)
+    # avail ring: heads 0 and 1, idx 2
+    sh zero, 0x104(s1)
+    li t0, 1
+    sh t0, 0x106(s1)
+    li t0, 2
+    sh t0, 0x102(s1)
+    li t0, 1
+    sw t0, 0x50(s0)             # notify TX
+    lhu s4, 0x202(s1)           # TX used idx
+
+    # RX: two 2 KiB writable buffers
+    li t1, 0x80013000
+    sd t1, 0(s2)
+    li t0, 0x800
+    sw t0, 8(s2)
+    li t0, 2
+    sh t0, 12(s2)               # WRITE
+    li t1, 0x80013800
+    sd t1, 16(s2)
+    li t0, 0x800
+    sw t0, 24(s2)
+    li t0, 2
+    sh t0, 28(s2)
+    sh zero, 0x104(s2)
+    li t0, 1
+    sh t0, 0x106(s2)
+    li t0, 2
+    sh t0, 0x102(s2)
+    sw zero, 0x50(s0)           # notify RX
+
+    # wait for both frames, frames arrive between blocks
+    li t2, 5000000
+1:  lhu s5, 0x202(s2)
+    li t0, 2
+    beq s5, t0, 2f
+    addi t2, t2, -1
+    bnez t2, 1b
+2:  lw s6, 0x208(s2)            # used[0].len
+    lw s7, 0x210(s2)            # used[1].len
+    li t1, 0x80013000
+    ld s8, 12(t1)               # first payload bytes
+    lw s9, 0x60(s0)             # interrupt status
+    li a0, 0
+    lui t5, 0x0
+    jr t5
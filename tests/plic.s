@@ -0,0 +1,91 @@
+# PLIC claim/complete, run with -9 on a scratch directory. Sets up the 9p
+# queue, sends one Tversion, waits for the reply, then walks the
+# interrupt through claim, complete, threshold and acknowledge.
+# expect: a3=9 a4=1 a5=0x200 a6=1 a7=0 s7=0x200 s8=0 s9=0 s10=0 s11=0
+# args: -9 {tmp}
+    .text
+    .globl _start
+_start:
+    li s0, 0x10001000           # virtio-mmio 9p
+    li s1, 0x80080000           # descriptors, avail at +0x100, used at +0x200
+    li s2, 0x80090000           # reply buffer
+    li t0, 3
+    sw t0, 0x70(s0)             # ACKNOWLEDGE | DRIVER
+    li t0, 1
+    sw t0, 0x24(s0)
+    sw t0, 0x20(s0)             # VERSION_1
+    sw zero, 0x24(s0)
+    sw t0, 0x20(s0)             # MOUNT_TAG
+    li t0, 11
+    sw t0, 0x70(s0)             # FEATURES_OK
+    sw zero, 0x30(s0)           # queue 0
+    li t0, 8
+    sw t0, 0x38(s0)
+    sw s1, 0x80(s0)
+    sw zero, 0x84(s0)
+    addi t0, s1, 0x100
+    sw t0, 0x90(s0)
+    sw zero, 0x94(s0)
+    addi t0, s1, 0x200
+    sw t0, 0xa0(s0)
+    sw zero, 0xa4(s0)
+    li t0, 1
+    sw t0, 0x44(s0)             # queue ready
+    li t0, 15
+    sw t0, 0x70(s0)             # DRIVER_OK
+    lbu a3, 0x100(s0)           # config: tag_len of "hostshare"
+    li s5, 0x0c000000           # PLIC
+    li t0, 1
+    sw t0, 4(s5)                # source 1 priority 1
+    li t1, 0x2080
+    add t1, s5, t1
+    li t0, 2
+    sw t0, 0(t1)                # context 1 enables source 1
+    li t1, 0x201000
+    add s6, s5, t1              # context 1 threshold / claim
+    sw zero, 0(s6)
+
+    la t1, tversion
+    sd t1, 0(s1)                # descriptor 0: the request
+    li t2, 21
+    sw t2, 8(s1)
+    li t2, 1
+    sh t2, 12(s1)               # NEXT
+    sh t2, 14(s1)
+    sd s2, 16(s1)               # descriptor 1: the reply
+    li t2, 0x1000
+    sw t2, 24(s1)
+    li t2, 2
+    sh t2, 28(s1)               # WRITE
+    sh zero, 0x104(s1)          # avail ring[0] = descriptor 0
+    fence
+    li t2, 1
+    sh t2, 0x102(s1)            # avail idx
+    fence
+    sw zero, 0x50(s0)           # notify
+wait:
+    lhu t2, 0x202(s1)
+    beqz t2, wait
+
+    lw a4, 0x60(s0)             # isr: used buffer
+    csrr a5, sip                # SEIP set
+    lw a6, 4(s6)                # claim -> source 1
+    csrr a7, sip                # SEIP clear while claimed
+    sw a6, 4(s6)                # complete, line still high
+    csrr s7, sip                # SEIP again
+    li t0, 1
+    sw t0, 0(s6)                # threshold 1 masks priority 1
+    csrr s8, sip
+    sw zero, 0(s6)
+    sw a4, 0x64(s0)             # acknowledge, the line drops
+    csrr s9, sip
+    li t1, 0x1000
+    add t1, s5, t1
+    lw s10, 0(t1)               # pending word
+    lw s11, 4(s6)               # claim -> nothing
+    lui t5, 0
+    jr t5
+
+tversion:                       # size, Tversion, NOTAG, msize 8192, "9P2000.L"
+    .byte 21, 0, 0, 0, 100, 0xff, 0xff, 0, 0x20, 0, 0, 8, 0
+    .ascii "9P2000.L"
@@ -0,0 +1,46 @@
+# Calls, returns and indirect jumps whose targets alternate, for the
+# return stack and the per-site target cache: the hit counts are fixed
+# by the program. A routine that returns somewhere other than its
+# call site must still land where ra says.
+# expect: a0=0x64 a1=0x96 a2=0x32 s3=1 s4=0
+# stderr: return stack : 296 hits, 5 misses
+# stderr: indirect targets : 197 hits, 105 misses
+    .text
+    .globl _start
+_start:
+    li s0, 0
+    li s1, 100
+    la s2, table
+loop:
+    call f
+    andi t0, s0, 1
+    slli t0, t0, 3
+    add t0, t0, s2
+    ld t1, 0(t0)
+    jalr ra, 0(t1)              # g and h in turn
+    la t2, g
+    jalr ra, 0(t2)
+    addi s0, s0, 1
+    blt s0, s1, loop
+    call k                      # returns to elsewhere
+    li s4, 1
+elsewhere:
+    li s3, 1
+    lui t5, 0
+    jr t5
+f:
+    addi a0, a0, 1
+    ret
+g:
+    addi a1, a1, 1
+    ret
+h:
+    addi a2, a2, 1
+    ret
+k:
+    la ra, elsewhere
+    ret
+
+    .balign 8
+table:
+    .dword g, h
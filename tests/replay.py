@@ -0,0 +1,28 @@
+# Host side of tests/replay.s: records a run with -R, replays it with -P
+# on different input, and checks both runs ended the same way
+import os
+import subprocess
+
+
+def run(emu, args, data):
+    return subprocess.run([emu, "-q", "-s"] + args, input=data,
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=60)
+
+
+def check(emu, image, tmp):
+    log = os.path.join(tmp, "log")
+    errors = []
+    if run(emu, ["-R", log, "-u", image], b"").returncode == 0:
+        errors.append("-R without -I was accepted")
+
+    rec = run(emu, ["-I", "100", "-R", log, "-u", image], b"recorded\n")
+    if rec.stdout != b"recorded\n":
+        errors.append("recorded run wrote %r" % rec.stdout)
+    for i in range(3):
+        play = run(emu, ["-I", "100", "-P", log, "-u", image], b"other\n")
+        if play.stdout != rec.stdout:
+            errors.append("replay %d wrote %r" % (i, play.stdout))
+        if play.returncode != rec.returncode:
+            errors.append("replay %d exited with %d, recorded %d"
+                    % (i, play.returncode, rec.returncode))
+    return errors
@@ -0,0 +1,43 @@
+# Driven by replay.py: reads stdin, the wall clock, random bytes and the
+# pid, echoes the input and exits with a mix of the three, so a run only
+# repeats if -P feeds back everything -R logged.
+# host: replay.py
+    .text
+    .globl _start
+_start:
+    li   a0, 0                  # read(0, buf, 64)
+    la   a1, buf
+    li   a2, 64
+    li   a7, 63
+    ecall
+    mv   s0, a0
+    li   a0, 0                  # clock_gettime(CLOCK_REALTIME, ts)
+    la   a1, ts
+    li   a7, 113
+    ecall
+    la   a0, rnd                # getrandom(rnd, 8, 0)
+    li   a1, 8
+    li   a2, 0
+    li   a7, 278
+    ecall
+    li   a7, 172                # getpid
+    ecall
+    mv   s1, a0
+    li   a0, 1                  # write(1, buf, n)
+    la   a1, buf
+    mv   a2, s0
+    li   a7, 64
+    ecall
+    la   t0, rnd                # exit((rnd ^ ts.nsec ^ pid) & 0xff)
+    ld   t0, 0(t0)
+    la   t1, ts
+    ld   t1, 8(t1)
+    xor  a0, t0, t1
+    xor  a0, a0, s1
+    andi a0, a0, 0xff
+    li   a7, 93
+    ecall
+    .bss
+buf: .space 64
+ts:  .space 16
+rnd: .space 8
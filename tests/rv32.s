@@ -0,0 +1,56 @@
+# An RV32IMA image in an ELF32: 32-bit shifts, M-extension corner
+# cases, sign-extending loads, AMOs, unsigned branches and the
+# high halves of the counters. Writes to cycleh are ignored.
+# expect: a0=0x80000000 a2=0xffffffff a3=1 a4=0xc0000000 a5=0x40000000
+# expect: a6=0xfffffffe a7=0x80000000 s2=0 s3=1 s4=0 s5=0x80000000
+# expect: s6=0x8000 s7=0x40001101 s8=0x12345 s9=1
+# expect: t3=0xfffffffe t4=3 t6=0xfffffff9 s10=0 s11=0
+    .text
+    .globl _start
+_start:
+    li a0, 0x7fffffff
+    addi a0, a0, 1
+    li a1, -1
+    srai a2, a1, 31
+    srli a3, a1, 31
+    li t0, 33
+    sra a4, a0, t0              # shift amount is taken mod 32
+    mulh a5, a0, a0
+    mulhu a6, a1, a1
+    li t1, -1
+    div a7, a0, t1              # overflow: the dividend
+    rem s2, a0, t1
+    slt s3, a1, t0
+    sltu s4, a1, t0
+    addi sp, sp, -16
+    sw a0, 0(sp)
+    lw s5, 0(sp)
+    lhu s6, 2(sp)
+    csrr s7, misa
+    call f
+    mul s9, a1, a1
+
+    la s0, data
+    li t0, -2
+    sw t0, 0(s0)
+    li t1, 5
+    amoadd.w t3, t1, (s0)       # mem = 3
+    li t1, -7
+    amomin.w t4, t1, (s0)       # mem = -7
+    lr.w t6, (s0)
+    sc.w s10, t0, (s0)
+    li t2, 1
+    bgeu t0, t2, 1f             # 0xfffffffe >= 1 unsigned
+    li s10, 99
+1:  rdcycleh s11                # still 0 this early
+    csrw cycleh, t2
+    rdcycleh s11
+    lui t5, 0
+    jr t5
+f:
+    li s8, 0x12345
+    ret
+
+    .balign 4
+data:
+    .word 0
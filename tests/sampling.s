@@ -0,0 +1,23 @@
+# A load per 64-byte line over 256K, sampled as 2000 instructions
+# fast-forwarded, 1000 warming the caches and 1000 measured: four
+# samples, each load in them a miss in l1d and l2, and the loop's own
+# fetches already warm.
+# args: -T 2000:1000:1000
+# expect: s0=1
+# stderr: detailed samples : 4, 4000 instructions
+# stderr: l1i : 1000 hits, 0 misses
+# stderr: l1d : 0 hits, 1000 misses
+# stderr: l2 : 0 hits, 1000 misses
+    .text
+    .globl _start
+_start:
+    li a0, 1
+    slli a0, a0, 31
+    li t0, 0x10000
+    add a0, a0, t0              # buffer at DRAM_BASE + 64K
+    li t0, 4096
+1:  ld t1, 0(a0)
+    addi a0, a0, 64
+    addi t0, t0, -1
+    bnez t0, 1b
+    li s0, 1
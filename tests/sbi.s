@@ -0,0 +1,37 @@
+# A payload booted with -k: a1 holds the device tree, the DBCN
+# extension is probed and used, the legacy putchar still works, and
+# a system reset shutdown stops the hart before the next instruction.
+# args: -k {image}
+# expect: s1=0xedfe0dd0 s2=1 s3=0
+# stdout: kernel!
+# stderr: sbi calls : 5
+    .text
+    .globl _start
+_start:
+    mv   s0, a1
+    lwu  s1, 0(s0)              # fdt magic, big-endian
+    li   a7, 0x10               # base: probe_extension(DBCN)
+    li   a6, 3
+    li   a0, 0x4442434E
+    ecall
+    mv   s2, a1
+    li   a7, 0x4442434E         # DBCN: console_write(6, msg)
+    li   a6, 0
+    li   a0, 6
+    la   a1, msg
+    li   a2, 0
+    ecall
+    li   a7, 1                  # legacy console_putchar
+    li   a0, 33
+    ecall
+    li   a7, 1
+    li   a0, 10
+    ecall
+    li   a7, 0x53525354         # SRST: system_reset(shutdown)
+    li   a6, 0
+    li   a0, 0
+    li   a1, 0
+    ecall
+    li   s3, 99                 # must not run
+msg:
+    .ascii "kernel"
@@ -0,0 +1,31 @@
+# A 4 KiB host-file region with a doorbell at 0x40000000: data stores
+# read back, doorbell stores are written to the inherited fd (a zero
+# store rings as 1), and a doubleword straddling the region's end and
+# the doorbell raises a store access fault before s2 is written.
+# args: -m 0x40000000,4096,{tmp}/region,{fd}
+# expect: a0=0x1122334455667788 a1=0x55667788 a2=0x55667788ff a3=0 s2=0
+# doorbell: 5 1
+# stderr: traps, cause 7 : 1
+    .text
+    .globl _start
+_start:
+    li s0, 0x40000000
+    li t0, 0x1122334455667788
+    sd t0, 0(s0)
+    ld a0, 0(s0)
+    lwu a1, 0(s0)
+    li t1, 0x1000
+    add s1, s0, t1              # the doorbell
+    li t1, 0xff
+    sb t1, -8(s1)
+    sw t0, -7(s1)               # unaligned, wholly inside the region
+    ld a2, -8(s1)
+    ld a3, 0(s1)                # reads as zero
+    li t1, 5
+    sd t1, 0(s1)
+    sd zero, 0(s1)
+    li t1, -1
+    sd t1, -4(s1)               # half region, half doorbell
+    li s2, 1
+    lui t5, 0
+    jr t5
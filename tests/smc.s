@@ -0,0 +1,35 @@
+# Code patched by stores: the next call must run the new instruction,
+# with or without a fence.i, also once the block has turned hot and
+# been optimised.
+# expect: s1=1 s2=2 s3=3 s4=0x258 s5=5
+# stderr: cache flushes : 1
+    .text
+    .globl _start
+_start:
+    call target
+    mv s1, a0
+    la t0, target
+    li t1, 0x00200513           # addi a0, zero, 2
+    sw t1, 0(t0)
+    call target
+    mv s2, a0
+    li t1, 0x00300513           # addi a0, zero, 3
+    sw t1, 0(t0)
+    fence.i
+    call target
+    mv s3, a0
+    li s0, 200                  # hot enough to be optimised
+    li s4, 0
+1:  call target
+    add s4, s4, a0
+    addi s0, s0, -1
+    bnez s0, 1b
+    li t1, 0x00500513           # addi a0, zero, 5
+    sw t1, 0(t0)
+    call target
+    mv s5, a0
+    lui t5, 0
+    jr t5
+target:
+    addi a0, zero, 1
+    ret
@@ -0,0 +1,29 @@
+# Three passes over a 2000-dword buffer, long enough to cross several
+# snapshot periods. Restoring the full snapshot plus the incremental
+# ones must end in the same state as the uninterrupted run.
+# snapshot: 20000
+# expect: s0=0 s1=0x7d0 s2=0xb70390 s3=3
+    .text
+    .globl _start
+_start:
+    li a0, 1
+    slli a0, a0, 31
+    li t0, 0x10000
+    add a0, a0, t0              # buffer at DRAM_BASE + 64K
+    li s0, 0
+    li s1, 2000
+    li s2, 0
+loop:
+    slli t1, s0, 3
+    add t1, t1, a0
+    ld t2, 0(t1)
+    add t2, t2, s0
+    sd t2, 0(t1)
+    add s2, s2, t2
+    addi s0, s0, 1
+    blt s0, s1, loop
+    li s0, 0
+    addi s3, s3, 1
+    li t3, 3
+    blt s3, t3, loop
+    .word 0
@@ -0,0 +1,21 @@
+# Host side of tests/tiering.s: when the compiler thread gets to a block
+# is up to the host, so this only asks that it got to one, and that the
+# patched loop counted the same either way
+import re
+import subprocess
+
+
+def check(emu, image, tmp):
+    p = subprocess.run([emu, "-q", "-s", image], stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE, timeout=60)
+    out, err = p.stdout.decode(), p.stderr.decode()
+    errors = []
+    a0 = re.search(r"a0:\s*(0x[0-9a-f]+|00)", out)
+    if not a0 or int(a0.group(1), 16) != 300000:
+        errors.append("a0 = %s, expected 300000" % (a0 and a0.group(1)))
+    if "instructions retired : 600020" not in err:
+        errors.append("instructions retired changed")
+    m = re.search(r"blocks optimised\s*: (\d+)", err)
+    if not m or int(m.group(1)) == 0:
+        errors.append("no block was optimised")
+    return errors
@@ -0,0 +1,24 @@
+# A loop hot enough to be optimised, then patched: the store and fence.i
+# must drop the optimised block, and the second pass counts by 2 in a
+# block that is decoded and optimised again.
+# host: tiering.py
+    .text
+    .globl _start
+_start:
+    li a0, 0
+    li s1, 2
+1:  li t0, 100000
+2:  addi a0, a0, 1              # patched to add 2
+    addi t0, t0, -1
+    bnez t0, 2b
+    addi s1, s1, -1
+    beqz s1, 3f
+    la t1, 2b
+    lw t2, 0(t1)
+    li t3, 1 << 20              # immediate + 1
+    add t2, t2, t3
+    sw t2, 0(t1)
+    fence.i
+    j 1b
+3:  lui t5, 0
+    jr t5
@@ -0,0 +1,99 @@
+# A static Linux program under -u: argv, write, brk, anonymous mmap,
+# openat/write/close on /dev/null and an unknown syscall, which must fail
+# with ENOSYS. Exits with argc * 10 plus the number of failed checks.
+# args: -u {image} abc
+# stdout: hello abc
+# exit: 20
+    .text
+    .globl _start
+_start:
+    li s3, 0                    # failed checks
+    ld s0, 0(sp)                # argc
+    ld s1, 16(sp)               # argv[1]
+    li a0, 1
+    la a1, msg
+    li a2, 6
+    li a7, 64                   # write
+    ecall
+    mv a1, s1
+    li a2, 0
+1:  add t0, a1, a2
+    lbu t0, 0(t0)
+    beqz t0, 2f
+    addi a2, a2, 1
+    j 1b
+2:  li a0, 1
+    li a7, 64
+    ecall
+
+    li a0, 0
+    li a7, 214                  # brk
+    ecall
+    mv s2, a0
+    li t0, 4096
+    add a0, a0, t0
+    li a7, 214
+    ecall
+    sub t0, a0, s2
+    li s4, 4096
+    sub t0, t0, s4
+    snez t0, t0
+    add s3, s3, t0
+    li t1, 0x1234
+    sd t1, 8(s2)
+
+    li a0, 0
+    li a1, 8192
+    li a2, 3
+    li a3, 0x22                 # MAP_PRIVATE | MAP_ANONYMOUS
+    li a4, -1
+    li a5, 0
+    li a7, 222                  # mmap
+    ecall
+    ld t2, 8(s2)
+    add t0, a0, s4              # second page
+    sd t2, 0(t0)
+    ld t3, 0(t0)
+    sub t3, t3, t1
+    snez t3, t3
+    add s3, s3, t3
+
+    li a0, -100                 # AT_FDCWD
+    la a1, devnull
+    li a2, 1                    # O_WRONLY
+    li a7, 56                   # openat
+    ecall
+    mv s4, a0
+    slti t0, s4, 0
+    add s3, s3, t0
+    mv a0, s4
+    la a1, msg
+    li a2, 6
+    li a7, 64
+    ecall
+    addi t0, a0, -6
+    snez t0, t0
+    add s3, s3, t0
+    mv a0, s4
+    li a7, 57                   # close
+    ecall
+    snez t0, a0
+    add s3, s3, t0
+
+    li a7, 500                  # no such syscall
+    ecall
+    addi t0, a0, 38             # -ENOSYS
+    snez t0, t0
+    add s3, s3, t0
+
+    li t4, 10
+    mul a0, s0, t4
+    add a0, a0, s3
+    li a7, 93                   # exit
+    ecall
+
+    .section .rodata
+msg:
+    .ascii "hello "
+devnull:
+    .asciz "/dev/null"
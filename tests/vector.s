@@ -0,0 +1,64 @@
+# RVV loads, stores, arithmetic, masks and reductions at several SEW/LMUL
+# settings, then a shift whose destination group is not aligned to LMUL,
+# which must raise an illegal instruction instead of writing past v31.
+# expect: a2=0x18c a4=4 a5=0x6e a6=0x28 a7=0 s2=0x100 s3=0xffffffffffffff80
+# expect: s4=0x4034000000000000 s5=0x3ff0000000000000 s6=0x16 s7=1 s8=0
+# stderr: traps, cause 2 : 1
+    .text
+    .globl _start
+_start:
+    la a0, data
+    li a1, 8
+    vsetvli t0, a1, e32, m1, ta, ma
+    vle32.v v1, (a0)
+    addi t1, a0, 32
+    vle32.v v2, (t1)
+    vadd.vv v3, v1, v2
+    addi t2, a0, 64
+    vse32.v v3, (t2)
+    vmv.s.x v5, zero
+    vredsum.vs v4, v3, v5
+    vmv.x.s a2, v4              # 36 + 360
+    li a3, 5
+    vmslt.vx v0, v1, a3         # elements 1..4 below 5
+    vcpop.m a4, v0              # 4
+    vmv.v.i v6, 0
+    vadd.vv v6, v1, v2, v0.t
+    vredsum.vs v7, v6, v5
+    vmv.x.s a5, v7              # (1+2+3+4) + (10+20+30+40)
+    vmul.vx v8, v1, a3
+    vredmax.vs v9, v8, v5
+    vmv.x.s a6, v9              # 8 * 5
+    vfirst.m a7, v0             # 0
+    vsetvli t0, zero, e8, m8, ta, ma
+    mv s2, t0                   # vlmax 256
+    vid.v v8
+    vredsum.vs v16, v8, v5
+    vmv.x.s s3, v16             # sum 0..255 mod 256, sign-extended
+    li a1, 4
+    vsetvli t0, a1, e64, m1, ta, ma
+    addi t1, a0, 96
+    vle64.v v1, (t1)
+    vfadd.vv v2, v1, v1
+    vfredusum.vs v3, v2, v5
+    vmv.x.s s4, v3              # 20.0
+    li t3, 16
+    vlse64.v v4, (t1), t3
+    vmv.x.s s5, v4              # 1.0
+    addi t2, a0, 64
+    lw s6, 4(t2)                # 2 + 20
+    li t0, 256
+    vsetvli t1, t0, e8, m8, ta, ma
+    vmseq.vv v31, v8, v16       # compares write one mask register, any vd
+    li s7, 1
+    vsll.vv v31, v8, v16        # shifts write a group, v31 cannot start one
+    li s8, 1
+    lui t5, 0
+    jr t5
+
+    .balign 8
+data:
+    .word 1, 2, 3, 4, 5, 6, 7, 8
+    .word 10, 20, 30, 40, 50, 60, 70, 80
+    .word 0, 0, 0, 0, 0, 0, 0, 0
+    .double 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0
@@ -0,0 +1,22 @@
+# Stores around an 8-byte write watch at DRAM_BASE + 64K + 8: only the
+# two that overlap it are logged, with their pcs, and the watched page
+# still reads back what was stored.
+# args: -W 0x80010008,8
+# expect: t2=5 s0=0x500000005 s1=1
+# stderr: watch 0x80010008+8: write at 0x80010008 by pc 0x80000018
+# stderr: watch 0x80010008+8: write at 0x8001000c by pc 0x80000020
+    .text
+    .globl _start
+_start:
+    li a0, 1
+    slli a0, a0, 31
+    li t0, 0x10000
+    add a0, a0, t0
+    li t1, 5
+    sd t1, 0(a0)
+    sd t1, 8(a0)                # hit
+    ld t2, 8(a0)
+    sw t1, 12(a0)               # hit, high half
+    sd t1, 16(a0)
+    ld s0, 8(a0)
+    li s1, 1
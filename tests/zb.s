@@ -0,0 +1,38 @@
+# Zba, Zbb and Zbs, ending with a sh1add.uw encoding whose funct7 is 0,
+# which must be rejected as an illegal instruction before t3 is written.
+# expect: a2=0x1ffffffff a3=0x80000004 a4=0x21 a5=0x100000000 a6=0x3d a7=2
+# expect: s2=0x40 s3=0x1d s4=1 s5=0xfffffffffffffffb s6=0xff00ff
+# expect: s7=0x7856341200000000 s8=0x100000001 s9=0x800000000000000f
+# expect: s10=1 s11=0x8000000000000000 t3=0
+# stderr: traps, cause 2 : 1
+    .text
+    .globl _start
+_start:
+    li a0, -1
+    li a1, 1
+    li t1, 4
+    sh1add.uw a2, a0, a1        # 0xffffffff * 2 + 1
+    li t0, 0x80000000
+    sh2add a3, a1, t0
+    sh3add.uw a4, t1, a1
+    add.uw a5, a0, a1           # only the low word of rs1
+    clz a6, t1
+    ctz a7, t1
+    cpop s2, a0
+    clzw s3, t1
+    max s4, a0, a1
+    andn s5, a0, t1
+    li t2, 0x00ff0001
+    orc.b s6, t2
+    li t2, 0x12345678
+    rev8 s7, t2
+    bseti s8, a1, 32
+    li t2, 0xf
+    binvi s9, t2, 63
+    li t2, 0x2d
+    bexti s10, t2, 2
+    rori s11, a1, 1
+    .word 0x00b5263b            # sh1add.uw with funct7 0 is not an instruction
+    li t3, 1
+    lui t5, 0
+    jr t5
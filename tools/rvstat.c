@@ -0,0 +1,129 @@
+// rvstat: prints rates from the counters a running emulator publishes with -M
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../includes/metrics.h"
+
+static void usage(void) {
+    printf("Usage: rvstat [-i ms] [-n count] <file|shm:name>\n");
+    printf("  -i    sampling interval in milliseconds, default 1000\n");
+    printf("  -n    stop after count samples\n");
+    exit(1);
+}
+
+static uint64_t get(const uint64_t* p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static double pct(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void print_hart(uint32_t i, const METRICS_HART* a, const METRICS_HART* b, double secs) {
+    uint64_t blocks = b->blocks_executed - a->blocks_executed;
+    uint64_t misses = b->blocks_translated - a->blocks_translated;
+    uint64_t tlb = (b->tlb_hits - a->tlb_hits) + (b->tlb_misses - a->tlb_misses);
+    uint64_t traps = 0;
+    for (int c = 0; c < METRICS_TRAPS; c++)
+        traps += b->traps[c] - a->traps[c];
+
+    printf("%4u %9.2f %8.1f%% ", i, (b->instret - a->instret) / secs / 1e6,
+           pct(blocks - (misses < blocks ? misses : blocks), blocks));
+    if (tlb)
+        printf("%7.1f%% ", pct(b->tlb_hits - a->tlb_hits, tlb));
+    else
+        printf("%8s ", "-");
+    printf("%9.0f %8.0f %8.0f", traps / secs, (b->interrupts - a->interrupts) / secs,
+           (b->wfi - a->wfi) / secs);
+    for (int c = 0; c < METRICS_TRAPS; c++)
+        if (b->traps[c] != a->traps[c])
+            printf("  cause%d %.0f/s", c, (b->traps[c] - a->traps[c]) / secs);
+    printf("%s\n", b->running ? "" : "  (stopped)");
+}
+
+static void sample(const METRICS_PAGE* page, METRICS_HART* out) {
+    for (uint32_t i = 0; i < page->nharts; i++) {
+        const uint64_t* src = (const uint64_t*) &page->hart[i];
+        uint64_t* dst = (uint64_t*) &out[i];
+        for (size_t w = 0; w < sizeof(METRICS_HART) / sizeof(uint64_t); w++)
+            dst[w] = get(src + w);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    long interval = 1000, count = -1;
+    while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+        switch (opt) {
+            case 'i': interval = strtol(optarg, NULL, 0); break;
+            case 'n': count = strtol(optarg, NULL, 0); break;
+            default: usage();
+        }
+    }
+    if (argc - optind != 1 || interval <= 0)
+        usage();
+
+    const char* spec = argv[optind];
+    int fd = strncmp(spec, "shm:", 4) == 0 ? shm_open(spec + 4, O_RDONLY, 0) : open(spec, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(METRICS_PAGE)) {
+        fprintf(stderr, "[-] ERROR-> cannot open metrics %s\n", spec);
+        return 1;
+    }
+    METRICS_PAGE* page = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED || memcmp(page->magic, METRICS_MAGIC, sizeof(page->magic)) != 0
+            || page->version != METRICS_VERSION
+            || sizeof(METRICS_PAGE) + (uint64_t) page->nharts * sizeof(METRICS_HART)
+               > (uint64_t) st.st_size) {
+        fprintf(stderr, "[-] ERROR-> %s is not a metrics page\n", spec);
+        return 1;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    uint32_t n = page->nharts;
+    METRICS_HART* prev = calloc(n, sizeof(METRICS_HART));
+    METRICS_HART* cur = calloc(n, sizeof(METRICS_HART));
+    if (!prev || !cur) {
+        fprintf(stderr, "Memory error!");
+        return 1;
+    }
+    printf("pid %u, %u hart%s\n", page->pid, n, n == 1 ? "" : "s");
+
+    struct timespec t0, t1, nap = { interval / 1000, interval % 1000 * 1000000 };
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    sample(page, prev);
+    while (count < 0 || count-- > 0) {
+        nanosleep(&nap, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        sample(page, cur);
+        double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+        int running = 0;
+        printf("hart      mips   decode     tlb   traps/s   irqs/s    wfi/s\n");
+        for (uint32_t i = 0; i < n; i++) {
+            print_hart(i, &prev[i], &cur[i], secs);
+            running |= cur[i].running != 0;
+        }
+        for (uint32_t q = 0; q < page->nqueues && q < METRICS_QUEUES; q++)
+            printf("queue %-24s %u/%u\n", page->queue[q].name,
+                   __atomic_load_n(&page->queue[q].depth, __ATOMIC_RELAXED),
+                   __atomic_load_n(&page->queue[q].size, __ATOMIC_RELAXED));
+        fflush(stdout);
+        if (!running)
+            break;
+
+        METRICS_HART* t = prev;
+        prev = cur;
+        cur = t;
+        t0 = t1;
+    }
+    return 0;
+}